@@ -0,0 +1,475 @@
+/*
+ * e820-base-tb.c: the old e820 update code, as the benchmark baseline
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * The e820 update code as it was before the map was kept sorted and
+ * coalesced, used as the baseline in e820-test's benchmark.  It is kept
+ * as it was, bugs and all (protecting a region below the first entry
+ * overwrites entry 0), so it must not be used to check results.
+ */
+
+#include <config.h>
+#include <types.h>
+#include <stdbool.h>
+#include <printk.h>
+#include <cmdline.h>
+#include <string.h>
+#include <uuid.h>
+#include <loader.h>
+#include <stdarg.h>
+#include <misc.h>
+#include <pci_cfgreg.h>
+#include <e820.h>
+#include <txt/config_regs.h>
+
+/*
+ * copy of bootloader/BIOS e820 table with adjusted entries
+ * this version will replace original in mbi
+ */
+#define MAX_E820_ENTRIES      (TBOOT_E820_COPY_SIZE / sizeof(memory_map_t))
+static unsigned int g_nr_map;
+static memory_map_t *g_copy_e820_map;
+
+static inline void split64b(uint64_t val, uint32_t *val_lo, uint32_t *val_hi)  {
+     *val_lo = (uint32_t)(val & 0xffffffff); 
+     *val_hi = (uint32_t)(val >> 32);
+ }
+
+static inline uint64_t combine64b(uint32_t val_lo, uint32_t val_hi)
+{
+    return ((uint64_t)val_hi << 32) | (uint64_t)val_lo;
+}
+
+static inline uint64_t e820_base_64(memory_map_t *entry)
+{
+    return combine64b(entry->base_addr_low, entry->base_addr_high);
+}
+
+static inline uint64_t e820_length_64(memory_map_t *entry)
+{
+    return combine64b(entry->length_low, entry->length_high);
+}
+
+static bool insert_after_region(memory_map_t *e820map, unsigned int *nr_map,
+                                unsigned int pos, uint64_t addr, uint64_t size,
+                                uint32_t type)
+{
+    /* no more room */
+    if ( *nr_map + 1 > MAX_E820_ENTRIES )
+        return false;
+
+    /* shift (copy) everything up one entry */
+    for ( unsigned int i = *nr_map - 1; i > pos; i--)
+        e820map[i+1] = e820map[i];
+
+    /* now add our entry */
+    split64b(addr, &(e820map[pos+1].base_addr_low),
+             &(e820map[pos+1].base_addr_high));
+    split64b(size, &(e820map[pos+1].length_low),
+             &(e820map[pos+1].length_high));
+    e820map[pos+1].type = type;
+    e820map[pos+1].size = sizeof(memory_map_t) - sizeof(uint32_t);
+
+    (*nr_map)++;
+
+    return true;
+}
+
+static void remove_region(memory_map_t *e820map, unsigned int *nr_map,
+                          unsigned int pos)
+{
+    /* shift (copy) everything down one entry */
+    for ( unsigned int i = pos; i < *nr_map - 1; i++)
+        e820map[i] = e820map[i+1];
+
+    (*nr_map)--;
+}
+
+static bool protect_region(memory_map_t *e820map, unsigned int *nr_map,
+                           uint64_t new_addr, uint64_t new_size,
+                           uint32_t new_type)
+{
+    uint64_t addr, tmp_addr, size, tmp_size;
+    uint32_t type;
+    unsigned int i;
+
+    if ( new_size == 0 )
+        return true;
+    /* check for wrap */
+    if ( new_addr + new_size < new_addr )
+        return false;
+
+    /* find where our region belongs in the table and insert it */
+    for ( i = 0; i < *nr_map; i++ ) {
+        addr = e820_base_64(&e820map[i]);
+        size = e820_length_64(&e820map[i]);
+        type = e820map[i].type;
+        /* is our region at the beginning of the current map region? */
+        if ( new_addr == addr ) {
+            if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
+                                      new_type) )
+                return false;
+            break;
+        }
+        /* are we w/in the current map region? */
+        else if ( new_addr > addr && new_addr < (addr + size) ) {
+            if ( !insert_after_region(e820map, nr_map, i, new_addr, new_size,
+                                      new_type) )
+                return false;
+            /* fixup current region */
+            tmp_addr = e820_base_64(&e820map[i]);
+            split64b(new_addr - tmp_addr, &(e820map[i].length_low),
+                     &(e820map[i].length_high));
+            i++;   /* adjust to always be that of our region */
+            /* insert a copy of current region (before adj) after us so */
+            /* that rest of code can be common with previous case */
+            if ( !insert_after_region(e820map, nr_map, i, addr, size, type) )
+                return false;
+            break;
+        }
+        /* is our region in a gap in the map? */
+        else if ( addr > new_addr ) {
+            if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
+                                      new_type) )
+                return false;
+            break;
+        }
+    }
+    /* if we reached the end of the map without finding an overlapping */
+    /* region, insert us at the end (note that this test won't trigger */
+    /* for the second case above because the insert() will have incremented */
+    /* nr_map and so i++ will still be less) */
+    if ( i == *nr_map ) {
+        if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
+                                  new_type) )
+            return false;
+        return true;
+    }
+
+    i++;     /* move to entry after our inserted one (we're not at end yet) */
+
+    tmp_addr = e820_base_64(&e820map[i]);
+    tmp_size = e820_length_64(&e820map[i]);
+
+    /* did we split the (formerly) previous region? */
+    if ( (new_addr >= tmp_addr) &&
+         ((new_addr + new_size) < (tmp_addr + tmp_size)) ) {
+        /* then adjust the current region (adj size first) */
+        split64b((tmp_addr + tmp_size) - (new_addr + new_size),
+                 &(e820map[i].length_low), &(e820map[i].length_high));
+        split64b(new_addr + new_size,
+                 &(e820map[i].base_addr_low), &(e820map[i].base_addr_high));
+        return true;
+    }
+
+    /* if our region completely covers any existing regions, delete them */
+    while ( (i < *nr_map) && ((new_addr + new_size) >=
+                              (tmp_addr + tmp_size)) ) {
+        remove_region(e820map, nr_map, i);
+        tmp_addr = e820_base_64(&e820map[i]);
+        tmp_size = e820_length_64(&e820map[i]);
+    }
+
+    /* finally, if our region partially overlaps an existing region, */
+    /* then truncate the existing region */
+    if ( i < *nr_map ) {
+        tmp_addr = e820_base_64(&e820map[i]);
+        tmp_size = e820_length_64(&e820map[i]);
+        if ( (new_addr + new_size) > tmp_addr ) {
+            split64b((tmp_addr + tmp_size) - (new_addr + new_size),
+                        &(e820map[i].length_low), &(e820map[i].length_high));
+            split64b(new_addr + new_size, &(e820map[i].base_addr_low),
+                        &(e820map[i].base_addr_high));
+        }
+    }
+
+    return true;
+}
+
+/*
+ * is_overlapped
+ *
+ * Detect whether two ranges are overlapped.
+ *
+ * return: true = overlapped
+ */
+static bool is_overlapped(uint64_t base, uint64_t end, uint64_t e820_base,
+                          uint64_t e820_end)
+{
+    uint64_t length = end - base, e820_length = e820_end - e820_base;
+    uint64_t min, max;
+
+    min = (base < e820_base)?base:e820_base;
+    max = (end > e820_end)?end:e820_end;
+
+    /* overlapping */
+    if ( (max - min) < (length + e820_length) )
+        return true;
+
+    if ( (max - min) == (length + e820_length)
+         && ( ((length == 0) && (base > e820_base) && (base < e820_end))
+              || ((e820_length == 0) && (e820_base > base) &&
+                  (e820_base < end)) ) )
+        return true;
+
+    return false;
+}
+
+/*
+ * base_e820_check_region
+ *
+ * Given a range, check which kind of range it covers
+ *
+ * return: E820_GAP, it covers gap in e820 map;
+ *         E820_MIXED, it covers at least two different kinds of ranges;
+ *         E820_XXX, it covers E820_XXX range only;
+ *         it will not return 0.
+ */
+uint32_t base_e820_check_region(uint64_t base, uint64_t length)
+{
+    memory_map_t* e820_entry;
+    uint64_t end = base + length, e820_base, e820_end, e820_length;
+    uint32_t type;
+    uint32_t ret = 0;
+    bool gap = true; /* suppose there is always a virtual gap at first */
+
+    e820_base = 0;
+    e820_length = 0;
+
+    for ( unsigned int i = 0; i < g_nr_map; i = gap ? i : i+1, gap = !gap ) {
+        e820_entry = &g_copy_e820_map[i];
+        if ( gap ) {
+            /* deal with the gap in e820 map */
+            e820_base = e820_base + e820_length;
+            e820_length = e820_base_64(e820_entry) - e820_base;
+            type = E820_GAP;
+        }
+        else {
+            /* deal with the normal item in e820 map */
+            e820_base = e820_base_64(e820_entry);
+            e820_length = e820_length_64(e820_entry);
+            type = e820_entry->type;
+        }
+
+        if ( e820_length == 0 )
+            continue; /* if the range is zero, then skip */
+
+        e820_end = e820_base + e820_length;
+
+        if ( !is_overlapped(base, end, e820_base, e820_end) )
+            continue; /* if no overlapping, then skip */
+
+        /* if the value of ret is not assigned before,
+           then set ret to type directly */
+        if ( ret == 0 ) {
+            ret = type;
+            continue;
+        }
+
+        /* if the value of ret is assigned before but ret is equal to type,
+           then no need to do anything */
+        if ( ret == type )
+            continue;
+
+        /* if the value of ret is assigned before but it is GAP,
+           then no need to do anything since any type merged with GAP is GAP */
+        if ( ret == E820_GAP )
+            continue;
+
+        /* if the value of ret is assigned before but it is not GAP and type
+           is GAP now this time, then set ret to GAP since any type merged
+           with GAP is GAP. */
+        if ( type == E820_GAP ) {
+            ret = E820_GAP;
+            continue;
+        }
+
+        /* if the value of ret is assigned before but both ret and type are
+           not GAP and their values are not equal, then set ret to MIXED
+           since any two non-GAP values are merged into MIXED if they are
+           not equal. */
+        ret = E820_MIXED;
+    }
+
+    /* deal with the last gap */
+    if ( is_overlapped(base, end, e820_base + e820_length, (uint64_t)-1) )
+        ret = E820_GAP;
+
+    /* print the result */
+    printk(TBOOT_DETA" (range from %016Lx to %016Lx is in ", base, base + length);
+    switch (ret) {
+        case E820_RAM:
+            printk(TBOOT_INFO"E820_RAM)\n"); break;
+        case E820_RESERVED:
+            printk(TBOOT_INFO"E820_RESERVED)\n"); break;
+        case E820_ACPI:
+            printk(TBOOT_INFO"E820_ACPI)\n"); break;
+        case E820_NVS:
+            printk(TBOOT_INFO"E820_NVS)\n"); break;
+        case E820_UNUSABLE:
+            printk(TBOOT_INFO"E820_UNUSABLE)\n"); break;
+        case E820_GAP:
+            printk(TBOOT_INFO"E820_GAP)\n"); break;
+        case E820_MIXED:
+            printk(TBOOT_INFO"E820_MIXED)\n"); break;
+        default:
+            printk(TBOOT_INFO"UNKNOWN)\n");
+    }
+
+    return ret;
+}
+
+/*
+ * base_e820_reserve_ram
+ *
+ * Given the range, any ram range in e820 is in it, change type to reserved.
+ *
+ * return:  false = error
+ */
+bool base_e820_reserve_ram(uint64_t base, uint64_t length)
+{
+    memory_map_t* e820_entry;
+    uint64_t e820_base, e820_length, e820_end;
+    uint64_t end;
+
+    if ( length == 0 )
+        return true;
+
+    end = base + length;
+
+    /* find where our region should cover the ram in e820 */
+    for ( unsigned int i = 0; i < g_nr_map; i++ ) {
+        e820_entry = &g_copy_e820_map[i];
+        e820_base = e820_base_64(e820_entry);
+        e820_length = e820_length_64(e820_entry);
+        e820_end = e820_base + e820_length;
+
+        /* if not ram, no need to deal with */
+        if ( e820_entry->type != E820_RAM )
+            continue;
+
+        /* if the range is before the current ram range, skip the ram range */
+        if ( end <= e820_base )
+            continue;
+        /* if the range is after the current ram range, skip the ram range */
+        if ( base >= e820_end )
+            continue;
+
+        /* case 1: the current ram range is within the range:
+           base, e820_base, e820_end, end */
+        if ( (base <= e820_base) && (e820_end <= end) )
+            e820_entry->type = E820_RESERVED;
+        /* case 2: overlapping:
+           base, e820_base, end, e820_end */
+        else if ( (e820_base >= base) && (end > e820_base) &&
+                  (e820_end > end) ) {
+            /* split the current ram map */
+            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i-1,
+                                      e820_base, (end - e820_base),
+                                      E820_RESERVED) )
+                return false;
+            /* fixup the current ram map */
+            i++;
+            split64b(end, &(g_copy_e820_map[i].base_addr_low),
+                     &(g_copy_e820_map[i].base_addr_high));
+            split64b(e820_end - end, &(g_copy_e820_map[i].length_low),
+                     &(g_copy_e820_map[i].length_high));
+            /* no need to check more */
+            break;
+        }
+        /* case 3: overlapping:
+           e820_base, base, e820_end, end */
+        else if ( (base > e820_base) && (e820_end > base) &&
+                  (end >= e820_end) ) {
+            /* fixup the current ram map */
+            split64b((base - e820_base), &(g_copy_e820_map[i].length_low),
+                     &(g_copy_e820_map[i].length_high));
+            /* split the current ram map */
+            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, base,
+                                      (e820_end - base), E820_RESERVED) )
+                return false;
+            i++;
+        }
+        /* case 4: the range is within the current ram range:
+           e820_base, base, end, e820_end */
+        else if ( (base > e820_base) && (e820_end > end) ) {
+            /* fixup the current ram map */
+            split64b((base - e820_base), &(g_copy_e820_map[i].length_low),
+                     &(g_copy_e820_map[i].length_high));
+            /* split the current ram map */
+            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, base,
+                                      length, E820_RESERVED) )
+                return false;
+            i++;
+            /* fixup the rest of the current ram map */
+            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, end,
+                                      (e820_end - end), e820_entry->type) )
+                return false;
+            i++;
+            /* no need to check more */
+            break;
+        }
+        else {
+            printk(TBOOT_ERR"we should never get here\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static memory_map_t base_map[MAX_E820_ENTRIES];
+
+void base_e820_reset(void)
+{
+    g_copy_e820_map = base_map;
+    g_nr_map = 0;
+}
+
+bool base_e820_protect_region(uint64_t addr, uint64_t size, uint32_t type)
+{
+    return protect_region(g_copy_e820_map, &g_nr_map, addr, size, type);
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,428 @@
+/*
+ * e820-test.c: checks tboot's e820 updates against a model of the
+ *              map, and times them against the old code
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host-test.h"
+
+#define E820_RAM         1
+#define E820_RESERVED    2
+#define E820_MIXED       ((uint32_t)-1 - 1)
+#define E820_GAP         ((uint32_t)-1)
+
+/* as in tboot/include/e820.h */
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+    uint32_t type;
+} e820_range_t;
+
+/* e820.c */
+extern bool e820_protect_region(uint64_t addr, uint64_t size, uint32_t type);
+extern bool e820_reserve_ram(uint64_t base, uint64_t length);
+extern bool e820_protect_regions(const e820_range_t *ranges,
+                                 unsigned int nr_ranges);
+extern bool e820_reserve_ram_regions(const e820_range_t *ranges,
+                                     unsigned int nr_ranges);
+extern uint32_t e820_check_region(uint64_t base, uint64_t length);
+extern void get_highest_sized_ram(uint64_t size, uint64_t limit,
+                                  uint64_t *ram_base, uint64_t *ram_size);
+
+/* e820-tb.c */
+extern const unsigned int test_e820_max;
+extern void test_e820_reset(void);
+extern unsigned int test_e820_nr(void);
+extern void test_e820_entry(unsigned int i, uint64_t *base, uint64_t *end,
+                            uint32_t *type);
+
+/* e820-base-tb.c */
+extern void base_e820_reset(void);
+extern bool base_e820_protect_region(uint64_t addr, uint64_t size,
+                                     uint32_t type);
+extern bool base_e820_reserve_ram(uint64_t base, uint64_t length);
+
+/*
+ * The fuzzer keeps a model of the map with one type per unit (0 for a
+ * gap) over a window of UNITS units, applies the same random updates to
+ * the model and to the table, and compares them after every update.
+ */
+#define UNITS            512
+#define MAX_OPS          40
+#define MAX_BULK         8
+/* the default; more can be asked for on the command line */
+#define ITERATIONS       20000
+
+static uint64_t window_base, unit_size;
+static uint8_t model[UNITS];
+
+static uint64_t addr_of(unsigned int unit)
+{
+    return window_base + unit * unit_size;
+}
+
+static unsigned int model_runs(const uint8_t *m)
+{
+    unsigned int n = 0;
+
+    for ( unsigned int i = 0; i < UNITS; i++ ) {
+        if ( m[i] != 0 && (i == 0 || m[i] != m[i - 1]) )
+            n++;
+    }
+    return n;
+}
+
+static void model_protect(uint8_t *m, unsigned int a, unsigned int e,
+                          uint8_t type)
+{
+    memset(m + a, type, e - a);
+}
+
+static void model_reserve(uint8_t *m, unsigned int a, unsigned int e)
+{
+    for ( unsigned int i = a; i < e; i++ ) {
+        if ( m[i] == E820_RAM )
+            m[i] = E820_RESERVED;
+    }
+}
+
+/*
+ * check that the table is sorted, non-overlapping and coalesced, lies in
+ * the window on unit boundaries, and says what the model says
+ */
+static void check_table(const char *what)
+{
+    uint8_t got[UNITS];
+    uint64_t prev_end = 0;
+    uint32_t prev_type = 0;
+
+    memset(got, 0, sizeof(got));
+    for ( unsigned int i = 0; i < test_e820_nr(); i++ ) {
+        uint64_t base, end;
+        uint32_t type;
+
+        test_e820_entry(i, &base, &end, &type);
+        CHECK(base < end, "%s: entry %u is empty", what, i);
+        CHECK(i == 0 || base >= prev_end, "%s: entry %u out of order", what,
+              i);
+        CHECK(i == 0 || base > prev_end || type != prev_type,
+              "%s: entries %u and %u not coalesced", what, i - 1, i);
+        CHECK(base >= addr_of(0) && end <= addr_of(UNITS) &&
+              (base - window_base) % unit_size == 0 &&
+              (end - window_base) % unit_size == 0,
+              "%s: entry %u (0x%llx-0x%llx) off the grid", what, i,
+              (unsigned long long)base, (unsigned long long)end);
+        for ( uint64_t a = base; a < end; a += unit_size )
+            got[(a - window_base) / unit_size] = type;
+        prev_end = end;
+        prev_type = type;
+    }
+    for ( unsigned int i = 0; i < UNITS; i++ )
+        CHECK(got[i] == model[i], "%s: unit %u (0x%llx) is %u, not %u",
+              what, i, (unsigned long long)addr_of(i), got[i], model[i]);
+}
+
+/*
+ * an update must succeed when its result fits in the table, and must
+ * leave the table as it was when it doesn't
+ */
+static void apply_result(bool ok, const uint8_t *next, const char *what)
+{
+    if ( model_runs(next) <= test_e820_max ) {
+        CHECK(ok, "%s failed with room in the table", what);
+        memcpy(model, next, UNITS);
+    }
+    else
+        CHECK(!ok, "%s succeeded with no room in the table", what);
+    check_table(what);
+}
+
+static void check_queries(uint64_t *seed)
+{
+    for ( int q = 0; q < 4; q++ ) {
+        unsigned int a = test_rand(seed) % UNITS;
+        unsigned int e = a + 1 + test_rand(seed) % 8;
+        uint64_t length, ram_base, ram_size, size, want_base = 0, want_size = 0;
+        uint32_t want = 0, type;
+        unsigned int limit;
+
+        if ( e > UNITS )
+            e = UNITS;
+        length = (e - a) * unit_size;
+        /* part of a unit now and then */
+        if ( test_rand(seed) % 3 == 0 ) {
+            e = a + 1;
+            length = 1 + test_rand(seed) % unit_size;
+        }
+        for ( unsigned int i = a; i < e; i++ ) {
+            if ( model[i] == 0 )
+                want = E820_GAP;
+            else if ( want == 0 )
+                want = model[i];
+            else if ( want != E820_GAP && want != model[i] )
+                want = E820_MIXED;
+        }
+        type = e820_check_region(addr_of(a), length);
+        CHECK(type == want, "check_region(0x%llx, 0x%llx) is 0x%x, not 0x%x",
+              (unsigned long long)addr_of(a), (unsigned long long)length,
+              type, want);
+
+        /* the highest RAM run that ends at or below limit and is big
+           enough; a run in the model is an entry in the coalesced table */
+        size = (test_rand(seed) % 8) * unit_size;
+        limit = test_rand(seed) % (UNITS + 1);
+        for ( unsigned int i = 0; i < limit; ) {
+            unsigned int j = i;
+
+            while ( j < UNITS && model[j] == model[i] )
+                j++;
+            if ( model[i] == E820_RAM && j <= limit &&
+                 (j - i) * unit_size >= size ) {
+                want_base = addr_of(i);
+                want_size = (j - i) * unit_size;
+            }
+            i = j;
+        }
+        get_highest_sized_ram(size, addr_of(limit), &ram_base, &ram_size);
+        CHECK(ram_base == want_base && ram_size == want_size,
+              "highest_sized_ram(0x%llx, 0x%llx) is 0x%llx+0x%llx, "
+              "not 0x%llx+0x%llx", (unsigned long long)size,
+              (unsigned long long)addr_of(limit),
+              (unsigned long long)ram_base, (unsigned long long)ram_size,
+              (unsigned long long)want_base, (unsigned long long)want_size);
+    }
+}
+
+static void random_range(uint64_t *seed, unsigned int max_len,
+                         unsigned int *a, unsigned int *e)
+{
+    *a = test_rand(seed) % UNITS;
+    *e = *a + test_rand(seed) % (max_len + 1);
+    if ( *e > UNITS )
+        *e = UNITS;
+}
+
+/* random sequences of protect, reserve and bulk updates */
+static void test_fuzz(long iterations)
+{
+    uint64_t seed = 0xe820;
+
+    for ( long it = 0; it < iterations; it++ ) {
+        unsigned int nr_ops = 1 + test_rand(&seed) % MAX_OPS;
+
+        /* below 4GB and across it, in pages and in small units */
+        window_base = (it & 1) ? 0x100000000ULL - UNITS / 2 * 0x1000ULL : 0;
+        unit_size = (it & 2) ? 0x1000 : 0x40;
+        memset(model, 0, sizeof(model));
+        test_e820_reset();
+
+        for ( unsigned int k = 0; k < nr_ops; k++ ) {
+            unsigned int kind = test_rand(&seed) % 10, a, e;
+            uint8_t next[UNITS];
+            bool ok;
+
+            memcpy(next, model, UNITS);
+            /* lay down a few regions before reserving any */
+            if ( k > 3 && kind < 2 ) {
+                e820_range_t ranges[MAX_BULK];
+                unsigned int nr = 1 + test_rand(&seed) % MAX_BULK;
+                bool reserve = test_rand(&seed) % 2;
+                /* overlapping ranges must be of the same type */
+                uint8_t type = 1 + test_rand(&seed) % 5;
+
+                for ( unsigned int i = 0; i < nr; i++ ) {
+                    random_range(&seed, UNITS / 8, &a, &e);
+                    ranges[i].base = addr_of(a);
+                    ranges[i].size = (e - a) * unit_size;
+                    ranges[i].type = type;
+                    if ( reserve )
+                        model_reserve(next, a, e);
+                    else
+                        model_protect(next, a, e, type);
+                }
+                if ( reserve )
+                    ok = e820_reserve_ram_regions(ranges, nr);
+                else
+                    ok = e820_protect_regions(ranges, nr);
+                apply_result(ok, next, reserve ? "bulk reserve" :
+                                                 "bulk protect");
+            }
+            else if ( k > 3 && kind < 4 ) {
+                random_range(&seed, UNITS / 4, &a, &e);
+                model_reserve(next, a, e);
+                ok = e820_reserve_ram(addr_of(a), (e - a) * unit_size);
+                apply_result(ok, next, "reserve");
+            }
+            else {
+                uint8_t type = 1 + test_rand(&seed) % 5;
+
+                random_range(&seed, UNITS / 4, &a, &e);
+                model_protect(next, a, e, type);
+                ok = e820_protect_region(addr_of(a), (e - a) * unit_size,
+                                         type);
+                apply_result(ok, next, "protect");
+            }
+            check_queries(&seed);
+        }
+    }
+    printf("fuzz: %ld sequences: ok\n", iterations);
+}
+
+/* fill the table, then check updates that would overflow it are refused */
+static void test_full(void)
+{
+    uint8_t next[UNITS];
+
+    window_base = 0;
+    unit_size = 0x1000;
+    memset(model, 0, sizeof(model));
+    test_e820_reset();
+    CHECK(test_e820_max < UNITS, "window too small to fill the table");
+
+    for ( unsigned int i = 0; i < test_e820_max; i++ ) {
+        CHECK(e820_protect_region(addr_of(i), unit_size, 1 + i % 2),
+              "protect %u", i);
+        model[i] = 1 + i % 2;
+    }
+    check_table("full");
+
+    /* one more entry doesn't fit, in a gap or splitting an entry */
+    CHECK(!e820_protect_region(addr_of(test_e820_max + 1), unit_size, 1),
+          "protect past the end of a full table");
+    CHECK(!e820_reserve_ram(addr_of(0), unit_size / 2),
+          "split in a full table");
+    check_table("full, after refusals");
+
+    /* ... but one that merges entries does */
+    memcpy(next, model, UNITS);
+    model_protect(next, 0, 3, 2);
+    apply_result(e820_protect_region(addr_of(0), 3 * unit_size, 2), next,
+                 "merge in a full table");
+
+    /* a range that wraps is an error to protect, and has no RAM in it */
+    CHECK(!e820_protect_region(~0ULL - 0xfff, 0x2000, 1), "wrap protect");
+    CHECK(e820_reserve_ram(~0ULL - 0xfff, 0x2000), "wrap reserve");
+    check_table("wrap");
+    printf("full table: ok\n");
+}
+
+/*
+ * a fragmented map (alternating RAM and reserved pages) and then many
+ * sub-page reservations in it: one at a time with the old code and the
+ * new, and in bulk
+ */
+#define BENCH_ROUNDS     2000
+#define BENCH_PAGES      120
+#define BENCH_RESERVES   100
+#define BENCH_BATCH      25
+
+static void bench_map(bool base)
+{
+    for ( unsigned int i = 0; i < BENCH_PAGES; i++ ) {
+        if ( base )
+            base_e820_protect_region(i * 0x2000ULL, 0x1000, 1 + (i & 1));
+        else
+            e820_protect_region(i * 0x2000ULL, 0x1000, 1 + (i & 1));
+    }
+}
+
+static void run_bench(void)
+{
+    double start, secs[3];
+    uint64_t seed;
+
+    for ( int t = 0; t < 3; t++ ) {
+        seed = 0xbe;
+        start = now_secs();
+        for ( int r = 0; r < BENCH_ROUNDS; r++ ) {
+            if ( t == 0 )
+                base_e820_reset();
+            else
+                test_e820_reset();
+            bench_map(t == 0);
+            for ( int i = 0; i < BENCH_RESERVES; i += BENCH_BATCH ) {
+                e820_range_t ranges[BENCH_BATCH];
+
+                for ( int j = 0; j < BENCH_BATCH; j++ ) {
+                    ranges[j].base = (test_rand(&seed) % (2 * BENCH_PAGES))
+                                     * 0x1000ULL;
+                    ranges[j].size = 0x800;
+                    ranges[j].type = E820_RESERVED;
+                    if ( t == 0 )
+                        base_e820_reserve_ram(ranges[j].base, 0x800);
+                    else if ( t == 1 )
+                        e820_reserve_ram(ranges[j].base, 0x800);
+                }
+                if ( t == 2 )
+                    e820_reserve_ram_regions(ranges, BENCH_BATCH);
+            }
+        }
+        secs[t] = now_secs() - start;
+    }
+
+    printf("%d maps of %d entries, %d reservations each:\n",
+           BENCH_ROUNDS, BENCH_PAGES, BENCH_RESERVES);
+    printf("  old, one at a time  %8.3f s\n", secs[0]);
+    printf("  new, one at a time  %8.3f s  (%.1fx)\n", secs[1],
+           secs[0] / secs[1]);
+    printf("  new, %d at a time   %8.3f s  (%.1fx)\n", BENCH_BATCH, secs[2],
+           secs[0] / secs[2]);
+}
+
+int main(int argc, char *argv[])
+{
+    if ( argc > 1 && strcmp(argv[1], "--bench") == 0 )
+        run_bench();
+    else {
+        test_full();
+        test_fuzz(argc > 1 ? atol(argv[1]) : ITERATIONS);
+    }
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,226 @@
+/*
+ * memcmp-test.c: checks tb_memcmp(), tb_consttime_memequal() and
+ *                tb_memset() against the byte-at-a-time versions
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host-test.h"
+
+/* memcmp-tb.c */
+extern int tb_memcmp(const void *b1, const void *b2, size_t len);
+extern int tb_consttime_memequal(const void *b1, const void *b2, size_t len);
+extern void *test_memset(void *b, int c, size_t len);
+
+#define MAX_OFF    8
+#define MAX_LEN    80
+#define BUF_SIZE   (MAX_OFF + MAX_LEN + MAX_OFF)
+
+/* tb_memcmp() before it compared words, whose results must not change */
+static int old_memcmp(const void *s1, const void *s2, size_t n)
+{
+    if ( s1 == NULL || s2 == NULL )
+        return -1;
+
+    if ( s1 == s2 )
+        return 0;
+
+    if ( n != 0 ) {
+        const unsigned char *p1 = s1, *p2 = s2;
+
+        do {
+            if ( *p1++ != *p2++ )
+                return *--p1 - *--p2;
+        } while ( --n != 0 );
+    }
+    return 0;
+}
+
+static int sign(int x)
+{
+    return (x > 0) - (x < 0);
+}
+
+static void check_memcmp(const uint8_t *p1, const uint8_t *p2, size_t len,
+                         const char *what)
+{
+    int want = old_memcmp(p1, p2, len);
+    int got = tb_memcmp(p1, p2, len);
+
+    CHECK(got == want, "tb_memcmp %s, %zu bytes (+%zu, +%zu): %d, was %d",
+          what, len, (size_t)((uintptr_t)p1 % MAX_OFF),
+          (size_t)((uintptr_t)p2 % MAX_OFF), got, want);
+    CHECK(sign(tb_memcmp(p2, p1, len)) == -sign(want),
+          "tb_memcmp %s, %zu bytes: not antisymmetric", what, len);
+}
+
+/*
+ * every pair of alignments, every length (so every tail), and a single
+ * difference at every position, in both directions and with the high bit
+ * set so that the comparison must be unsigned
+ */
+static void test_memcmp(void)
+{
+    static uint8_t buf1[BUF_SIZE] __attribute__ ((aligned (MAX_OFF)));
+    static uint8_t buf2[BUF_SIZE] __attribute__ ((aligned (MAX_OFF)));
+    const uint8_t pairs[][2] = { { 0x00, 0x01 }, { 0x7f, 0x80 },
+                                 { 0x00, 0xff }, { 0x10, 0x20 } };
+    uint64_t seed = 0x36;
+
+    for ( size_t off1 = 0; off1 < MAX_OFF; off1++ ) {
+        for ( size_t off2 = 0; off2 < MAX_OFF; off2++ ) {
+            uint8_t *p1 = buf1 + off1, *p2 = buf2 + off2;
+
+            for ( size_t len = 0; len <= MAX_LEN; len++ ) {
+                for ( size_t i = 0; i < len; i++ )
+                    p1[i] = p2[i] = test_rand(&seed);
+                check_memcmp(p1, p2, len, "equal");
+
+                for ( size_t pos = 0; pos < len; pos++ ) {
+                    for ( size_t k = 0; k < sizeof(pairs) / sizeof(pairs[0]);
+                          k++ ) {
+                        uint8_t saved1 = p1[pos], saved2 = p2[pos];
+
+                        p1[pos] = pairs[k][0];
+                        p2[pos] = pairs[k][1];
+                        check_memcmp(p1, p2, len, "one difference");
+                        /* and a later difference that must not matter */
+                        if ( pos + 1 < len ) {
+                            uint8_t saved = p1[len - 1];
+                            p1[len - 1] ^= 0xff;
+                            check_memcmp(p1, p2, len, "two differences");
+                            p1[len - 1] = saved;
+                        }
+                        p1[pos] = saved1;
+                        p2[pos] = saved2;
+                    }
+                }
+            }
+        }
+    }
+
+    CHECK(tb_memcmp(NULL, buf2, 1) == -1 && tb_memcmp(buf1, NULL, 1) == -1,
+          "tb_memcmp with NULL");
+    CHECK(tb_memcmp(buf1, buf1, BUF_SIZE) == 0, "tb_memcmp with itself");
+    printf("tb_memcmp: ok\n");
+}
+
+/* non-zero exactly when the buffers are equal, for every single bit flip */
+static void test_consttime_memequal(void)
+{
+    static uint8_t buf1[BUF_SIZE], buf2[BUF_SIZE];
+    uint64_t seed = 0x3636;
+
+    for ( size_t off = 0; off < MAX_OFF; off++ ) {
+        for ( size_t len = 0; len <= MAX_LEN; len++ ) {
+            uint8_t *p1 = buf1 + off, *p2 = buf2 + MAX_OFF - 1 - off;
+
+            for ( size_t i = 0; i < len; i++ )
+                p1[i] = p2[i] = test_rand(&seed);
+            CHECK(tb_consttime_memequal(p1, p2, len) != 0,
+                  "tb_consttime_memequal: equal %zu bytes reported unequal",
+                  len);
+
+            for ( size_t pos = 0; pos < len; pos++ ) {
+                for ( unsigned int diff = 1; diff <= 0xff; diff++ ) {
+                    p2[pos] ^= diff;
+                    CHECK(tb_consttime_memequal(p1, p2, len) == 0,
+                          "tb_consttime_memequal: %zu bytes differing by "
+                          "0x%x at %zu reported equal", len, diff, pos);
+                    p2[pos] ^= diff;
+                }
+            }
+        }
+    }
+
+    CHECK(tb_consttime_memequal(NULL, buf2, 1) == 0 &&
+          tb_consttime_memequal(buf1, NULL, 1) == 0,
+          "tb_consttime_memequal with NULL");
+    printf("tb_consttime_memequal: ok\n");
+}
+
+/* every alignment, length and fill value, with nothing written outside */
+static void test_tb_memset(void)
+{
+    static uint8_t buf[BUF_SIZE];
+    const int values[] = { 0, 1, 0x7f, 0x80, 0xa5, 0xff, -1, 0x1234 };
+
+    for ( size_t off = 0; off < MAX_OFF; off++ ) {
+        for ( size_t len = 0; len <= MAX_LEN; len++ ) {
+            for ( size_t k = 0; k < sizeof(values) / sizeof(values[0]);
+                  k++ ) {
+                uint8_t want = (uint8_t)values[k];
+
+                memset(buf, ~want, sizeof(buf));
+                CHECK(test_memset(buf + off, values[k], len) == buf + off,
+                      "tb_memset: wrong return value");
+                for ( size_t i = 0; i < sizeof(buf); i++ ) {
+                    bool inside = i >= off && i < off + len;
+                    CHECK(buf[i] == (inside ? want : (uint8_t)~want),
+                          "tb_memset 0x%x, %zu bytes at +%zu: byte %zu is "
+                          "0x%x", values[k], len, off, i, buf[i]);
+                }
+            }
+        }
+    }
+    printf("tb_memset: ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argv;
+
+    if ( argc > 1 )
+        return 0;        /* nothing to benchmark */
+
+    test_memcmp();
+    test_consttime_memequal();
+    test_tb_memset();
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
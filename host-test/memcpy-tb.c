@@ -0,0 +1,75 @@
+/*
+ * memcpy-tb.c: tboot's tb_memcpy() built for the host, with hooks to
+ *              pick the copy tiers
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "../tboot/common/memcpy.c"
+
+const size_t test_copy_small_max = COPY_SMALL_MAX;
+const size_t test_copy_nt_default = COPY_NT_DEFAULT;
+
+/* use the CPU's real features and LLC size, as tboot would */
+void test_copy_probe(bool *rep_movsb, bool *movnti, size_t *nt_threshold)
+{
+    probe_copy_features();
+    *rep_movsb = copy_rep_movsb;
+    *movnti = copy_movnti;
+    *nt_threshold = copy_nt_threshold;
+}
+
+/* force the tiers, e.g. to reach the movnti path with small copies */
+void test_copy_force(bool rep_movsb, bool movnti, size_t nt_threshold)
+{
+    copy_probed = true;
+    copy_rep_movsb = rep_movsb;
+    copy_movnti = movnti;
+    copy_nt_threshold = nt_threshold;
+}
+
+/* the word loop on its own, i.e. tb_memcpy() before it was tiered */
+void test_copy_words(void *dst, const void *src, size_t length)
+{
+    bcopy_words(dst, src, length);
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,313 @@
+/*
+ * memcpy-test.c: checks tb_memcpy() at every copy tier boundary and
+ *                benchmarks the tiers (--bench)
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpuid.h>
+
+#include "host-test.h"
+
+/* memcpy-tb.c */
+extern void *tb_memcpy(void *dst, const void *src, size_t len);
+extern const size_t test_copy_small_max;
+extern const size_t test_copy_nt_default;
+extern void test_copy_probe(bool *rep_movsb, bool *movnti,
+                            size_t *nt_threshold);
+extern void test_copy_force(bool rep_movsb, bool movnti, size_t nt_threshold);
+extern void test_copy_words(void *dst, const void *src, size_t length);
+
+#define GUARD          64
+#define GUARD_BYTE     0xa5
+/* small enough that the movnti tier is reachable in the tests */
+#define TEST_NT_SIZE   4096
+
+typedef struct {
+    const char *name;
+    bool       rep_movsb;
+    bool       movnti;
+    size_t     nt_threshold;
+} tier_config_t;
+
+static tier_config_t configs[] = {
+    { "words",           false, false, 0 },
+    { "rep movsb",       true,  false, 0 },
+    { "movnti",          false, true,  TEST_NT_SIZE },
+    { "rep movsb+movnti", true, true,  TEST_NT_SIZE },
+};
+#define NR_CONFIGS     (sizeof(configs) / sizeof(configs[0]))
+
+static uint8_t *src_buf, *dst_buf, *ref_buf;
+static size_t buf_size;
+
+static void fill_random(uint8_t *p, size_t len, uint64_t *seed)
+{
+    for ( size_t i = 0; i < len; i++ )
+        p[i] = test_rand(seed);
+}
+
+/* copy len bytes between the given offsets and check the copy and guards */
+static void check_copy(const char *tier, size_t len, size_t src_off,
+                       size_t dst_off)
+{
+    uint8_t *dst = dst_buf + GUARD + dst_off;
+    const uint8_t *src = src_buf + GUARD + src_off;
+
+    memset(dst_buf, GUARD_BYTE, GUARD + dst_off + len + GUARD);
+    CHECK(tb_memcpy(dst, src, len) == dst, "%s: wrong return value", tier);
+    CHECK(memcmp(dst, src, len) == 0,
+          "%s: bad copy of %zu bytes (src +%zu, dst +%zu)", tier, len,
+          src_off, dst_off);
+    for ( size_t i = 0; i < GUARD + dst_off; i++ )
+        CHECK(dst_buf[i] == GUARD_BYTE,
+              "%s: %zu byte copy wrote before dst (src +%zu, dst +%zu)",
+              tier, len, src_off, dst_off);
+    for ( size_t i = 0; i < GUARD; i++ )
+        CHECK(dst[len + i] == GUARD_BYTE,
+              "%s: %zu byte copy wrote past dst (src +%zu, dst +%zu)",
+              tier, len, src_off, dst_off);
+}
+
+/* lengths either side of each boundary where tb_memcpy() changes tier */
+static size_t boundary_lens(size_t nt_threshold, size_t *lens)
+{
+    const size_t bounds[] = { 0, 4, 64, test_copy_small_max, TEST_NT_SIZE,
+                              nt_threshold, 64 * 1024 };
+    size_t n = 0;
+
+    for ( size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++ ) {
+        for ( size_t d = 0; d <= 2 * 8; d++ ) {
+            size_t len = bounds[i] + d - 8;
+            if ( d < 8 && bounds[i] < 8 - d )
+                continue;
+            if ( len + 2 * GUARD + 64 > buf_size )
+                continue;
+            lens[n++] = len;
+        }
+        /* and a partial streaming line on the far side */
+        if ( bounds[i] + 63 + 2 * GUARD + 64 <= buf_size )
+            lens[n++] = bounds[i] + 63;
+    }
+    return n;
+}
+
+static void test_tier(const tier_config_t *cfg)
+{
+    size_t lens[256];
+    size_t nr_lens;
+
+    test_copy_force(cfg->rep_movsb, cfg->movnti, cfg->nt_threshold);
+    nr_lens = boundary_lens(cfg->nt_threshold, lens);
+
+    for ( size_t i = 0; i < nr_lens; i++ ) {
+        /* every source alignment and every destination line offset */
+        for ( size_t src_off = 0; src_off < 8; src_off++ ) {
+            for ( size_t dst_off = 0; dst_off < 64; dst_off++ ) {
+                if ( lens[i] > 4 * TEST_NT_SIZE && dst_off % 8 != 7 &&
+                     dst_off != 0 )
+                    continue;    /* keep the big copies quick */
+                check_copy(cfg->name, lens[i], src_off, dst_off);
+            }
+        }
+    }
+}
+
+/*
+ * overlapping copies must behave as memmove() whatever the tiers, since
+ * tb_memmove() is tb_memcpy()
+ */
+static void test_overlap(const tier_config_t *cfg)
+{
+    const size_t lens[] = { 1, 7, 63, test_copy_small_max - 1,
+                            test_copy_small_max, test_copy_small_max + 1,
+                            TEST_NT_SIZE, TEST_NT_SIZE + 65 };
+    const long shifts[] = { 1, 3, 4, 8, 63, 64, 65, 511 };
+
+    test_copy_force(cfg->rep_movsb, cfg->movnti, cfg->nt_threshold);
+
+    for ( size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++ ) {
+        for ( size_t j = 0; j < sizeof(shifts) / sizeof(shifts[0]); j++ ) {
+            for ( int dir = -1; dir <= 1; dir += 2 ) {
+                long shift = dir * shifts[j];
+                size_t base = GUARD + 1024;
+                uint8_t *src = dst_buf + base;
+                uint8_t *dst = src + shift;
+
+                if ( (size_t)shifts[j] >= lens[i] )
+                    continue;              /* not an overlap */
+                memcpy(dst_buf, src_buf, buf_size);
+                memcpy(ref_buf, src_buf, buf_size);
+                memmove(ref_buf + base + shift, ref_buf + base, lens[i]);
+                tb_memcpy(dst, src, lens[i]);
+                CHECK(memcmp(dst_buf, ref_buf, buf_size) == 0,
+                      "%s: bad overlapping copy of %zu bytes, shift %ld",
+                      cfg->name, lens[i], shift);
+            }
+        }
+    }
+}
+
+/* the probe should agree with CPUID on the features, and find an LLC */
+static void test_probe(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    bool rep_movsb, movnti, want_rep_movsb = false, want_movnti = false;
+    size_t nt_threshold;
+
+    test_copy_probe(&rep_movsb, &movnti, &nt_threshold);
+
+    if ( __get_cpuid(1, &eax, &ebx, &ecx, &edx) )
+        want_movnti = (edx & bit_SSE2) != 0;
+    if ( __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) )
+        want_rep_movsb = (ebx & (1 << 9)) || (edx & (1 << 4));
+    CHECK(movnti == want_movnti, "probe: movnti is %d, CPUID says %d",
+          movnti, want_movnti);
+    CHECK(rep_movsb == want_rep_movsb, "probe: rep movsb is %d, CPUID says %d",
+          rep_movsb, want_rep_movsb);
+    CHECK(nt_threshold >= 64 * 1024 && nt_threshold <= 1024 * 1024 * 1024,
+          "probe: implausible LLC size %zu", nt_threshold);
+    printf("probe: rep movsb %s, movnti %s, streaming from %zu KB%s\n",
+           rep_movsb ? "yes" : "no", movnti ? "yes" : "no",
+           nt_threshold / 1024,
+           nt_threshold == test_copy_nt_default ? " (default)" : " (LLC)");
+}
+
+static void *alloc_buf(size_t size)
+{
+    void *p;
+
+    CHECK(posix_memalign(&p, 4096, size) == 0, "out of memory");
+    return p;
+}
+
+static void run_tests(void)
+{
+    uint64_t seed = 0x5eed;
+
+    buf_size = 4 * TEST_NT_SIZE + 64 * 1024 + 4096;
+    src_buf = alloc_buf(buf_size);
+    dst_buf = alloc_buf(buf_size);
+    ref_buf = alloc_buf(buf_size);
+    fill_random(src_buf, buf_size, &seed);
+
+    test_probe();
+    for ( size_t i = 0; i < NR_CONFIGS; i++ ) {
+        test_tier(&configs[i]);
+        test_overlap(&configs[i]);
+        printf("tier %s: ok\n", configs[i].name);
+    }
+
+    free(src_buf);
+    free(dst_buf);
+    free(ref_buf);
+}
+
+/*
+ * throughput of each tier (and of the old word loop) across sizes; small
+ * copies are repeated in place, large ones walk a buffer bigger than the
+ * LLC so that they are not just cache to cache
+ */
+static void run_bench(void)
+{
+    const size_t sizes[] = { 256, 4096, 64 * 1024, 1024 * 1024,
+                             16 * 1024 * 1024, 64 * 1024 * 1024 };
+    const size_t total = 512 * 1024 * 1024;
+    bool rep_movsb, movnti;
+    size_t nt_threshold;
+    uint8_t *src, *dst;
+
+    test_copy_probe(&rep_movsb, &movnti, &nt_threshold);
+    src = alloc_buf(sizes[5]);
+    dst = alloc_buf(sizes[5]);
+    memset(src, 1, sizes[5]);
+    memset(dst, 2, sizes[5]);
+
+    printf("%-10s %12s %12s %12s %12s\n", "size", "old words", "rep movsb",
+           "movnti", "tb_memcpy");
+    for ( size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+        size_t n = total / sizes[i];
+        double mbs[4];
+
+        for ( int t = 0; t < 4; t++ ) {
+            double start;
+
+            if ( t == 1 )
+                test_copy_force(true, false, 0);
+            else if ( t == 2 )
+                test_copy_force(false, movnti, 0);
+            else if ( t == 3 )
+                test_copy_force(rep_movsb, movnti, nt_threshold);
+
+            start = now_secs();
+            for ( size_t j = 0; j < n; j++ ) {
+                if ( t == 0 )
+                    test_copy_words(dst, src, sizes[i]);
+                else
+                    tb_memcpy(dst, src, sizes[i]);
+            }
+            mbs[t] = (double)sizes[i] * n / (now_secs() - start) / 1e6;
+        }
+        printf("%-10zu %9.0f MB/s %7.0f MB/s %7.0f MB/s %7.0f MB/s\n",
+               sizes[i], mbs[0], mbs[1], mbs[2], mbs[3]);
+    }
+    if ( !movnti )
+        printf("(no SSE2, so the movnti column is the word loop)\n");
+
+    free(src);
+    free(dst);
+}
+
+int main(int argc, char *argv[])
+{
+    if ( argc > 1 && strcmp(argv[1], "--bench") == 0 )
+        run_bench();
+    else
+        run_tests();
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
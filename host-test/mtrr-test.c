@@ -0,0 +1,252 @@
+/*
+ * mtrr-test.c: checks tboot's variable MTRR planner
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host-test.h"
+
+#define MTRR_TYPE_UNCACHABLE  0
+#define MTRR_TYPE_WRBACK      6
+
+/* as in tboot/include/txt/mtrrs.h */
+typedef struct {
+    uint64_t     base;          /* in pages */
+    unsigned int order;         /* size is 2^order pages */
+    uint8_t      type;
+} mtrr_block_t;
+
+/* mtrrs.c */
+extern int plan_mtrr_cover(uint64_t base, uint64_t nr_pages, uint8_t mem_type,
+                           mtrr_block_t *plan, unsigned int max);
+
+#define MAX_PLAN         256
+/* the default; more can be asked for on the command line */
+#define ITERATIONS       20000
+
+/* the type a page gets from a plan, with UC winning where blocks overlap
+   and UC as the default */
+static int page_type(const mtrr_block_t *plan, int nr, uint64_t page)
+{
+    bool wb = false;
+
+    for ( int i = 0; i < nr; i++ ) {
+        uint64_t size = 1ULL << plan[i].order;
+
+        if ( page - plan[i].base < size ) {
+            if ( plan[i].type == MTRR_TYPE_UNCACHABLE )
+                return MTRR_TYPE_UNCACHABLE;
+            wb = true;
+        }
+    }
+    return wb ? MTRR_TYPE_WRBACK : MTRR_TYPE_UNCACHABLE;
+}
+
+static void check_aligned(const mtrr_block_t *plan, int nr, uint64_t base,
+                          uint64_t nr_pages)
+{
+    for ( int i = 0; i < nr; i++ ) {
+        CHECK(plan[i].order < 64 &&
+              (plan[i].base & ((1ULL << plan[i].order) - 1)) == 0,
+              "0x%llx+0x%llx: block %d (0x%llx, order %u) is not aligned",
+              (unsigned long long)base, (unsigned long long)nr_pages, i,
+              (unsigned long long)plan[i].base, plan[i].order);
+        CHECK(plan[i].type == MTRR_TYPE_UNCACHABLE ||
+              plan[i].type == MTRR_TYPE_WRBACK,
+              "0x%llx+0x%llx: block %d has type %u",
+              (unsigned long long)base, (unsigned long long)nr_pages, i,
+              plan[i].type);
+    }
+}
+
+static void check_page(const mtrr_block_t *plan, int nr, uint64_t base,
+                       uint64_t nr_pages, uint64_t page)
+{
+    int want = page - base < nr_pages ? MTRR_TYPE_WRBACK :
+                                        MTRR_TYPE_UNCACHABLE;
+
+    CHECK(page_type(plan, nr, page) == want,
+          "0x%llx+0x%llx: page 0x%llx is type %d, not %d",
+          (unsigned long long)base, (unsigned long long)nr_pages,
+          (unsigned long long)page, page_type(plan, nr, page), want);
+}
+
+/*
+ * every range in a small space: the plan must be exact, and no smaller
+ * set of aligned WB and UC blocks in that space may be
+ */
+#define SPACE            16
+
+static mtrr_block_t all_blocks[4 * SPACE];
+static int nr_all_blocks;
+
+static bool is_exact(const mtrr_block_t *plan, int nr, uint64_t a,
+                     uint64_t e)
+{
+    for ( uint64_t page = 0; page < SPACE; page++ ) {
+        int want = page >= a && page < e ? MTRR_TYPE_WRBACK :
+                                           MTRR_TYPE_UNCACHABLE;
+        if ( page_type(plan, nr, page) != want )
+            return false;
+    }
+    return true;
+}
+
+static bool search(mtrr_block_t *cur, int k, int first, int need,
+                   uint64_t a, uint64_t e)
+{
+    if ( k == need )
+        return is_exact(cur, k, a, e);
+    for ( int i = first; i < nr_all_blocks; i++ ) {
+        cur[k] = all_blocks[i];
+        if ( search(cur, k + 1, i + 1, need, a, e) )
+            return true;
+    }
+    return false;
+}
+
+static void test_exhaustive(void)
+{
+    mtrr_block_t plan[MAX_PLAN], cur[MAX_PLAN];
+
+    for ( unsigned int order = 0; (1U << order) <= SPACE; order++ ) {
+        for ( uint64_t blk = 0; blk < SPACE; blk += 1ULL << order ) {
+            all_blocks[nr_all_blocks++] =
+                (mtrr_block_t){ blk, order, MTRR_TYPE_WRBACK };
+            all_blocks[nr_all_blocks++] =
+                (mtrr_block_t){ blk, order, MTRR_TYPE_UNCACHABLE };
+        }
+    }
+
+    for ( uint64_t a = 0; a < SPACE; a++ ) {
+        for ( uint64_t e = a + 1; e <= SPACE; e++ ) {
+            int nr = plan_mtrr_cover(a, e - a, MTRR_TYPE_WRBACK, plan,
+                                     MAX_PLAN);
+
+            CHECK(nr > 0, "0x%llx-0x%llx: no plan", (unsigned long long)a,
+                  (unsigned long long)e);
+            check_aligned(plan, nr, a, e - a);
+            CHECK(is_exact(plan, nr, a, e), "0x%llx-0x%llx: plan not exact",
+                  (unsigned long long)a, (unsigned long long)e);
+            for ( int k = 0; k < nr; k++ )
+                CHECK(!search(cur, 0, 0, k, a, e),
+                      "0x%llx-0x%llx: %d MTRRs would do, not %d",
+                      (unsigned long long)a, (unsigned long long)e, k, nr);
+        }
+    }
+    CHECK(plan_mtrr_cover(3, 0, MTRR_TYPE_WRBACK, plan, MAX_PLAN) == 0,
+          "empty range");
+    printf("exhaustive: every range in %d pages is exact and minimal: ok\n",
+           SPACE);
+}
+
+/*
+ * random ranges up to 2^40 pages in: the plan must be exact around both
+ * ends and at random pages (and everywhere near small ranges), and must
+ * be refused when it doesn't fit
+ */
+static void test_random(long iterations)
+{
+    uint64_t seed = 0x3772;
+    mtrr_block_t plan[MAX_PLAN];
+    unsigned long total = 0;
+    int max_nr = 0;
+
+    for ( long it = 0; it < iterations; it++ ) {
+        uint64_t base = ((uint64_t)test_rand(&seed) << 8) ^ test_rand(&seed);
+        uint64_t nr_pages;
+        int nr;
+
+        base &= (it & 1) ? 0xffffffffffULL : 0xfffffULL;
+        if ( test_rand(&seed) % 4 == 0 )
+            nr_pages = 1 + test_rand(&seed) % (1 << 18);
+        else
+            nr_pages = 1 + test_rand(&seed) % 4096;
+
+        nr = plan_mtrr_cover(base, nr_pages, MTRR_TYPE_WRBACK, plan,
+                             MAX_PLAN);
+        CHECK(nr > 0, "0x%llx+0x%llx: no plan", (unsigned long long)base,
+              (unsigned long long)nr_pages);
+        check_aligned(plan, nr, base, nr_pages);
+
+        uint64_t pages[] = { base - 1, base, base + 1,
+                             base + nr_pages / 2,
+                             base + nr_pages - 1, base + nr_pages,
+                             base + test_rand(&seed) % nr_pages,
+                             base - 1 - test_rand(&seed) % 1000,
+                             base + nr_pages + test_rand(&seed) % 1000 };
+        for ( unsigned int j = 0; j < sizeof(pages) / sizeof(pages[0]); j++ )
+            check_page(plan, nr, base, nr_pages, pages[j]);
+        if ( nr_pages < 2000 ) {
+            uint64_t page = base > 4096 ? base - 4096 : 0;
+            for ( ; page < base + nr_pages + 4096; page++ )
+                check_page(plan, nr, base, nr_pages, page);
+        }
+
+        /* one MTRR short must fail cleanly */
+        CHECK(plan_mtrr_cover(base, nr_pages, MTRR_TYPE_WRBACK, plan,
+                              nr - 1) == -1,
+              "0x%llx+0x%llx: planned in %d MTRRs, not %d",
+              (unsigned long long)base, (unsigned long long)nr_pages,
+              nr - 1, nr);
+
+        total += nr;
+        if ( nr > max_nr )
+            max_nr = nr;
+    }
+    printf("random: %ld ranges, %.2f MTRRs on average, %d at most: ok\n",
+           iterations, (double)total / iterations, max_nr);
+}
+
+int main(int argc, char *argv[])
+{
+    test_exhaustive();
+    test_random(argc > 1 ? atol(argv[1]) : ITERATIONS);
+    return 0;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
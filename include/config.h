@@ -68,10 +68,6 @@
 #define TBOOT_KERNEL_CMDLINE_SIZE    0x0400
 
 
-#ifndef NR_CPUS
-#define NR_CPUS     512
-#endif
-
 #ifdef __ASSEMBLY__
 #define ENTRY(name)                             \
   .globl name;                                  \
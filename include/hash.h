@@ -102,6 +102,9 @@ extern bool hash_buffer(const unsigned char* buf, size_t size, tb_hash_t *hash,
                         uint16_t hash_alg);
 extern bool extend_hash(tb_hash_t *hash1, const tb_hash_t *hash2,
                         uint16_t hash_alg);
+extern bool copy_and_hash(void *dst, const void *src, size_t size,
+                          unsigned int alg_count, const uint16_t *algs,
+                          tb_hash_t *hashes);
 extern void print_hash(const tb_hash_t *hash, uint16_t hash_alg);
 extern void copy_hash(tb_hash_t *dest_hash, const tb_hash_t *src_hash,
                       uint16_t hash_alg);
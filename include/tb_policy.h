@@ -88,10 +88,28 @@ typedef struct __packed {
     tb_hash_t    hashes[];
 } tb_policy_entry_t;
 
+/*
+ * version 3 entries have the same fields as above but a 16-bit hash count,
+ * and their hashes must be sorted in ascending (byte) order so that they
+ * can be binary searched; use the get_policy_entry_*() helpers to access
+ * the count and hashes of either kind of entry
+ */
+typedef struct __packed {
+    uint8_t      mod_num;
+    uint8_t      pcr;
+    uint8_t      hash_type;
+    uint32_t     nv_index;
+    uint16_t     num_hashes;
+    tb_hash_t    hashes[];
+} tb_policy_entry_v3_t;
+
 #define TB_POLCTL_EXTEND_PCR17       0x1  /* extend policy into PCR 17 */
 
+#define TB_POLVER_2          2      /* entries are tb_policy_entry_t */
+#define TB_POLVER_SORTED     3      /* entries are tb_policy_entry_v3_t */
+
 typedef struct __packed {
-    uint8_t             version;          /* currently 2 */
+    uint8_t             version;          /* TB_POLVER_* */
     uint8_t             policy_type;      /* TB_POLTYPE_* */
     /* TODO should be changed to 16bit for TPM 2.0 */
     uint8_t             hash_alg;         /* TB_HALG_* */
@@ -109,6 +127,10 @@ typedef struct __packed {
 #define MAX_TB_POLICY_SIZE   \
     sizeof(tb_policy_t) + 8*(sizeof(tb_policy_entry_t) + 4*sizeof(tb_hash_t))
 
+/* max size of a policy with large (version 3) hash lists; these will
+   usually only fit when wrapped in LCP policy data */
+#define MAX_TB_POLICY_V3_SIZE   0x10000
+
 #define TB_POLICY_INDEX     0x20000001  /* policy index for Verified Launch */
 
 
@@ -149,16 +171,65 @@ static inline const char *policy_control_to_string(uint32_t policy_control)
         return "";
 }
 
-static inline size_t calc_policy_entry_size(const tb_policy_entry_t *pol_entry,
-                                            uint16_t hash_alg)
+static inline size_t get_policy_entry_hdr_size(const tb_policy_t *policy)
+{
+    if ( policy->version == TB_POLVER_SORTED )
+        return sizeof(tb_policy_entry_v3_t);
+    else
+        return sizeof(tb_policy_entry_t);
+}
+
+static inline unsigned int get_policy_max_hashes(const tb_policy_t *policy)
+{
+    if ( policy->version == TB_POLVER_SORTED )
+        return 0xffff;
+    else
+        return 0xff;
+}
+
+static inline unsigned int get_policy_entry_num_hashes(
+                const tb_policy_t *policy, const tb_policy_entry_t *pol_entry)
+{
+    if ( policy->version == TB_POLVER_SORTED )
+        return ((const tb_policy_entry_v3_t *)pol_entry)->num_hashes;
+    else
+        return pol_entry->num_hashes;
+}
+
+static inline void set_policy_entry_num_hashes(const tb_policy_t *policy,
+                                               tb_policy_entry_t *pol_entry,
+                                               unsigned int num_hashes)
+{
+    if ( policy->version == TB_POLVER_SORTED )
+        ((tb_policy_entry_v3_t *)pol_entry)->num_hashes = num_hashes;
+    else
+        pol_entry->num_hashes = num_hashes;
+}
+
+/* order of hashes in a version 3 entry */
+static inline int compare_policy_hashes(const void *hash1, const void *hash2,
+                                        size_t hash_size)
+{
+    const uint8_t *p1 = hash1, *p2 = hash2;
+
+    for ( size_t i = 0; i < hash_size; i++ ) {
+        if ( p1[i] != p2[i] )
+            return (int)p1[i] - (int)p2[i];
+    }
+    return 0;
+}
+
+static inline size_t calc_policy_entry_size(const tb_policy_t *policy,
+                                            const tb_policy_entry_t *pol_entry)
 {
     if ( pol_entry == NULL )
         return 0;
 
-    size_t size = sizeof(*pol_entry);
+    size_t size = get_policy_entry_hdr_size(policy);
     /* tb_policy_entry_t has empty hash array, which isn't counted in size */
     /* so add size of each hash */
-    size += pol_entry->num_hashes * get_hash_size(hash_alg);
+    size += get_policy_entry_num_hashes(policy, pol_entry) *
+            get_hash_size(policy->hash_alg);
 
     return size;
 }
@@ -171,8 +242,7 @@ static inline size_t calc_policy_size(const tb_policy_t *policy)
     /* so add size of each policy */
     const tb_policy_entry_t *pol_entry = policy->entries;
     for ( int i = 0; i < policy->num_entries; i++ ) {
-        size_t entry_size = calc_policy_entry_size(pol_entry,
-                                                   policy->hash_alg);
+        size_t entry_size = calc_policy_entry_size(policy, pol_entry);
         pol_entry = (void *)pol_entry + entry_size;
         size += entry_size;
     }
@@ -180,8 +250,8 @@ static inline size_t calc_policy_size(const tb_policy_t *policy)
     return size;
 }
 
-static inline tb_hash_t *get_policy_entry_hash(
-                const tb_policy_entry_t *pol_entry, uint16_t hash_alg, int i)
+static inline tb_hash_t *get_policy_entry_hash(const tb_policy_t *policy,
+                const tb_policy_entry_t *pol_entry, int i)
 {
     /* assumes policy has already been validated */
 
@@ -190,13 +260,14 @@ static inline tb_hash_t *get_policy_entry_hash(
         return NULL;
     }
 
-    if ( i < 0 || i >= pol_entry->num_hashes ) {
+    if ( i < 0 || (unsigned int)i >= get_policy_entry_num_hashes(policy,
+                                                                pol_entry) ) {
         PRINT(TBOOT_ERR"Error: position is not correct.\n");
         return NULL;
     }
 
-    return (tb_hash_t *)((void *)pol_entry->hashes +
-                         i * get_hash_size(hash_alg));
+    return (tb_hash_t *)((void *)pol_entry + get_policy_entry_hdr_size(policy)
+                         + i * get_hash_size(policy->hash_alg));
 }
 
 static inline tb_policy_entry_t* get_policy_entry(const tb_policy_t *policy,
@@ -215,10 +286,8 @@ static inline tb_policy_entry_t* get_policy_entry(const tb_policy_t *policy,
     }
 
     tb_policy_entry_t *pol_entry = (tb_policy_entry_t *)policy->entries;
-    for ( int j = 0; j < i; j++ ) {
-        pol_entry = (void *)pol_entry +
-            calc_policy_entry_size(pol_entry, policy->hash_alg);
-    }
+    for ( int j = 0; j < i; j++ )
+        pol_entry = (void *)pol_entry + calc_policy_entry_size(policy, pol_entry);
 
     return pol_entry;
 }
@@ -233,14 +302,15 @@ static inline tb_policy_entry_t* find_policy_entry(const tb_policy_t *policy,
         return NULL;
     }
 
+    /* step through the entries rather than using get_policy_entry(),
+       which would walk them from the start each time */
+    tb_policy_entry_t *pol_entry = (tb_policy_entry_t *)policy->entries;
     for ( int i = 0; i < policy->num_entries; i++ ) {
-        tb_policy_entry_t *pol_entry = get_policy_entry(policy, i);
-        if ( pol_entry == NULL )
-            return NULL;
-
         if ( pol_entry->mod_num == mod_num ||
              pol_entry->mod_num == TB_POL_MOD_NUM_ANY )
             return pol_entry;
+
+        pol_entry = (void *)pol_entry + calc_policy_entry_size(policy, pol_entry);
     }
 
     return NULL;
@@ -264,7 +334,8 @@ static inline bool verify_policy(const tb_policy_t *policy, size_t size, bool pr
         return false;
     }
 
-    if ( policy->version != 0x02 ) {
+    if ( policy->version != TB_POLVER_2 &&
+         policy->version != TB_POLVER_SORTED ) {
         if ( print ) PRINT(TBOOT_ERR"unsupported version (%u)\n", policy->version);
         return false;
     }
@@ -277,6 +348,10 @@ static inline bool verify_policy(const tb_policy_t *policy, size_t size, bool pr
 
     if ( print ) PRINT(TBOOT_DETA"\t hash_alg: %s\n",
                        hash_alg_to_string(policy->hash_alg));
+    /* version 3 came after the tools always set hash_alg */
+    if ( policy->version == TB_POLVER_SORTED &&
+         get_hash_size(policy->hash_alg) == 0 )
+        return false;
 
     if ( print ) PRINT(TBOOT_DETA"\t policy_control: %08x (%s)\n",
                        policy->policy_control,
@@ -284,11 +359,12 @@ static inline bool verify_policy(const tb_policy_t *policy, size_t size, bool pr
 
     if ( print ) PRINT(TBOOT_DETA"\t num_entries: %u\n", policy->num_entries);
 
+    size_t hdr_size = get_policy_entry_hdr_size(policy);
+    size_t hash_size = get_hash_size(policy->hash_alg);
     const tb_policy_entry_t *pol_entry = policy->entries;
     for ( int i = 0; i < policy->num_entries; i++ ) {
         /* check header of policy entry */
-        if ( ((void *)pol_entry - (void *)policy + sizeof(*pol_entry)) >
-             size ) {
+        if ( ((void *)pol_entry - (void *)policy + hdr_size) > size ) {
             if ( print ) PRINT(TBOOT_ERR"size of policy entry is too small (%lu)\n",
                                (unsigned long)size);
             return false;
@@ -339,28 +415,36 @@ static inline bool verify_policy(const tb_policy_t *policy, size_t size, bool pr
         if ( pol_entry->hash_type > TB_HTYPE_IMAGE )
             return false;
 
-        if ( print ) PRINT(TBOOT_DETA"\t\t num_hashes: %u\n", pol_entry->num_hashes);
+        unsigned int num_hashes = get_policy_entry_num_hashes(policy,
+                                                              pol_entry);
+        if ( print ) PRINT(TBOOT_DETA"\t\t num_hashes: %u\n", num_hashes);
 
         /* check all of policy */
-        if ( ((void *)pol_entry - (void *)policy + sizeof(*pol_entry) +
-              pol_entry->num_hashes * get_hash_size(policy->hash_alg))
-             > size ) {
+        if ( ((void *)pol_entry - (void *)policy + hdr_size +
+              num_hashes * hash_size) > size ) {
             if ( print ) PRINT(TBOOT_ERR"size of policy entry is too small (%lu)\n",
                                (unsigned long)size);
             return false;
         }
 
-        for ( int j = 0; j < pol_entry->num_hashes; j++ ) {
+        for ( int j = 0; j < (int)num_hashes; j++ ) {
+            const tb_hash_t *hash = get_policy_entry_hash(policy, pol_entry, j);
+
             if ( print ) {
                 PRINT(TBOOT_DETA"\t\t hashes[%d]: ", j);
-                print_hash(get_policy_entry_hash(pol_entry,
-                                                 policy->hash_alg, j),
-                           policy->hash_alg);
+                print_hash(hash, policy->hash_alg);
+            }
+
+            /* version 3 hashes are binary searched, so must be sorted */
+            if ( policy->version == TB_POLVER_SORTED && j > 0 &&
+                 compare_policy_hashes((const void *)hash - hash_size, hash,
+                                       hash_size) >= 0 ) {
+                if ( print ) PRINT(TBOOT_ERR"hashes are not sorted\n");
+                return false;
             }
         }
 
-        pol_entry = (void *)pol_entry +
-                          calc_policy_entry_size(pol_entry, policy->hash_alg);
+        pol_entry = (void *)pol_entry + calc_policy_entry_size(policy, pol_entry);
     }
 
     return true;
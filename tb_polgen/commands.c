@@ -35,6 +35,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
@@ -144,11 +145,17 @@ bool do_create(const param_data_t *params)
 
     /* if file does not exist then create empty policy */
     if ( !existing_policy )
-        new_policy(params->policy_type, params->policy_control, params->hash_alg);
+        new_policy(params->policy_type, params->policy_control, params->hash_alg,
+                   params->version);
     else {
         error_msg("warning: modifing existing policy file, hash algorithm "
                   "will not be changed\n");
         modify_policy(params->policy_type, params->policy_control);
+        if ( params->version == TB_POLVER_SORTED && !upgrade_policy() ) {
+            error_msg("Error converting policy to version %d\n",
+                      params->version);
+            return false;
+        }
     }
 
     info_msg("writing new policy file...\n");
@@ -248,12 +255,14 @@ bool do_del(const param_data_t *params)
 
     /* if pos was specified, find it */
     if ( params->pos != -1 ) {
-        if ( params->pos >= pol_entry->num_hashes ) {
+        unsigned int num_hashes = get_policy_entry_num_hashes(g_policy,
+                                                              pol_entry);
+        if ( params->pos < 0 || (unsigned int)params->pos >= num_hashes ) {
             error_msg("specified pos does not exist\n");
             return false;
         }
         /* if entry only has 1 hash, then delete the entire entry */
-        if ( pol_entry->num_hashes == 1 ) {
+        if ( num_hashes == 1 ) {
             if ( !del_entry(pol_entry) ) {
                 error_msg("failed to delete entry\n");
                 return false;
@@ -309,10 +318,33 @@ bool do_unwrap(const param_data_t *params)
         goto exit;
     }
 
+    size_t hdr_len = offsetof(lcp_policy_element_t, data) +
+                     offsetof(lcp_custom_element_t, data);
+    if ( file_len < hdr_len ) {
+        error_msg("data is too small\n");
+        goto exit;
+    }
+
     lcp_custom_element_t *custom = (lcp_custom_element_t *)&elt->data;
     tb_policy_t *pol = (tb_policy_t *)&custom->data;
+    size_t data_len = file_len - hdr_len;
 
-    memcpy_s(g_policy, MAX_TB_POLICY_SIZE, pol, calc_policy_size(pol));
+    /* the policy must fit in the element's data, which verify_policy()
+       checks before anything walks its entries */
+    if ( !verify_policy(pol, data_len, verbose) ) {
+        error_msg("policy in elt file is invalid\n");
+        goto exit;
+    }
+    size_t pol_size = calc_policy_size(pol);
+    if ( pol_size > data_len || pol_size > MAX_TB_POLICY_V3_SIZE ) {
+        error_msg("policy in elt file is too big (%zu)\n", pol_size);
+        goto exit;
+    }
+
+    if ( memcpy_s(g_policy, MAX_TB_POLICY_V3_SIZE, pol, pol_size) != EOK ) {
+        error_msg("copying policy failed\n");
+        goto exit;
+    }
 
     info_msg("writing/overwriting policy file...\n");
     if ( !write_policy_file(params->policy_file) )
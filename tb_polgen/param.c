@@ -53,6 +53,7 @@ static const char *help[] = {
     "tb_polgen --create --type        nonfatal|continue|halt\n",
     "                   [--alg        sha1 (default)|sha256]\n",
     "                   [--ctrl       <policy control value>]\n",
+    "                   [--ver        2 (default)|3]\n",
     "                   [--verbose]\n",
     "                   <policy file name>\n",
     "tb_polgen --add    --num         <module number>|any\n",
@@ -94,6 +95,7 @@ static struct option long_options[] =
     {"type",           required_argument,    NULL,    't'},
     {"ctrl",           required_argument,    NULL,    'c'},
     {"alg",            required_argument,    NULL,    'a'},
+    {"ver",            required_argument,    NULL,    'V'},
 
     {"num",            required_argument,    NULL,    'n'},
     {"pcr",            required_argument,    NULL,    'p'},
@@ -143,6 +145,12 @@ static option_table_t alg_opts[] = {
     {NULL}
 };
 
+static option_table_t version_opts[] = {
+    {"2",            int_opt : TB_POLVER_2},
+    {"3",            int_opt : TB_POLVER_SORTED},
+    {NULL}
+};
+
 static bool strtonum(char *optarg, int *i)
 {
     if ( optarg == NULL || i == NULL )
@@ -189,6 +197,7 @@ void print_params(param_data_t *params)
     info_msg("\t cmd = %d\n", params->cmd);
     info_msg("\t policy_type = %d\n", params->policy_type);
     info_msg("\t hash_alg = %d\n", params->hash_alg);
+    info_msg("\t version = %d\n", params->version);
     info_msg("\t policy_control = %d\n", params->policy_control);
     info_msg("\t mod_num = %d\n", params->mod_num);
     info_msg("\t pcr = %d\n", params->pcr);
@@ -329,6 +338,7 @@ bool parse_input_params(int argc, char **argv, param_data_t *params)
     params->mod_num = -1;
     params->pcr = -1;
     params->hash_alg = TB_HALG_SHA1;
+    params->version = TB_POLVER_2;
     params->policy_type = -1;
     params->policy_control = TB_POLCTL_EXTEND_PCR17;
     params->hash_type = -1;
@@ -338,7 +348,7 @@ bool parse_input_params(int argc, char **argv, param_data_t *params)
     params->elt_file[0] = '\0';
 
     while ( true ) {
-        c = getopt_long_only(argc, argv, "HCADUSt:a:c:n:p:h:l:i:o:e:",
+        c = getopt_long_only(argc, argv, "HCADUSt:a:V:c:n:p:h:l:i:o:e:",
                              long_options, &option_index);
         if ( c == -1 )     /* no more args */
             break;
@@ -398,6 +408,13 @@ bool parse_input_params(int argc, char **argv, param_data_t *params)
                     return false;
                 }
                 break;
+            case 'V':                       /* --ver */
+                if ( !parse_int_option(version_opts, optarg,
+                                       (int *)&params->version) ) {
+                    error_msg("Unknown --ver option\n");
+                    return false;
+                }
+                break;
             case 'c':                       /* --ctrl */
                 if ( !strtonum(optarg, &params->policy_control) ) {
                     error_msg("Unknown --ctrl option\n");
@@ -48,7 +48,7 @@
 #include "tb_polgen.h"
 
 /* buffer for policy read/written from/to policy file */
-static uint8_t _policy_buf[MAX_TB_POLICY_SIZE];
+static uint8_t _policy_buf[MAX_TB_POLICY_V3_SIZE];
 
 tb_policy_t *g_policy = (tb_policy_t *)_policy_buf;
 
@@ -147,10 +147,10 @@ bool write_policy_file(const char *policy_filename)
     return true;
 }
 
-void new_policy(int policy_type, int policy_control, int hash_alg)
+void new_policy(int policy_type, int policy_control, int hash_alg,
+                int version)
 {
-    /* current version is 2 */
-    g_policy->version = 2;
+    g_policy->version = version;
 
     g_policy->hash_alg = hash_alg;
 
@@ -181,14 +181,14 @@ tb_policy_entry_t *add_pol_entry(uint8_t mod_num, uint8_t pcr,
     /* always goes at end of policy, so no need to make space, */
     /* just find end of policy data */
     size_t size = calc_policy_size(g_policy);
-    if ( size + sizeof(tb_policy_entry_t) > sizeof(_policy_buf) )
+    if ( size + get_policy_entry_hdr_size(g_policy) > sizeof(_policy_buf) )
         return NULL;
     tb_policy_entry_t *pol_entry = (tb_policy_entry_t *)(_policy_buf + size);
 
     pol_entry->mod_num = mod_num;
     pol_entry->pcr = pcr;
     pol_entry->hash_type = hash_type;
-    pol_entry->num_hashes = 0;
+    set_policy_entry_num_hashes(g_policy, pol_entry, 0);
 
     g_policy->num_entries++;
 
@@ -207,23 +207,133 @@ void modify_pol_entry(tb_policy_entry_t *pol_entry, uint8_t pcr,
     pol_entry->hash_type = hash_type;
 }
 
+static size_t sort_hash_size;
+
+static int cmp_hashes(const void *hash1, const void *hash2)
+{
+    return compare_policy_hashes(hash1, hash2, sort_hash_size);
+}
+
+/*
+ * upgrade_policy
+ *
+ * convert the policy to version 3: widen each entry's hash count and sort
+ * (and de-duplicate) its hashes
+ */
+bool upgrade_policy(void)
+{
+    if ( g_policy->version == TB_POLVER_SORTED )
+        return true;
+
+    size_t hash_size = get_hash_size(g_policy->hash_alg);
+    size_t new_size = calc_policy_size(g_policy) + g_policy->num_entries *
+        (sizeof(tb_policy_entry_v3_t) - sizeof(tb_policy_entry_t));
+    if ( new_size > sizeof(_policy_buf) )
+        return false;
+
+    uint8_t *new_buf = malloc(sizeof(_policy_buf));
+    if ( new_buf == NULL )
+        return false;
+
+    tb_policy_t *policy3 = (tb_policy_t *)new_buf;
+    memcpy_s(policy3, sizeof(_policy_buf), g_policy, sizeof(*g_policy));
+    policy3->version = TB_POLVER_SORTED;
+
+    const tb_policy_entry_t *pol_entry = g_policy->entries;
+    uint8_t *new_entry = (uint8_t *)policy3->entries;
+    for ( int i = 0; i < g_policy->num_entries; i++ ) {
+        tb_policy_entry_v3_t *entry3 = (tb_policy_entry_v3_t *)new_entry;
+        unsigned int num_hashes = pol_entry->num_hashes, n = 0;
+
+        entry3->mod_num = pol_entry->mod_num;
+        entry3->pcr = pol_entry->pcr;
+        entry3->hash_type = pol_entry->hash_type;
+        entry3->nv_index = pol_entry->nv_index;
+        memcpy_s(entry3->hashes, sizeof(_policy_buf) -
+                 (new_entry - new_buf) - sizeof(*entry3),
+                 pol_entry->hashes, num_hashes * hash_size);
+
+        sort_hash_size = hash_size;
+        qsort(entry3->hashes, num_hashes, hash_size, cmp_hashes);
+        for ( unsigned int j = 0; j < num_hashes; j++ ) {
+            uint8_t *hash = (uint8_t *)entry3->hashes + j * hash_size;
+            if ( n > 0 && cmp_hashes(hash - hash_size, hash) == 0 )
+                continue;
+            memmove((uint8_t *)entry3->hashes + n * hash_size, hash,
+                    hash_size);
+            n++;
+        }
+        entry3->num_hashes = n;
+
+        new_entry += sizeof(*entry3) + n * hash_size;
+        pol_entry = (void *)pol_entry + calc_policy_entry_size(g_policy,
+                                                               pol_entry);
+    }
+
+    memset_s(_policy_buf, sizeof(_policy_buf), 0);
+    memcpy_s(_policy_buf, sizeof(_policy_buf), new_buf,
+             new_entry - new_buf);
+    free(new_buf);
+
+    info_msg("upgraded policy to version %u\n", TB_POLVER_SORTED);
+    return true;
+}
+
 bool add_hash(tb_policy_entry_t *pol_entry, const tb_hash_t *hash)
 {
     if ( pol_entry == NULL )
         return false;
 
+    /* a version 2 entry can only count 255 hashes, so switch to version 3
+       to add more; entries move, so find ours again afterwards */
+    if ( get_policy_entry_num_hashes(g_policy, pol_entry) >=
+         get_policy_max_hashes(g_policy) ) {
+        if ( g_policy->version == TB_POLVER_SORTED )
+            return false;
+
+        int idx = 0;
+        while ( get_policy_entry(g_policy, idx) != pol_entry )
+            idx++;
+        if ( !upgrade_policy() )
+            return false;
+        pol_entry = get_policy_entry(g_policy, idx);
+    }
+
+    unsigned int num_hashes = get_policy_entry_num_hashes(g_policy, pol_entry);
+    size_t hash_size = get_hash_size(g_policy->hash_alg);
+    unsigned char *hashes = (unsigned char *)pol_entry +
+                            get_policy_entry_hdr_size(g_policy);
+    unsigned int pos = num_hashes;
+
+    /* version 3 hashes are kept sorted, so find where this one goes */
+    if ( g_policy->version == TB_POLVER_SORTED ) {
+        unsigned int lo = 0, hi = num_hashes;
+        while ( lo < hi ) {
+            unsigned int mid = lo + (hi - lo) / 2;
+            int cmp = compare_policy_hashes(hashes + mid * hash_size, hash,
+                                            hash_size);
+            if ( cmp == 0 ) {
+                info_msg("hash is already in the policy entry\n");
+                return true;
+            }
+            if ( cmp < 0 )
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        pos = lo;
+    }
+
     /* since pol_entry may not be last in policy, need to make space */
     size_t pol_size = calc_policy_size(g_policy);
-    size_t hash_size = get_hash_size(g_policy->hash_alg);
     if ( pol_size + hash_size > sizeof(_policy_buf) )
         return false;
-    unsigned char *entry_end = (unsigned char *)pol_entry + sizeof(*pol_entry)
-                               + (pol_entry->num_hashes * hash_size);
+    unsigned char *hash_start = hashes + pos * hash_size;
     unsigned char *pol_end = _policy_buf + pol_size;
-    memmove(entry_end + hash_size, entry_end, pol_end - entry_end);
+    memmove(hash_start + hash_size, hash_start, pol_end - hash_start);
 
-    copy_hash((tb_hash_t *)entry_end, hash, g_policy->hash_alg);
-    pol_entry->num_hashes++;
+    copy_hash((tb_hash_t *)hash_start, hash, g_policy->hash_alg);
+    set_policy_entry_num_hashes(g_policy, pol_entry, num_hashes + 1);
 
     return true;
 }
@@ -232,14 +342,17 @@ bool del_hash(tb_policy_entry_t *pol_entry, int i)
 {
     if ( pol_entry == NULL )
         return false;
-    if ( i < 0 || i >= pol_entry->num_hashes )
+
+    unsigned int num_hashes = get_policy_entry_num_hashes(g_policy, pol_entry);
+    if ( i < 0 || (unsigned int)i >= num_hashes )
         return false;
 
-    void *start = get_policy_entry_hash(pol_entry, g_policy->hash_alg, i);
+    void *start = get_policy_entry_hash(g_policy, pol_entry, i);
     size_t size = get_hash_size(g_policy->hash_alg);
-    memmove(start, start + size, calc_policy_size(g_policy) - size);
+    void *pol_end = _policy_buf + calc_policy_size(g_policy);
+    memmove(start, start + size, pol_end - (start + size));
 
-    pol_entry->num_hashes--;
+    set_policy_entry_num_hashes(g_policy, pol_entry, num_hashes - 1);
 
     return true;
 }
@@ -250,15 +363,15 @@ bool del_entry(tb_policy_entry_t *pol_entry)
         return false;
 
     void *start = pol_entry;
-    size_t size = calc_policy_entry_size(pol_entry, g_policy->hash_alg);
-    memmove(start, start + size, calc_policy_size(g_policy) - size);
+    size_t size = calc_policy_entry_size(g_policy, pol_entry);
+    void *pol_end = _policy_buf + calc_policy_size(g_policy);
+    memmove(start, start + size, pol_end - (start + size));
 
     g_policy->num_entries--;
 
     return true;
 }
 
-
 /*
  * Local variables:
  * mode: C
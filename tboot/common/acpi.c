@@ -328,6 +328,58 @@ struct acpi_table_ioapic *get_acpi_ioapic_table(void)
     return NULL;
 }
 
+/*
+ * highest (x2)APIC ID of the processors in the MADT that are enabled or can
+ * be brought online; false if there is no MADT or no such processor in it
+ */
+bool get_madt_max_apic_id(uint32_t *max_id)
+{
+    struct acpi_madt *madt = get_apic_table();
+    bool found = false;
+
+    if ( madt == NULL ) {
+        printk(TBOOT_ERR"no MADT table found\n");
+        return false;
+    }
+
+    void *end = (void *)madt + madt->hdr.length;
+    union acpi_madt_entry *entry = (union acpi_madt_entry *)(madt + 1);
+
+    *max_id = 0;
+    while ( (void *)entry + 2 <= end ) {
+        uint8_t length = entry->madt_lapic.length;
+        uint32_t id, flags;
+
+        if ( length < 2 || (void *)entry + length > end ) {
+            printk(TBOOT_ERR"APIC length error.\n");
+            return false;
+        }
+
+        if ( entry->madt_lapic.apic_type == ACPI_MADT_LAPIC &&
+             length >= sizeof(entry->madt_lapic) ) {
+            id = entry->madt_lapic.apic_id;
+            flags = entry->madt_lapic.flags;
+        }
+        else if ( entry->madt_x2apic.apic_type == ACPI_MADT_X2APIC &&
+                  length >= sizeof(entry->madt_x2apic) ) {
+            id = entry->madt_x2apic.x2apic_id;
+            flags = entry->madt_x2apic.flags;
+        }
+        else {
+            entry = (void *)entry + length;
+            continue;
+        }
+
+        if ( flags & (ACPI_PROC_ENABLE | ACPI_PROC_ONLINE_CAPABLE) ) {
+            if ( id > *max_id )
+                *max_id = id;
+            found = true;
+        }
+        entry = (void *)entry + length;
+    }
+    return found;
+}
+
 struct acpi_mcfg *get_acpi_mcfg_table(void)
 {
     return (struct acpi_mcfg *)find_table(MCFG_SIG);
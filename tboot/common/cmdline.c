@@ -87,6 +87,7 @@ static const cmdline_option_t g_tboot_cmdline_options[] = {
     { "ignore_prev_err", "true"},    /* true|false */
     { "force_tpm2_legacy_log", "false"}, /* true|false */
     { "save_vtd", "false"},          /* true|false */
+    { "decompress", "none"},         /* none|kernel|all */
     { NULL, NULL }
 };
 static char g_tboot_param_values[ARRAY_SIZE(g_tboot_cmdline_options)][MAX_VALUE_LEN];
@@ -564,6 +565,31 @@ bool get_tboot_save_vtd(void)
     return false;
 }
 
+/* gzip-compressed kernel (first module) is decompressed for "kernel"/"all" */
+bool get_tboot_decompress_kernel(void)
+{
+    const char *decompress =
+       get_option_val(g_tboot_cmdline_options,
+              g_tboot_param_values,
+              "decompress");
+    if ( decompress != NULL && (tb_strcmp(decompress, "kernel") == 0 ||
+                                tb_strcmp(decompress, "all") == 0) )
+       return true;
+    return false;
+}
+
+/* the other gzip-compressed modules are only decompressed for "all" */
+bool get_tboot_decompress_all(void)
+{
+    const char *decompress =
+       get_option_val(g_tboot_cmdline_options,
+              g_tboot_param_values,
+              "decompress");
+    if ( decompress != NULL && tb_strcmp(decompress, "all") == 0 )
+       return true;
+    return false;
+}
+
 /*
  * linux kernel command line parsing
  */
@@ -103,140 +103,245 @@ static void print_map(memory_map_t *e820, int nr_map)
     }
 }
 
-static bool insert_after_region(memory_map_t *e820map, unsigned int *nr_map,
-                                unsigned int pos, uint64_t addr, uint64_t size,
-                                uint32_t type)
-{
-    /* no more room */
-    if ( *nr_map + 1 > MAX_E820_ENTRIES )
-        return false;
+/*
+ * the map is kept sorted, non-overlapping and with adjacent entries of the
+ * same type coalesced, so lookups can binary search it and updates only
+ * have to rewrite the part of the table at and above the first entry that
+ * they touch
+ */
 
-    /* shift (copy) everything up one entry */
-    for ( unsigned int i = *nr_map - 1; i > pos; i--)
-        e820map[i+1] = e820map[i];
+/* an update to the map: set [base, end) to type, or if ram_only is set,
+   turn just the RAM inside it into E820_RESERVED */
+typedef struct {
+    uint64_t base;
+    uint64_t end;
+    uint32_t type;
+    bool     ram_only;
+} e820_op_t;
 
-    /* now add our entry */
-    split64b(addr, &(e820map[pos+1].base_addr_low),
-             &(e820map[pos+1].base_addr_high));
-    split64b(size, &(e820map[pos+1].length_low),
-             &(e820map[pos+1].length_high));
-    e820map[pos+1].type = type;
-    e820map[pos+1].size = sizeof(memory_map_t) - sizeof(uint32_t);
+#define MAX_E820_OPS          32
 
-    (*nr_map)++;
+static e820_op_t g_e820_ops[MAX_E820_OPS];
+/* scratch for the rewritten part of the table */
+static memory_map_t g_e820_scratch[MAX_E820_ENTRIES];
 
-    return true;
+static inline uint64_t e820_end_64(memory_map_t *entry)
+{
+    return e820_base_64(entry) + e820_length_64(entry);
 }
 
-static void remove_region(memory_map_t *e820map, unsigned int *nr_map,
-                          unsigned int pos)
+/* index of first entry that ends above addr (nr_map if none) */
+static unsigned int find_first_above(memory_map_t *e820map,
+                                     unsigned int nr_map, uint64_t addr)
 {
-    /* shift (copy) everything down one entry */
-    for ( unsigned int i = pos; i < *nr_map - 1; i++)
-        e820map[i] = e820map[i+1];
-
-    (*nr_map)--;
+    unsigned int lo = 0, hi = nr_map;
+
+    while ( lo < hi ) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if ( e820_end_64(&e820map[mid]) > addr )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
 }
 
-static bool protect_region(memory_map_t *e820map, unsigned int *nr_map,
-                           uint64_t new_addr, uint64_t new_size,
-                           uint32_t new_type)
+/* append [base, end) to the scratch table, merging it into the previous
+   entry if they are contiguous and of the same type */
+static bool emit_region(unsigned int *nr_out, unsigned int max_out,
+                        uint64_t base, uint64_t end, uint32_t type)
 {
-    uint64_t addr, tmp_addr, size, tmp_size;
-    uint32_t type;
-    unsigned int i;
+    memory_map_t *entry;
 
-    if ( new_size == 0 )
+    if ( end <= base )
         return true;
-    /* check for wrap */
-    if ( new_addr + new_size < new_addr )
-        return false;
 
-    /* find where our region belongs in the table and insert it */
-    for ( i = 0; i < *nr_map; i++ ) {
-        addr = e820_base_64(&e820map[i]);
-        size = e820_length_64(&e820map[i]);
-        type = e820map[i].type;
-        /* is our region at the beginning of the current map region? */
-        if ( new_addr == addr ) {
-            if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
-                                      new_type) )
-                return false;
-            break;
-        }
-        /* are we w/in the current map region? */
-        else if ( new_addr > addr && new_addr < (addr + size) ) {
-            if ( !insert_after_region(e820map, nr_map, i, new_addr, new_size,
-                                      new_type) )
-                return false;
-            /* fixup current region */
-            tmp_addr = e820_base_64(&e820map[i]);
-            split64b(new_addr - tmp_addr, &(e820map[i].length_low),
-                     &(e820map[i].length_high));
-            i++;   /* adjust to always be that of our region */
-            /* insert a copy of current region (before adj) after us so */
-            /* that rest of code can be common with previous case */
-            if ( !insert_after_region(e820map, nr_map, i, addr, size, type) )
-                return false;
-            break;
-        }
-        /* is our region in a gap in the map? */
-        else if ( addr > new_addr ) {
-            if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
-                                      new_type) )
-                return false;
-            break;
+    if ( *nr_out > 0 ) {
+        entry = &g_e820_scratch[*nr_out - 1];
+        if ( entry->type == type && e820_end_64(entry) == base ) {
+            split64b(end - e820_base_64(entry), &(entry->length_low),
+                     &(entry->length_high));
+            return true;
         }
     }
-    /* if we reached the end of the map without finding an overlapping */
-    /* region, insert us at the end (note that this test won't trigger */
-    /* for the second case above because the insert() will have incremented */
-    /* nr_map and so i++ will still be less) */
-    if ( i == *nr_map ) {
-        if ( !insert_after_region(e820map, nr_map, i-1, new_addr, new_size,
-                                  new_type) )
+
+    /* no more room */
+    if ( *nr_out >= max_out )
+        return false;
+
+    entry = &g_e820_scratch[(*nr_out)++];
+    split64b(base, &(entry->base_addr_low), &(entry->base_addr_high));
+    split64b(end - base, &(entry->length_low), &(entry->length_high));
+    entry->type = type;
+    entry->size = sizeof(memory_map_t) - sizeof(uint32_t);
+    return true;
+}
+
+/*
+ * sort the ops by base and merge those that overlap or touch; ops that
+ * overlap but would leave different types behind are rejected since the
+ * result would depend on the order they were given in
+ */
+static bool sort_ops(e820_op_t *ops, unsigned int *nr_ops)
+{
+    unsigned int i, j, n;
+
+    for ( i = 1; i < *nr_ops; i++ ) {
+        e820_op_t tmp = ops[i];
+        for ( j = i; j > 0 && ops[j-1].base > tmp.base; j-- )
+            ops[j] = ops[j-1];
+        ops[j] = tmp;
+    }
+
+    for ( i = 1, n = 1; i < *nr_ops; i++ ) {
+        e820_op_t *prev = &ops[n-1];
+        if ( ops[i].base <= prev->end && ops[i].type == prev->type &&
+             ops[i].ram_only == prev->ram_only ) {
+            if ( ops[i].end > prev->end )
+                prev->end = ops[i].end;
+        }
+        else if ( ops[i].base < prev->end ) {
+            printk(TBOOT_ERR"conflicting e820 updates: 0x%Lx - 0x%Lx and "
+                   "0x%Lx - 0x%Lx\n", prev->base, prev->end, ops[i].base,
+                   ops[i].end);
             return false;
-        return true;
+        }
+        else
+            ops[n++] = ops[i];
     }
+    if ( *nr_ops > 0 )
+        *nr_ops = n;
 
-    i++;     /* move to entry after our inserted one (we're not at end yet) */
+    return true;
+}
 
-    tmp_addr = e820_base_64(&e820map[i]);
-    tmp_size = e820_length_64(&e820map[i]);
+/*
+ * apply_ops
+ *
+ * Applies a set of updates to the table in a single pass: the entries
+ * below the lowest update are left alone and everything from there up is
+ * merged with the (sorted) updates into the scratch table, which then
+ * replaces it.  The table is not changed if the result does not fit.
+ */
+static bool apply_ops(memory_map_t *e820map, unsigned int *nr_map,
+                      e820_op_t *ops, unsigned int nr_ops)
+{
+    unsigned int start, i, j, nr_out = 0, max_out;
+    uint64_t cur_base = 0, cur_end = 0, addr;
+    uint32_t cur_type = 0;
+    bool have_cur = false;
 
-    /* did we split the (formerly) previous region? */
-    if ( (new_addr >= tmp_addr) &&
-         ((new_addr + new_size) < (tmp_addr + tmp_size)) ) {
-        /* then adjust the current region (adj size first) */
-        split64b((tmp_addr + tmp_size) - (new_addr + new_size),
-                 &(e820map[i].length_low), &(e820map[i].length_high));
-        split64b(new_addr + new_size,
-                 &(e820map[i].base_addr_low), &(e820map[i].base_addr_high));
+    if ( !sort_ops(ops, &nr_ops) )
+        return false;
+    if ( nr_ops == 0 )
         return true;
-    }
 
-    /* if our region completely covers any existing regions, delete them */
-    while ( (i < *nr_map) && ((new_addr + new_size) >=
-                              (tmp_addr + tmp_size)) ) {
-        remove_region(e820map, nr_map, i);
-        tmp_addr = e820_base_64(&e820map[i]);
-        tmp_size = e820_length_64(&e820map[i]);
-    }
+    /* start one entry early so that we can coalesce with it */
+    start = find_first_above(e820map, *nr_map, ops[0].base);
+    if ( start > 0 )
+        start--;
+    max_out = MAX_E820_ENTRIES - start;
+
+#define NEXT_ENTRY()                                                    \
+    ( i < *nr_map ?                                                     \
+      (cur_base = e820_base_64(&e820map[i]),                            \
+       cur_end = e820_end_64(&e820map[i]),                              \
+       cur_type = e820map[i++].type, have_cur = true) : false )
+
+    i = start;
+    for ( j = 0; j < nr_ops; j++ ) {
+        e820_op_t *op = &ops[j];
+
+        /* copy everything below the op, splitting an entry that straddles
+           its start */
+        while ( have_cur || NEXT_ENTRY() ) {
+            if ( cur_end > op->base ) {
+                if ( cur_base < op->base ) {
+                    if ( !emit_region(&nr_out, max_out, cur_base, op->base,
+                                      cur_type) )
+                        goto too_big;
+                    cur_base = op->base;
+                }
+                break;
+            }
+            if ( !emit_region(&nr_out, max_out, cur_base, cur_end, cur_type) )
+                goto too_big;
+            have_cur = false;
+        }
 
-    /* finally, if our region partially overlaps an existing region, */
-    /* then truncate the existing region */
-    if ( i < *nr_map ) {
-        tmp_addr = e820_base_64(&e820map[i]);
-        tmp_size = e820_length_64(&e820map[i]);
-        if ( (new_addr + new_size) > tmp_addr ) {
-            split64b((tmp_addr + tmp_size) - (new_addr + new_size),
-                        &(e820map[i].length_low), &(e820map[i].length_high));
-            split64b(new_addr + new_size, &(e820map[i].base_addr_low),
-                        &(e820map[i].base_addr_high));
+        /* then walk the entries and gaps covered by the op */
+        addr = op->base;
+        while ( addr < op->end ) {
+            uint64_t end;
+            uint32_t type;
+
+            if ( (!have_cur && !NEXT_ENTRY()) || cur_base >= op->end ) {
+                /* gap up to the end of the op */
+                if ( !op->ram_only &&
+                     !emit_region(&nr_out, max_out, addr, op->end, op->type) )
+                    goto too_big;
+                break;
+            }
+            if ( cur_base > addr ) {
+                /* gap before the entry */
+                if ( !op->ram_only &&
+                     !emit_region(&nr_out, max_out, addr, cur_base, op->type) )
+                    goto too_big;
+                addr = cur_base;
+            }
+
+            end = (cur_end < op->end) ? cur_end : op->end;
+            if ( !op->ram_only )
+                type = op->type;
+            else
+                type = (cur_type == E820_RAM) ? E820_RESERVED : cur_type;
+            if ( !emit_region(&nr_out, max_out, addr, end, type) )
+                goto too_big;
+            addr = end;
+
+            if ( cur_end <= op->end )
+                have_cur = false;
+            else
+                cur_base = op->end;
         }
     }
 
+    /* and whatever is left above the last op */
+    while ( have_cur || NEXT_ENTRY() ) {
+        if ( !emit_region(&nr_out, max_out, cur_base, cur_end, cur_type) )
+            goto too_big;
+        have_cur = false;
+    }
+#undef NEXT_ENTRY
+
+    tb_memcpy(&e820map[start], g_e820_scratch, nr_out * sizeof(memory_map_t));
+    *nr_map = start + nr_out;
+
     return true;
+
+too_big:
+    printk(TBOOT_ERR"e820 table is full (%u entries)\n",
+           (unsigned int)MAX_E820_ENTRIES);
+    return false;
+}
+
+static bool protect_region(memory_map_t *e820map, unsigned int *nr_map,
+                           uint64_t new_addr, uint64_t new_size,
+                           uint32_t new_type)
+{
+    e820_op_t op;
+
+    if ( new_size == 0 )
+        return true;
+    /* check for wrap */
+    if ( new_addr + new_size < new_addr )
+        return false;
+
+    op.base = new_addr;
+    op.end = new_addr + new_size;
+    op.type = new_type;
+    op.ram_only = false;
+    return apply_ops(e820map, nr_map, &op, 1);
 }
 
 /*
@@ -381,11 +486,28 @@ uint32_t e820_check_region(uint64_t base, uint64_t length)
     uint32_t type;
     uint32_t ret = 0;
     bool gap = true; /* suppose there is always a virtual gap at first */
+    unsigned int first, last;
+
+    /* only the entries from the first one that ends above base up to the
+       first one that starts at or above end (and the gaps in between) can
+       overlap the range */
+    first = find_first_above(g_copy_e820_map, g_nr_map, base);
+    last = first;
+    while ( last < g_nr_map && e820_base_64(&g_copy_e820_map[last]) < end )
+        last++;
+    if ( last < g_nr_map )
+        last++;
+
+    if ( first > 0 ) {
+        e820_base = e820_base_64(&g_copy_e820_map[first - 1]);
+        e820_length = e820_length_64(&g_copy_e820_map[first - 1]);
+    }
+    else {
+        e820_base = 0;
+        e820_length = 0;
+    }
 
-    e820_base = 0;
-    e820_length = 0;
-
-    for ( unsigned int i = 0; i < g_nr_map; i = gap ? i : i+1, gap = !gap ) {
+    for ( unsigned int i = first; i < last; i = gap ? i : i+1, gap = !gap ) {
         e820_entry = &g_copy_e820_map[i];
         if ( gap ) {
             /* deal with the gap in e820 map */
@@ -440,8 +562,9 @@ uint32_t e820_check_region(uint64_t base, uint64_t length)
         ret = E820_MIXED;
     }
 
-    /* deal with the last gap */
-    if ( is_overlapped(base, end, e820_base + e820_length, (uint64_t)-1) )
+    /* deal with the last gap (is_overlapped() can't take it as a range
+       to the top of memory, its lengths would overflow) */
+    if ( end > e820_base + e820_length )
         ret = E820_GAP;
 
     /* print the result */
@@ -477,96 +600,93 @@ uint32_t e820_check_region(uint64_t base, uint64_t length)
  */
 bool e820_reserve_ram(uint64_t base, uint64_t length)
 {
-    memory_map_t* e820_entry;
-    uint64_t e820_base, e820_length, e820_end;
-    uint64_t end;
+    e820_op_t op;
 
     if ( length == 0 )
         return true;
 
-    end = base + length;
+    op.base = base;
+    op.end = base + length;
+    /* a range that wraps has no RAM in it */
+    if ( op.end < base )
+        return true;
+    op.type = E820_RESERVED;
+    op.ram_only = true;
+    return apply_ops(g_copy_e820_map, &g_nr_map, &op, 1);
+}
 
-    /* find where our region should cover the ram in e820 */
-    for ( unsigned int i = 0; i < g_nr_map; i++ ) {
-        e820_entry = &g_copy_e820_map[i];
-        e820_base = e820_base_64(e820_entry);
-        e820_length = e820_length_64(e820_entry);
-        e820_end = e820_base + e820_length;
+/*
+ * copy a caller's list of ranges into the op table; empty ranges are
+ * dropped, as are ranges that wrap when reserving RAM (there is no RAM in
+ * them), while protecting a range that wraps is an error
+ */
+static bool load_ops(const e820_range_t *ranges, unsigned int nr_ranges,
+                     bool ram_only, unsigned int *nr_ops)
+{
+    if ( ranges == NULL && nr_ranges > 0 )
+        return false;
+    if ( nr_ranges > MAX_E820_OPS ) {
+        printk(TBOOT_ERR"too many e820 updates (%u)\n", nr_ranges);
+        return false;
+    }
 
-        /* if not ram, no need to deal with */
-        if ( e820_entry->type != E820_RAM )
-            continue;
+    *nr_ops = 0;
+    for ( unsigned int i = 0; i < nr_ranges; i++ ) {
+        e820_op_t *op = &g_e820_ops[*nr_ops];
 
-        /* if the range is before the current ram range, skip the ram range */
-        if ( end <= e820_base )
+        if ( ranges[i].size == 0 )
             continue;
-        /* if the range is after the current ram range, skip the ram range */
-        if ( base >= e820_end )
-            continue;
-
-        /* case 1: the current ram range is within the range:
-           base, e820_base, e820_end, end */
-        if ( (base <= e820_base) && (e820_end <= end) )
-            e820_entry->type = E820_RESERVED;
-        /* case 2: overlapping:
-           base, e820_base, end, e820_end */
-        else if ( (e820_base >= base) && (end > e820_base) &&
-                  (e820_end > end) ) {
-            /* split the current ram map */
-            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i-1,
-                                      e820_base, (end - e820_base),
-                                      E820_RESERVED) )
-                return false;
-            /* fixup the current ram map */
-            i++;
-            split64b(end, &(g_copy_e820_map[i].base_addr_low),
-                     &(g_copy_e820_map[i].base_addr_high));
-            split64b(e820_end - end, &(g_copy_e820_map[i].length_low),
-                     &(g_copy_e820_map[i].length_high));
-            /* no need to check more */
-            break;
-        }
-        /* case 3: overlapping:
-           e820_base, base, e820_end, end */
-        else if ( (base > e820_base) && (e820_end > base) &&
-                  (end >= e820_end) ) {
-            /* fixup the current ram map */
-            split64b((base - e820_base), &(g_copy_e820_map[i].length_low),
-                     &(g_copy_e820_map[i].length_high));
-            /* split the current ram map */
-            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, base,
-                                      (e820_end - base), E820_RESERVED) )
-                return false;
-            i++;
-        }
-        /* case 4: the range is within the current ram range:
-           e820_base, base, end, e820_end */
-        else if ( (base > e820_base) && (e820_end > end) ) {
-            /* fixup the current ram map */
-            split64b((base - e820_base), &(g_copy_e820_map[i].length_low),
-                     &(g_copy_e820_map[i].length_high));
-            /* split the current ram map */
-            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, base,
-                                      length, E820_RESERVED) )
-                return false;
-            i++;
-            /* fixup the rest of the current ram map */
-            if ( !insert_after_region(g_copy_e820_map, &g_nr_map, i, end,
-                                      (e820_end - end), e820_entry->type) )
+        op->base = ranges[i].base;
+        op->end = ranges[i].base + ranges[i].size;
+        if ( op->end < op->base ) {
+            if ( !ram_only )
                 return false;
-            i++;
-            /* no need to check more */
-            break;
-        }
-        else {
-            printk(TBOOT_ERR"we should never get here\n");
-            return false;
+            continue;
         }
+        op->type = ram_only ? E820_RESERVED : ranges[i].type;
+        op->ram_only = ram_only;
+        (*nr_ops)++;
     }
 
     return true;
 }
 
+/*
+ * e820_protect_regions
+ *
+ * Same as calling e820_protect_region() for each range, but the table is
+ * only rewritten once.  The ranges may be in any order; overlapping ranges
+ * must be of the same type.
+ *
+ * return:  false = error (table unchanged)
+ */
+bool e820_protect_regions(const e820_range_t *ranges, unsigned int nr_ranges)
+{
+    unsigned int nr_ops;
+
+    if ( !load_ops(ranges, nr_ranges, false, &nr_ops) )
+        return false;
+    return apply_ops(g_copy_e820_map, &g_nr_map, g_e820_ops, nr_ops);
+}
+
+/*
+ * e820_reserve_ram_regions
+ *
+ * Same as calling e820_reserve_ram() for each range (type is ignored), but
+ * the table is only rewritten once.
+ *
+ * return:  false = error (table unchanged)
+ */
+bool e820_reserve_ram_regions(const e820_range_t *ranges,
+                              unsigned int nr_ranges)
+{
+    unsigned int nr_ops;
+
+    if ( !load_ops(ranges, nr_ranges, true, &nr_ops) )
+        return false;
+    return apply_ops(g_copy_e820_map, &g_nr_map, g_e820_ops, nr_ops);
+}
+
 void print_e820_map(void)
 {
     print_map(g_copy_e820_map, g_nr_map);
@@ -583,6 +703,7 @@ bool get_ram_ranges(uint64_t *min_lo_ram, uint64_t *max_lo_ram,
     *max_lo_ram = *max_hi_ram = 0;
     bool found_reserved_region = false;
     uint64_t last_min_ram_base = 0, last_min_ram_size = 0;
+    uint64_t discard_base = 0x100000000ULL;
 
     /* 
      * if g_min_ram > 0, we will never mark a region > g_min_ram in size
@@ -626,8 +747,9 @@ bool get_ram_ranges(uint64_t *min_lo_ram, uint64_t *max_lo_ram,
             else {     /* need to reserve low RAM above reserved regions */
                 if ( base < 0x100000000ULL ) {
                     printk(TBOOT_DETA"discarding RAM above reserved regions: 0x%Lx - 0x%Lx\n", base, limit);
-                    if ( !e820_reserve_ram(base, limit - base) )
-                        return false;
+                    /* reserved below, so don't change the map under us */
+                    if ( base < discard_base )
+                        discard_base = base;
                 }
             }
 
@@ -645,6 +767,12 @@ bool get_ram_ranges(uint64_t *min_lo_ram, uint64_t *max_lo_ram,
         }
     }
 
+    /* everything discarded is RAM between the first discarded region and
+       4GB, so one pass over the map reserves it all */
+    if ( discard_base < 0x100000000ULL &&
+         !e820_reserve_ram(discard_base, 0x100000000ULL - discard_base) )
+        return false;
+
     /* no low RAM found */
     if ( *min_lo_ram >= *max_lo_ram ) {
         printk(TBOOT_ERR"no low ram in e820 map\n");
@@ -661,33 +789,28 @@ bool get_ram_ranges(uint64_t *min_lo_ram, uint64_t *max_lo_ram,
 void get_highest_sized_ram(uint64_t size, uint64_t limit,
                            uint64_t *ram_base, uint64_t *ram_size)
 {
-    uint64_t last_fit_base = 0, last_fit_size = 0;
+    unsigned int i;
 
     if ( ram_base == NULL || ram_size == NULL )
         return;
 
-    for ( unsigned int i = 0; i < g_nr_map; i++ ) {
-        memory_map_t *entry = &g_copy_e820_map[i];
+    *ram_base = 0;
+    *ram_size = 0;
 
-        if ( entry->type == E820_RAM ) {
-            uint64_t base = e820_base_64(entry);
-            uint64_t length = e820_length_64(entry);
+    /* entries are sorted, so the candidates are those below the first one
+       that ends above the limit; take the highest of them that fits */
+    i = find_first_above(g_copy_e820_map, g_nr_map, limit);
+    while ( i-- > 0 ) {
+        memory_map_t *entry = &g_copy_e820_map[i];
 
-            /* over 4GB so use the last region that fit */
-            if ( base + length > limit )
-                break;
-            if ( size <= length ) {
-                last_fit_base = base;
-                last_fit_size = length;
-            }
+        if ( entry->type == E820_RAM && size <= e820_length_64(entry) ) {
+            *ram_base = e820_base_64(entry);
+            *ram_size = e820_length_64(entry);
+            break;
         }
     }
-
-    *ram_base = last_fit_base;
-    *ram_size = last_fit_size;
 }
 
-
 /*
  * Local variables:
  * mode: C
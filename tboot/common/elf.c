@@ -161,7 +161,7 @@ bool get_elf_image_range(const elf_header_t *elf, void **start, void **end)
         return false;
     }
 
-    u_start = 0;
+    u_start = 0xffffffff;
     u_end = 0;
     for ( int i = 0; i < elf->e_phnum; i++ ) {
         elf_program_header_t *ph = (elf_program_header_t *)
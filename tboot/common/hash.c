@@ -62,7 +62,7 @@ bool are_hashes_equal(const tb_hash_t *hash1, const tb_hash_t *hash2,
 
     len = get_hash_size(hash_alg);
     if ( len > 0 )
-        return (tb_memcmp(hash1, hash2, len) == 0);
+        return tb_consttime_memequal(hash1, hash2, len);
     else {
         printk(TBOOT_ERR"unsupported hash alg (%u)\n", hash_alg);
         return false;
@@ -138,6 +138,74 @@ bool extend_hash(tb_hash_t *hash1, const tb_hash_t *hash2, uint16_t hash_alg)
     }
 }
 
+/*
+ * copy_and_hash
+ *
+ * copy a buffer and hash it with each of the given algorithms in the same
+ * pass: the copy is done a chunk at a time and each chunk is hashed from
+ * its destination while it is still in the cache, instead of reading the
+ * whole buffer back in from memory after the copy
+ *
+ */
+#define COPY_HASH_CHUNK    0x8000
+
+bool copy_and_hash(void *dst, const void *src, size_t size,
+                   unsigned int alg_count, const uint16_t *algs,
+                   tb_hash_t *hashes)
+{
+    SHA_CTX sha1_ctx;
+    sha256_state sha256_ctx;
+    sha1_hash_t sha1_digest;
+    sha256_hash_t sha256_digest;
+    bool do_sha1 = false, do_sha256 = false;
+    size_t off, len;
+
+    if ( dst == NULL || src == NULL || algs == NULL || hashes == NULL ) {
+        printk(TBOOT_ERR"Error: input parameter is wrong.\n");
+        return false;
+    }
+
+    for ( unsigned int i = 0; i < alg_count; i++ ) {
+        if ( algs[i] == TB_HALG_SHA1 )
+            do_sha1 = true;
+        else if ( algs[i] == TB_HALG_SHA256 )
+            do_sha256 = true;
+        else {
+            printk(TBOOT_ERR"unsupported hash alg (%u)\n", algs[i]);
+            return false;
+        }
+    }
+
+    if ( do_sha1 )
+        SHA1_Init(&sha1_ctx);
+    if ( do_sha256 )
+        sha256_init(&sha256_ctx);
+
+    for ( off = 0; off < size; off += len ) {
+        len = size - off;
+        if ( len > COPY_HASH_CHUNK )
+            len = COPY_HASH_CHUNK;
+        tb_memcpy(dst + off, src + off, len);
+        if ( do_sha1 )
+            SHA1_Update(&sha1_ctx, dst + off, len);
+        if ( do_sha256 )
+            sha256_process(&sha256_ctx, dst + off, len);
+    }
+
+    if ( do_sha1 )
+        SHA1_Final(sha1_digest, &sha1_ctx);
+    if ( do_sha256 )
+        sha256_done(&sha256_ctx, sha256_digest);
+
+    for ( unsigned int i = 0; i < alg_count; i++ ) {
+        if ( algs[i] == TB_HALG_SHA1 )
+            tb_memcpy(hashes[i].sha1, sha1_digest, SHA1_LENGTH);
+        else
+            tb_memcpy(hashes[i].sha256, sha256_digest, SHA256_LENGTH);
+    }
+    return true;
+}
+
 void print_hash(const tb_hash_t *hash, uint16_t hash_alg)
 {
     if ( hash == NULL ) {
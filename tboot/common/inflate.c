@@ -0,0 +1,503 @@
+/*
+ * inflate.c: gzip (RFC 1952) / deflate (RFC 1951) decompression
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * This is a small, table-free implementation in the spirit of zlib's
+ * "puff": all of the output is decompressed straight into its final
+ * location, which doubles as the LZ77 window, so no separate window or
+ * output buffer is needed.  All state lives in BSS to stay off tboot's
+ * small stack.
+ */
+
+#include <config.h>
+#include <types.h>
+#include <stdbool.h>
+#include <printk.h>
+#include <compiler.h>
+#include <string.h>
+#include <inflate.h>
+
+#define MAXBITS      15             /* maximum bits in a code */
+#define MAXLCODES    286            /* maximum number of literal/length codes */
+#define MAXDCODES    30             /* maximum number of distance codes */
+#define MAXCODES     (MAXLCODES + MAXDCODES)
+#define FIXLCODES    288            /* number of fixed literal/length codes */
+
+/* output is handed to the flush callback in pieces of (at least) this size */
+#define FLUSH_SIZE   0x8000
+
+typedef struct {
+    const uint8_t   *in;
+    size_t          in_size;
+    size_t          in_pos;
+    uint32_t        bitbuf;
+    unsigned int    bitcnt;
+    uint8_t         *out;
+    size_t          out_size;
+    size_t          out_pos;
+    size_t          flushed;
+    uint32_t        crc;
+    inflate_flush_t flush;
+    void            *arg;
+    bool            error;
+} inflate_state_t;
+
+typedef struct {
+    uint16_t count[MAXBITS + 1];    /* number of symbols of each length */
+    uint16_t symbol[FIXLCODES];     /* canonically ordered symbols */
+} huffman_t;
+
+static inflate_state_t state;
+static huffman_t lencode, distcode;
+static uint16_t lengths[MAXCODES];
+
+static uint32_t crc_table[256];
+static bool crc_table_ready;
+
+static void make_crc_table(void)
+{
+    for ( uint32_t n = 0; n < 256; n++ ) {
+        uint32_t c = n;
+        for ( unsigned int k = 0; k < 8; k++ )
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+    crc_table_ready = true;
+}
+
+static uint32_t update_crc(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    crc = ~crc;
+    while ( len-- != 0 )
+        crc = crc_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* pass on (and checksum) the output produced since the last flush */
+static bool flush_output(inflate_state_t *s, bool force)
+{
+    size_t len = s->out_pos - s->flushed;
+
+    if ( len == 0 || (!force && len < FLUSH_SIZE) )
+        return true;
+    s->crc = update_crc(s->crc, s->out + s->flushed, len);
+    if ( s->flush != NULL && !s->flush(s->arg, s->out + s->flushed, len) )
+        return false;
+    s->flushed = s->out_pos;
+    return true;
+}
+
+static unsigned int bits(inflate_state_t *s, unsigned int need)
+{
+    uint32_t val = s->bitbuf;
+
+    while ( s->bitcnt < need ) {
+        if ( s->in_pos >= s->in_size ) {
+            s->error = true;
+            return 0;
+        }
+        val |= (uint32_t)s->in[s->in_pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return val & ((1U << need) - 1);
+}
+
+/* decode one symbol, a bit at a time, using canonical code h */
+static int decode(inflate_state_t *s, const huffman_t *h)
+{
+    int code = 0, first = 0, index = 0;
+
+    for ( unsigned int len = 1; len <= MAXBITS; len++ ) {
+        int count;
+
+        code |= bits(s, 1);
+        if ( s->error )
+            return -1;
+        count = h->count[len];
+        if ( code - count < first )
+            return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;                      /* ran out of codes */
+}
+
+/*
+ * build the canonical code for n symbols with the given code lengths;
+ * returns 0 for a complete code, > 0 for an incomplete one and < 0 if
+ * the lengths are oversubscribed
+ */
+static int construct(huffman_t *h, const uint16_t *length, unsigned int n)
+{
+    uint16_t offs[MAXBITS + 1];
+    int left = 1;
+
+    for ( unsigned int len = 0; len <= MAXBITS; len++ )
+        h->count[len] = 0;
+    for ( unsigned int symbol = 0; symbol < n; symbol++ )
+        h->count[length[symbol]]++;
+    if ( h->count[0] == n )
+        return 0;
+
+    for ( unsigned int len = 1; len <= MAXBITS; len++ ) {
+        left <<= 1;
+        left -= h->count[len];
+        if ( left < 0 )
+            return left;
+    }
+
+    offs[1] = 0;
+    for ( unsigned int len = 1; len < MAXBITS; len++ )
+        offs[len + 1] = offs[len] + h->count[len];
+    for ( unsigned int symbol = 0; symbol < n; symbol++ )
+        if ( length[symbol] != 0 )
+            h->symbol[offs[length[symbol]]++] = symbol;
+
+    return left;
+}
+
+static bool stored(inflate_state_t *s)
+{
+    unsigned int len;
+
+    /* discard the rest of the current byte */
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+
+    if ( s->in_size - s->in_pos < 4 )
+        return false;
+    len = s->in[s->in_pos] | (s->in[s->in_pos + 1] << 8);
+    if ( (s->in[s->in_pos + 2] != (~len & 0xff)) ||
+         (s->in[s->in_pos + 3] != ((~len >> 8) & 0xff)) )
+        return false;
+    s->in_pos += 4;
+
+    if ( len > s->in_size - s->in_pos || len > s->out_size - s->out_pos )
+        return false;
+    tb_memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->in_pos += len;
+    s->out_pos += len;
+    return flush_output(s, false);
+}
+
+static bool codes(inflate_state_t *s, const huffman_t *lcode,
+                  const huffman_t *dcode)
+{
+    static const uint16_t lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    static const uint8_t dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for ( ;; ) {
+        int symbol = decode(s, lcode);
+        size_t len, dist;
+
+        if ( symbol < 0 )
+            return false;
+        if ( symbol == 256 )        /* end of block */
+            return true;
+
+        if ( symbol < 256 ) {       /* literal */
+            if ( s->out_pos >= s->out_size )
+                return false;
+            s->out[s->out_pos++] = symbol;
+        }
+        else {                      /* length/distance pair */
+            symbol -= 257;
+            if ( symbol >= 29 )
+                return false;
+            len = lbase[symbol] + bits(s, lext[symbol]);
+
+            symbol = decode(s, dcode);
+            if ( symbol < 0 || symbol >= 30 )
+                return false;
+            dist = dbase[symbol] + bits(s, dext[symbol]);
+            if ( s->error || dist > s->out_pos ||
+                 len > s->out_size - s->out_pos )
+                return false;
+
+            /* byte at a time, as the source may overlap the copy */
+            uint8_t *to = s->out + s->out_pos;
+            const uint8_t *from = to - dist;
+            s->out_pos += len;
+            while ( len-- != 0 )
+                *to++ = *from++;
+        }
+
+        if ( !flush_output(s, false) )
+            return false;
+    }
+}
+
+static bool fixed(inflate_state_t *s)
+{
+    unsigned int symbol;
+
+    /* literal/length table */
+    for ( symbol = 0; symbol < 144; symbol++ )
+        lengths[symbol] = 8;
+    for ( ; symbol < 256; symbol++ )
+        lengths[symbol] = 9;
+    for ( ; symbol < 280; symbol++ )
+        lengths[symbol] = 7;
+    for ( ; symbol < FIXLCODES; symbol++ )
+        lengths[symbol] = 8;
+    construct(&lencode, lengths, FIXLCODES);
+
+    /* distance table */
+    for ( symbol = 0; symbol < MAXDCODES; symbol++ )
+        lengths[symbol] = 5;
+    construct(&distcode, lengths, MAXDCODES);
+
+    return codes(s, &lencode, &distcode);
+}
+
+static bool dynamic(inflate_state_t *s)
+{
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    unsigned int nlen, ndist, ncode, index;
+    int err;
+
+    nlen = bits(s, 5) + 257;
+    ndist = bits(s, 5) + 1;
+    ncode = bits(s, 4) + 4;
+    if ( s->error || nlen > MAXLCODES || ndist > MAXDCODES )
+        return false;
+
+    /* code length code lengths, and the code length code */
+    for ( index = 0; index < ncode; index++ )
+        lengths[order[index]] = bits(s, 3);
+    for ( ; index < 19; index++ )
+        lengths[order[index]] = 0;
+    if ( s->error || construct(&lencode, lengths, 19) != 0 )
+        return false;
+
+    /* literal/length and distance code lengths */
+    index = 0;
+    while ( index < nlen + ndist ) {
+        int symbol = decode(s, &lencode);
+        unsigned int len = 0, repeat;
+
+        if ( symbol < 0 )
+            return false;
+        if ( symbol < 16 ) {
+            lengths[index++] = symbol;
+            continue;
+        }
+        if ( symbol == 16 ) {       /* repeat last length 3..6 times */
+            if ( index == 0 )
+                return false;
+            len = lengths[index - 1];
+            repeat = 3 + bits(s, 2);
+        }
+        else if ( symbol == 17 )    /* repeat zero 3..10 times */
+            repeat = 3 + bits(s, 3);
+        else                        /* repeat zero 11..138 times */
+            repeat = 11 + bits(s, 7);
+        if ( s->error || index + repeat > nlen + ndist )
+            return false;
+        while ( repeat-- != 0 )
+            lengths[index++] = len;
+    }
+
+    /* there must be an end-of-block code */
+    if ( lengths[256] == 0 )
+        return false;
+
+    /* incomplete codes are only allowed for a single length-1 code */
+    err = construct(&lencode, lengths, nlen);
+    if ( err != 0 && (err < 0 || nlen != lencode.count[0] + lencode.count[1]) )
+        return false;
+    err = construct(&distcode, lengths + nlen, ndist);
+    if ( err != 0 &&
+         (err < 0 || ndist != distcode.count[0] + distcode.count[1]) )
+        return false;
+
+    return codes(s, &lencode, &distcode);
+}
+
+static bool inflate(inflate_state_t *s)
+{
+    unsigned int last, type;
+
+    do {
+        last = bits(s, 1);
+        type = bits(s, 2);
+        if ( s->error )
+            return false;
+
+        switch ( type ) {
+        case 0:
+            if ( !stored(s) )
+                return false;
+            break;
+        case 1:
+            if ( !fixed(s) )
+                return false;
+            break;
+        case 2:
+            if ( !dynamic(s) )
+                return false;
+            break;
+        default:
+            return false;
+        }
+    } while ( !last );
+
+    return flush_output(s, true);
+}
+
+bool is_gzip_image(const void *image, size_t size)
+{
+    const uint8_t *p = image;
+
+    /* header (10) + empty deflate stream (2) + trailer (8) */
+    return image != NULL && size >= 20 &&
+           p[0] == 0x1f && p[1] == 0x8b && p[2] == 8;
+}
+
+/* decompressed size (modulo 2^32) from the gzip trailer */
+uint32_t get_gzip_image_size(const void *image, size_t size)
+{
+    const uint8_t *p = image + size - 4;
+
+    if ( !is_gzip_image(image, size) )
+        return 0;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * decompress the gzip image src into dst, which must be exactly as large
+ * as the trailer says; the output is passed to flush (if not NULL) in
+ * order as it is produced and is checked against the trailer's CRC-32
+ */
+bool gunzip(const void *src, size_t src_size, void *dst, size_t dst_size,
+            inflate_flush_t flush, void *arg)
+{
+    const uint8_t *in = src;
+    inflate_state_t *s = &state;
+    size_t pos = 10;
+    uint8_t flags;
+    uint32_t crc;
+
+    if ( !is_gzip_image(src, src_size) || dst == NULL ) {
+        printk(TBOOT_ERR"Error: not a gzip image\n");
+        return false;
+    }
+
+    /* skip the optional header fields */
+    flags = in[3];
+    if ( flags & 0xe0 ) {
+        printk(TBOOT_ERR"Error: unknown gzip header flags 0x%x\n", flags);
+        return false;
+    }
+    if ( flags & 0x04 ) {           /* FEXTRA */
+        if ( src_size - 8 < pos + 2 )
+            return false;
+        pos += 2 + (in[pos] | (in[pos + 1] << 8));
+    }
+    if ( flags & 0x08 ) {           /* FNAME */
+        while ( pos < src_size - 8 && in[pos] != 0 )
+            pos++;
+        pos++;
+    }
+    if ( flags & 0x10 ) {           /* FCOMMENT */
+        while ( pos < src_size - 8 && in[pos] != 0 )
+            pos++;
+        pos++;
+    }
+    if ( flags & 0x02 )             /* FHCRC */
+        pos += 2;
+    if ( pos >= src_size - 8 ) {
+        printk(TBOOT_ERR"Error: truncated gzip header\n");
+        return false;
+    }
+
+    if ( !crc_table_ready )
+        make_crc_table();
+
+    tb_memset(s, 0, sizeof(*s));
+    s->in = in;
+    s->in_pos = pos;
+    s->in_size = src_size - 8;
+    s->out = dst;
+    s->out_size = dst_size;
+    s->flush = flush;
+    s->arg = arg;
+
+    if ( !inflate(s) ) {
+        printk(TBOOT_ERR"Error: corrupt deflate data at 0x%lx\n",
+               (unsigned long)s->in_pos);
+        return false;
+    }
+
+    in += src_size - 8;
+    crc = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+    if ( s->out_pos != dst_size ||
+         (uint32_t)s->out_pos != get_gzip_image_size(src, src_size) ) {
+        printk(TBOOT_ERR"Error: gzip size mismatch\n");
+        return false;
+    }
+    if ( s->crc != crc ) {
+        printk(TBOOT_ERR"Error: gzip CRC mismatch\n");
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
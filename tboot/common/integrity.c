@@ -165,6 +165,17 @@ static bool seal_data(const void *data, size_t data_size, const void *secrets, s
     return err;
 }
 
+/* close any authorization sessions the seal/unseal calls kept open, so none
+   is left behind for the kernel */
+static void release_seal_sessions(void)
+{
+    struct tpm_if *tpm = get_tpm();
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+
+    if ( tpm_fp->release_sessions != NULL )
+        tpm_fp->release_sessions(tpm, tpm->cur_loc);
+}
+
 static bool verify_sealed_data(const uint8_t *sealed_data,  uint32_t sealed_data_size, const void *curr_data, size_t curr_data_size, void *secrets, size_t secrets_size)
 {
     /* sealed data is hash of state data and optional secret */
@@ -230,16 +241,23 @@ bool seal_pre_k_state(void)
 
     /* read PCR 17/18, only for tpm1.2 */
     if ( tpm->major == TPM12_VER_MAJOR ) {
-        if ( !tpm_fp->pcr_read(tpm, 2, 17, &post_launch_pcr17) ||
-             !tpm_fp->pcr_read(tpm, 2, 18, &post_launch_pcr18) )
+        tpm_pcr_value_t pcrs[2];
+
+        if ( !tpm_fp->pcr_read_multi(tpm, 2, TPM_PCR_MASK(17) | TPM_PCR_MASK(18),
+                                     1, &tpm->cur_alg, pcrs) )
             goto error;
+        post_launch_pcr17 = pcrs[0];
+        post_launch_pcr18 = pcrs[1];
     }
 
     sealed_pre_k_state_size = sizeof(sealed_pre_k_state);
     if ( !seal_data(&g_pre_k_s3_state, sizeof(g_pre_k_s3_state),
                     NULL, 0,
-                    sealed_pre_k_state, &sealed_pre_k_state_size) )
+                    sealed_pre_k_state, &sealed_pre_k_state_size) ) {
+        release_seal_sessions();
         goto error;
+    }
+    release_seal_sessions();
 
     /* we can't leave the system in a state without valid measurements of
        about-to-execute code in the PCRs, so this is a fatal error */
@@ -381,20 +399,20 @@ static bool measure_memory_integrity(vmac_t *mac, uint8_t key[VMAC_KEY_LEN/8])
  */
 bool verify_integrity(void)
 {
-    tpm_pcr_value_t pcr17, pcr18;
+    tpm_pcr_value_t pcrs[2];
     struct tpm_if *tpm = get_tpm();
     const struct tpm_if_fp *tpm_fp = get_tpm_fp();
 
     /* read PCR 17/18, only for tpm1.2 */
     if ( tpm->major == TPM12_VER_MAJOR ) {
-        if ( !tpm_fp->pcr_read(tpm, 2, 17, &pcr17) ||
-             !tpm_fp->pcr_read(tpm, 2, 18, &pcr18) )
+        if ( !tpm_fp->pcr_read_multi(tpm, 2, TPM_PCR_MASK(17) | TPM_PCR_MASK(18),
+                                     1, &tpm->cur_alg, pcrs) )
             goto error;
         printk(TBOOT_DETA"PCRs before unseal:\n");
         printk(TBOOT_DETA"  PCR 17: ");
-        print_hash((tb_hash_t *)&pcr17, TB_HALG_SHA1);
+        print_hash(&pcrs[0], TB_HALG_SHA1);
         printk(TBOOT_DETA"  PCR 18: ");
-        print_hash((tb_hash_t *)&pcr18, TB_HALG_SHA1);
+        print_hash(&pcrs[1], TB_HALG_SHA1);
     }
 
     /* verify integrity of pre-kernel state data */
@@ -416,12 +434,14 @@ bool verify_integrity(void)
                              &g_post_k_s3_state, sizeof(g_post_k_s3_state),
                              &secrets, sizeof(secrets)) )
         goto error;
+    release_seal_sessions();
 
     /* Verify memory integrity against sealed value */
     vmac_t mac;
     if ( !measure_memory_integrity(&mac, secrets.mac_key) )
         goto error;
-    if ( tb_memcmp(&mac, &g_post_k_s3_state.kernel_integ, sizeof(mac)) ) {
+    if ( !tb_consttime_memequal(&mac, &g_post_k_s3_state.kernel_integ,
+                                sizeof(mac)) ) {
         printk(TBOOT_INFO"memory integrity lost on S3 resume\n");
         printk(TBOOT_DETA"MAC of current image is: ");
         print_hex(NULL, &mac, sizeof(mac));
@@ -450,6 +470,7 @@ bool verify_integrity(void)
     return true;
 
  error:
+    release_seal_sessions();
     /* since we can't leave the system without any measurments representing the
        code-about-to-execute, and yet there is no integrity of that code,
        just cap PCR 18 */
@@ -488,7 +509,11 @@ bool seal_post_k_state(void)
     print_post_k_s3_state();
 
     sealed_post_k_state_size = sizeof(sealed_post_k_state);
-    if ( !seal_data(&g_post_k_s3_state, sizeof(g_post_k_s3_state), &secrets, sizeof(secrets), sealed_post_k_state, &sealed_post_k_state_size) ) return false;
+    if ( !seal_data(&g_post_k_s3_state, sizeof(g_post_k_s3_state), &secrets, sizeof(secrets), sealed_post_k_state, &sealed_post_k_state_size) ) {
+        release_seal_sessions();
+        return false;
+    }
+    release_seal_sessions();
 
     /* wipe secrets from memory */
     tb_memset(&secrets, 0, sizeof(secrets));
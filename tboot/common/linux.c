@@ -50,6 +50,7 @@
 #include <hash.h>
 #include <integrity.h>
 #include <processor.h>
+#include <percpu.h>
 
 extern loader_ctx *g_ldr_ctx;
 
@@ -58,8 +59,6 @@ extern tboot_shared_t _tboot_shared;
 
 static boot_params_t *boot_params;
 
-extern void *get_tboot_mem_end(void);
-
 static void
 printk_long(const char *what)
 {
@@ -77,6 +76,63 @@ printk_long(const char *what)
     }
 }
 
+static bool ranges_overlap(uint32_t base1, uint32_t size1,
+                           uint32_t base2, uint32_t size2)
+{
+    return base1 < base2 + size2 && base2 < base1 + size1;
+}
+
+/*
+ * check that [base, base + size) is RAM that tboot, the loader context and
+ * the remaining modules (other than skip) don't use, so that a kernel or
+ * initrd placed there by the loader can stay where it is
+ */
+static bool is_free_ram(uint32_t base, uint32_t size, const void *skip)
+{
+    uint32_t tboot_end = (uint32_t)get_tboot_mem_end();
+    uint32_t ctx_end = get_loader_ctx_end(g_ldr_ctx);
+
+    if ( size == 0 || plus_overflow_u32(base, size) )
+        return false;
+    if ( base < 0x100000 )
+        return false;
+    if ( ranges_overlap(base, size, TBOOT_BASE_ADDR,
+                        tboot_end - TBOOT_BASE_ADDR) )
+        return false;
+    if ( ranges_overlap(base, size, (uint32_t)g_ldr_ctx->addr,
+                        ctx_end - (uint32_t)g_ldr_ctx->addr) )
+        return false;
+    for ( unsigned int i = 0; i < get_module_count(g_ldr_ctx); i++ ) {
+        module_t *m = get_module(g_ldr_ctx, i);
+        if ( m == NULL || (void *)m->mod_start == skip )
+            continue;
+        if ( ranges_overlap(base, size, m->mod_start,
+                            m->mod_end - m->mod_start) )
+            return false;
+    }
+    return e820_check_region(base, size) == E820_RAM;
+}
+
+/*
+ * a relocatable kernel can run from wherever the loader put it, as long
+ * as that is suitably aligned and the memory it expands into is free
+ */
+static bool can_run_in_place(const linux_kernel_header_t *hdr,
+                             uint32_t base, uint32_t size)
+{
+    uint32_t align = hdr->kernel_alignment;
+
+    if ( !hdr->relocatable_kernel )
+        return false;
+    /* boot protocol 2.10+ allows anything down to the minimum alignment */
+    if ( hdr->version >= 0x020a && hdr->min_alignment > 0 &&
+         hdr->min_alignment < 32 )
+        align = 1U << hdr->min_alignment;
+    if ( align == 0 || (align & (align - 1)) != 0 || (base & (align - 1)) )
+        return false;
+    return is_free_ram(base, size, NULL);
+}
+
 /* expand linux kernel with kernel image and initrd image */
 bool expand_linux_image(const void *linux_image, size_t linux_size,
                         const void *initrd_image, size_t initrd_size,
@@ -161,18 +217,113 @@ bool expand_linux_image(const void *linux_image, size_t linux_size,
     hdr->loadflags |= FLAG_CAN_USE_HEAP;         /* can use heap */
     hdr->heap_end_ptr = KERNEL_CMDLINE_OFFSET - BOOT_SECTOR_OFFSET;
 
-    if ( initrd_size > 0 ) {
+    real_mode_size = (hdr->setup_sects + 1) * SECTOR_SIZE;
+    if ( real_mode_size + sizeof(boot_params_t) > KERNEL_CMDLINE_OFFSET ) {
+        printk(TBOOT_ERR"realmode data is too large\n");
+        return false;
+    }
+    protected_mode_size = linux_size - real_mode_size;
+
+    /* the protected mode part of a relocatable kernel that is already
+       aligned in free RAM is left where it is; init_size (2.10+) covers
+       what it needs to decompress itself in place */
+    uint32_t in_place_base = (uint32_t)linux_image + real_mode_size;
+    uint32_t in_place_size = protected_mode_size;
+    if ( hdr->version >= 0x020a && hdr->init_size > in_place_size )
+        in_place_size = hdr->init_size;
+    bool in_place = can_run_in_place(hdr, in_place_base, in_place_size);
+
+    /* if kernel is relocatable then run it in place or move it above */
+    /* tboot, else it may expand over top of tboot */
+    if ( in_place ) {
+        protected_mode_base = in_place_base;
+        hdr->code32_start = protected_mode_base;
+    }
+    else if ( hdr->relocatable_kernel ) {
+        protected_mode_base = (uint32_t)get_tboot_mem_end();
+        /* fix possible mbi overwrite in grub2 case */
+        /* assuming grub2 only used for relocatable kernel */
+        /* assuming mbi & components are contiguous */
+        unsigned long ldr_ctx_end = get_loader_ctx_end(g_ldr_ctx);
+        if ( ldr_ctx_end > protected_mode_base )
+            protected_mode_base = ldr_ctx_end;
+        /* overflow? */
+        if ( plus_overflow_u32(protected_mode_base,
+                 hdr->kernel_alignment - 1) ) {
+            printk(TBOOT_ERR"protected_mode_base overflows\n");
+            return false;
+        }
+        /* round it up to kernel alignment */
+        protected_mode_base = (protected_mode_base + hdr->kernel_alignment - 1)
+                              & ~(hdr->kernel_alignment-1);
+        hdr->code32_start = protected_mode_base;
+    }
+    else if ( hdr->loadflags & FLAG_LOAD_HIGH ) {
+        protected_mode_base = BZIMAGE_PROTECTED_START;
+                /* bzImage:0x100000 */
+        /* overflow? */
+        if ( plus_overflow_u32(protected_mode_base, protected_mode_size) ) {
+            printk(TBOOT_ERR
+                   "protected_mode_base plus protected_mode_size overflows\n");
+            return false;
+        }
+        /* Check: protected mode part cannot exceed mem_upper */
+        if ( have_loader_memlimits(g_ldr_ctx)){
+            uint32_t mem_upper = get_loader_mem_upper(g_ldr_ctx);
+            if ( (protected_mode_base + protected_mode_size)
+                    > ((mem_upper << 10) + 0x100000) ) {
+                printk(TBOOT_ERR
+                       "Error: Linux protected mode part (0x%lx ~ 0x%lx) "
+                       "exceeds mem_upper (0x%lx ~ 0x%lx).\n",
+                       (unsigned long)protected_mode_base,
+                       (unsigned long)
+                       (protected_mode_base + protected_mode_size),
+                       (unsigned long)0x100000,
+                       (unsigned long)((mem_upper << 10) + 0x100000));
+                return false;
+            }
+        }
+    }
+    else {
+        printk(TBOOT_ERR"Error: Linux protected mode not loaded high\n");
+        return false;
+    }
+
+    /* memory the kernel will occupy while starting, for initrd placement */
+    uint32_t kernel_base = (uint32_t)linux_image;
+    uint32_t kernel_size = linux_size;
+    if ( in_place && in_place_base + in_place_size > kernel_base + kernel_size )
+        kernel_size = in_place_base + in_place_size - kernel_base;
+
+    /* check if Linux command line explicitly specified a memory limit */
+    uint64_t mem_limit;
+    get_linux_mem(&mem_limit);
+    if ( mem_limit > 0x100000000ULL || mem_limit == 0 )
+        mem_limit = 0x100000000ULL;
+
+    /* leave the initrd where the loader put it if that already satisfies
+       the kernel's constraints */
+    bool initrd_in_place = false;
+    initrd_base = (uint32_t)initrd_image;
+    if ( initrd_size > 0 &&
+         (uint64_t)initrd_base + initrd_size <= mem_limit &&
+         (uint64_t)initrd_base + initrd_size <= hdr->initrd_addr_max + 1ULL &&
+         !ranges_overlap(initrd_base, initrd_size, kernel_base, kernel_size) &&
+         !ranges_overlap(initrd_base, initrd_size, protected_mode_base,
+                         in_place_size) &&
+         is_free_ram(initrd_base, initrd_size, initrd_image) ) {
+        initrd_in_place = true;
+        printk(TBOOT_DETA"Initrd left in place at 0x%lx to 0x%lx\n",
+               (unsigned long)initrd_base,
+               (unsigned long)(initrd_base + initrd_size));
+    }
+
+    if ( initrd_size > 0 && !initrd_in_place ) {
         /* load initrd and set ramdisk_image and ramdisk_size */
         /* The initrd should typically be located as high in memory as
            possible, as it may otherwise get overwritten by the early
            kernel initialization sequence. */
 
-        /* check if Linux command line explicitly specified a memory limit */
-        uint64_t mem_limit;
-        get_linux_mem(&mem_limit);
-        if ( mem_limit > 0x100000000ULL || mem_limit == 0 )
-            mem_limit = 0x100000000ULL;
-
         uint64_t max_ram_base, max_ram_size;
         get_highest_sized_ram(initrd_size, mem_limit,
                               &max_ram_base, &max_ram_size);
@@ -206,10 +357,9 @@ bool expand_linux_image(const void *linux_image, size_t linux_size,
         }
 
         /* check for overlap with a kernel image placed high in memory */
-        if( (initrd_base < ((uint32_t)linux_image + linux_size))
-            && ((uint32_t)linux_image < (initrd_base+initrd_size)) ){
+        if( ranges_overlap(initrd_base, initrd_size, kernel_base, kernel_size) ){
             /* set the starting address just below the image */
-            initrd_base = (uint32_t)linux_image - initrd_size;
+            initrd_base = kernel_base - initrd_size;
             initrd_base = initrd_base & PAGE_MASK;
             /* make sure we're still in usable RAM and above tboot end address*/
             if( initrd_base < max_ram_base ){
@@ -241,67 +391,6 @@ bool expand_linux_image(const void *linux_image, size_t linux_size,
     if ( real_mode_base > LEGACY_REAL_START )
         real_mode_base = LEGACY_REAL_START;
 
-    real_mode_size = (hdr->setup_sects + 1) * SECTOR_SIZE;
-    if ( real_mode_size + sizeof(boot_params_t) > KERNEL_CMDLINE_OFFSET ) {
-        printk(TBOOT_ERR"realmode data is too large\n");
-        return false;
-    }
-
-    /* calc location of protected mode part */
-    protected_mode_size = linux_size - real_mode_size;
-
-    /* if kernel is relocatable then move it above tboot */
-    /* else it may expand over top of tboot */
-    if ( hdr->relocatable_kernel ) {
-        protected_mode_base = (uint32_t)get_tboot_mem_end();
-        /* fix possible mbi overwrite in grub2 case */
-        /* assuming grub2 only used for relocatable kernel */
-        /* assuming mbi & components are contiguous */
-        unsigned long ldr_ctx_end = get_loader_ctx_end(g_ldr_ctx);
-        if ( ldr_ctx_end > protected_mode_base )
-            protected_mode_base = ldr_ctx_end;
-        /* overflow? */
-        if ( plus_overflow_u32(protected_mode_base,
-                 hdr->kernel_alignment - 1) ) {
-            printk(TBOOT_ERR"protected_mode_base overflows\n");
-            return false;
-        }
-        /* round it up to kernel alignment */
-        protected_mode_base = (protected_mode_base + hdr->kernel_alignment - 1)
-                              & ~(hdr->kernel_alignment-1);
-        hdr->code32_start = protected_mode_base;
-    }
-    else if ( hdr->loadflags & FLAG_LOAD_HIGH ) {
-        protected_mode_base = BZIMAGE_PROTECTED_START;
-                /* bzImage:0x100000 */
-        /* overflow? */
-        if ( plus_overflow_u32(protected_mode_base, protected_mode_size) ) {
-            printk(TBOOT_ERR
-                   "protected_mode_base plus protected_mode_size overflows\n");
-            return false;
-        }
-        /* Check: protected mode part cannot exceed mem_upper */
-        if ( have_loader_memlimits(g_ldr_ctx)){
-            uint32_t mem_upper = get_loader_mem_upper(g_ldr_ctx);
-            if ( (protected_mode_base + protected_mode_size)
-                    > ((mem_upper << 10) + 0x100000) ) {
-                printk(TBOOT_ERR
-                       "Error: Linux protected mode part (0x%lx ~ 0x%lx) "
-                       "exceeds mem_upper (0x%lx ~ 0x%lx).\n",
-                       (unsigned long)protected_mode_base,
-                       (unsigned long)
-                       (protected_mode_base + protected_mode_size),
-                       (unsigned long)0x100000,
-                       (unsigned long)((mem_upper << 10) + 0x100000));
-                return false;
-            }
-        }
-    }
-    else {
-        printk(TBOOT_ERR"Error: Linux protected mode not loaded high\n");
-        return false;
-    }
-
     /* set cmd_line_ptr */
     hdr->cmd_line_ptr = real_mode_base + KERNEL_CMDLINE_OFFSET;
 
@@ -311,9 +400,14 @@ bool expand_linux_image(const void *linux_image, size_t linux_size,
     hdr = &temp_hdr;
 
     /* load protected-mode part */
-    tb_memmove((void *)protected_mode_base, linux_image + real_mode_size,
-            protected_mode_size);
-    printk(TBOOT_DETA"Kernel (protected mode) from 0x%lx to 0x%lx\n",
+    if ( in_place )
+        printk(TBOOT_DETA"Kernel (protected mode) left in place at ");
+    else {
+        tb_memmove((void *)protected_mode_base, linux_image + real_mode_size,
+                   protected_mode_size);
+        printk(TBOOT_DETA"Kernel (protected mode) from ");
+    }
+    printk(TBOOT_DETA"0x%lx to 0x%lx\n",
            (unsigned long)protected_mode_base,
            (unsigned long)(protected_mode_base + protected_mode_size));
 
@@ -415,6 +509,11 @@ bool expand_linux_image(const void *linux_image, size_t linux_size,
         }
         uint32_t memmap_start = (uint32_t) p;
         uint32_t memmap_length = get_loader_memmap_length(g_ldr_ctx);
+        if ( memmap_length / sizeof(memory_map_t) > E820MAX ) {
+            printk(TBOOT_ERR"Error: e820 map has too many entries (%u)\n",
+                   memmap_length / sizeof(memory_map_t));
+            return false;
+        }
         for ( i = 0; (uint32_t)p < memmap_start + memmap_length; i++ )
         {
             boot_params->e820_map[i].addr = ((uint64_t)p->base_addr_high << 32)
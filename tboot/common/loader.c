@@ -57,6 +57,11 @@
 #include <txt/acmod.h>
 #include <cmdline.h>
 #include <tpm.h>
+#include <hash.h>
+#include <sha1.h>
+#include <sha256.h>
+#include <inflate.h>
+#include <percpu.h>
 
 /* copy of kernel/VMM command line so that can append 'tboot=0x1234' */
 static char *new_cmdline = (char *)TBOOT_KERNEL_CMDLINE_ADDR;
@@ -78,6 +83,7 @@ extern bool is_sinit_acmod(const void *acmod_base, uint32_t acmod_size,
                            bool quiet);
 extern void apply_policy(tb_error_t error);
 extern uint32_t g_mb_orig_size;
+extern unsigned int get_module_hash_algs(uint16_t *algs, unsigned int max_algs);
 
 #define LOADER_CTX_BAD(xctx) \
     xctx == NULL ? true : \
@@ -146,29 +152,65 @@ static struct mb2_tag
     return start;
 }
 
+static void index_mb2_modules(loader_ctx *lctx)
+{
+    struct mb2_tag *start = (struct mb2_tag *)(lctx->addr + 8);
+    uint32_t count = 0;
+
+    start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
+    while (start != NULL){
+        if (count < LOADER_CTX_MOD_INDEX_SIZE)
+            lctx->mod_offsets[count] = (void *)start - lctx->addr;
+        count++;
+        /* nudge off this hit */
+        start = next_mb2_tag(start);
+        start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
+    }
+    lctx->mod_count = count;
+    lctx->mod_cursor = 0;
+    lctx->mod_cursor_offset = lctx->mod_offsets[0];
+    lctx->mod_index_valid = true;
+}
+
 static module_t 
 *get_module_mb2(loader_ctx *lctx, unsigned int i)
 {
-    struct mb2_tag *start = (struct mb2_tag *)(lctx->addr + 8);
+    struct mb2_tag *start;
+    struct mb2_tag_module *tag_mod;
     unsigned int ii;
-    struct mb2_tag_module *tag_mod = NULL;
-    module_t *mt = NULL;
-    start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
-    if (start != NULL){
-        for (ii = 1; ii <= i; ii++){
+
+    if (!lctx->mod_index_valid)
+        index_mb2_modules(lctx);
+    if (i >= lctx->mod_count)
+        return NULL;
+
+    if (i < LOADER_CTX_MOD_INDEX_SIZE)
+        start = (struct mb2_tag *)(lctx->addr + lctx->mod_offsets[i]);
+    else {
+        /* past the index, walk on from the last module looked up (or the
+           last indexed one), so a loop over all modules stays linear */
+        if (lctx->mod_cursor >= LOADER_CTX_MOD_INDEX_SIZE &&
+            lctx->mod_cursor <= i){
+            ii = lctx->mod_cursor;
+            start = (struct mb2_tag *)(lctx->addr + lctx->mod_cursor_offset);
+        }
+        else {
+            ii = LOADER_CTX_MOD_INDEX_SIZE - 1;
+            start = (struct mb2_tag *)(lctx->addr + lctx->mod_offsets[ii]);
+        }
+        for (; ii < i; ii++){
+            start = next_mb2_tag(start);
+            start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
             if (start == NULL)
                 return NULL;
-            else {
-                /* nudge off this hit */
-                start = next_mb2_tag(start);
-                start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
-            }
         }
-        /* if we're here, we have the tag struct for the desired module */
-        tag_mod = (struct mb2_tag_module *) start;
-        mt = (module_t *) &(tag_mod->mod_start);
+        lctx->mod_cursor = i;
+        lctx->mod_cursor_offset = (void *)start - lctx->addr;
     }
-    return mt;
+
+    /* if we're here, we have the tag struct for the desired module */
+    tag_mod = (struct mb2_tag_module *) start;
+    return (module_t *) &(tag_mod->mod_start);
 }
 
 #if 0
@@ -318,6 +360,7 @@ static bool remove_mb2_tag(loader_ctx *lctx, struct mb2_tag *cur)
     /* adjust MB2 length */
     *((unsigned long *) lctx->addr) -= 
         (uint8_t *)next - (uint8_t *)cur;
+    lctx->mod_index_valid = false;
     /* sanity check */
     /* print_loader_ctx(lctx); */
     return true;
@@ -366,6 +409,7 @@ grow_mb2_tag(loader_ctx *lctx, struct mb2_tag *which, uint32_t how_much)
     }
     /* adjust MB2 length */
     *((uint32_t *) lctx->addr) += growth;
+    lctx->mod_index_valid = false;
     return true;
 }
 
@@ -460,29 +504,9 @@ static void *remove_module(loader_ctx *lctx, void *mod_start)
          * and shorten the total length of the MB2 structure.
          */
         {
-            struct mb2_tag *cur;
-            struct mb2_tag_module *mod = NULL;
-            module_t *cur_mod = NULL;
-            cur = (struct mb2_tag *)(lctx->addr + 8);
-            cur = find_mb2_tag_type(cur, MB2_TAG_TYPE_MODULE);
-            mod = (struct mb2_tag_module *) cur;
-            if (mod != NULL)
-                cur_mod = (module_t *)&(mod->mod_start);
-
-            while (cur_mod != NULL && cur_mod != m){
-                /* nudge off current record */
-                cur = next_mb2_tag(cur);
-                cur = find_mb2_tag_type(cur, MB2_TAG_TYPE_MODULE);
-                mod = (struct mb2_tag_module *) cur;
-                if (mod != NULL)
-                    cur_mod = (module_t *)&(mod->mod_start);
-                else
-                    cur_mod = NULL;
-            }
-            if (cur_mod == NULL){
-                printk(TBOOT_ERR"remove_module() for MB2 failed\n");
-                return NULL;
-            }
+            /* m points into its module tag, so the tag is found directly */
+            struct mb2_tag *cur = (struct mb2_tag *)
+                ((void *)m - offsetof(struct mb2_tag_module, mod_start));
 
             /* we're here.  cur is the MB2 tag we need to overwrite. */
             if (false == remove_mb2_tag(lctx, cur))
@@ -682,7 +706,7 @@ find_lcp_module(loader_ctx *lctx, void **base, uint32_t *size)
 }
 
 /*
- * remove (all) SINIT and LCP policy data modules (if present)
+ * remove (all) SINIT, ACM catalog and LCP policy data modules (if present)
  */
 bool 
 remove_txt_modules(loader_ctx *lctx)
@@ -708,6 +732,17 @@ remove_txt_modules(loader_ctx *lctx)
     }
 
     void *base = NULL;
+    size_t size;
+    if ( find_module_by_file_signature(lctx, &base, &size,
+                                       ACM_CATALOG_SIGNATURE) ) {
+        if ( remove_module(lctx, base) == NULL ) {
+            printk(TBOOT_ERR
+                   "failed to remove ACM catalog module from module list\n");
+            return false;
+        }
+    }
+
+    base = NULL;
     if ( find_lcp_module(lctx, &base, NULL) ) {
         if ( remove_module(lctx, base) == NULL ) {
             printk(TBOOT_ERR"failed to remove LCP module from module list\n");
@@ -718,13 +753,6 @@ remove_txt_modules(loader_ctx *lctx)
     return true;
 }
 
-extern unsigned long get_tboot_mem_end(void);
-
-static bool below_tboot(unsigned long addr)
-{
-    return addr >= 0x100000 && addr < TBOOT_BASE_ADDR;
-}
-
 static unsigned long max(unsigned long a, unsigned long b)
 {
     return (a > b) ? a : b;
@@ -780,338 +808,691 @@ unsigned long get_mbi_mem_end_mb1(const multiboot_info_t *mbi)
 }
 
 /*
- * Move all mbi components/modules/mbi to end of memory
+ * Module/loader context relocation planner
+ *
+ * The ELF kernel is expanded to its physical load addresses, which may
+ * overlap modules or the loader context that the bootloader put there
+ * (GRUB2 likes to load modules at low addresses).  Rather than shuffling
+ * every module around several times, work out up front which objects are
+ * actually in the way and where each of them can go, then copy each one
+ * exactly once.  Everything else is left where the bootloader put it.
  */
-static bool move_modules_to_high_memory(loader_ctx  *lctx)
+
+/* objects that are candidates for relocation: all modules plus the ctx */
+#define MAX_RELOC_ITEMS   64
+
+/* nothing below 1MB is ever relocated or used as a relocation target */
+#define RELOC_FLOOR       0x100000ULL
+#define RELOC_CEILING     0x100000000ULL
+
+typedef struct {
+    uint64_t start;         /* current range, [start, end) */
+    uint64_t end;
+    uint64_t new_start;     /* destination, valid if move is set */
+    bool     move;
+} reloc_item_t;
+
+static reloc_item_t reloc_items[MAX_RELOC_ITEMS];
+
+static bool ranges_overlap(uint64_t s1, uint64_t e1, uint64_t s2, uint64_t e2)
 {
-    uint32_t memRequired;
-    uint64_t max_ram_base, max_ram_size, ld_ceiling;
+    return s1 < e2 && s2 < e1;
+}
 
-    uint32_t module_count, mod_i, mods_remaining;
-    module_t *m;
+static unsigned long min_reloc_addr(unsigned long start, unsigned long addr)
+{
+    return (addr >= RELOC_FLOOR && addr < start) ? addr : start;
+}
 
-    if (LOADER_CTX_BAD(lctx))
-        return false;
+/*
+ * lowest address at or above 1MB of any MB1 component; pieces below 1MB
+ * (BIOS tables, tboot's own copies of cmdline/mmap) are left alone
+ */
+static unsigned long get_mbi_mem_start_mb1(const multiboot_info_t *mbi)
+{
+    unsigned long start = ~0UL;
 
-    /*  Determine the size of memory required to pack all modules together */
-    module_count = get_module_count(lctx);
-    for( memRequired=0, mod_i=0; mod_i < module_count; mod_i++ ){
-        m = get_module(lctx, mod_i);
-        memRequired += PAGE_UP(m->mod_end - m->mod_start);
-    }
-
-    /*  NOTE: the e820 map has been modified already to reserve critical
-        memory regions (tboot memory, etc ...). get_highest_sized_ram
-        will return a range that excludes critical memory regions. */
-    get_highest_sized_ram(  memRequired, 0x100000000ULL,
-                            &max_ram_base, &max_ram_size);
-    if(!max_ram_base || !max_ram_size){
-        printk(TBOOT_INFO"ERROR No memory area found for image relocation!\n");
-        printk(TBOOT_INFO"required 0x%X\n", memRequired);
-        return false;
+    start = min_reloc_addr(start, (unsigned long)mbi);
+    if ( mbi->flags & MBI_CMDLINE )
+        start = min_reloc_addr(start, mbi->cmdline);
+    if ( mbi->flags & MBI_MODULES ) {
+        start = min_reloc_addr(start, mbi->mods_addr);
+        for ( unsigned int i = 0; i < mbi->mods_count; i++ ) {
+            module_t *p = get_module_mb1(mbi, i);
+            if ( p == NULL )
+                break;
+            start = min_reloc_addr(start, p->string);
+        }
+    }
+    if ( mbi->flags & MBI_MEMMAP )
+        start = min_reloc_addr(start, mbi->mmap_addr);
+    if ( mbi->flags & MBI_DRIVES )
+        start = min_reloc_addr(start, mbi->drives_addr);
+    if ( mbi->flags & MBI_BTLDNAME )
+        start = min_reloc_addr(start, mbi->boot_loader_name);
+    if ( mbi->flags & MBI_APM )
+        start = min_reloc_addr(start, mbi->apm_table);
+    if ( mbi->flags & MBI_VBE ) {
+        start = min_reloc_addr(start, mbi->vbe_control_info);
+        start = min_reloc_addr(start, mbi->vbe_mode_info);
     }
-    printk(TBOOT_INFO"highest suitable area @ 0x%llX (size 0x%llX)\n",
-            max_ram_base, max_ram_size);
-    ld_ceiling = PAGE_DOWN(max_ram_base + max_ram_size);
 
-    /*  Move modules below the load ceiling upto the ceiling:
-        Prevent module corruption:
-        - Move modules in order of highest to lowest.
-        - Only move modules completely below the load ceiling.
-     */
-    for( mods_remaining=module_count; mods_remaining > 0; mods_remaining--){
-        uint32_t    highest_mod_i = 0,
-                    highest_mod_base = 0,
-                    highest_mod_end = 0;
-        bool mod_found = false;
-        for( mod_i=0; mod_i<module_count; mod_i++){
-            m = get_module(lctx, mod_i);
-            if( (m->mod_start < ld_ceiling) ){
-                if( (m->mod_end > highest_mod_end) || !mod_found ){
-                    highest_mod_i   = mod_i;
-                    highest_mod_base= m->mod_start;
-                    highest_mod_end = m->mod_end;
-                    mod_found = true;
-                }
-            }
-        }
+    return PAGE_DOWN(start);
+}
 
-        /* If no modules found, all modules are above ld_ceiling, We're done. */
-        if( !mod_found )
-            break;
+/*
+ * there's no use passing symbol info on to Xen or whatever, since it
+ * describes tboot's image, not the target's!  We don't want the thing we
+ * launch using tboot image addresses to deduce anything about itself!
+ */
+static void strip_loader_syms(loader_ctx *lctx)
+{
+    if (lctx->type == MB1_ONLY){
+        multiboot_info_t *mbi = (multiboot_info_t *) lctx->addr;
 
-        m = get_module(lctx, highest_mod_i);
-        /* only move the highest module if explicitly below the ceiling */
-        if(highest_mod_end < ld_ceiling){
-            uint32_t size = highest_mod_end - highest_mod_base;
-            uint32_t highest_mod_newbase = PAGE_DOWN(ld_ceiling-size);
-            printk(TBOOT_INFO"moving module %u (%u B) from 0x%08X to 0x%08X\n",
-                    highest_mod_i, size, highest_mod_base, highest_mod_newbase);
-            tb_memcpy((void *)highest_mod_newbase, (void *)highest_mod_base, size);
-            m->mod_start= highest_mod_newbase;
-            m->mod_end  = highest_mod_newbase+size;
+        if (mbi->flags & MBI_AOUT){
+            mbi->syms.aout_image.addr = 0;
+            mbi->flags &= ~MBI_AOUT;
+        }
+        if (mbi->flags & MBI_ELF){
+            mbi->syms.elf_image.addr = 0;
+            mbi->flags &= ~MBI_ELF;
         }
-        /* lower the celing to the base address of the highest module */
-        ld_ceiling = PAGE_DOWN(m->mod_start);
     }
-    return true;
+    else {
+        struct mb2_tag *start, *victim;
+
+        start = (struct mb2_tag *) (lctx->addr + 8);
+        victim = find_mb2_tag_type(start, MB2_TAG_TYPE_ELF_SECTIONS);
+        if (victim != NULL)
+            (void) remove_mb2_tag(lctx,victim);
+    }
+}
+
+static void
+get_loader_ctx_range(loader_ctx *lctx, uint64_t *start, uint64_t *end)
+{
+    if (lctx->type == MB1_ONLY)
+        *start = get_mbi_mem_start_mb1((multiboot_info_t *) lctx->addr);
+    else
+        *start = (unsigned long) lctx->addr;
+    *end = get_loader_ctx_end(lctx);
+}
+
+static void reloc_ptr(uint32_t *p, uint32_t start, uint32_t end,
+                      uint32_t offset)
+{
+    if ( *p >= start && *p < end )
+        *p += offset;
 }
 
 /*
- * Move any mbi components/modules/mbi that just above the kernel
+ * fix up every pointer in the loader context that pointed into
+ * [start, end) after that range was copied offset bytes away.  MB2 data is
+ * all inline, so only the context address itself changes.
  */
-static bool move_modules_above_elf_kernel(  loader_ctx      *lctx,
-                                            elf_header_t    *kernel_image)
+static void fixup_loader_ctx(loader_ctx *lctx, uint32_t start, uint32_t end,
+                             uint32_t offset)
 {
-    void *elf_start, *elf_end;
-    uint32_t ld_floor, ld_ceiling;
+    uint32_t addr = (uint32_t) lctx->addr;
+    multiboot_info_t *mbi;
 
-    uint32_t module_count, mod_i, mods_remaining;
-    module_t *m;
+    reloc_ptr(&addr, start, end, offset);
+    if ( addr != (uint32_t) lctx->addr ) {
+        printk(TBOOT_INFO"loader context was moved from %p to 0x%08X\n",
+               lctx->addr, addr);
+        lctx->addr = (void *) addr;
+    }
 
-    if (LOADER_CTX_BAD(lctx))
-        return false;
+    if (lctx->type != MB1_ONLY)
+        return;
 
-    /* get end address of loaded elf image */
-    if ( !get_elf_image_range(kernel_image, &elf_start, &elf_end) ){
-        printk(TBOOT_INFO"ERROR: failed to get elf image range\n");
-        return false;
+    /* tboot replaces mmap_addr w/ a copy, and makes a copy of cmdline
+     * because we modify it; those live below 1MB and are never in range
+     */
+    mbi = (multiboot_info_t *) lctx->addr;
+    if ( mbi->flags & MBI_MODULES ) {
+        reloc_ptr(&mbi->mods_addr, start, end, offset);
+        for ( unsigned int i = 0; i < mbi->mods_count; i++ ) {
+            module_t *m = get_module_mb1(mbi, i);
+            if ( m == NULL )
+                break;
+            reloc_ptr(&m->string, start, end, offset);
+        }
     }
-    printk(TBOOT_INFO"ELF kernel top is at 0x%X\n", (uint32_t)elf_end);
+    if ( mbi->flags & MBI_CMDLINE )
+        reloc_ptr(&mbi->cmdline, start, end, offset);
+    if ( mbi->flags & MBI_MEMMAP )
+        reloc_ptr(&mbi->mmap_addr, start, end, offset);
+    if ( mbi->flags & MBI_DRIVES )
+        reloc_ptr(&mbi->drives_addr, start, end, offset);
+    if ( mbi->flags & MBI_CONFIG )
+        reloc_ptr(&mbi->config_table, start, end, offset);
+    if ( mbi->flags & MBI_BTLDNAME )
+        reloc_ptr(&mbi->boot_loader_name, start, end, offset);
+    if ( mbi->flags & MBI_APM )
+        reloc_ptr(&mbi->apm_table, start, end, offset);
+    if ( mbi->flags & MBI_VBE ) {
+        reloc_ptr(&mbi->vbe_control_info, start, end, offset);
+        reloc_ptr(&mbi->vbe_mode_info, start, end, offset);
+    }
+}
 
-    /*  compute the lowest base address of all the modules: the ld ceiling */
-    module_count = get_module_count(lctx);
-    for( mod_i=0, ld_ceiling=0; mod_i < module_count; mod_i++ ){
-        m = get_module(lctx,mod_i);
-        ld_ceiling = (ld_ceiling < m->mod_start)? m->mod_start : ld_ceiling;
-    }
-
-    /*  set ld_floor to the highest of tboot end address or the ELF-image
-        end address, and then page align */
-    ld_floor = get_tboot_mem_end();
-    ld_floor = (ld_floor < (uint32_t)elf_end)? (uint32_t)elf_end : ld_floor;
-    ld_floor = PAGE_UP(ld_floor);
-
-    /*  Ensures all modules are above ld_floor: only move mods down, never up.
-        Failing this check is an indication ELF-loading may have corrupted one
-        of the modules. */
-    if( (uint32_t)ld_floor > ld_ceiling ){
-        printk( TBOOT_INFO"Load floor (0x%08X) > load ceiling (0x%08X)\n",
-                ld_floor, ld_ceiling);
-        return false;
+/*
+ * return true if [start, end) collides with anything that must be
+ * preserved: a forbidden range, the current location of any object, or a
+ * destination already handed out.  *conflict gets the lowest start of
+ * the colliding ranges, so the caller can skip below all of them at once.
+ */
+static bool reloc_conflict(uint64_t start, uint64_t end,
+                           const uint64_t (*forbidden)[2],
+                           unsigned int nr_forbidden,
+                           unsigned int nr_items, uint64_t *conflict)
+{
+    bool found = false;
+
+    *conflict = end;
+    for ( unsigned int i = 0; i < nr_forbidden; i++ ) {
+        if ( ranges_overlap(start, end, forbidden[i][0], forbidden[i][1]) ) {
+            found = true;
+            if ( forbidden[i][0] < *conflict )
+                *conflict = forbidden[i][0];
+        }
     }
+    for ( unsigned int i = 0; i < nr_items; i++ ) {
+        reloc_item_t *it = &reloc_items[i];
 
-    /*  the i-th iteration of this loop will
-    move the i-th lowest module in memory to ld_floor
-    and raise ld_floor to the new end address of the i-th lowest module */
-    for( mods_remaining = module_count; mods_remaining > 0; mods_remaining--){
-        uint32_t    lowest_mod_i = 0,
-                    lowest_mod_base = 0,
-                    lowest_mod_end = 0;
-        bool mod_found = false;
-        /* find the lowest module above the floor */
-        for( mod_i=0; mod_i<module_count; mod_i++){
-            m = get_module(lctx, mod_i);
-            if(m->mod_start >= ld_floor){
-                if( (m->mod_start < lowest_mod_base) || !mod_found  ){
-                    lowest_mod_i   = mod_i;
-                    lowest_mod_base= m->mod_start;
-                    lowest_mod_end = m->mod_end;
-                    mod_found = true;
-                }
-            }
+        if ( ranges_overlap(start, end, it->start, it->end) ) {
+            found = true;
+            if ( it->start < *conflict )
+                *conflict = it->start;
         }
-        m = get_module(lctx, lowest_mod_i);
-
-        /* only move the lowest module if not already at the floor */
-        if(lowest_mod_base > ld_floor){
-            uint32_t size = lowest_mod_end - lowest_mod_base;
-            uint32_t lowest_mod_newbase = ld_floor; /* already page aligned */
-            printk(TBOOT_INFO"moving module %u (%u B) from 0x%08X to 0x%08X\n",
-                    lowest_mod_i, size, lowest_mod_base, lowest_mod_newbase);
-            tb_memcpy((void *)lowest_mod_newbase, (void *)lowest_mod_base, size);
-            m->mod_start= lowest_mod_newbase;
-            m->mod_end  = lowest_mod_newbase+size;
+        if ( it->move && it->new_start != 0 &&
+             ranges_overlap(start, end, it->new_start,
+                            it->new_start + (it->end - it->start)) ) {
+            found = true;
+            if ( it->new_start < *conflict )
+                *conflict = it->new_start;
         }
-        /* raise the floor to the end address of the lowest module */
-        ld_floor = PAGE_UP(m->mod_end);
     }
-    return true;
+    return found;
 }
 
-static void fixup_modules(loader_ctx *lctx, size_t offset)
+/*
+ * find the highest page-aligned block of size bytes in E820 RAM below 4GB
+ * that doesn't collide with anything (see reloc_conflict())
+ */
+static uint64_t find_reloc_dest(uint64_t size, const uint64_t (*forbidden)[2],
+                                unsigned int nr_forbidden,
+                                unsigned int nr_items)
 {
-    unsigned int module_count = get_module_count(lctx);
-    for ( unsigned int i = 0; i < module_count; i++ ) {
-        module_t *m = get_module(lctx, i);
-        if ( below_tboot(m->mod_start) ) {
-            m->mod_start += offset;
-            m->mod_end += offset;
+    memory_map_t *e820 = get_e820_copy();
+    unsigned int nr_map = get_nr_map();
+    uint64_t best = 0;
+
+    size = PAGE_UP(size);
+    for ( unsigned int i = 0; i < nr_map; i++ ) {
+        uint64_t base, top, conflict;
+
+        if ( e820[i].type != E820_RAM )
+            continue;
+        base = ((uint64_t)e820[i].base_addr_high << 32) |
+               e820[i].base_addr_low;
+        top = base + (((uint64_t)e820[i].length_high << 32) |
+                      e820[i].length_low);
+        if ( base < RELOC_FLOOR )
+            base = RELOC_FLOOR;
+        if ( top > RELOC_CEILING )
+            top = RELOC_CEILING;
+        base = (base + PAGE_SIZE - 1) & ~((uint64_t)PAGE_SIZE - 1);
+        top &= ~((uint64_t)PAGE_SIZE - 1);
+
+        /* walk down from the top of the entry, hopping below collisions */
+        while ( top > base && top - base >= size && top - size > best ) {
+            if ( !reloc_conflict(top - size, top, forbidden, nr_forbidden,
+                                 nr_items, &conflict) ) {
+                best = top - size;
+                break;
+            }
+            top = conflict & ~((uint64_t)PAGE_SIZE - 1);
         }
-        /* MB2 module strings are inline, not addresses */
-        if (lctx->type == 1)
-            if ( below_tboot(m->string) )
-                m->string += offset;
     }
+    return best;
 }
 
 /*
- * fixup_loader_ctx() is to be called after modules and/or mbi are moved from 
- * below tboot memory to above tboot. It will fixup all pointers in mbi if 
- * mbi was moved; fixup modules table if any modules are moved. If mbi was 
- * moved, adjust the addr field in context, otherwise, leave alone.
+ * Digests of modules taken while relocate_modules() copied them, so that
+ * verify_module() doesn't have to read them back in.  An entry is only
+ * good for exactly the range it was taken over and is dropped as soon as
+ * anything else gets copied over (part of) that range.  For a module
+ * tboot decompressed, the digests of the compressed image it was handed
+ * are kept as well.
  */
-static 
-void fixup_loader_ctx(loader_ctx *lctx, size_t offset)
+#define MAX_MOD_DIGESTS       8
+#define MAX_MOD_DIGEST_ALGS   2
+
+typedef struct {
+    uint32_t     start;
+    uint32_t     size;
+    unsigned int alg_count;
+    uint16_t     algs[MAX_MOD_DIGEST_ALGS];
+    tb_hash_t    hashes[MAX_MOD_DIGEST_ALGS];
+    bool         compressed;
+    tb_hash_t    zhashes[MAX_MOD_DIGEST_ALGS];
+} mod_digest_t;
+
+static mod_digest_t mod_digests[MAX_MOD_DIGESTS];
+static unsigned int nr_mod_digests;
+
+static void forget_module_digests(uint32_t start, uint32_t end)
 {
-    if (LOADER_CTX_BAD(lctx))
-        return;
-
-    bool moving_ctx = below_tboot((unsigned long)lctx->addr);
-    multiboot_info_t *mbi = lctx->addr;
+    unsigned int i = 0;
 
-    if ( moving_ctx ) {
-        printk(TBOOT_INFO"loader context was moved from %p to ", lctx->addr);
-        lctx->addr += offset;
-        printk(TBOOT_INFO"%p\n", lctx->addr);
+    while ( i < nr_mod_digests ) {
+        mod_digest_t *d = &mod_digests[i];
+        if ( ranges_overlap(start, end, d->start, d->start + d->size) )
+            *d = mod_digests[--nr_mod_digests];
+        else
+            i++;
     }
+}
 
-    if (0 < get_module_count(lctx)) {
-        if (lctx->type == MB1_ONLY)
-            if ( below_tboot(mbi->mods_addr) )
-                mbi->mods_addr += offset;
-        /* not required for MB2--if we moved the pile, we moved this too */
-        fixup_modules(lctx, offset);
-    }
+static bool lookup_module_digest(loader_ctx *lctx, const void *base,
+                                 size_t size, uint16_t hash_alg,
+                                 bool compressed, tb_hash_t *hash)
+{
+    if (LOADER_CTX_BAD(lctx) || hash == NULL)
+        return false;
 
-    if (lctx->type == MB1_ONLY){
-        /* RLM change.  There's no use passing these on to Xen or whatever,
-         * since they will be tboot's addrs, not the target's!  We don't
-         * want the thing we launch using tboot image addresses to deduce
-         * anything about itself!
-         */
-        if (mbi->flags & MBI_AOUT){
-            mbi->syms.aout_image.addr = 0;
-            mbi->flags &= ~MBI_AOUT;
+    for ( unsigned int i = 0; i < nr_mod_digests; i++ ) {
+        mod_digest_t *d = &mod_digests[i];
+        if ( d->start != (uint32_t)base || d->size != size )
+            continue;
+        if ( compressed && !d->compressed )
+            return false;
+        for ( unsigned int j = 0; j < d->alg_count; j++ ) {
+            if ( d->algs[j] == hash_alg ) {
+                copy_hash(hash, compressed ? &d->zhashes[j] : &d->hashes[j],
+                          hash_alg);
+                return true;
+            }
         }
-        if (mbi->flags & MBI_ELF){
-            mbi->syms.elf_image.addr = 0;
-            mbi->flags &= ~MBI_ELF;
+    }
+    return false;
+}
+
+bool find_module_digest(loader_ctx *lctx, const void *base, size_t size,
+                        uint16_t hash_alg, tb_hash_t *hash)
+{
+    return lookup_module_digest(lctx, base, size, hash_alg, false, hash);
+}
+
+/* digest of the compressed image a decompressed module was made from */
+bool find_module_compressed_digest(loader_ctx *lctx, const void *base,
+                                   size_t size, uint16_t hash_alg,
+                                   tb_hash_t *hash)
+{
+    return lookup_module_digest(lctx, base, size, hash_alg, true, hash);
+}
+
+/* copy a module to dst, hashing it on the way if the policy will need it */
+static void copy_module(uint32_t dst, uint32_t src, uint32_t size)
+{
+    mod_digest_t *d;
+
+    forget_module_digests(dst, dst + size);
+    if ( nr_mod_digests < MAX_MOD_DIGESTS ) {
+        d = &mod_digests[nr_mod_digests];
+        d->alg_count = get_module_hash_algs(d->algs, MAX_MOD_DIGEST_ALGS);
+        if ( d->alg_count > 0 &&
+             copy_and_hash((void *)dst, (void *)src, size, d->alg_count,
+                           d->algs, d->hashes) ) {
+            d->start = dst;
+            d->size = size;
+            d->compressed = false;
+            nr_mod_digests++;
+            return;
         }
     }
+    tb_memcpy((void *)dst, (void *)src, size);
+}
 
-    if (lctx->type == MB2_ONLY){
-        struct mb2_tag *start, *victim;
-        /* as above, we need to remove ELF tag if we have it */
-        start = (struct mb2_tag *) (lctx->addr + 8);
-        victim = find_mb2_tag_type(start, MB2_TAG_TYPE_ELF_SECTIONS);
-        if (victim != NULL)
-            (void) remove_mb2_tag(lctx,victim);
-        /* and that's all, folks! */
-        return;
+static bool overlaps_forbidden(uint64_t start, uint64_t end,
+                               const uint64_t (*forbidden)[2],
+                               unsigned int nr_forbidden)
+{
+    for ( unsigned int i = 0; i < nr_forbidden; i++ ) {
+        if ( ranges_overlap(start, end, forbidden[i][0], forbidden[i][1]) )
+            return true;
     }
-    if ( !moving_ctx)
-        return;
+    return false;
+}
 
-    /* tboot replace mmap_addr w/ a copy, and make a copy of cmdline
-     * because we modify it. Those pointers don't need offset adjustment.
-     * To make it general and depend less on such kind of changes, just 
-     * check whether we need to adjust offset before trying to do it for 
-     * each field 
-     */
-    if ( (mbi->flags & MBI_CMDLINE) && below_tboot(mbi->cmdline) )
-        mbi->cmdline += offset;
+/*
+ * Relocate only those modules (and the loader context) that are in any of
+ * the forbidden ranges, copying each of them exactly once to the highest
+ * free RAM below 4GB
+ */
+static bool relocate_out_of(loader_ctx *lctx, const uint64_t (*forbidden)[2],
+                            unsigned int nr_forbidden)
+{
+    unsigned int mod_count, nr_items, nr_moved = 0;
+    uint32_t bytes_moved = 0;
 
-    if ( (mbi->flags & MBI_MEMMAP) && below_tboot(mbi->mmap_addr) )
-        mbi->mmap_addr += offset;
+    mod_count = get_module_count(lctx);
+    if ( mod_count + 1 > MAX_RELOC_ITEMS ) {
+        printk(TBOOT_ERR"ERROR: too many modules to relocate (%u)\n",
+               mod_count);
+        return false;
+    }
 
-    if ( (mbi->flags & MBI_DRIVES) && below_tboot(mbi->drives_addr) )
-        mbi->drives_addr += offset;
+    /* items 0..mod_count-1 are the modules, the last one is the ctx */
+    nr_items = 0;
+    for ( unsigned int i = 0; i < mod_count; i++ ) {
+        module_t *m = get_module(lctx, i);
+        if ( m == NULL )
+            return false;
+        reloc_items[nr_items].start = m->mod_start;
+        reloc_items[nr_items].end = m->mod_end;
+        nr_items++;
+    }
+    get_loader_ctx_range(lctx, &reloc_items[nr_items].start,
+                         &reloc_items[nr_items].end);
+    nr_items++;
+
+    /* decide what has to move and where; nothing is copied yet */
+    for ( unsigned int i = 0; i < nr_items; i++ ) {
+        reloc_item_t *it = &reloc_items[i];
+
+        it->move = false;
+        it->new_start = 0;
+        if ( it->start >= it->end || it->start < RELOC_FLOOR )
+            continue;
+        if ( !overlaps_forbidden(it->start, it->end, forbidden,
+                                 nr_forbidden) )
+            continue;
+
+        it->move = true;
+        it->new_start = find_reloc_dest(it->end - it->start, forbidden,
+                                        nr_forbidden, nr_items);
+        if ( it->new_start == 0 ) {
+            printk(TBOOT_ERR"ERROR: no memory area found for relocation!\n");
+            printk(TBOOT_ERR"required 0x%X\n", (uint32_t)(it->end - it->start));
+            return false;
+        }
+    }
 
-    if ( (mbi->flags & MBI_CONFIG) && below_tboot(mbi->config_table) )
-        mbi->config_table += offset;
+    /* the ctx goes first, so the module table is at its final address */
+    reloc_item_t *ctx = &reloc_items[nr_items - 1];
+    if ( ctx->move ) {
+        uint32_t size = ctx->end - ctx->start;
 
-    if ( (mbi->flags & MBI_BTLDNAME) && below_tboot(mbi->boot_loader_name) )
-        mbi->boot_loader_name += offset;
+        forget_module_digests(ctx->new_start, ctx->new_start + size);
+        tb_memcpy((void *)(uint32_t)ctx->new_start,
+                  (void *)(uint32_t)ctx->start, size);
+        fixup_loader_ctx(lctx, ctx->start, ctx->end,
+                         ctx->new_start - ctx->start);
+        nr_moved++;
+        bytes_moved += size;
+    }
 
-    if ( (mbi->flags & MBI_APM) && below_tboot(mbi->apm_table) )
-        mbi->apm_table += offset;
+    for ( unsigned int i = 0; i < mod_count; i++ ) {
+        reloc_item_t *it = &reloc_items[i];
+        uint32_t size = it->end - it->start;
+        module_t *m;
 
-    if ( mbi->flags & MBI_VBE ) {
-        if ( below_tboot(mbi->vbe_control_info) )
-            mbi->vbe_control_info += offset;
-        if ( below_tboot(mbi->vbe_mode_info) )
-            mbi->vbe_mode_info += offset;
+        if ( !it->move )
+            continue;
+        m = get_module(lctx, i);
+        if ( m == NULL )
+            return false;
+        printk(TBOOT_INFO"moving module %u (%u B) from 0x%08X to 0x%08X\n",
+               i, size, m->mod_start, (uint32_t)it->new_start);
+        copy_module(it->new_start, m->mod_start, size);
+        m->mod_start = it->new_start;
+        m->mod_end = it->new_start + size;
+        nr_moved++;
+        bytes_moved += size;
     }
-    return;
+
+    printk(TBOOT_INFO"relocated %u of %u objects (0x%X bytes copied)\n",
+           nr_moved, nr_items, bytes_moved);
+    return true;
 }
 
-static uint32_t get_lowest_mod_start_below_tboot(loader_ctx *lctx)
+/*
+ * Relocate only those modules (and the loader context) that are in the
+ * way of the ELF kernel image or of tboot itself
+ */
+static bool relocate_modules(loader_ctx *lctx, const elf_header_t *kernel_image)
 {
-    uint32_t lowest = 0xffffffff;
-    unsigned int mod_count = get_module_count(lctx);
-    for ( unsigned int i = 0; i < mod_count; i++ ) {
-        module_t *m = get_module(lctx, i);
-        if ( m->mod_start < lowest &&
-                below_tboot(m->mod_start))
-            lowest = m->mod_start;
+    void *elf_start, *elf_end;
+    uint64_t forbidden[2][2];
+
+    if (LOADER_CTX_BAD(lctx))
+        return false;
+
+    if ( !get_elf_image_range(kernel_image, &elf_start, &elf_end) ) {
+        printk(TBOOT_ERR"ERROR: failed to get elf image range\n");
+        return false;
     }
+    printk(TBOOT_INFO"ELF kernel will be loaded at 0x%08X - 0x%08X\n",
+           (uint32_t)elf_start, (uint32_t)elf_end);
+
+    /* symbol info is stripped first so it doesn't count towards the ctx */
+    strip_loader_syms(lctx);
 
-    return lowest;
+    forbidden[0][0] = PAGE_DOWN(elf_start);
+    forbidden[0][1] = PAGE_UP(elf_end);
+    forbidden[1][0] = TBOOT_BASE_ADDR;
+    forbidden[1][1] = get_tboot_mem_end();
+
+    return relocate_out_of(lctx, forbidden, 2);
 }
 
-static uint32_t get_highest_mod_end(loader_ctx *lctx)
+/*
+ * Before launch, move whatever the loader put where tboot's per-CPU data
+ * is about to go (the loader only knew about tboot's image)
+ */
+bool relocate_modules_from_tboot(loader_ctx *lctx)
 {
-    uint32_t highest = 0;
-    unsigned int mod_count = get_module_count(lctx);
-    for ( unsigned int i = 0; i < mod_count; i++ ) {
+    uint64_t forbidden[1][2];
+    uint64_t start, end;
+
+    if (LOADER_CTX_BAD(lctx))
+        return false;
+
+    forbidden[0][0] = TBOOT_BASE_ADDR;
+    forbidden[0][1] = get_tboot_mem_end();
+
+    /* nothing to do in the common case */
+    get_loader_ctx_range(lctx, &start, &end);
+    bool in_the_way = overlaps_forbidden(start, end, forbidden, 1);
+    for ( unsigned int i = 0; !in_the_way && i < get_module_count(lctx); i++ ) {
         module_t *m = get_module(lctx, i);
-        if ( m->mod_end > highest )
-            highest = m->mod_end;
+        if ( m == NULL )
+            return false;
+        in_the_way = overlaps_forbidden(m->mod_start, m->mod_end,
+                                        forbidden, 1);
     }
+    if ( !in_the_way )
+        return true;
 
-    return highest;
+    return relocate_out_of(lctx, forbidden, 1);
 }
 
 /*
- * Move any mbi components/modules/mbi that are below tboot to just above tboot
+ * gzip-compressed modules are decompressed into free RAM before they are
+ * verified.  The output is hashed as the decompressor produces it, so that
+ * pass doubles as the measurement and verify_module() uses the digests.
  */
-static void
-move_modules(loader_ctx *lctx)
+typedef struct {
+    unsigned int   alg_count;
+    const uint16_t *algs;
+    SHA_CTX        sha1_ctx;
+    sha256_state   sha256_ctx;
+} stream_hash_t;
+
+static stream_hash_t gunzip_hash;
+static bool modules_decompressed;
+
+static bool stream_hash_update(void *arg, const uint8_t *buf, size_t len)
+{
+    stream_hash_t *h = arg;
+
+    for ( unsigned int i = 0; i < h->alg_count; i++ ) {
+        if ( h->algs[i] == TB_HALG_SHA1 )
+            SHA1_Update(&h->sha1_ctx, buf, len);
+        else
+            sha256_process(&h->sha256_ctx, buf, len);
+    }
+    return true;
+}
+
+static bool decompress_module(loader_ctx *lctx, unsigned int i,
+                              const uint64_t (*forbidden)[2],
+                              unsigned int nr_items)
+{
+    module_t *m = get_module(lctx, i);
+    void *image = (void *)m->mod_start;
+    size_t image_size = m->mod_end - m->mod_start;
+    uint32_t size = get_gzip_image_size(image, image_size);
+    stream_hash_t *h = &gunzip_hash;
+    mod_digest_t *d = NULL;
+    uint32_t dst;
+
+    if ( size == 0 )
+        return false;
+    dst = find_reloc_dest(size, forbidden, 1, nr_items);
+    if ( dst == 0 ) {
+        printk(TBOOT_ERR"no memory area found for decompressing module %u"
+               " (0x%X bytes)\n", i, size);
+        return false;
+    }
+
+    /* hash the output if the policy will want it and tboot can do it */
+    forget_module_digests(dst, dst + size);
+    h->alg_count = 0;
+    if ( nr_mod_digests < MAX_MOD_DIGESTS ) {
+        d = &mod_digests[nr_mod_digests];
+        d->alg_count = get_module_hash_algs(d->algs, MAX_MOD_DIGEST_ALGS);
+        for ( unsigned int j = 0; j < d->alg_count; j++ ) {
+            if ( d->algs[j] == TB_HALG_SHA1 )
+                SHA1_Init(&h->sha1_ctx);
+            else if ( d->algs[j] == TB_HALG_SHA256 )
+                sha256_init(&h->sha256_ctx);
+            else
+                d->alg_count = 0;
+        }
+        h->alg_count = d->alg_count;
+        h->algs = d->algs;
+    }
+
+    printk(TBOOT_INFO"decompressing module %u (%u B) from 0x%08X to 0x%08X"
+           " (%u B)\n", i, (uint32_t)image_size, m->mod_start, dst, size);
+    if ( !gunzip(image, image_size, (void *)dst, size,
+                 stream_hash_update, h) )
+        return false;
+
+    if ( d != NULL && h->alg_count > 0 ) {
+        /* keep the digests of what the loader actually handed us, too */
+        d->compressed = true;
+        for ( unsigned int j = 0; j < d->alg_count; j++ ) {
+            if ( d->algs[j] == TB_HALG_SHA1 )
+                SHA1_Final(d->hashes[j].sha1, &h->sha1_ctx);
+            else
+                sha256_done(&h->sha256_ctx, d->hashes[j].sha256);
+            if ( !hash_buffer(image, image_size, &d->zhashes[j], d->algs[j]) )
+                d->compressed = false;
+        }
+        d->start = dst;
+        d->size = size;
+        nr_mod_digests++;
+    }
+
+    m->mod_start = dst;
+    m->mod_end = dst + size;
+    return true;
+}
+
+/*
+ * Decompress gzip-compressed modules (per the "decompress" option) to the
+ * highest free RAM below 4GB.  A module that fails to decompress is left
+ * as it is, to be verified (and likely rejected) as is.
+ */
+bool decompress_modules(loader_ctx *lctx)
 {
+    uint64_t forbidden[1][2];
+    unsigned int mod_count, nr_items = 0;
+
     if (LOADER_CTX_BAD(lctx))
-        return;
+        return false;
+    if ( modules_decompressed )
+        return true;
+    modules_decompressed = true;
 
-    unsigned long lowest = get_lowest_mod_start_below_tboot(lctx);
-    unsigned long from = 0;
+    mod_count = get_module_count(lctx);
+    if ( mod_count + 1 > MAX_RELOC_ITEMS ) {
+        printk(TBOOT_ERR"ERROR: too many modules (%u)\n", mod_count);
+        return false;
+    }
 
-    if ( below_tboot(lowest) )
-        from = lowest;
-    else
-        if ( below_tboot((unsigned long)lctx->addr) )
-            from = (unsigned long)lctx->addr;
-        else
-            return;
+    /* destinations must avoid tboot, all modules and the ctx */
+    forbidden[0][0] = TBOOT_BASE_ADDR;
+    forbidden[0][1] = get_tboot_mem_end();
+    for ( unsigned int i = 0; i < mod_count; i++ ) {
+        module_t *m = get_module(lctx, i);
+        if ( m == NULL )
+            return false;
+        reloc_items[nr_items].start = m->mod_start;
+        reloc_items[nr_items].end = m->mod_end;
+        reloc_items[nr_items].move = false;
+        nr_items++;
+    }
+    get_loader_ctx_range(lctx, &reloc_items[nr_items].start,
+                         &reloc_items[nr_items].end);
+    reloc_items[nr_items].move = false;
+    nr_items++;
 
-    unsigned long highest = get_highest_mod_end(lctx);
-    unsigned long to = PAGE_UP(highest);
+    for ( unsigned int i = 0; i < mod_count; i++ ) {
+        module_t *m = get_module(lctx, i);
 
-    if ( to < get_tboot_mem_end() )
-        to = get_tboot_mem_end();
+        if ( !is_gzip_image((void *)m->mod_start, m->mod_end - m->mod_start) )
+            continue;
+        if ( i == 0 ? !get_tboot_decompress_kernel() :
+                      !get_tboot_decompress_all() )
+            continue;
+        if ( !decompress_module(lctx, i, forbidden, nr_items) ) {
+            printk(TBOOT_WARN"module %u left compressed\n", i);
+            continue;
+        }
+        /* the compressed copy is no longer needed, the output is */
+        reloc_items[i].start = m->mod_start;
+        reloc_items[i].end = m->mod_end;
+    }
+    return true;
+}
 
-    /*
-     * assuming that all of the members of mbi (e.g. cmdline, 
-     * syms.aout_image.addr, etc.) are contiguous with the mbi structure
-     */
-    if ( to < get_loader_ctx_end(lctx) )
-        to = get_loader_ctx_end(lctx);
+/*
+ * Move modules out of the way of an ELF kernel ahead of verifying them,
+ * so verification can use the digests taken while copying.  launch_kernel()
+ * will find nothing left to move.
+ */
+bool relocate_kernel_modules(loader_ctx *lctx)
+{
+    module_t *m;
 
-    tb_memcpy((void *)to, (void *)from, TBOOT_BASE_ADDR - from);
-    
-    printk(TBOOT_DETA"0x%lx bytes copied from 0x%lx to 0x%lx\n",
-           TBOOT_BASE_ADDR - from, from, to);
-    fixup_loader_ctx(lctx, to - from);
-    return;
+    if (LOADER_CTX_BAD(lctx))
+        return false;
+    if ( get_module_count(lctx) == 0 )
+        return true;
+
+    m = get_module(lctx, 0);
+    if ( m == NULL )
+        return false;
+    if ( !is_elf_image((void *)m->mod_start, m->mod_end - m->mod_start) )
+        return true;
+    return relocate_modules(lctx, (elf_header_t *)m->mod_start);
 }
 
 module_t *get_module(loader_ctx *lctx, unsigned int i)
@@ -1139,6 +1520,15 @@ static void *remove_first_module(loader_ctx *lctx)
 #define MB2_TEMP_SIZE 512
 static uint32_t mb2_temp[MB2_TEMP_SIZE];
 
+/* copy a NUL-terminated string to obd and return the aligned obd after it */
+static uint32_t copy_mb1_string(uint32_t obd, const char *s)
+{
+    size_t len = tb_strlen(s) + 1;
+
+    tb_memcpy((void *)obd, s, len);
+    return (obd + len + 3) & ~3;
+}
+
 static bool convert_mb2_to_mb1(void)
 {
     /* it's too hard to do this in place.  MB2 "data" is all inline, so
@@ -1146,10 +1536,20 @@ static bool convert_mb2_to_mb1(void)
      * has pointers in the info struct to other stuff further along in its
      * stuff, so it doesn't copy/move well.  We'll make a copy of the MB2
      * info, and then build the MB1 in place where the MB2 we started with was.
+     *
+     * this is only done once, right before jumping to the kernel, so that
+     * everything up to then works on the MB2 info directly
      */
     uint32_t mb2_size;
     multiboot_info_t *mbi;
     uint32_t i, obd;
+    struct mb2_tag *tag;
+    struct mb2_tag_string *cmdline = NULL, *bload = NULL;
+    struct mb2_tag_memlimits *lim = NULL;
+    struct mb2_tag_bootdev *bd = NULL;
+    struct mb2_tag_apm *apm = NULL;
+    struct mb2_tag_vbe *vbe = NULL;
+    bool have_mmap = false;
     
     if (LOADER_CTX_BAD(g_ldr_ctx))
         return false;
@@ -1159,16 +1559,45 @@ static bool convert_mb2_to_mb1(void)
     if (mb2_size >= MB2_TEMP_SIZE * 4)
         return false;
     /* copy it all to temp */
-    {
-        uint8_t *s, *d;
-        s = (uint8_t *) g_ldr_ctx->addr;
-        d = (uint8_t *) mb2_temp;
-        for (i = 0; i < mb2_size; i++)
-            d[i] = s[i];
-        mbi = (multiboot_info_t *) g_ldr_ctx->addr;
-        g_ldr_ctx->addr = mb2_temp;
-        for (i = 0; i < mb2_size; i++)
-            ((uint8_t *)mbi)[i] = 0;
+    mbi = (multiboot_info_t *) g_ldr_ctx->addr;
+    tb_memcpy(mb2_temp, mbi, mb2_size);
+    g_ldr_ctx->addr = mb2_temp;
+    tb_memset(mbi, 0, mb2_size);
+
+    /* pick out every tag we translate in one walk */
+    for (tag = (struct mb2_tag *)(g_ldr_ctx->addr + 8); tag != NULL;
+         tag = next_mb2_tag(tag)){
+        switch (tag->type){
+        case MB2_TAG_TYPE_CMDLINE:
+            if (cmdline == NULL)
+                cmdline = (struct mb2_tag_string *) tag;
+            break;
+        case MB2_TAG_TYPE_LOADER_NAME:
+            if (bload == NULL)
+                bload = (struct mb2_tag_string *) tag;
+            break;
+        case MB2_TAG_TYPE_MEMLIMITS:
+            if (lim == NULL)
+                lim = (struct mb2_tag_memlimits *) tag;
+            break;
+        case MB2_TAG_TYPE_BOOTDEV:
+            if (bd == NULL)
+                bd = (struct mb2_tag_bootdev *) tag;
+            break;
+        case MB2_TAG_TYPE_MMAP:
+            have_mmap = true;
+            break;
+        case MB2_TAG_TYPE_APM:
+            if (apm == NULL)
+                apm = (struct mb2_tag_apm *) tag;
+            break;
+        case MB2_TAG_TYPE_VBE:
+            if (vbe == NULL)
+                vbe = (struct mb2_tag_vbe *) tag;
+            break;
+        default:
+            break;
+        }
     }
 
     /* out of band data pointer */
@@ -1177,39 +1606,28 @@ static bool convert_mb2_to_mb1(void)
     obd = (obd + 3) & ~3;
 
     /* do we have mem_limits? */
-    if (have_loader_memlimits(g_ldr_ctx)){
+    if (lim != NULL){
         mbi->flags |= MBI_MEMLIMITS;
-        mbi->mem_lower = get_loader_mem_lower(g_ldr_ctx);
-        mbi->mem_upper = get_loader_mem_upper(g_ldr_ctx);
+        mbi->mem_lower = lim->mem_lower;
+        mbi->mem_upper = lim->mem_upper;
     }
 
     /* do we have a boot device? */
-    {
-        struct mb2_tag *start = (struct mb2_tag *)(g_ldr_ctx->addr + 8);
-        start = find_mb2_tag_type(start, MB2_TAG_TYPE_BOOTDEV);
-        if (start != NULL){
-            struct mb2_tag_bootdev *bd = (struct mb2_tag_bootdev *) start;
-            mbi->flags |= MBI_BOOTDEV;
-            mbi->boot_device.bios_driver = bd->biosdev;
-            mbi->boot_device.top_level_partition = bd->part;
-            mbi->boot_device.sub_partition = bd->slice;
-            mbi->boot_device.third_partition = 0xff;
-        }
+    if (bd != NULL){
+        mbi->flags |= MBI_BOOTDEV;
+        mbi->boot_device.bios_driver = bd->biosdev;
+        mbi->boot_device.top_level_partition = bd->part;
+        mbi->boot_device.sub_partition = bd->slice;
+        mbi->boot_device.third_partition = 0xff;
     }
+
     /* command line */
-    {
-        const char *mb2_cmd = get_cmdline(g_ldr_ctx);
-        if (mb2_cmd){
-            char *mb1_cmd = (char *) obd;
-            while (*mb2_cmd){
-                *mb1_cmd = *mb2_cmd;
-                mb1_cmd++; mb2_cmd++; obd++;
-            }
-            /* uint32_t align it again */
-            obd = (obd + 3) & ~3;
-            mbi->flags |= MBI_CMDLINE;
-        }
+    if (cmdline != NULL){
+        mbi->cmdline = obd;
+        obd = copy_mb1_string(obd, cmdline->string);
+        mbi->flags |= MBI_CMDLINE;
     }
+
     /* modules--in MB1, this is a count and a pointer to an array of module_t */
     mbi->mods_count = get_module_count(g_ldr_ctx);
     if (mbi->mods_count > 0){
@@ -1219,20 +1637,17 @@ static bool convert_mb2_to_mb1(void)
         mbi->mods_addr = obd;
         
         for (i = 0; i < mbi->mods_count; i++){
-            module_t *mb1_mt = (module_t *) obd;
+            module_t *mb1_mt = (module_t *) obd + i;
             module_t *mb2_mt = get_module(g_ldr_ctx, i);
-            char *s = (char *)&mb2_mt->string;
+            const char *s = (const char *)&mb2_mt->string;
+            size_t len = tb_strlen(s);
             mb1_mt->mod_start = mb2_mt->mod_start;
             mb1_mt->mod_end = mb2_mt->mod_end;
             mb1_mt->reserved = 0;
-            if (*s){
-                char *d = (char *) obd_str;
+            if (len > 0){
                 mb1_mt->string = obd_str;
-                while (*s){
-                    *d = *s;
-                    d++; s++; obd_str++;
-                }
-                *d = *s; obd_str++;
+                tb_memcpy((void *)obd_str, s, len + 1);
+                obd_str += len + 1;
             } else {
                 mb1_mt->string = 0;
             }
@@ -1245,7 +1660,7 @@ static bool convert_mb2_to_mb1(void)
     /* a.out/elf sections--we know these are not there */
     
     /* memory map--we can just use the modified copy for this one */
-    if (have_loader_memmap(g_ldr_ctx)){
+    if (have_mmap){
         mbi->mmap_addr = (uint32_t)get_e820_copy();
         mbi->mmap_length = (get_nr_map()) * sizeof(memory_map_t);
         mbi->flags |= MBI_MEMMAP;
@@ -1256,76 +1671,42 @@ static bool convert_mb2_to_mb1(void)
     /* config table -- again, nothing equivalent? */
 
     /* boot loader name */
-    {
-        struct mb2_tag *start = (struct mb2_tag *)(g_ldr_ctx->addr + 8);
-        start = find_mb2_tag_type(start, MB2_TAG_TYPE_LOADER_NAME);
-        if (start){
-            struct mb2_tag_string *bload = (struct mb2_tag_string *) start;
-            char *s, *d;
-            mbi->boot_loader_name = obd;
-            s = (char *) &bload->string[0];
-            d = (char *) obd;
-            while (*s){
-                *d = *s;
-                s++; d++; obd++;
-            }
-            *d = *s; obd++;
-            obd = (obd + 3) & ~3;
-            mbi->flags |= MBI_BTLDNAME;
-        }
+    if (bload != NULL){
+        mbi->boot_loader_name = obd;
+        obd = copy_mb1_string(obd, bload->string);
+        mbi->flags |= MBI_BTLDNAME;
     }
 
     /* apm table */
-    {
-        struct mb2_tag *start = (struct mb2_tag *)(g_ldr_ctx->addr + 8);
-        start = find_mb2_tag_type(start, MB2_TAG_TYPE_APM);
-        if (start){
-            struct mb2_tag_apm *apm = (struct mb2_tag_apm *) start;
-            uint8_t *s, *d;
-            s = (uint8_t *)&apm->version;
-            d = (uint8_t *) obd;  mbi->apm_table = obd;
-            for (i = 0; 
-                 i < sizeof(struct mb2_tag_apm) - sizeof(uint32_t);
-                 i++){
-                *d = *s;
-                d++; s++; obd++;
-            }
-            obd = (obd + 3) & ~3;
-            mbi->flags |= MBI_APM;
-        }
+    if (apm != NULL){
+        mbi->apm_table = obd;
+        tb_memcpy((void *)obd, &apm->version,
+                  sizeof(struct mb2_tag_apm) - sizeof(uint32_t));
+        obd += sizeof(struct mb2_tag_apm) - sizeof(uint32_t);
+        obd = (obd + 3) & ~3;
+        mbi->flags |= MBI_APM;
     }
 
     /* vbe poop, if we can get these to map across */
-    {
-        struct mb2_tag *start = (struct mb2_tag *)(g_ldr_ctx->addr + 8);
-        start = find_mb2_tag_type(start, MB2_TAG_TYPE_VBE);
-        if (start){
-            struct mb2_tag_vbe *vbe = (struct mb2_tag_vbe *) start;
-            uint8_t *s, *d;
-            mbi->vbe_mode = vbe->vbe_mode;
-            mbi->vbe_interface_seg = vbe->vbe_interface_seg;
-            mbi->vbe_interface_off = vbe->vbe_interface_off;
-            mbi->vbe_interface_len = vbe->vbe_interface_len;
-            mbi->vbe_control_info = obd;
-            d = (uint8_t *) obd;
-            s = &vbe->vbe_control_info.external_specification[0];
-            for (i = 0; i < 512; i++){
-                *d = *s;
-                d++; s++; obd++;
-            }
-            /* if obd was aligned before, it still is */
-            mbi->vbe_mode_info = obd;
-            d = (uint8_t *) obd;
-            s = &vbe->vbe_mode_info.external_specification[0];
-            for (i = 0; i < 256; i++){
-                *d = *s;
-                d++; s++; obd++;
-            }
-            mbi->flags |= MBI_VBE;
-        }
+    if (vbe != NULL){
+        mbi->vbe_mode = vbe->vbe_mode;
+        mbi->vbe_interface_seg = vbe->vbe_interface_seg;
+        mbi->vbe_interface_off = vbe->vbe_interface_off;
+        mbi->vbe_interface_len = vbe->vbe_interface_len;
+        mbi->vbe_control_info = obd;
+        tb_memcpy((void *)obd,
+                  &vbe->vbe_control_info.external_specification[0], 512);
+        obd += 512;
+        /* if obd was aligned before, it still is */
+        mbi->vbe_mode_info = obd;
+        tb_memcpy((void *)obd,
+                  &vbe->vbe_mode_info.external_specification[0], 256);
+        obd += 256;
+        mbi->flags |= MBI_VBE;
     }
+
     /* all good--point g_ldr_ctx addr to new, fix type */
-    g_ldr_ctx->addr = (void *)&mbi;
+    g_ldr_ctx->addr = (void *)mbi;
     g_ldr_ctx->type = MB1_ONLY;
     return true;
 }
@@ -1363,6 +1744,7 @@ bool launch_kernel(bool is_measured_launch)
 
     void *kernel_entry_point;
     uint32_t mb_type = MB_NONE;
+    bool downrev_to_mb1 = false;
     struct tpm_if *tpm = get_tpm();
 
     if (g_tpm_family != TPM_IF_20_CRB ) {
@@ -1396,6 +1778,10 @@ bool launch_kernel(bool is_measured_launch)
     /* remove all SINIT and LCP modules since kernel may not handle */
     remove_txt_modules(g_ldr_ctx);
 
+    /* gzip-compressed kernel/modules (already done for a measured launch) */
+    if ( !decompress_modules(g_ldr_ctx) )
+        return false;
+
     module_t *m = get_module(g_ldr_ctx,0);
 
     void *kernel_image = (void *)m->mod_start;
@@ -1415,11 +1801,11 @@ bool launch_kernel(bool is_measured_launch)
             }
             /* if we got MB2 and they want MB1 and this is trad BIOS,
              * we can downrev the MB data to MB1 and pass that along.
+             * that is done once the MB2 info is final, just before the
+             * jump, so nothing in between has to deal with both formats.
              */
-            if (g_ldr_ctx->type == MB2_ONLY){
-                if (false == convert_mb2_to_mb1())
-                    return false;
-            }
+            if (g_ldr_ctx->type == MB2_ONLY)
+                downrev_to_mb1 = true;
             break;
         case MB2_ONLY:
             /* if we got MB1, we need to die here */
@@ -1438,12 +1824,10 @@ bool launch_kernel(bool is_measured_launch)
             return false;
         }
         
-        /* fix for GRUB2, which may load modules into memory before tboot */
-        move_modules(g_ldr_ctx);
-
-        /* move modules out of the way (to top og memory below 4G) */
-        printk(TBOOT_INFO"move modules to high memory\n");
-        if(!move_modules_to_high_memory(g_ldr_ctx))
+        /* move whatever is in the way of the kernel or tboot, e.g. GRUB2
+         * may load modules into memory before tboot
+         */
+        if ( !relocate_modules(g_ldr_ctx, (elf_header_t *)kernel_image) )
             return false;
     }
     else {
@@ -1464,8 +1848,7 @@ bool launch_kernel(bool is_measured_launch)
                                &kernel_entry_point) )
             return false;
 
-        /* move modules on top of expanded kernel */
-        if(!move_modules_above_elf_kernel(g_ldr_ctx, (elf_header_t *)kernel_image))
+        if ( downrev_to_mb1 && !convert_mb2_to_mb1() )
             return false;
 
         printk(TBOOT_INFO"transfering control to kernel @%p...\n", 
@@ -1660,16 +2043,9 @@ unsigned int get_module_count(loader_ctx *lctx)
         return(((multiboot_info_t *) lctx->addr)->mods_count);
     } else {
         /* currently must be type 2 */
-        struct mb2_tag *start = (struct mb2_tag *)(lctx->addr + 8);
-        unsigned int count = 0;
-        start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
-        while (start != NULL){
-            count++;
-            /* nudge off this guy */
-            start = next_mb2_tag(start);
-            start = find_mb2_tag_type(start, MB2_TAG_TYPE_MODULE);
-        }
-        return count;
+        if (!lctx->mod_index_valid)
+            index_mb2_modules(lctx);
+        return lctx->mod_count;
     }
 }
 
@@ -1748,6 +2124,54 @@ get_loader_ctx_end(loader_ctx *lctx)
     }
 }
 
+/*
+ * use the ACM catalog module (if there is one) to go straight to the ACM of
+ * one of the types in type_mask for this platform; anything it finds is
+ * still checked, and callers fall back to checking every module if not
+ */
+static bool
+find_catalog_acm(loader_ctx *lctx, uint32_t type_mask, void **base,
+                 uint32_t *size)
+{
+    void *catalog = NULL;
+    size_t catalog_size = 0;
+    const acm_catalog_acm_t *id;
+    uint32_t pos = 0;
+
+    if ( !find_module_by_file_signature(lctx, &catalog, &catalog_size,
+                                        ACM_CATALOG_SIGNATURE) )
+        return false;
+    if ( !is_acm_catalog(catalog, catalog_size) )
+        return false;
+
+    while ( (id = next_acm_catalog_match(catalog, type_mask, &pos)) != NULL ) {
+        for ( unsigned int i = get_module_count(lctx) - 1; i > 0; i-- ) {
+            module_t *m = get_module(lctx, i);
+            void *base2 = (void *)m->mod_start;
+            uint32_t size2 = m->mod_end - (unsigned long)(base2);
+
+            if ( !is_acm_catalog_entry(id, base2, size2) )
+                continue;
+            if ( id->chipset_acm_type == ACM_CHIPSET_TYPE_SINIT ?
+                 !is_sinit_acmod(base2, size2, false) :
+                 !is_racm_acmod(base2, size2, false) )
+                continue;
+            if ( !does_acmod_match_platform((acm_hdr_t *)base2) )
+                continue;
+
+            printk(TBOOT_INFO"ACM catalog: using module #%u (date 0x%08x)\n",
+                   i, id->date);
+            *base = base2;
+            *size = size2;
+            return true;
+        }
+    }
+
+    printk(TBOOT_INFO"ACM catalog has no ACM for this platform, "
+           "checking all modules\n");
+    return false;
+}
+
 /*
  * will go through all modules to find an RACM that matches the platform
  * (size can be NULL)
@@ -1765,13 +2189,25 @@ find_platform_racm(loader_ctx *lctx, void **base, uint32_t *size)
         return false;
     }
 
+    void *base2;
+    uint32_t size2;
+    if ( find_catalog_acm(lctx, ACM_CATALOG_TYPE(ACM_CHIPSET_TYPE_BIOS_REVOC) |
+                                ACM_CATALOG_TYPE(ACM_CHIPSET_TYPE_SINIT_REVOC),
+                          &base2, &size2) ) {
+        if ( base != NULL )
+            *base = base2;
+        if ( size != NULL )
+            *size = size2;
+        return true;
+    }
+
     for ( int i = get_module_count(lctx) - 1; i >= 0; i-- ) {
         module_t *m = get_module(lctx, i);
         printk(TBOOT_DETA
                "checking if module %s is an RACM for this platform...\n",
                get_module_cmd(lctx, m));
-        void *base2 = (void *)m->mod_start;
-        uint32_t size2 = m->mod_end - (unsigned long)(base2);
+        base2 = (void *)m->mod_start;
+        size2 = m->mod_end - (unsigned long)(base2);
         if ( is_racm_acmod(base2, size2, false) &&
              does_acmod_match_platform((acm_hdr_t *)base2) ) {
             if ( base != NULL )
@@ -1804,6 +2240,17 @@ find_platform_sinit_module(loader_ctx *lctx, void **base, uint32_t *size)
         return false;
     }
 
+    void *base2;
+    uint32_t size2;
+    if ( find_catalog_acm(lctx, ACM_CATALOG_TYPE(ACM_CHIPSET_TYPE_SINIT),
+                          &base2, &size2) ) {
+        if ( base != NULL )
+            *base = base2;
+        if ( size != NULL )
+            *size = size2;
+        return true;
+    }
+
     for ( unsigned int i = get_module_count(lctx) - 1; i > 0; i-- ) {
         module_t *m = get_module(lctx, i);
         if (lctx->type == 1)
@@ -1815,8 +2262,8 @@ find_platform_sinit_module(loader_ctx *lctx, void **base, uint32_t *size)
                    "checking if module %s is an SINIT for this platform...\n",
                    (const char *)&(m->string));
 
-        void *base2 = (void *)m->mod_start;
-        uint32_t size2 = m->mod_end - (unsigned long)(base2);
+        base2 = (void *)m->mod_start;
+        size2 = m->mod_end - (unsigned long)(base2);
         if ( is_sinit_acmod(base2, size2, false) &&
              does_acmod_match_platform((acm_hdr_t *)base2) ) {
             if ( base != NULL )
@@ -2067,6 +2514,7 @@ void determine_loader_type(void *addr, uint32_t magic)
     if (g_ldr_ctx->addr == NULL){
         /* brave new world */
         g_ldr_ctx->addr = addr;  /* save for post launch */
+        g_ldr_ctx->mod_index_valid = false;
         switch (magic){
         case MB_MAGIC:
             g_ldr_ctx->type = MB1_ONLY;
@@ -77,6 +77,9 @@
 * marcus.geelnard at home.se
 *************************************************************************/
 
+#ifndef IS_INCLUDED
+#include <lz.h>
+#endif
 
 /*************************************************************************
 * Constants used for LZ77 coding
@@ -172,6 +175,32 @@ static int _LZ_ReadVarSize( unsigned int * x, char * buf )
 }
 
 
+/*************************************************************************
+* _LZ_ReadVarSizeBounded() - Same as _LZ_ReadVarSize(), but reads no more
+* than size bytes. Returns 0 if the value does not end within them.
+*************************************************************************/
+
+static unsigned int _LZ_ReadVarSizeBounded( unsigned int * x, char * buf,
+                                            unsigned int size )
+{
+    unsigned int y, b, num_bytes;
+
+    y = 0;
+    num_bytes = 0;
+    do
+    {
+        if( num_bytes == size )
+            return 0;
+        b = (unsigned int) buf[ num_bytes ++ ];
+        y = (y << 7) | (b & 0x0000007f);
+    }
+    while( b & 0x00000080 );
+
+    *x = y;
+    return num_bytes;
+}
+
+
 
 /*************************************************************************
 *                            PUBLIC FUNCTIONS                            *
@@ -393,3 +422,100 @@ int LZ_Uncompress( char *in, char *out, unsigned int insize, unsigned int outsiz
 
     return outpos;
 }
+
+
+/*************************************************************************
+* LZ_UncompressStream() - Uncompress a block of data using an LZ77
+* decoder, passing the output to a writer as it is produced. Only the
+* history window needed for back references is kept, so the size of the
+* uncompressed data is not limited.
+*  in      - Input (compressed) buffer.
+*  insize  - Number of input bytes.
+*  outsize - Largest uncompressed size to accept, a guard against
+*            corrupt input rather than a buffer size.
+*  writer  - Called with each run of uncompressed data.
+*  ctx     - Passed to writer.
+* The function returns the size of the uncompressed data or (-1) if the
+* input is corrupt or would uncompress to more than outsize bytes.
+*************************************************************************/
+
+/* Power of two no smaller than LZ_MAX_OFFSET */
+#define LZ_WINDOW_SIZE 8192
+
+int LZ_UncompressStream( char *in, unsigned int insize, unsigned int outsize,
+                         LZ_Writer writer, void *ctx )
+{
+    char window[ LZ_WINDOW_SIZE ];
+    char marker, symbol;
+    unsigned int  i, inpos, outpos, flushed, length, offset, n;
+
+    /* Do we have anything to uncompress? */
+    if( insize < 1 )
+    {
+        return -1;
+    }
+
+    /* Get marker symbol from input stream */
+    marker = in[ 0 ];
+    inpos = 1;
+
+    /* Main decompression loop */
+    outpos = 0;
+    flushed = 0;
+    while( inpos < insize )
+    {
+        symbol = in[ inpos ++ ];
+        length = 1;
+        offset = 0;
+        if( symbol == marker )
+        {
+            if( inpos >= insize )
+                return -1;
+            if( in[ inpos ] == 0 )
+            {
+                /* It was a single occurrence of the marker byte */
+                ++ inpos;
+            }
+            else
+            {
+                /* Extract true length and offset, which must both end
+                   within the input */
+                n = _LZ_ReadVarSizeBounded( &length, &in[ inpos ],
+                                            insize - inpos );
+                if( n == 0 )
+                    return -1;
+                inpos += n;
+                n = _LZ_ReadVarSizeBounded( &offset, &in[ inpos ],
+                                            insize - inpos );
+                if( n == 0 )
+                    return -1;
+                inpos += n;
+                if( offset == 0 || offset > LZ_MAX_OFFSET || offset > outpos )
+                    return -1;
+            }
+        }
+        if( length > outsize - outpos )
+            return -1;
+
+        for( i = 0; i < length; ++ i )
+        {
+            /* Copy from history window, or the literal symbol */
+            if( offset != 0 )
+                symbol = window[ (outpos - offset) & (LZ_WINDOW_SIZE - 1) ];
+            window[ outpos & (LZ_WINDOW_SIZE - 1) ] = symbol;
+            ++ outpos;
+
+            /* Hand over the window each time it fills up */
+            if( outpos - flushed == LZ_WINDOW_SIZE )
+            {
+                writer( window, LZ_WINDOW_SIZE, ctx );
+                flushed = outpos;
+            }
+        }
+    }
+
+    if( outpos != flushed )
+        writer( window, outpos - flushed, ctx );
+
+    return outpos;
+}
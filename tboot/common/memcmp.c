@@ -36,24 +36,54 @@
  */
 #include <string.h>
 
+typedef uint32_t word;
+#define wsize	sizeof(word)
+
 /*
  * Compare memory regions.
+ *
+ * Compares a word at a time (x86 is fine with unaligned loads) and only
+ * falls back to bytes to find the first difference, so the sign of the
+ * result is the same as for the byte-wise loop.
  */
 int tb_memcmp(const void *s1, const void *s2, size_t n)
 {
+	const unsigned char *p1 = s1, *p2 = s2;
+
 	if (s1 == NULL || s2 == NULL)
 		return (-1);
 
 	if (s1 == s2)
 		return (0);
 
-	if (n != 0) {
-		const unsigned char *p1 = s1, *p2 = s2;
-
-		do {
-			if (*p1++ != *p2++)
-				return (*--p1 - *--p2);
-		} while (--n != 0);
+	for (; n >= wsize; n -= wsize, p1 += wsize, p2 += wsize) {
+		if (*(const word *)p1 != *(const word *)p2)
+			break;
+	}
+	for (; n != 0; n--, p1++, p2++) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
 	}
 	return (0);
 }
+
+/*
+ * Compare memory regions in time that only depends on n, for use on
+ * secrets (MACs, unsealed hashes) where an early exit would leak how
+ * many leading bytes matched.  Returns non-zero if the regions are equal
+ * and 0 if they differ, as NetBSD's consttime_memequal().
+ */
+int tb_consttime_memequal(const void *s1, const void *s2, size_t n)
+{
+	const volatile unsigned char *p1 = s1, *p2 = s2;
+	unsigned int res = 0;
+
+	if (s1 == NULL || s2 == NULL)
+		return (0);
+
+	while (n-- != 0)
+		res |= *p1++ ^ *p2++;
+
+	/* map 0 to 1 and 1..255 to 0 without a data dependent branch */
+	return (1 & ((res - 1) >> 8));
+}
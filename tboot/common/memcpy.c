@@ -32,7 +32,11 @@
 
 /* $FreeBSD: src/sys/powerpc/powerpc/bcopy.c,v 1.5.24.1 2010/02/10 00:26:20 kensmith Exp $ */
 
+#include <stdbool.h>
+#include <types.h>
+#include <compiler.h>
 #include <string.h>
+#include <processor.h>
 
 /*
  * sizeof(word) MUST BE A POWER OF TWO
@@ -48,7 +52,7 @@ typedef	int	word;		/* "word" used for optimal copy speed */
  * This is the routine that actually implements
  * (the portable versions of) bcopy, memcpy, and memmove.
  */
-void *tb_memcpy(void *dst0, const void *src0, size_t length)
+static void bcopy_words(void *dst0, const void *src0, size_t length)
 {
 	char		*dst;
 	const char	*src;
@@ -57,12 +61,6 @@ void *tb_memcpy(void *dst0, const void *src0, size_t length)
 	dst = dst0;
 	src = src0;
 
-	if (dst0 == NULL || src0 == NULL)
-		return NULL;
-	if (length == 0 || dst == src) {	/* nothing to do */
-		goto done;
-	}
-
 	/*
 	 * Macros: loop-t-times; and loop-t-times, t>0
 	 */
@@ -123,6 +121,147 @@ void *tb_memcpy(void *dst0, const void *src0, size_t length)
 		t = length & wmask;
 		TLOOP(*--dst = *--src);
 	}
-done:
+}
+
+/*
+ * Large copies (modules, kernels, SINIT) dominate the time tboot spends
+ * copying, so non-overlapping copies are tiered by size:
+ *  - below COPY_SMALL_MAX bytes, the word loop above;
+ *  - up to the last level cache size, rep movsb if the CPU has enhanced
+ *    (ERMS) or fast short (FSRM) rep movsb;
+ *  - beyond that, movnti streaming stores, which don't pull the
+ *    destination into (and evict everything else from) the cache.
+ * movnti only uses general purpose registers, so unlike the SSE/AVX
+ * streaming moves it works without tboot enabling XMM state.
+ */
+#define COPY_SMALL_MAX		512
+#define COPY_NT_DEFAULT		(4 * 1024 * 1024)
+
+#define CPUID_1_EDX_SSE2	(1 << 26)
+#define CPUID_7_EBX_ERMS	(1 << 9)
+#define CPUID_7_EDX_FSRM	(1 << 4)
+
+static bool	copy_probed;
+static bool	copy_rep_movsb;
+static bool	copy_movnti;
+static size_t	copy_nt_threshold;
+
+/* size of the largest cache reported by CPUID leaf 4, or 0 */
+static size_t get_llc_size(void)
+{
+	uint32_t regs[4];
+	size_t llc = 0;
+
+	for (unsigned int i = 0; i < 16; i++) {
+		size_t size;
+
+		do_cpuid1(4, i, regs);
+		if ((regs[0] & 0x1f) == 0)	/* no more caches */
+			break;
+		size = ((regs[1] >> 22) + 1) *		/* ways */
+		    (((regs[1] >> 12) & 0x3ff) + 1) *	/* partitions */
+		    ((regs[1] & 0xfff) + 1) *		/* line size */
+		    (regs[2] + 1);			/* sets */
+		if (size > llc)
+			llc = size;
+	}
+	return (llc);
+}
+
+static void probe_copy_features(void)
+{
+	uint32_t regs[4];
+	uint32_t max_leaf = cpuid_eax(0);
+
+	copy_nt_threshold = COPY_NT_DEFAULT;
+	if (max_leaf >= 1)
+		copy_movnti = (cpuid_edx(1) & CPUID_1_EDX_SSE2) != 0;
+	if (max_leaf >= 4) {
+		size_t llc = get_llc_size();
+		if (llc != 0)
+			copy_nt_threshold = llc;
+	}
+	if (max_leaf >= 7) {
+		do_cpuid1(7, 0, regs);
+		copy_rep_movsb = (regs[1] & CPUID_7_EBX_ERMS) ||
+		    (regs[3] & CPUID_7_EDX_FSRM);
+	}
+	copy_probed = true;
+}
+
+static void copy_rep_movsb_fwd(void *dst, const void *src, size_t length)
+{
+	__asm__ __volatile__ ("cld; rep movsb"
+			      : "+D" (dst), "+S" (src), "+c" (length)
+			      :
+			      : "memory");
+}
+
+static void copy_movnti_fwd(void *dst0, const void *src0, size_t length)
+{
+	char		*dst = dst0;
+	const char	*src = src0;
+	size_t		t;
+
+	/* align the destination so no streaming store splits a line */
+	t = (64 - ((unsigned long)dst & 63)) & 63;
+	if (t != 0) {
+		bcopy_words(dst, src, t);
+		dst += t;
+		src += t;
+		length -= t;
+	}
+
+	for (t = length / 64; t != 0; t--) {
+		const word *s = (const word *)src;
+		word *d = (word *)dst;
+
+		for (unsigned int i = 0; i < 64 / wsize; i += 4) {
+			word w0 = s[i], w1 = s[i + 1], w2 = s[i + 2],
+			    w3 = s[i + 3];
+			__asm__ __volatile__ (
+			    "movnti %4, %0; movnti %5, %1;"
+			    "movnti %6, %2; movnti %7, %3"
+			    : "=m" (d[i]), "=m" (d[i + 1]), "=m" (d[i + 2]),
+			      "=m" (d[i + 3])
+			    : "r" (w0), "r" (w1), "r" (w2), "r" (w3));
+		}
+		src += 64;
+		dst += 64;
+	}
+	/* streaming stores are weakly ordered */
+	__asm__ __volatile__ ("sfence" : : : "memory");
+
+	if (length & 63)
+		bcopy_words(dst, src, length & 63);
+}
+
+void *tb_memcpy(void *dst0, const void *src0, size_t length)
+{
+	unsigned long dst = (unsigned long)dst0;
+	unsigned long src = (unsigned long)src0;
+
+	if (dst0 == NULL || src0 == NULL)
+		return NULL;
+	if (length == 0 || dst == src)		/* nothing to do */
+		return (dst0);
+
+	/* overlapping copies keep the (direction aware) word loop */
+	if (length < COPY_SMALL_MAX ||
+	    (dst > src && dst - src < length) ||
+	    (src > dst && src - dst < length)) {
+		bcopy_words(dst0, src0, length);
+		return (dst0);
+	}
+
+	if (!copy_probed)
+		probe_copy_features();
+
+	if (copy_movnti && length >= copy_nt_threshold)
+		copy_movnti_fwd(dst0, src0, length);
+	else if (copy_rep_movsb)
+		copy_rep_movsb_fwd(dst0, src0, length);
+	else
+		bcopy_words(dst0, src0, length);
 	return (dst0);
 }
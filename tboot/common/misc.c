@@ -136,6 +136,44 @@ void delay(int millisecs)
     }
 }
 
+/*
+ * TSC-based deadlines for polling loops: a deadline is the TSC value after
+ * which the wait is considered to have timed out
+ */
+uint64_t tsc_deadline(uint32_t millisecs)
+{
+    calibrate_tsc();
+
+    return rdtsc() + (uint64_t)millisecs * g_ticks_per_millisec;
+}
+
+bool tsc_expired(uint64_t deadline)
+{
+    return rdtsc() > deadline;
+}
+
+/* returns ~0 if the microseconds don't fit in 32 bits (over an hour) */
+uint32_t tsc_to_microsecs(uint64_t ticks)
+{
+    uint32_t high = ticks >> 32, low = (uint32_t)ticks, us, rem;
+
+    calibrate_tsc();
+
+    uint32_t ticks_per_microsec = (uint32_t)g_ticks_per_millisec / 1000;
+    if ( ticks_per_microsec == 0 )
+        ticks_per_microsec = 1;
+    if ( high >= ticks_per_microsec )
+        return 0xffffffff;
+
+    /* the quotient fits in 32 bits, so one divl does the 64-bit division
+       (and avoids needing __udivdi3) */
+    __asm__ __volatile__ ( "divl %4;"
+                           : "=a"(us), "=d"(rem)
+                           : "a"(low), "d"(high), "r"(ticks_per_microsec));
+    (void)rem;
+    return us;
+}
+
 /* used by isXXX() in ctype.h */
 /* originally from:
  * http://fxr.watson.org/fxr/source/dist/acpica/utclib.c?v=NETBSD5
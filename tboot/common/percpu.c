@@ -0,0 +1,137 @@
+/*
+ * percpu.c: per-CPU data (AP stacks and VMCS regions) sized for the
+ *           platform at launch
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include <types.h>
+#include <stdbool.h>
+#include <compiler.h>
+#include <string.h>
+#include <printk.h>
+#include <misc.h>
+#include <page.h>
+#include <processor.h>
+#include <uuid.h>
+#include <loader.h>
+#include <e820.h>
+#include <tboot.h>
+#include <mle.h>
+#include <hash.h>
+#include <acpi.h>
+#include <percpu.h>
+#include <txt/config_regs.h>
+#include <txt/mtrrs.h>
+#include <txt/heap.h>
+
+extern long s3_flag;
+
+/*
+ * The per-CPU area follows tboot's image and is part of tboot's memory
+ * (see get_tboot_mem_end()), so it gets the same treatment: modules are
+ * moved out of it and it is protected in the e820 table and by the PMRs.
+ * It holds one VMCS page per CPU followed by the AP stacks, which grow
+ * down from the end of the area.  CPUs are indexed by (x2)APIC ID.
+ *
+ * bss is cleared on every entry to tboot, so this is sized both before the
+ * measured launch (to make room for it) and again after (to use it).
+ */
+
+/* used by the AP entry code in boot.S and shutdown.S */
+uint32_t g_nr_cpu_slots;
+unsigned long g_ap_stacks;
+
+static unsigned long g_percpu_base;
+
+bool percpu_init(void)
+{
+    txt_heap_t *txt_heap = get_txt_heap();
+    bios_data_t *bios_data = get_bios_data_start(txt_heap);
+    uint64_t nr_slots, base, size;
+    uint32_t max_id;
+
+    /* APIC IDs need not be dense, so size for the highest one */
+    nr_slots = bios_data->num_logical_procs;
+    if ( get_madt_max_apic_id(&max_id) && max_id >= nr_slots )
+        nr_slots = (uint64_t)max_id + 1;
+
+    base = PAGE_UP((unsigned long)&_end);
+    size = nr_slots * (PAGE_SIZE + AP_STACK_SIZE);
+    if ( base + size > 0x100000000ULL ) {
+        printk(TBOOT_ERR"no room for per-CPU data of %Lu CPUs\n", nr_slots);
+        return false;
+    }
+
+    /* after S3 it is already reserved, as part of tboot */
+    if ( !s3_flag && e820_check_region(base, size) != E820_RAM ) {
+        printk(TBOOT_ERR"per-CPU data (%Lx - %Lx) is not in RAM\n",
+               base, base + size - 1);
+        return false;
+    }
+
+    g_percpu_base = base;
+    g_nr_cpu_slots = nr_slots;
+    g_ap_stacks = base + size;
+
+    printk(TBOOT_DETA"per-CPU data for %u CPUs at %Lx - %Lx\n",
+           g_nr_cpu_slots, base, base + size - 1);
+    return true;
+}
+
+unsigned int get_nr_cpu_slots(void)
+{
+    return g_nr_cpu_slots;
+}
+
+/* end of the per-CPU area, or 0 if it hasn't been sized yet */
+unsigned long get_percpu_end(void)
+{
+    return g_ap_stacks;
+}
+
+void *get_ap_vmcs(unsigned int cpuid)
+{
+    return (void *)(g_percpu_base + cpuid * PAGE_SIZE);
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
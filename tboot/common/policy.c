@@ -53,6 +53,7 @@
 #include <tboot.h>
 #include <integrity.h>
 #include <tpm.h>
+#include <sha1.h>
 #include <tb_policy.h>
 #include <lcp3.h>
 #include <lcp3_hlp.h>
@@ -70,6 +71,14 @@ extern tboot_shared_t _tboot_shared;
 
 extern long s3_flag;
 
+/* digests the loader took while relocating modules (in loader.c) */
+extern bool find_module_digest(loader_ctx *lctx, const void *base,
+                               size_t size, uint16_t hash_alg,
+                               tb_hash_t *hash);
+extern bool find_module_compressed_digest(loader_ctx *lctx, const void *base,
+                                          size_t size, uint16_t hash_alg,
+                                          tb_hash_t *hash);
+
 /*
  * policy actions
  */
@@ -126,10 +135,11 @@ static const tb_policy_map_t g_policy_map[] = {
     },
 };
 
-/* buffer for policy as read from TPM NV */
-#define MAX_POLICY_SIZE                             \
-    (( MAX_TB_POLICY_SIZE > sizeof(lcp_policy_t) )  \
-        ? MAX_TB_POLICY_SIZE                        \
+/* buffer for policy as read from TPM NV or unwrapped from LCP policy data
+   (which is where large version 3 policies will come from) */
+#define MAX_POLICY_SIZE                                 \
+    (( MAX_TB_POLICY_V3_SIZE > sizeof(lcp_policy_t) )   \
+        ? MAX_TB_POLICY_V3_SIZE                         \
         : sizeof(lcp_policy_t) )
 static uint8_t _policy_index_buf[MAX_POLICY_SIZE];
 
@@ -196,28 +206,39 @@ static const tb_policy_t _def_policy_da = {
 /* current policy */
 static const tb_policy_t* g_policy = &_def_policy;
 
+/*
+ * index of g_policy, built once when it is first used so that looking up an
+ * entry doesn't have to walk the variable-size entries before it
+ */
+static const tb_policy_t *g_indexed_policy;
+static const tb_policy_entry_t *g_pol_entries[256];
+/* first entry that applies to each module number (index + 1, 0 = none) */
+static uint8_t g_pol_mod_entries[TB_POL_MAX_MOD_NUM + 1];
+static uint8_t g_pol_any_entry;
+/* NV entries, in policy order */
+static uint8_t g_pol_nv_entries[256];
+static unsigned int g_nr_pol_nv_entries;
+
 /*
  * read_policy_from_tpm
  *
- * read policy from TPM NV into buffer
+ * read policy from TPM NV into buffer, in the largest chunks the TPM allows
  *
  * policy_index_size is in/out
  */
 static bool read_policy_from_tpm(uint32_t index, void* policy_index, size_t *policy_index_size)
 {
-#define NV_READ_SEG_SIZE    256
     unsigned int offset = 0;
     unsigned int data_size = 0;
     uint32_t ret, index_size;
     struct tpm_if *tpm = get_tpm();
-    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
 
     if ( policy_index_size == NULL ) {
         printk(TBOOT_ERR"size is NULL\n");
         return false;
     }
 
-    ret = tpm_fp->get_nvindex_size(tpm, tpm->cur_loc, index, &index_size);
+    ret = tpm_get_nvindex_size(tpm, tpm->cur_loc, index, &index_size);
     if ( !ret )
         return false;
 
@@ -229,14 +250,14 @@ static bool read_policy_from_tpm(uint32_t index, void* policy_index, size_t *pol
 
     do {
         /* get data_size */
-        if ( (index_size - offset) > NV_READ_SEG_SIZE )
-            data_size = NV_READ_SEG_SIZE;
+        if ( (index_size - offset) > tpm->nv_buf_max )
+            data_size = tpm->nv_buf_max;
         else
             data_size = (uint32_t)(index_size - offset);
 
         /* read! */
-        ret = tpm_fp->nv_read(tpm, tpm->cur_loc, index, offset,
-                             (uint8_t *)policy_index + offset, &data_size);
+        ret = tpm_nv_read(tpm, tpm->cur_loc, index, offset,
+                          (uint8_t *)policy_index + offset, &data_size);
         if ( !ret || data_size == 0 )
             break;
 
@@ -257,10 +278,11 @@ static bool read_policy_from_tpm(uint32_t index, void* policy_index, size_t *pol
 /*
  * unwrap_lcp_policy
  *
- * unwrap custom element in lcp policy into tb policy
+ * unwrap custom element in lcp policy into tb policy, returning the size
+ * of what was copied in *policy_size
  * assume sinit has already verified lcp policy and lcp policy data.
  */
-static bool unwrap_lcp_policy(void)
+static bool unwrap_lcp_policy(size_t *policy_size)
 {
     void* lcp_base;
     uint32_t lcp_size;
@@ -301,8 +323,16 @@ static bool unwrap_lcp_policy(void)
                     /* check uuid in custom element */
                     if ( are_uuids_equal(&custom->uuid,
                              &((uuid_t)LCP_CUSTOM_ELEMENT_TBOOT_UUID)) ) {
-                        tb_memcpy(_policy_index_buf, &custom->data,
-                            elt->size - sizeof(*elt) - sizeof(uuid_t));
+                        uint32_t data_size = elt->size - sizeof(*elt) -
+                                             sizeof(uuid_t);
+                        if ( elt->size < sizeof(*elt) + sizeof(uuid_t) ||
+                             data_size > sizeof(_policy_index_buf) ) {
+                            printk(TBOOT_ERR"tboot policy in LCP custom "
+                                   "element is too big (%u)\n", elt->size);
+                            return false;
+                        }
+                        tb_memcpy(_policy_index_buf, &custom->data, data_size);
+                        *policy_size = data_size;
                         return true; /* find tb policy */
                     }
                 }
@@ -324,6 +354,65 @@ static bool unwrap_lcp_policy(void)
     return false;
 }
 
+/*
+ * index_policy
+ *
+ * record where each entry of the (validated) g_policy starts and which
+ * entries apply to each module and NV index, in one pass over the policy
+ */
+static void index_policy(void)
+{
+    const tb_policy_entry_t *pol_entry = g_policy->entries;
+
+    tb_memset(g_pol_mod_entries, 0, sizeof(g_pol_mod_entries));
+    g_pol_any_entry = 0;
+    g_nr_pol_nv_entries = 0;
+
+    for ( int i = 0; i < g_policy->num_entries; i++ ) {
+        uint8_t mod_num = pol_entry->mod_num;
+
+        g_pol_entries[i] = pol_entry;
+        if ( mod_num <= TB_POL_MAX_MOD_NUM ) {
+            if ( g_pol_mod_entries[mod_num] == 0 )
+                g_pol_mod_entries[mod_num] = i + 1;
+        }
+        else if ( mod_num == TB_POL_MOD_NUM_ANY ) {
+            if ( g_pol_any_entry == 0 )
+                g_pol_any_entry = i + 1;
+        }
+        else if ( mod_num == TB_POL_MOD_NUM_NV ||
+                  mod_num == TB_POL_MOD_NUM_NV_RAW )
+            g_pol_nv_entries[g_nr_pol_nv_entries++] = i;
+
+        pol_entry = (void *)pol_entry + calc_policy_entry_size(g_policy, pol_entry);
+    }
+
+    g_indexed_policy = g_policy;
+}
+
+/*
+ * find_module_policy_entry
+ *
+ * same as find_policy_entry(g_policy, mod_num): the first entry for the
+ * module or for any module, whichever comes first
+ */
+static tb_policy_entry_t *find_module_policy_entry(unsigned int mod_num)
+{
+    unsigned int idx = 0;
+
+    if ( g_indexed_policy != g_policy )
+        index_policy();
+
+    if ( mod_num <= TB_POL_MAX_MOD_NUM )
+        idx = g_pol_mod_entries[mod_num];
+    if ( g_pol_any_entry != 0 && (idx == 0 || g_pol_any_entry < idx) )
+        idx = g_pol_any_entry;
+    if ( idx == 0 )
+        return NULL;
+
+    return (tb_policy_entry_t *)g_pol_entries[idx - 1];
+}
+
 /*
  * set_policy
  *
@@ -353,24 +442,27 @@ tb_error_t set_policy(void)
      * type is LCP_POLTYPE_LIST (since we could have been give a policy data
      * file even though the policy was not a LIST */
     printk(TBOOT_INFO"reading Launch Control Policy from TPM NV...\n");
+    policy_index_size = sizeof(_policy_index_buf);
     if ( read_policy_from_tpm(tpm->lcp_own_index,
              _policy_index_buf, &policy_index_size) ) {
         printk(TBOOT_DETA"\t:%lu bytes read\n", policy_index_size);
         /* assume lcp policy has been verified by sinit already */
+        /* the tb policy is only as big as the custom element it came in;
+           verify_policy() rejects one whose entries run past that */
         lcp_policy_t *pol = (lcp_policy_t *)_policy_index_buf;
         if ( pol->version == LCP_DEFAULT_POLICY_VERSION_2 &&
-             pol->policy_type == LCP_POLTYPE_LIST && unwrap_lcp_policy() ) {
+             pol->policy_type == LCP_POLTYPE_LIST &&
+             unwrap_lcp_policy(&policy_index_size) ) {
             if ( verify_policy((tb_policy_t *)_policy_index_buf,
-                     calc_policy_size((tb_policy_t *)_policy_index_buf),
-                     true) )
+                     policy_index_size, true) )
                 goto policy_found;
         }
         lcp_policy_t2 *pol2 = (lcp_policy_t2 *)_policy_index_buf;
         if ( pol2->version == LCP_DEFAULT_POLICY_VERSION &&
-             pol2->policy_type == LCP_POLTYPE_LIST && unwrap_lcp_policy() ) {
+             pol2->policy_type == LCP_POLTYPE_LIST &&
+             unwrap_lcp_policy(&policy_index_size) ) {
             if ( verify_policy((tb_policy_t *)_policy_index_buf,
-                     calc_policy_size((tb_policy_t *)_policy_index_buf),
-                     true) )
+                     policy_index_size, true) )
                 goto policy_found;
         }
     }
@@ -384,8 +476,8 @@ tb_error_t set_policy(void)
     /* sanity check; but if it fails something is really wrong */
     if ( !verify_policy(g_policy, policy_index_size, true) )
         return TB_ERR_FATAL;
-    else
-        return TB_ERR_POLICY_NOT_PRESENT;
+    index_policy();
+    return TB_ERR_POLICY_NOT_PRESENT;
 
 policy_found:
     /* compatible with tb_policy tools for TPM 1.2 */
@@ -395,6 +487,7 @@ policy_found:
             tmp_policy->hash_alg = TB_HALG_SHA1;
     }
     g_policy = (tb_policy_t *)_policy_index_buf;
+    index_policy();
     return TB_ERR_NONE;
 }
 
@@ -410,6 +503,42 @@ bool hash_policy(tb_hash_t *hash, uint16_t hash_alg)
                        hash, hash_alg);
 }
 
+/*
+ * algorithms hash_module() hashes module images with in software, so the
+ * loader can compute them while it copies a module; 0 if the TPM hashes
+ * the images itself
+ */
+unsigned int get_module_hash_algs(uint16_t *algs, unsigned int max_algs)
+{
+    struct tpm_if *tpm = get_tpm();
+    unsigned int count = 0;
+
+    switch (tpm->extpol) {
+    case TB_EXTPOL_FIXED:
+        if ( max_algs > 0 )
+            algs[count++] = tpm->cur_alg;
+        break;
+    case TB_EXTPOL_EMBEDDED:
+        if ( tpm->alg_count > max_algs )
+            break;
+        for ( ; count < tpm->alg_count; count++ )
+            algs[count] = tpm->algs[count];
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+/* hash a module image, reusing the digest taken when it was relocated */
+static bool hash_module_image(void *base, size_t size, tb_hash_t *hash,
+                              uint16_t hash_alg)
+{
+    if ( find_module_digest(g_ldr_ctx, base, size, hash_alg, hash) )
+        return true;
+    return hash_buffer(base, size, hash, hash_alg);
+}
+
 /* generate hash by hashing cmdline and module image */
 static bool hash_module(hash_list_t *hl,
                         const char* cmdline, void *base,
@@ -444,7 +573,7 @@ static bool hash_module(hash_list_t *hl,
             return false;
         /* hash image and extend into cmdline hash */
         tb_hash_t img_hash;
-        if ( !hash_buffer(base, size, &img_hash, tpm->cur_alg) )
+        if ( !hash_module_image(base, size, &img_hash, tpm->cur_alg) )
             return false;
         if ( !extend_hash(&hl->entries[0].hash, &img_hash, tpm->cur_alg) )
             return false;
@@ -500,7 +629,7 @@ static bool hash_module(hash_list_t *hl,
                         &hl->entries[i].hash, tpm->algs[i]) )
                 return false;
 
-            if ( !hash_buffer(base, size, &img_hash, tpm->algs[i]) )
+            if ( !hash_module_image(base, size, &img_hash, tpm->algs[i]) )
                 return false;
             if ( !extend_hash(&hl->entries[i].hash, &img_hash, tpm->algs[i]) )
                 return false;
@@ -529,10 +658,42 @@ static bool is_hash_in_policy_entry(const tb_policy_entry_t *pol_entry,
     if ( pol_entry->hash_type == TB_HTYPE_ANY )
         return true;
     else if ( pol_entry->hash_type == TB_HTYPE_IMAGE ) {
-        for ( int i = 0; i < pol_entry->num_hashes; i++ ) {
-            if ( are_hashes_equal(get_policy_entry_hash(pol_entry, hash_alg,
-                                                        i), hash, hash_alg) )
+        unsigned int num_hashes = get_policy_entry_num_hashes(g_policy,
+                                                              pol_entry);
+        size_t hash_size = get_hash_size(hash_alg);
+
+        if ( num_hashes == 0 )
+            return false;
+
+        /* version 3 hashes are sorted (verify_policy() checked), so binary
+           search them; the hashes are public, so the order compare is not a
+           timing concern, but the final match still uses the normal check */
+        if ( g_policy->version == TB_POLVER_SORTED ) {
+            unsigned int lo = 0, hi = num_hashes;
+
+            while ( lo < hi ) {
+                unsigned int mid = lo + (hi - lo) / 2;
+                const tb_hash_t *pol_hash = get_policy_entry_hash(g_policy,
+                                                                  pol_entry,
+                                                                  mid);
+                int cmp = compare_policy_hashes(pol_hash, hash, hash_size);
+
+                if ( cmp == 0 )
+                    return are_hashes_equal(pol_hash, hash, hash_alg);
+                if ( cmp < 0 )
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return false;
+        }
+
+        const tb_hash_t *pol_hash = get_policy_entry_hash(g_policy, pol_entry,
+                                                          0);
+        for ( unsigned int i = 0; i < num_hashes; i++ ) {
+            if ( are_hashes_equal(pol_hash, hash, hash_alg) )
                 return true;
+            pol_hash = (const void *)pol_hash + hash_size;
         }
     }
 
@@ -607,6 +768,37 @@ void apply_policy(tb_error_t error)
 #define VL_ENTRIES(i)    g_pre_k_s3_state.vl_entries[i]
 #define NUM_VL_ENTRIES   g_pre_k_s3_state.num_vl_entries
 
+/*
+ * a module tboot decompressed is measured as decompressed; the digest of
+ * the compressed image it came from is saved right after it, to the same
+ * PCR, so the log shows what the loader actually handed over as well
+ */
+static void save_compressed_hash(module_t *module, const hash_list_t *hl,
+                                 uint8_t pcr)
+{
+    void *base = (void *)module->mod_start;
+    size_t size = module->mod_end - module->mod_start;
+    hash_list_t zhl;
+
+    zhl.count = hl->count;
+    for ( unsigned int i = 0; i < hl->count; i++ ) {
+        zhl.entries[i].alg = hl->entries[i].alg;
+        if ( !find_module_compressed_digest(g_ldr_ctx, base, size,
+                                            zhl.entries[i].alg,
+                                            &zhl.entries[i].hash) )
+            return;
+    }
+
+    printk(TBOOT_DETA"\t compressed image: ");
+    print_hash(&zhl.entries[0].hash, zhl.entries[0].alg);
+    if ( NUM_VL_ENTRIES >= MAX_VL_HASHES ) {
+        printk(TBOOT_WARN"\t too many hashes to save\n");
+        return;
+    }
+    VL_ENTRIES(NUM_VL_ENTRIES).pcr = pcr;
+    VL_ENTRIES(NUM_VL_ENTRIES++).hl = zhl;
+}
+
 /*
  * verify modules against Verified Launch policy and save hash
  * if pol_entry is NULL, assume it is for module 0, which gets extended
@@ -660,6 +852,7 @@ static tb_error_t verify_module(module_t *module, tb_policy_entry_t *pol_entry,
                           (g_using_da ? 17 : 18) : pol_entry->pcr;
         VL_ENTRIES(NUM_VL_ENTRIES).pcr = pcr;
         VL_ENTRIES(NUM_VL_ENTRIES++).hl = hl;
+        save_compressed_hash(module, &hl, pcr);
     }
 
     if ( tpm->extpol != TB_EXTPOL_FIXED )
@@ -757,7 +950,7 @@ void verify_all_modules(loader_ctx *lctx)
     /* now verify each module and add its hash */
     for ( unsigned int i = 0; i < get_module_count(lctx); i++ ) {
         module_t *module = get_module(lctx, i);
-        tb_policy_entry_t *pol_entry = find_policy_entry(g_policy, i);
+        tb_policy_entry_t *pol_entry = find_module_policy_entry(i);
         if ( module == NULL ) {
             printk(TBOOT_ERR"missing module entry %u\n", i);
             apply_policy(TB_ERR_MODULE_VERIFICATION_FAILED);
@@ -773,46 +966,41 @@ void verify_all_modules(loader_ctx *lctx)
     printk(TBOOT_INFO"all modules are verified\n");
 }
 
-static int find_first_nvpolicy_entry(const tb_policy_t *policy)
-{
-    if ( policy == NULL ) {
-        PRINT(TBOOT_ERR"Error: policy pointer is NULL\n");
-        return -1;
-    }
-
-    for ( int i = 0; i < policy->num_entries; i++ ) {
-        tb_policy_entry_t *pol_entry = get_policy_entry(policy, i);
-        if ( pol_entry == NULL )
-            return -1;
-
-        if ( pol_entry->mod_num == TB_POL_MOD_NUM_NV ||
-             pol_entry->mod_num == TB_POL_MOD_NUM_NV_RAW )
-            return i;
-    }
-
-    return -1;
-}
+static uint8_t nv_buf[4096];
 
-static int find_next_nvpolicy_entry(const tb_policy_t *policy, int i)
+/*
+ * hash_nv_index
+ *
+ * SHA-1 the whole content of an NV index; it is streamed through nv_buf one
+ * TPM read at a time, so the index can be larger than the buffer
+ */
+static bool hash_nv_index(uint32_t index, tb_hash_t *digest)
 {
-    if ( policy == NULL || i < 0 || i >= policy->num_entries )
-        return -1;
+    struct sha1_ctxt ctx;
+    uint32_t index_size, offset, data_size;
+    struct tpm_if *tpm = get_tpm();
+
+    if ( !tpm_get_nvindex_size(tpm, tpm->cur_loc, index, &index_size) )
+        return false;
 
-    for ( i++; i < policy->num_entries; i++ ) {
-        tb_policy_entry_t *pol_entry = get_policy_entry(policy, i);
-        if ( pol_entry == NULL )
-            return -1;
+    sha1_init(&ctx);
+    for ( offset = 0; offset < index_size; offset += data_size ) {
+        data_size = index_size - offset;
+        if ( data_size > tpm->nv_buf_max )
+            data_size = tpm->nv_buf_max;
+        if ( data_size > sizeof(nv_buf) )
+            data_size = sizeof(nv_buf);
 
-        if ( pol_entry->mod_num == TB_POL_MOD_NUM_NV ||
-             pol_entry->mod_num == TB_POL_MOD_NUM_NV_RAW )
-            return i;
+        if ( !tpm_nv_read(tpm, tpm->cur_loc, index, offset,
+                          nv_buf, &data_size) || data_size == 0 )
+            return false;
+        sha1_loop(&ctx, nv_buf, data_size);
     }
+    sha1_result(&ctx, digest->sha1);
 
-    return -1;
+    return true;
 }
 
-static uint8_t nv_buf[4096];
-
 static tb_error_t verify_nvindex(tb_policy_entry_t *pol_entry,
                                  uint16_t hash_alg)
 {
@@ -820,7 +1008,6 @@ static tb_error_t verify_nvindex(tb_policy_entry_t *pol_entry,
     tb_hash_t digest;
     uint32_t attribute;
     struct tpm_if *tpm = get_tpm();
-    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
 
     if ( pol_entry == NULL )
         return TB_ERR_NV_VERIFICATION_FAILED;
@@ -828,8 +1015,8 @@ static tb_error_t verify_nvindex(tb_policy_entry_t *pol_entry,
     printk(TBOOT_INFO"verifying nv index 0x%08X\n", pol_entry->nv_index);
 
     /* check nv attribute */
-    if ( !tpm_fp->get_nvindex_permission(tpm, 0, pol_entry->nv_index,
-                                                   &attribute) ) {
+    if ( !tpm_get_nvindex_permission(tpm, 0, pol_entry->nv_index,
+                                     &attribute) ) {
         printk(TBOOT_ERR"\t :reading nv index permission failed\n");
         return TB_ERR_NV_VERIFICATION_FAILED;
     }
@@ -838,25 +1025,23 @@ static tb_error_t verify_nvindex(tb_policy_entry_t *pol_entry,
         return TB_ERR_NV_VERIFICATION_FAILED;
     }
 
-    /* get nv content */
-    tb_memset(nv_buf, 0, sizeof(nv_buf));
-    if ( !read_policy_from_tpm(pol_entry->nv_index,
-                nv_buf, &nv_size) ) {
-        printk(TBOOT_ERR"\t :reading nv index 0x%08X failed\n",
-               pol_entry->nv_index);
-        return TB_ERR_NV_VERIFICATION_FAILED;
-    }
-
-    /* hash the buffer if needed */
+    /* get (and hash if needed) nv content */
     switch ( pol_entry->mod_num ) {
     case TB_POL_MOD_NUM_NV:
-        if ( !hash_buffer((const uint8_t*)nv_buf, nv_size, &digest,
-                          TB_HALG_SHA1) ) {
-            printk(TBOOT_ERR"\t :nv content hash failed\n");
+        if ( !hash_nv_index(pol_entry->nv_index, &digest) ) {
+            printk(TBOOT_ERR"\t :reading nv index 0x%08X failed\n",
+                   pol_entry->nv_index);
             return TB_ERR_NV_VERIFICATION_FAILED;
         }
         break;
     case TB_POL_MOD_NUM_NV_RAW:
+        tb_memset(nv_buf, 0, sizeof(nv_buf));
+        if ( !read_policy_from_tpm(pol_entry->nv_index,
+                    nv_buf, &nv_size) ) {
+            printk(TBOOT_ERR"\t :reading nv index 0x%08X failed\n",
+                   pol_entry->nv_index);
+            return TB_ERR_NV_VERIFICATION_FAILED;
+        }
         if ( nv_size != sizeof(digest.sha1) ) {
             printk(TBOOT_ERR"\t :raw nv with wrong size (%d), should be %d\n",
                    (int)nv_size, sizeof(digest.sha1));
@@ -895,11 +1080,13 @@ static tb_error_t verify_nvindex(tb_policy_entry_t *pol_entry,
 
 void verify_all_nvindices(void)
 {
+    if ( g_indexed_policy != g_policy )
+        index_policy();
+
     /* go through nv policies in tb policy */
-    for ( int i = find_first_nvpolicy_entry(g_policy);
-          i >= 0;
-          i = find_next_nvpolicy_entry(g_policy, i) ) {
-        tb_policy_entry_t *pol_entry = get_policy_entry(g_policy, i);
+    for ( unsigned int i = 0; i < g_nr_pol_nv_entries; i++ ) {
+        tb_policy_entry_t *pol_entry =
+            (tb_policy_entry_t *)g_pol_entries[g_pol_nv_entries[i]];
         apply_policy(verify_nvindex(pol_entry, g_policy->hash_alg));
     }
 }
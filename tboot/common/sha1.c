@@ -41,10 +41,12 @@
  * implemented by Jun-ichiro itojun Itoh <itojun@itojun.org>
  */
 
+#ifndef IS_INCLUDED
 #include <types.h>
 #include <compiler.h>
 #include <string.h>
 #include <sha1.h>
+#endif
 
 #define BIG_ENDIAN \
     (!(__x86_64__ || __i386__ || _M_IX86 || _M_X64 || __ARMEL__ || __MIPSEL__))
@@ -1,7 +1,9 @@
+#ifndef IS_INCLUDED
 #include <types.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sha256.h>
+#endif
 
 /* Various logical functions */
 #define RORc(x, y)      ( ((((unsigned long)(x)&0xFFFFFFFFUL)>>(unsigned long)((y)&31)) \
@@ -178,7 +178,7 @@ bool write_tb_error_code(tb_error_t error)
     if ( !tpm || !tpm_fp || no_err_idx )
         return false;
 
-    if ( !tpm_fp->nv_write(tpm, tpm->cur_loc, tpm->tb_err_index, 0,
+    if ( !tpm_nv_write(tpm, tpm->cur_loc, tpm->tb_err_index, 0,
 				      (uint8_t *)&error, sizeof(tb_error_t)) ) {
         printk(TBOOT_WARN"Error: write TPM error: 0x%x.\n", tpm->error);
         no_err_idx = true;
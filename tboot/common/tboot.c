@@ -70,6 +70,7 @@
 #include <integrity.h>
 #include <cmdline.h>
 #include <tpm_20.h>
+#include <percpu.h>
 
 extern void _prot_to_real(uint32_t dist_addr);
 extern bool set_policy(void);
@@ -78,8 +79,6 @@ extern void verify_all_nvindices(void);
 extern void apply_policy(tb_error_t error);
 extern void verify_IA32_se_svn_status(const acm_hdr_t *acm_hdr);
 void s3_launch(void);
-extern __data u32 handle2048;
-extern __data tpm_contextsave_out tpm2_context_saved;
 /* counter timeout for waiting for all APs to exit guests */
 #define AP_GUEST_EXIT_TIMEOUT     0x01000000
 
@@ -107,9 +106,12 @@ extern tboot_shared_t _tboot_shared;
  */
 static __data uint8_t g_saved_s3_wakeup_page[PAGE_SIZE];
 
+/* the per-CPU data follows the image, once it has been sized */
 unsigned long get_tboot_mem_end(void)
 {
-    return PAGE_UP((unsigned long)&_end);
+    unsigned long end = get_percpu_end();
+
+    return end != 0 ? end : PAGE_UP((unsigned long)&_end);
 }
 
 static tb_error_t verify_platform(void)
@@ -191,7 +193,7 @@ static void post_launch(void)
 
     /* verify that tboot is in valid RAM (i.e. E820_RAM) */
     base = (uint64_t)TBOOT_BASE_ADDR;
-    size = (uint64_t)((unsigned long)&_end - base);
+    size = (uint64_t)get_tboot_mem_end() - base;
     printk(TBOOT_INFO"verifying tboot and its page table (%Lx - %Lx) in e820 table\n\t",  base, (base + size - 1));
     if ( e820_check_region(base, size) != E820_RAM ) {
         printk(TBOOT_ERR": failed.\n");
@@ -208,6 +210,13 @@ static void post_launch(void)
     if ( !e820_protect_region(base, size, mem_type) )      
         apply_policy(TB_ERR_FATAL);
 
+    /* decompress and relocate modules now, so verification can reuse the
+       digests taken while writing them */
+    if ( !decompress_modules(g_ldr_ctx) )
+        apply_policy(TB_ERR_FATAL);
+    if ( !relocate_kernel_modules(g_ldr_ctx) )
+        apply_policy(TB_ERR_FATAL);
+
     /*
      * verify modules against policy
      */
@@ -225,10 +234,6 @@ static void post_launch(void)
     if ( !seal_pre_k_state() )        
 	apply_policy(TB_ERR_S3_INTEGRITY);
 
-	
-    if ( tpm->major == TPM20_VER_MAJOR ) {
-	tpm_fp->context_save(tpm, tpm->cur_loc, handle2048, &tpm2_context_saved);
-    }
 
 	/*
      * init MLE/kernel shared data page
@@ -239,7 +244,7 @@ static void post_launch(void)
     _tboot_shared.log_addr = (uint32_t)g_log;
     _tboot_shared.shutdown_entry = (uint32_t)shutdown_entry;
     _tboot_shared.tboot_base = (uint32_t)&_start;
-    _tboot_shared.tboot_size = (uint32_t)&_end - (uint32_t)&_start;
+    _tboot_shared.tboot_size = get_tboot_mem_end() - (uint32_t)&_start;
     uint32_t key_size = sizeof(_tboot_shared.s3_key);
     if ( !tpm_fp->get_random(tpm, 2, _tboot_shared.s3_key, &key_size) || key_size != sizeof(_tboot_shared.s3_key) )
         apply_policy(TB_ERR_S3_INTEGRITY);
@@ -253,6 +258,7 @@ static void post_launch(void)
     }
 
     print_tboot_shared(&_tboot_shared);
+    tpm_print_cmd_stats();
 
     launch_kernel(true);
     apply_policy(TB_ERR_FATAL);
@@ -427,6 +433,16 @@ void begin_launch(void *addr, uint32_t magic)
     if ( !s3_flag && !verify_loader_context(g_ldr_ctx) )
         apply_policy(TB_ERR_FATAL);
 
+    /* size per-CPU data for this platform; it extends tboot's memory, */
+    /* so before launch move anything the loader put there */
+    /* (before launch, no room for it means no measured launch on this */
+    /* platform, as the old NR_CPUS check in verify_bios_data() did) */
+    if ( !percpu_init() )
+        apply_policy(is_launched() ? TB_ERR_FATAL : TB_ERR_TXT_NOT_SUPPORTED);
+    if ( !is_launched() && !s3_flag &&
+         !relocate_modules_from_tboot(g_ldr_ctx) )
+        apply_policy(TB_ERR_FATAL);
+
     /* this is being called post-measured launch */
     if ( is_launched() ){
         printk(TBOOT_INFO"Post_launch started ...\n");
@@ -463,15 +479,8 @@ void begin_launch(void *addr, uint32_t magic)
 
 void s3_launch(void)
 {
-    struct tpm_if *tpm = get_tpm();
-    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
     /* restore backed-up s3 wakeup page */
     restore_saved_s3_wakeup_page();
-    /* load saved tpm2 context for unseal */
-    if ( tpm->major == TPM20_VER_MAJOR ) {
-        tpm_fp->context_flush(tpm, tpm->cur_loc, handle2048);
-        tpm_fp->context_load(tpm, tpm->cur_loc, &tpm2_context_saved, &handle2048);
-    }
 
     /* remove DMAR table if necessary */
     if ( get_tboot_save_vtd() )
@@ -487,6 +496,7 @@ void s3_launch(void)
     }
 
     print_tboot_shared(&_tboot_shared);
+    tpm_print_cmd_stats();
 
     /* (optionally) pause when transferring kernel resume */
     if ( g_vga_delay > 0 )
@@ -558,7 +568,6 @@ void shutdown(void)
     if ( _tboot_shared.shutdown_type == TB_SHUTDOWN_WFS ) {
         atomic_inc(&ap_wfs_count);
         _tboot_shared.ap_wake_trigger = 0;
-        mtx_enter(&ap_lock);
         printk(TBOOT_INFO"shutdown(): TB_SHUTDOWN_WFS\n");
         if ( use_mwait() )
             ap_wait(get_apicid());
@@ -595,10 +604,6 @@ void shutdown(void)
         /* restore DMAR table if needed */
         if ( get_tboot_save_vtd() )
             restore_vtd_dmar_table();
-	if ( tpm->major == TPM20_VER_MAJOR ) {
-	    tpm_fp->context_flush(tpm, tpm->cur_loc, handle2048);
-	    tpm_fp->context_load(tpm, tpm->cur_loc, &tpm2_context_saved, &handle2048);
- 	}
 
 		
 	/* save kernel/VMM resume vector for sealing */
@@ -52,6 +52,10 @@ __data struct tpm_if g_tpm = {
     .timeout.timeout_b = TIMEOUT_B,
     .timeout.timeout_c = TIMEOUT_C,
     .timeout.timeout_d = TIMEOUT_D,
+    .duration.duration_short = DURATION_SHORT,
+    .duration.duration_medium = DURATION_MEDIUM,
+    .duration.duration_long = DURATION_LONG,
+    .nv_buf_max = NV_READ_SEG_SIZE,
 };
 
 u16 tboot_alg_list[] = {TB_HALG_SHA1, TB_HALG_SHA256};
@@ -72,18 +76,126 @@ typedef union {
         uint8_t _raw[1];
 } tpm_reg_data_crb_t;
 
+/* all timeouts are in milliseconds and are enforced against the TSC */
 #define TPM_ACTIVE_LOCALITY_TIME_OUT    \
-          (TIMEOUT_UNIT *get_tpm()->timeout.timeout_a)  /* according to spec */
+          (get_tpm()->timeout.timeout_a)  /* according to spec */
 #define TPM_CMD_READY_TIME_OUT          \
-          (TIMEOUT_UNIT *get_tpm()->timeout.timeout_b)  /* according to spec */
+          (get_tpm()->timeout.timeout_b)  /* according to spec */
 #define TPM_CMD_WRITE_TIME_OUT          \
-          (TIMEOUT_UNIT *get_tpm()->timeout.timeout_d)  /* let it long enough */
+          (get_tpm()->timeout.timeout_d)  /* let it long enough */
 #define TPM_DATA_AVAIL_TIME_OUT         \
-          (TIMEOUT_UNIT *get_tpm()->timeout.timeout_c)  /* let it long enough */
+          (get_tpm()->timeout.timeout_c)  /* let it long enough */
 #define TPM_RSP_READ_TIME_OUT           \
-          (TIMEOUT_UNIT *get_tpm()->timeout.timeout_d)  /* let it long enough */
+          (get_tpm()->timeout.timeout_d)  /* let it long enough */
+#define TPM_CMD_EXEC_TIME_OUT           \
+          tpm_cmd_exec_timeout()          /* longest cmd duration */
 #define TPM_VALIDATE_LOCALITY_TIME_OUT  0x100
 
+/* upper bound of pause instructions between two polls of a TPM register */
+#define TPM_POLL_MAX_RELAX              1024
+
+static uint32_t tpm_cmd_exec_timeout(void)
+{
+    struct tpm_if *tpm = get_tpm();
+
+    if ( tpm->duration.duration_long > tpm->timeout.timeout_c )
+        return tpm->duration.duration_long;
+    return tpm->timeout.timeout_c;
+}
+
+/*
+ * poll cond() until it holds or the timeout expires; the delay between
+ * polls doubles each time so that fast TPMs are answered right away while
+ * slow ones are not flooded with register reads
+ */
+static bool tpm_wait_for(bool (*cond)(uint32_t), uint32_t locality,
+                         uint32_t timeout)
+{
+    uint64_t deadline = tsc_deadline(timeout);
+    uint32_t relax = 1;
+
+    while ( !cond(locality) ) {
+        if ( tsc_expired(deadline) )
+            return cond(locality);
+        for ( uint32_t i = 0; i < relax; i++ )
+            cpu_relax();
+        if ( relax < TPM_POLL_MAX_RELAX )
+            relax <<= 1;
+    }
+
+    return true;
+}
+
+/*
+ * per-command latency histograms, written to the log by
+ * tpm_print_cmd_stats(); bucket n counts the commands that completed in
+ * less than 2^(n+6) us and the last bucket collects all slower ones
+ */
+#define TPM_CMD_STATS_MAX       16
+#define TPM_CMD_STATS_BUCKETS   16
+#define TPM_CMD_STATS_SHIFT     6
+
+typedef struct {
+    uint32_t cc;
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[TPM_CMD_STATS_BUCKETS];
+} tpm_cmd_stats_t;
+
+static tpm_cmd_stats_t g_cmd_stats[TPM_CMD_STATS_MAX];
+static uint32_t g_cmd_stats_count;
+
+static void tpm_record_cmd_latency(const u8 *in, uint64_t start)
+{
+    tpm_cmd_stats_t *stats = NULL;
+    uint32_t cc, us, bucket;
+
+    us = tsc_to_microsecs(rdtsc() - start);
+    reverse_copy(&cc, &in[CMD_CC_OFFSET], sizeof(cc));
+
+    for ( uint32_t i = 0; i < g_cmd_stats_count; i++ ) {
+        if ( g_cmd_stats[i].cc == cc ) {
+            stats = &g_cmd_stats[i];
+            break;
+        }
+    }
+    if ( stats == NULL ) {
+        if ( g_cmd_stats_count >= TPM_CMD_STATS_MAX )
+            return;
+        stats = &g_cmd_stats[g_cmd_stats_count++];
+        stats->cc = cc;
+    }
+
+    for ( bucket = 0; bucket < TPM_CMD_STATS_BUCKETS - 1; bucket++ ) {
+        if ( (us >> (bucket + TPM_CMD_STATS_SHIFT)) == 0 )
+            break;
+    }
+    stats->buckets[bucket]++;
+    stats->count++;
+    if ( us > stats->max_us )
+        stats->max_us = us;
+}
+
+void tpm_print_cmd_stats(void)
+{
+    if ( g_cmd_stats_count == 0 )
+        return;
+
+    printk(TBOOT_DETA"TPM: command latencies (us buckets <64, <128, ...):\n");
+    for ( uint32_t i = 0; i < g_cmd_stats_count; i++ ) {
+        tpm_cmd_stats_t *stats = &g_cmd_stats[i];
+        uint32_t last = TPM_CMD_STATS_BUCKETS;
+
+        while ( last > 0 && stats->buckets[last - 1] == 0 )
+            last--;
+        printk(TBOOT_DETA"\t cc 0x%08x: count %u, max %uus, histogram:",
+               stats->cc, stats->count, stats->max_us);
+        for ( uint32_t b = 0; b < last; b++ )
+            printk(TBOOT_DETA" %u", stats->buckets[b]);
+        printk(TBOOT_DETA"\n");
+    }
+}
+
 #define read_tpm_sts_reg(locality) { \
 if ( g_tpm_family == 0 ) \
     read_tpm_reg(locality, TPM_REG_STS, g_reg_sts_12); \
@@ -107,6 +219,18 @@ static void tpm_send_cmd_ready_status(uint32_t locality)
 }
 
 
+static bool tpm_check_go_idle_done_crb(uint32_t locality)
+{
+    tpm_reg_ctrl_request_t reg_ctrl_request;
+
+    read_tpm_reg(locality, TPM_CRB_CTRL_REQ, &reg_ctrl_request);
+#ifdef TPM_TRACE
+    printk(TBOOT_INFO"1. reg_ctrl_request.goIdle: 0x%x\n", reg_ctrl_request.goIdle);
+    printk(TBOOT_INFO"1. reg_ctrl_request.cmdReady: 0x%x\n", reg_ctrl_request.cmdReady);
+#endif
+    return reg_ctrl_request.goIdle == 0;
+}
+
 static bool tpm_send_cmd_ready_status_crb(uint32_t locality)
 {
       tpm_reg_ctrl_request_t reg_ctrl_request;
@@ -130,26 +254,9 @@ static bool tpm_send_cmd_ready_status_crb(uint32_t locality)
       tb_memset(&reg_ctrl_request,0,sizeof(reg_ctrl_request));
       reg_ctrl_request.goIdle = 1;
       write_tpm_reg(locality, TPM_CRB_CTRL_REQ, &reg_ctrl_request);
-	  
-      uint32_t i = 0;
-      do {
-          read_tpm_reg(locality, TPM_CRB_CTRL_REQ, &reg_ctrl_request);
-          if ( reg_ctrl_request.goIdle == 0) 
-		break;
-          else {
-              cpu_relax(); 
-	       read_tpm_reg(locality, TPM_CRB_CTRL_REQ, &reg_ctrl_request);
 
-#ifdef TPM_TRACE
-		printk(TBOOT_INFO"1. reg_ctrl_request.goIdle: 0x%x\n", reg_ctrl_request.goIdle);
-		printk(TBOOT_INFO"1. reg_ctrl_request.cmdReady: 0x%x\n", reg_ctrl_request.cmdReady);
-#endif
-
-          }
-          i++;
-       } while ( i <= TPM_DATA_AVAIL_TIME_OUT);
-
-       if ( i > TPM_DATA_AVAIL_TIME_OUT ) {
+       if ( !tpm_wait_for(tpm_check_go_idle_done_crb, locality,
+                          TPM_DATA_AVAIL_TIME_OUT) ) {
             printk(TBOOT_ERR"TPM: reg_ctrl_request.goidle timeout!\n");
             return false;
        }
@@ -250,6 +357,57 @@ static bool tpm_check_da_status(uint32_t locality)
     return g_reg_sts.sts_valid == 1 && g_reg_sts.data_avail == 1;
 }
 
+static bool tpm_check_burst_count(uint32_t locality)
+{
+    return tpm_get_burst_count(locality) > 0;
+}
+
+static bool tpm_request_cmd_ready(uint32_t locality)
+{
+    tpm_send_cmd_ready_status(locality);
+    cpu_relax();
+    /* then see if it has */
+    return tpm_check_cmd_ready_status(locality);
+}
+
+static bool tpm_check_locality_active(uint32_t locality)
+{
+    tpm_reg_access_t reg_acc;
+
+    read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
+    return reg_acc.active_locality == 1;
+}
+
+static bool tpm_check_locality_released(uint32_t locality)
+{
+    return !tpm_check_locality_active(locality);
+}
+
+static bool tpm_check_locality_assigned_crb(uint32_t locality)
+{
+    tpm_reg_loc_state_t reg_loc_state;
+
+    read_tpm_reg(locality, TPM_REG_LOC_STATE, &reg_loc_state);
+    return reg_loc_state.active_locality == locality &&
+           reg_loc_state.loc_assigned == 1;
+}
+
+static bool tpm_check_locality_released_crb(uint32_t locality)
+{
+    tpm_reg_loc_state_t reg_loc_state;
+
+    read_tpm_reg(locality, TPM_REG_LOC_STATE, &reg_loc_state);
+    return reg_loc_state.loc_assigned == 0;
+}
+
+static bool tpm_check_cmd_done_crb(uint32_t locality)
+{
+    tpm_reg_ctrl_start_t start;
+
+    read_tpm_reg(locality, TPM_CRB_CTRL_START, &start);
+    return start.start == 0;
+}
+
 static void tpm_execute_cmd(uint32_t locality)
 {
     tb_memset((void *)&g_reg_sts, 0, sizeof(g_reg_sts));
@@ -305,7 +463,6 @@ bool tpm_validate_locality_crb(uint32_t locality)
 
 bool tpm_wait_cmd_ready(uint32_t locality)
 {
-    uint32_t            i;
     tpm_reg_access_t    reg_acc;
 
 #if 0 /* some tpms doesn't always return 1 for reg_acc.tpm_reg_valid_sts */
@@ -326,17 +483,8 @@ bool tpm_wait_cmd_ready(uint32_t locality)
     reg_acc.request_use = 1;
     write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
 
-    i = 0;
-    do {
-        read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-        if ( reg_acc.active_locality == 1 )
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT);
-
-    if ( i > TPM_ACTIVE_LOCALITY_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_locality_active, locality,
+                       TPM_ACTIVE_LOCALITY_TIME_OUT) ) {
         printk(TBOOT_ERR"TPM: FIFO_INF access reg request use timeout\n");
         return false;
     }
@@ -345,23 +493,13 @@ bool tpm_wait_cmd_ready(uint32_t locality)
 #ifdef TPM_TRACE
     printk(TBOOT_INFO"TPM: wait for cmd ready \n");
 #endif
-    i = 0;
-    do {
-        tpm_send_cmd_ready_status(locality);
-        cpu_relax();
-        /* then see if it has */
-
-        if ( tpm_check_cmd_ready_status(locality) )
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_CMD_READY_TIME_OUT );
+    bool ready = tpm_wait_for(tpm_request_cmd_ready, locality,
+                              TPM_CMD_READY_TIME_OUT);
 #ifdef TPM_TRACE
     printk(TBOOT_INFO"\n");
 #endif
 
-    if ( i > TPM_CMD_READY_TIME_OUT ) {
+    if ( !ready ) {
         tpm_print_status_register();
         printk(TBOOT_INFO"TPM: tpm timeout for command_ready\n");
         goto RelinquishControl;
@@ -380,23 +518,13 @@ RelinquishControl:
 
 static bool tpm_wait_cmd_ready_crb(uint32_t locality)
 {
-    uint32_t i;
-
     /* ensure the TPM is ready to accept a command */
 #ifdef TPM_TRACE
     printk(TBOOT_INFO"TPM: wait for cmd ready \n");
 #endif
     tpm_send_cmd_ready_status_crb(locality);
-    i = 0;
-    do {
-        if ( tpm_check_cmd_ready_status_crb(locality) )
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_CMD_READY_TIME_OUT );
-
-    if ( i > TPM_CMD_READY_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_cmd_ready_status_crb, locality,
+                       TPM_CMD_READY_TIME_OUT) ) {
         //tpm_print_status_register();
         printk(TBOOT_INFO"TPM: tpm timeout for command_ready\n");
         goto RelinquishControl;
@@ -416,9 +544,10 @@ RelinquishControl:
 
 bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
 {
-    u32 i, rsp_size, offset;
+    u32 rsp_size, offset;
     u16 row_size;
     tpm_reg_access_t    reg_acc;
+    uint64_t start;
     bool ret = true;
 
     if ( locality >= TPM_NR_LOCALITIES ) {
@@ -439,6 +568,7 @@ bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
         return false;
     }
 
+    start = rdtsc();
     if ( !tpm_wait_cmd_ready(locality) )   return false;
 
 #ifdef TPM_TRACE
@@ -451,30 +581,20 @@ bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
     /* write the command to the TPM FIFO */
     offset = 0;
     do {
-        i = 0;
-        do {
-            /* find out how many bytes the TPM can accept in a row */
-            row_size = tpm_get_burst_count(locality);
-            if ( row_size > 0 )   break;
-            else  cpu_relax();
-            i++;
-        } while ( i <= TPM_CMD_WRITE_TIME_OUT );
-        if ( i > TPM_CMD_WRITE_TIME_OUT ) {
+        /* find out how many bytes the TPM can accept in a row */
+        if ( !tpm_wait_for(tpm_check_burst_count, locality,
+                           TPM_CMD_WRITE_TIME_OUT) ) {
             printk(TBOOT_ERR"TPM: write cmd timeout\n");
             ret = false;
             goto RelinquishControl;
         }
+        row_size = g_reg_sts.burst_count;
 
         for ( ; row_size > 0 && offset < in_size; row_size--, offset++ )  write_tpm_reg(locality, TPM_REG_DATA_FIFO,  (tpm_reg_data_fifo_t *)&in[offset]);
     } while ( offset < in_size );
 
-    i = 0;
-    do {
-        if ( tpm_check_expect_status(locality) )  break;
-        else   cpu_relax();
-        i++;
-    } while ( i <= TPM_DATA_AVAIL_TIME_OUT );
-    if ( i > TPM_DATA_AVAIL_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_expect_status, locality,
+                       TPM_DATA_AVAIL_TIME_OUT) ) {
         printk(TBOOT_ERR"TPM: wait for expect becoming 0 timeout\n");
         ret = false;
         goto RelinquishControl;
@@ -484,13 +604,8 @@ bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
     tpm_execute_cmd(locality);
 
     /* check for data available */
-    i = 0;
-    do {
-        if ( tpm_check_da_status(locality) )  break;
-        else  cpu_relax();
-        i++;
-    } while ( i <= TPM_DATA_AVAIL_TIME_OUT );
-    if ( i > TPM_DATA_AVAIL_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_da_status, locality,
+                       TPM_CMD_EXEC_TIME_OUT) ) {
         printk(TBOOT_ERR"TPM: wait for data available timeout\n");
         ret = false;
         goto RelinquishControl;
@@ -500,18 +615,13 @@ bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
     offset = 0;
     do {
         /* find out how many bytes the TPM returned in a row */
-        i = 0;
-        do {
-            row_size = tpm_get_burst_count(locality);
-            if ( row_size > 0 )  break;
-            else cpu_relax();
-            i++;
-        } while ( i <= TPM_RSP_READ_TIME_OUT );
-        if ( i > TPM_RSP_READ_TIME_OUT ) {
+        if ( !tpm_wait_for(tpm_check_burst_count, locality,
+                           TPM_RSP_READ_TIME_OUT) ) {
             printk(TBOOT_ERR"TPM: read rsp timeout\n");
             ret = false;
             goto RelinquishControl;
         }
+        row_size = g_reg_sts.burst_count;
 
         for ( ; row_size > 0 && offset < *out_size; row_size--, offset++ ) {
             if ( offset < *out_size )  read_tpm_reg(locality, TPM_REG_DATA_FIFO, (tpm_reg_data_fifo_t *)&out[offset]);
@@ -539,6 +649,7 @@ bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_size)
 #endif
 
     tpm_send_cmd_ready_status(locality);
+    tpm_record_cmd_latency(in, start);
 
 RelinquishControl:
     /* deactivate current locality */
@@ -564,6 +675,7 @@ bool tpm_submit_cmd_crb(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_si
     tpm_reg_ctrl_rspsize_t  RspSize;
     tpm_reg_ctrl_rspaddr_t  RspAddr;
     uint32_t  tpm_crb_data_buffer_base;
+    uint64_t  start_tsc;
 	
     if ( locality >= TPM_NR_LOCALITIES ) {
         printk(TBOOT_WARN"TPM: Invalid locality for tpm_submit_cmd_crb()\n");
@@ -583,6 +695,7 @@ bool tpm_submit_cmd_crb(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_si
         return false;
     }
 
+    start_tsc = rdtsc();
     if ( !tpm_wait_cmd_ready_crb(locality) ) {
         printk(TBOOT_WARN"TPM: tpm_wait_cmd_read_crb failed\n");
 	 return false;
@@ -635,16 +748,8 @@ bool tpm_submit_cmd_crb(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_si
     printk(TBOOT_INFO"tpm_ctrl_start.start is 0x%x\n",start.start);
 	
     /* check for data available */
-    i = 0;
-    do {
-	   read_tpm_reg(locality, TPM_CRB_CTRL_START, &start);
-        //printk(TBOOT_INFO"tpm_ctrl_start.start is 0x%x\n",start.start);
-          if ( start.start == 0 ) break;
-          else  cpu_relax();
-          i++;
-    } while ( i <= TPM_DATA_AVAIL_TIME_OUT );
-
-    if ( i > TPM_DATA_AVAIL_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_cmd_done_crb, locality,
+                       TPM_CMD_EXEC_TIME_OUT) ) {
         printk(TBOOT_ERR"TPM: wait for data available timeout\n");
         ret = false;
         goto RelinquishControl;
@@ -667,6 +772,8 @@ bool tpm_submit_cmd_crb(u32 locality, u8 *in, u32 in_size,  u8 *out, u32 *out_si
     }
 #endif
 
+    tpm_record_cmd_latency(in, start_tsc);
+
     //tpm_send_cmd_ready_status_crb(locality);
 
 RelinquishControl:
@@ -682,7 +789,6 @@ RelinquishControl:
 
 bool release_locality(uint32_t locality)
 {
-    uint32_t i;
 #ifdef TPM_TRACE
     printk(TBOOT_DETA"TPM: releasing locality %u\n", locality);
 #endif
@@ -698,15 +804,9 @@ bool release_locality(uint32_t locality)
     reg_acc.active_locality = 1;
     write_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
 
-    i = 0;
-    do {
-        read_tpm_reg(locality, TPM_REG_ACCESS, &reg_acc);
-        if ( reg_acc.active_locality == 0 )
-            return true;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT );
+    if ( tpm_wait_for(tpm_check_locality_released, locality,
+                      TPM_ACTIVE_LOCALITY_TIME_OUT) )
+        return true;
 
     printk(TBOOT_INFO"TPM: access reg release locality timeout\n");
     return false;
@@ -714,7 +814,6 @@ bool release_locality(uint32_t locality)
 
 bool tpm_relinquish_locality_crb(uint32_t locality)
 {
-    uint32_t i;
     tpm_reg_loc_state_t reg_loc_state;
     tpm_reg_loc_ctrl_t reg_loc_ctrl;
 	
@@ -731,13 +830,9 @@ bool tpm_relinquish_locality_crb(uint32_t locality)
     reg_loc_ctrl.relinquish = 1;
     write_tpm_reg(locality, TPM_REG_LOC_CTRL, &reg_loc_ctrl);
 
-    i = 0;
-    do {
-        read_tpm_reg(locality, TPM_REG_LOC_STATE, &reg_loc_state);
-        if ( reg_loc_state.loc_assigned == 0 )    return true;
-        else cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT );
+    if ( tpm_wait_for(tpm_check_locality_released_crb, locality,
+                      TPM_ACTIVE_LOCALITY_TIME_OUT) )
+        return true;
 
     printk(TBOOT_INFO"TPM: CRB_INF release locality timeout\n");
     return false;
@@ -777,25 +872,14 @@ bool prepare_tpm(void)
 
 bool tpm_request_locality_crb(uint32_t locality){
 
-    uint32_t            i;
-    tpm_reg_loc_state_t  reg_loc_state;
     tpm_reg_loc_ctrl_t    reg_loc_ctrl;
     /* request access to the TPM from locality N */
     tb_memset(&reg_loc_ctrl,0,sizeof(reg_loc_ctrl));
     reg_loc_ctrl.requestAccess = 1;
     write_tpm_reg(locality, TPM_REG_LOC_CTRL, &reg_loc_ctrl);
 
-    i = 0;
-    do {
-        read_tpm_reg(locality, TPM_REG_LOC_STATE, &reg_loc_state);
-        if ( reg_loc_state.active_locality == locality && reg_loc_state.loc_assigned == 1)
-            break;
-        else
-            cpu_relax();
-        i++;
-    } while ( i <= TPM_ACTIVE_LOCALITY_TIME_OUT);
-
-    if ( i > TPM_ACTIVE_LOCALITY_TIME_OUT ) {
+    if ( !tpm_wait_for(tpm_check_locality_assigned_crb, locality,
+                       TPM_ACTIVE_LOCALITY_TIME_OUT) ) {
         printk(TBOOT_ERR"TPM: access loc request use timeout\n");
         return false;
     }
@@ -882,10 +966,179 @@ bool tpm_detect(void)
     if (g_tpm_family == TPM_IF_20_FIFO)  g_tpm_ver = TPM_VER_20;
     if (g_tpm_family == TPM_IF_20_CRB)  g_tpm_ver = TPM_VER_20;
 
+    /* NV contents may have changed since the last launch */
+    tpm_nv_cache_invalidate();
+
     tpm_fp = get_tpm_fp();
     return tpm_fp->init(tpm);
 }
 
+/*
+ * launch-scoped read-through cache of NV index sizes, permissions and
+ * contents, so that an index touched by both policy loading and NV
+ * verification is only fetched from the TPM once; it is dropped on every
+ * NV write and whenever the TPM is (re-)detected, i.e. once per launch.
+ * Entries are per locality, since an index's read access (and so what a
+ * read returns) can depend on the locality it is read from.
+ */
+#define NV_CACHE_ENTRIES     8
+#define NV_CACHE_POOL_SIZE   8192
+
+#define NV_CACHE_SIZE_VALID  0x1
+#define NV_CACHE_PERM_VALID  0x2
+#define NV_CACHE_DATA_VALID  0x4
+
+typedef struct {
+    uint32_t index;
+    uint32_t locality;
+    uint32_t flags;
+    uint32_t size;
+    uint32_t attribute;
+    uint8_t  *data;
+} nv_cache_entry_t;
+
+static nv_cache_entry_t g_nv_cache[NV_CACHE_ENTRIES];
+static uint32_t g_nv_cache_count;
+static uint8_t g_nv_cache_pool[NV_CACHE_POOL_SIZE];
+static uint32_t g_nv_cache_pool_used;
+
+void tpm_nv_cache_invalidate(void)
+{
+    g_nv_cache_count = 0;
+    g_nv_cache_pool_used = 0;
+}
+
+static nv_cache_entry_t *nv_cache_lookup(uint32_t locality, uint32_t index,
+                                         bool create)
+{
+    for ( uint32_t i = 0; i < g_nv_cache_count; i++ ) {
+        if ( g_nv_cache[i].index == index &&
+             g_nv_cache[i].locality == locality )
+            return &g_nv_cache[i];
+    }
+    if ( !create || g_nv_cache_count >= NV_CACHE_ENTRIES )
+        return NULL;
+
+    nv_cache_entry_t *entry = &g_nv_cache[g_nv_cache_count++];
+    entry->index = index;
+    entry->locality = locality;
+    entry->flags = 0;
+    entry->data = NULL;
+    return entry;
+}
+
+bool tpm_get_nvindex_size(struct tpm_if *ti, u32 locality, u32 index,
+                          u32 *size)
+{
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+    nv_cache_entry_t *entry = nv_cache_lookup(locality, index, true);
+
+    if ( size == NULL )
+        return false;
+
+    if ( entry != NULL && (entry->flags & NV_CACHE_SIZE_VALID) ) {
+        *size = entry->size;
+        return true;
+    }
+
+    if ( !tpm_fp->get_nvindex_size(ti, locality, index, size) )
+        return false;
+
+    if ( entry != NULL ) {
+        entry->size = *size;
+        entry->flags |= NV_CACHE_SIZE_VALID;
+    }
+    return true;
+}
+
+bool tpm_get_nvindex_permission(struct tpm_if *ti, u32 locality, u32 index,
+                                u32 *attribute)
+{
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+    nv_cache_entry_t *entry = nv_cache_lookup(locality, index, true);
+
+    if ( attribute == NULL )
+        return false;
+
+    if ( entry != NULL && (entry->flags & NV_CACHE_PERM_VALID) ) {
+        *attribute = entry->attribute;
+        return true;
+    }
+
+    if ( !tpm_fp->get_nvindex_permission(ti, locality, index, attribute) )
+        return false;
+
+    if ( entry != NULL ) {
+        entry->attribute = *attribute;
+        entry->flags |= NV_CACHE_PERM_VALID;
+    }
+    return true;
+}
+
+/* read the whole index into the cache pool, if it fits */
+static bool nv_cache_fill(struct tpm_if *ti, u32 locality,
+                          nv_cache_entry_t *entry)
+{
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+    uint32_t offset, data_size;
+
+    if ( !tpm_get_nvindex_size(ti, locality, entry->index, &entry->size) )
+        return false;
+    if ( entry->size == 0 ||
+         entry->size > NV_CACHE_POOL_SIZE - g_nv_cache_pool_used )
+        return false;
+
+    uint8_t *data = &g_nv_cache_pool[g_nv_cache_pool_used];
+    for ( offset = 0; offset < entry->size; offset += data_size ) {
+        data_size = entry->size - offset;
+        if ( data_size > ti->nv_buf_max )
+            data_size = ti->nv_buf_max;
+        if ( !tpm_fp->nv_read(ti, locality, entry->index, offset,
+                              data + offset, &data_size) || data_size == 0 )
+            return false;
+    }
+
+    g_nv_cache_pool_used += entry->size;
+    entry->data = data;
+    entry->flags |= NV_CACHE_DATA_VALID;
+    return true;
+}
+
+bool tpm_nv_read(struct tpm_if *ti, u32 locality, u32 index, u32 offset,
+                 u8 *data, u32 *data_size)
+{
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+    nv_cache_entry_t *entry;
+
+    if ( ti == NULL || data == NULL || data_size == NULL || *data_size == 0 )
+        return false;
+
+    entry = nv_cache_lookup(locality, index, true);
+    if ( entry != NULL && !(entry->flags & NV_CACHE_DATA_VALID) )
+        nv_cache_fill(ti, locality, entry);
+
+    if ( entry == NULL || !(entry->flags & NV_CACHE_DATA_VALID) ||
+         offset >= entry->size )
+        return tpm_fp->nv_read(ti, locality, index, offset, data, data_size);
+
+    /* same chunking as the TPM would apply */
+    if ( *data_size > ti->nv_buf_max )
+        *data_size = ti->nv_buf_max;
+    if ( *data_size > entry->size - offset )
+        *data_size = entry->size - offset;
+    tb_memcpy(data, entry->data + offset, *data_size);
+    return true;
+}
+
+bool tpm_nv_write(struct tpm_if *ti, u32 locality, u32 index, u32 offset,
+                  const u8 *data, u32 data_size)
+{
+    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
+
+    tpm_nv_cache_invalidate();
+    return tpm_fp->nv_write(ti, locality, index, offset, data, data_size);
+}
+
 void tpm_print(struct tpm_if *ti)
 {
     if ( ti == NULL )
@@ -895,6 +1148,8 @@ void tpm_print(struct tpm_if *ti)
     printk(TBOOT_INFO"\t extend policy: %d\n", ti->extpol);
     printk(TBOOT_INFO"\t current alg id: 0x%x\n", ti->cur_alg);
     printk(TBOOT_INFO"\t timeout values: A: %u, B: %u, C: %u, D: %u\n", ti->timeout.timeout_a, ti->timeout.timeout_b, ti->timeout.timeout_c, ti->timeout.timeout_d);
+    printk(TBOOT_INFO"\t duration values: short: %u, medium: %u, long: %u\n", ti->duration.duration_short, ti->duration.duration_medium, ti->duration.duration_long);
+    printk(TBOOT_INFO"\t NV read chunk size: %u\n", ti->nv_buf_max);
 } 
 
 struct tpm_if *get_tpm(void)
@@ -101,6 +101,7 @@ typedef uint8_t tpm_locality_selection_t;
 #define TPM_ORD_OIAP                0x0000000A
 #define TPM_ORD_SAVE_STATE          0x00000098
 #define TPM_ORD_GET_RANDOM          0x00000046
+#define TPM_ORD_FLUSH_SPECIFIC      0x000000BA
 
 #define TPM_TAG_PCR_INFO_LONG       0x0006
 #define TPM_TAG_STORED_DATA12       0x0016
@@ -256,6 +257,31 @@ static bool tpm12_pcr_read(struct tpm_if *ti, uint32_t locality,
     return true;
 }
 
+/* TPM 1.2 has a single SHA-1 bank and reads one PCR per TPM_PCRRead */
+static bool tpm12_pcr_read_multi(struct tpm_if *ti, uint32_t locality,
+                                 uint32_t pcr_mask, uint32_t alg_count,
+                                 const uint16_t *algs, tpm_pcr_value_t *out)
+{
+    uint32_t pcr;
+
+    if ( ti == NULL || algs == NULL || out == NULL || pcr_mask == 0
+         || alg_count != 1 || algs[0] != TB_HALG_SHA1
+         || (pcr_mask >> TPM_NR_PCRS) != 0 ) {
+        if ( ti != NULL )
+            ti->error = TPM_BAD_PARAMETER;
+        return false;
+    }
+
+    for ( pcr = 0; pcr < TPM_NR_PCRS; pcr++ ) {
+        if ( !(pcr_mask & TPM_PCR_MASK(pcr)) )
+            continue;
+        if ( !tpm12_pcr_read(ti, locality, pcr, out++) )
+            return false;
+    }
+
+    return true;
+}
+
 static bool _tpm12_pcr_extend(struct tpm_if *ti, uint32_t locality,
                              uint32_t pcr, const tpm_digest_t* in)
 {
@@ -493,12 +519,16 @@ typedef struct __packed {
 #define HMAC_BLOCK_SIZE     64
 #define HMAC_OUTPUT_SIZE    20
 
-static bool hmac(const uint8_t key[HMAC_OUTPUT_SIZE], const uint8_t *msg,
-                 uint32_t len, uint8_t md[HMAC_OUTPUT_SIZE])
+/* SHA-1 states with the inner and outer pads of one HMAC key absorbed */
+typedef struct {
+    SHA_CTX     ictx;
+    SHA_CTX     octx;
+} hmac_key_t;
+
+static void hmac_init_key(const uint8_t key[HMAC_OUTPUT_SIZE], hmac_key_t *hk)
 {
     uint8_t ipad[HMAC_BLOCK_SIZE], opad[HMAC_BLOCK_SIZE];
     uint32_t i;
-    SHA_CTX ctx;
 
     COMPILE_TIME_ASSERT(HMAC_OUTPUT_SIZE <= HMAC_BLOCK_SIZE);
 
@@ -512,15 +542,34 @@ static bool hmac(const uint8_t key[HMAC_OUTPUT_SIZE], const uint8_t *msg,
         opad[i] ^= key[i];
     }
 
-    SHA1_Init(&ctx);
-    SHA1_Update(&ctx, ipad, HMAC_BLOCK_SIZE);
+    SHA1_Init(&hk->ictx);
+    SHA1_Update(&hk->ictx, ipad, HMAC_BLOCK_SIZE);
+
+    SHA1_Init(&hk->octx);
+    SHA1_Update(&hk->octx, opad, HMAC_BLOCK_SIZE);
+}
+
+static void hmac_with_key(const hmac_key_t *hk, const uint8_t *msg,
+                          uint32_t len, uint8_t md[HMAC_OUTPUT_SIZE])
+{
+    SHA_CTX ctx;
+
+    ctx = hk->ictx;
     SHA1_Update(&ctx, msg, len);
     SHA1_Final(md, &ctx);
 
-    SHA1_Init(&ctx);
-    SHA1_Update(&ctx, opad, HMAC_BLOCK_SIZE);
+    ctx = hk->octx;
     SHA1_Update(&ctx, md, HMAC_OUTPUT_SIZE);
     SHA1_Final(md, &ctx);
+}
+
+static bool hmac(const uint8_t key[HMAC_OUTPUT_SIZE], const uint8_t *msg,
+                 uint32_t len, uint8_t md[HMAC_OUTPUT_SIZE])
+{
+    hmac_key_t hk;
+
+    hmac_init_key(key, &hk);
+    hmac_with_key(&hk, msg, len, md);
 
     return true;
 }
@@ -964,49 +1013,170 @@ static const tpm_authdata_t srk_authdata =
 static const tpm_authdata_t blob_authdata =
     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
+/*
+ * authorization sessions kept open across the seal/unseal commands of one
+ * sequence (see tpm12_release_sessions()): an OSAP session for the SRK and
+ * an OIAP session for the sealed blob's authdata.  each carries the rolling
+ * nonces and its HMAC key with the pads already absorbed.
+ */
+typedef struct {
+    bool                valid;
+    tpm_authhandle_t    handle;
+    tpm_nonce_t         nonce_even;
+    tpm_nonce_t         nonce_odd;
+    tpm_authdata_t      shared_secret;
+    hmac_key_t          key;
+} tpm12_auth_session_t;
+
+static tpm12_auth_session_t srk_osap;
+static tpm12_auth_session_t blob_oiap;
+
+#define TPM_RT_AUTH             0x00000002
+
+static uint32_t tpm12_get_srk_osap(uint32_t locality,
+                                   tpm12_auth_session_t **session)
+{
+    tpm12_auth_session_t *sess = &srk_osap;
+    tpm_nonce_t odd_osap, even_osap;
+    uint32_t ret, offset;
+
+    *session = sess;
+    if ( sess->valid )
+        return TPM_SUCCESS;
+
+    /* skip generate nonce for odd_osap, reuse the last odd nonce instead;
+       even_osap from the TPM already makes the shared secret unique */
+    odd_osap = sess->nonce_odd;
+
+    /* establish a osap session */
+    ret = tpm12_osap(locality, TPM_ET_SRK, TPM_KH_SRK, &odd_osap,
+                     &sess->handle, &sess->nonce_even, &even_osap);
+    if ( ret != TPM_SUCCESS )
+        return ret;
+
+    /* calculate the shared secret
+       shared-secret = HMAC(srk_auth, even_osap || odd_osap) */
+    offset = 0;
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &even_osap);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &odd_osap);
+    hmac((uint8_t *)&srk_authdata, WRAPPER_IN_BUF, offset,
+         (uint8_t *)&sess->shared_secret);
+    hmac_init_key((uint8_t *)&sess->shared_secret, &sess->key);
+
+    sess->valid = true;
+    return TPM_SUCCESS;
+}
+
+static uint32_t tpm12_get_blob_oiap(uint32_t locality,
+                                    tpm12_auth_session_t **session)
+{
+    tpm12_auth_session_t *sess = &blob_oiap;
+    uint32_t ret;
+
+    *session = sess;
+    if ( sess->valid )
+        return TPM_SUCCESS;
+
+    /* establish a oiap session */
+    ret = tpm12_oiap(locality, &sess->handle, &sess->nonce_even);
+    if ( ret != TPM_SUCCESS )
+        return ret;
+
+    hmac_init_key((uint8_t *)&blob_authdata, &sess->key);
+
+    sess->valid = true;
+    return TPM_SUCCESS;
+}
+
+/* each command on a session needs a new odd nonce; the TPM only requires
+   it to differ, so derive it from the previous nonces instead of asking
+   the TPM for random bytes */
+static void tpm12_next_nonce_odd(tpm12_auth_session_t *sess)
+{
+    uint32_t offset = 0;
+
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &sess->nonce_odd);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &sess->nonce_even);
+    sha1_buffer(WRAPPER_IN_BUF, offset, (uint8_t *)&sess->nonce_odd);
+}
+
+static void tpm12_flush_session(uint32_t locality, tpm12_auth_session_t *sess)
+{
+    uint32_t ret, offset, out_size;
+    uint32_t resource_type = TPM_RT_AUTH;
+
+    if ( !sess->valid )
+        return;
+    sess->valid = false;
+
+    offset = 0;
+    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, sess->handle);
+    UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, resource_type);
+
+    out_size = 0;
+    ret = tpm12_submit_cmd(locality, TPM_ORD_FLUSH_SPECIFIC, offset, &out_size);
+    if ( ret != TPM_SUCCESS )
+        printk(TBOOT_DETA"TPM: flush auth session %08X, return value = %08X\n",
+               sess->handle, ret);
+}
+
+/* keep the session only if the command succeeded and the TPM continued it;
+   a failed command may or may not have closed it, so flush it to be sure */
+static void tpm12_update_session(uint32_t locality, tpm12_auth_session_t *sess,
+                                 uint32_t ret, uint8_t cont_session,
+                                 const tpm_nonce_t *nonce_even)
+{
+    if ( ret != TPM_SUCCESS ) {
+        tpm12_flush_session(locality, sess);
+        return;
+    }
+    if ( !cont_session ) {
+        sess->valid = false;
+        return;
+    }
+    sess->nonce_even = *nonce_even;
+}
+
+static void tpm12_release_sessions(struct tpm_if *ti, uint32_t locality)
+{
+    if ( ti == NULL || locality >= TPM_NR_LOCALITIES )
+        return;
+
+    tpm12_flush_session(locality, &srk_osap);
+    tpm12_flush_session(locality, &blob_oiap);
+}
+
 static uint32_t _tpm12_wrap_seal(uint32_t locality,
                               const tpm_pcr_info_long_t *pcr_info,
                               uint32_t in_data_size, const uint8_t *in_data,
                               uint32_t *sealed_data_size, uint8_t *sealed_data)
 {
     uint32_t ret;
-    tpm_nonce_t odd_osap, even_osap, nonce_even, nonce_odd;
-    tpm_authhandle_t hauth;
-    tpm_authdata_t shared_secret, pub_auth, res_auth;
+    tpm12_auth_session_t *osap;
+    tpm_nonce_t nonce_even;
+    tpm_authdata_t pub_auth, res_auth;
     tpm_encauth_t enc_auth;
-    uint8_t cont_session = false;
+    uint8_t cont_session = true;
     tpm_key_handle_t hkey = TPM_KH_SRK;
     uint32_t pcr_info_size = sizeof(*pcr_info);
     uint32_t offset;
     uint32_t ordinal = TPM_ORD_SEAL;
     tpm12_digest_t digest;
 
-    /* skip generate nonce for odd_osap, just use the random value in stack */
-
-    /* establish a osap session */
-    ret = tpm12_osap(locality, TPM_ET_SRK, TPM_KH_SRK, &odd_osap, &hauth,
-                   &nonce_even, &even_osap);
+    ret = tpm12_get_srk_osap(locality, &osap);
     if ( ret != TPM_SUCCESS )
             return ret;
 
-    /* calculate the shared secret
-       shared-secret = HMAC(srk_auth, even_osap || odd_osap) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &even_osap);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &odd_osap);
-    hmac((uint8_t *)&srk_authdata, WRAPPER_IN_BUF, offset,
-         (uint8_t *)&shared_secret);
-
     /* generate ecrypted authdata for data
        enc_auth = XOR(authdata, sha1(shared_secret || last_even_nonce)) */
     offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &shared_secret);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->shared_secret);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->nonce_even);
     sha1_buffer(WRAPPER_IN_BUF, offset, (uint8_t *)&digest);
     tb_memcpy(&enc_auth, &blob_authdata, sizeof(blob_authdata));
     XOR_BLOB_TYPE(&enc_auth, &digest);
 
-    /* skip generate nonce for nonce_odd, just use the random value in stack */
+    tpm12_next_nonce_odd(osap);
 
     /* calculate authdata */
     /* in_param_digest = sha1(1S ~ 6S) */
@@ -1022,19 +1192,19 @@ static uint32_t _tpm12_wrap_seal(uint32_t locality,
     /* authdata = hmac(key, in_param_digest || auth_params) */
     offset = 0;
     UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->nonce_even);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->nonce_odd);
     UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session);
-    hmac((uint8_t *)&shared_secret, WRAPPER_IN_BUF, offset,
-         (uint8_t *)&pub_auth);
+    hmac_with_key(&osap->key, WRAPPER_IN_BUF, offset, (uint8_t *)&pub_auth);
 
     /* call the simple seal function */
     ret = _tpm12_seal(locality, hkey, (const tpm_encauth_t *)&enc_auth,
                     pcr_info_size, pcr_info, in_data_size, in_data,
-                    hauth, &nonce_odd, &cont_session,
+                    osap->handle, &osap->nonce_odd, &cont_session,
                     (const tpm_authdata_t *)&pub_auth,
                     sealed_data_size, sealed_data,
                     &nonce_even, &res_auth);
+    tpm12_update_session(locality, osap, ret, cont_session, &nonce_even);
 
     /* skip check for res_auth */
 
@@ -1045,39 +1215,25 @@ static uint32_t _tpm12_wrap_unseal(uint32_t locality, const uint8_t *in_data,
                                  uint32_t *secret_size, uint8_t *secret)
 {
     uint32_t ret;
-    tpm_nonce_t odd_osap, even_osap;
-    tpm_nonce_t nonce_even, nonce_odd, nonce_even_d, nonce_odd_d;
-    tpm_authhandle_t hauth, hauth_d;
-    tpm_authdata_t shared_secret;
+    tpm12_auth_session_t *osap, *oiap;
+    tpm_nonce_t nonce_even, nonce_even_d;
     tpm_authdata_t pub_auth, res_auth, pub_auth_d, res_auth_d;
-    uint8_t cont_session = false, cont_session_d = false;
+    uint8_t cont_session = true, cont_session_d = true;
     tpm_key_handle_t hkey = TPM_KH_SRK;
     uint32_t offset;
     uint32_t ordinal = TPM_ORD_UNSEAL;
     tpm12_digest_t digest;
 
-    /* skip generate nonce for odd_osap, just use the random value in stack */
-
-    /* establish a osap session */
-    ret = tpm12_osap(locality, TPM_ET_SRK, TPM_KH_SRK, &odd_osap, &hauth,
-                   &nonce_even, &even_osap);
+    ret = tpm12_get_srk_osap(locality, &osap);
     if ( ret != TPM_SUCCESS )
             return ret;
 
-    /* calculate the shared secret
-       shared-secret = HMAC(auth, even_osap || odd_osap) */
-    offset = 0;
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &even_osap);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &odd_osap);
-    hmac((uint8_t *)&srk_authdata, WRAPPER_IN_BUF, offset,
-         (uint8_t *)&shared_secret);
-
-    /* establish a oiap session */
-    ret = tpm12_oiap(locality, &hauth_d, &nonce_even_d);
+    ret = tpm12_get_blob_oiap(locality, &oiap);
     if ( ret != TPM_SUCCESS )
             return ret;
 
-    /* skip generate nonce_odd & nonce_odd_d, just use the random values */
+    tpm12_next_nonce_odd(osap);
+    tpm12_next_nonce_odd(oiap);
 
     /* calculate authdata */
     /* in_param_digest = sha1(1S ~ 6S) */
@@ -1089,29 +1245,29 @@ static uint32_t _tpm12_wrap_unseal(uint32_t locality, const uint8_t *in_data,
     /* authdata1 = hmac(key, in_param_digest || auth_params1) */
     offset = 0;
     UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->nonce_even);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &osap->nonce_odd);
     UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session);
-    hmac((uint8_t *)&shared_secret, WRAPPER_IN_BUF, offset,
-         (uint8_t *)&pub_auth);
+    hmac_with_key(&osap->key, WRAPPER_IN_BUF, offset, (uint8_t *)&pub_auth);
 
     /* authdata2 = hmac(key, in_param_digest || auth_params2) */
     offset = 0;
     UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &digest);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_even_d);
-    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &nonce_odd_d);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &oiap->nonce_even);
+    UNLOAD_BLOB_TYPE(WRAPPER_IN_BUF, offset, &oiap->nonce_odd);
     UNLOAD_INTEGER(WRAPPER_IN_BUF, offset, cont_session_d);
-    hmac((uint8_t *)&blob_authdata, WRAPPER_IN_BUF, offset,
-         (uint8_t *)&pub_auth_d);
+    hmac_with_key(&oiap->key, WRAPPER_IN_BUF, offset, (uint8_t *)&pub_auth_d);
 
     /* call the simple seal function */
     ret = _tpm12_unseal(locality, hkey, in_data,
-                      hauth, &nonce_odd, &cont_session,
+                      osap->handle, &osap->nonce_odd, &cont_session,
                       (const tpm_authdata_t *)&pub_auth,
-                      hauth_d, &nonce_odd_d, &cont_session_d,
+                      oiap->handle, &oiap->nonce_odd, &cont_session_d,
                       (const tpm_authdata_t *)&pub_auth_d,
                       secret_size, secret,
                       &nonce_even, &res_auth, &nonce_even_d, &res_auth_d);
+    tpm12_update_session(locality, osap, ret, cont_session, &nonce_even);
+    tpm12_update_session(locality, oiap, ret, cont_session_d, &nonce_even_d);
 
     /* skip check for res_auth */
 
@@ -1354,15 +1510,18 @@ static bool tpm12_verify_creation(struct tpm_if *ti, uint32_t sealed_data_size,
                             uint8_t *sealed_data)
 {
     uint8_t pcr_indcs_create[] = {17, 18};
-    tpm12_digest_t pcr17, pcr18;
-    const tpm12_digest_t *pcr_values_create[] = {&pcr17, &pcr18};
+    tpm_pcr_value_t pcrs[2];
+    tpm12_digest_t *pcr17 = (tpm12_digest_t *)&pcrs[0];
+    tpm12_digest_t *pcr18 = (tpm12_digest_t *)&pcrs[1];
+    const tpm12_digest_t *pcr_values_create[] = {pcr17, pcr18};
     int i;
 
     if ( ti == NULL || sealed_data == NULL )
         return false;
 
-    tpm12_pcr_read(ti, 2, 17, (tpm_pcr_value_t *)&pcr17);
-    tpm12_pcr_read(ti, 2, 18, (tpm_pcr_value_t *)&pcr18);
+    if ( !tpm12_pcr_read_multi(ti, 2, TPM_PCR_MASK(17) | TPM_PCR_MASK(18),
+                               1, &ti->cur_alg, pcrs) )
+        return false;
 
     /* to prevent rollback attack using old sealed measurements,
        verify that (creation) PCRs at mem integrity seal time are same as
@@ -1370,10 +1529,10 @@ static bool tpm12_verify_creation(struct tpm_if *ti, uint32_t sealed_data_size,
     /* TBD: we should check all DRTM PCRs */
     for ( i = 0; i < g_pre_k_s3_state.num_vl_entries; i++ ) {
         if ( g_pre_k_s3_state.vl_entries[i].pcr == 17 )
-            extend_hash((tb_hash_t *)&pcr17,
+            extend_hash((tb_hash_t *)pcr17,
                 &g_pre_k_s3_state.vl_entries[i].hl.entries[0].hash, TB_HALG_SHA1);
         else if ( g_pre_k_s3_state.vl_entries[i].pcr == 18 )
-            extend_hash((tb_hash_t *)&pcr18,
+            extend_hash((tb_hash_t *)pcr18,
                 &g_pre_k_s3_state.vl_entries[i].hl.entries[0].hash, TB_HALG_SHA1);
     }
     if ( !tpm12_cmp_creation_pcrs(ARRAY_SIZE(pcr_indcs_create),
@@ -1721,12 +1880,79 @@ static uint32_t tpm12_get_timeout(uint32_t locality,
     return ret;
 }
 
+#define TPM_CAP_PROP_DURATION     0x00000120
+#define TPM_CAP_PROP_INPUT_BUFFER 0x00000124
+
+static uint32_t tpm12_get_input_buffer_size(uint32_t locality, uint32_t *size)
+{
+    uint32_t ret, offset, resp_size, prop_id = TPM_CAP_PROP_INPUT_BUFFER;
+    uint8_t sub_cap[sizeof(prop_id)];
+    uint8_t resp[sizeof(uint32_t)];
+
+    offset = 0;
+    UNLOAD_INTEGER(sub_cap, offset, prop_id);
+
+    resp_size = sizeof(resp);
+    ret = tpm12_get_capability(locality, TPM_CAP_PROPERTY, sizeof(sub_cap),
+                               sub_cap, &resp_size, resp);
+    if ( ret != TPM_SUCCESS )
+        return ret;
+
+    if ( resp_size != sizeof(resp) ) {
+        printk(TBOOT_WARN"TPM: tpm12_get_input_buffer_size() response size incorrect\n");
+        return TPM_FAIL;
+    }
+
+    offset = 0;
+    LOAD_INTEGER(resp, offset, *size);
+
+    return ret;
+}
+
+static uint32_t tpm12_get_duration(uint32_t locality, uint32_t *duration,
+                                   uint32_t count)
+{
+    uint32_t ret, offset, resp_size, prop_id = TPM_CAP_PROP_DURATION;
+    uint8_t sub_cap[sizeof(prop_id)];
+    uint8_t resp[3 * sizeof(uint32_t)];
+
+    if ( (duration == NULL) || (count != 3) ) {
+        printk(TBOOT_WARN"TPM: tpm12_get_duration() bad parameter\n");
+        return TPM_BAD_PARAMETER;
+    }
+
+    offset = 0;
+    UNLOAD_INTEGER(sub_cap, offset, prop_id);
+
+    resp_size = sizeof(resp);
+    ret = tpm12_get_capability(locality, TPM_CAP_PROPERTY, sizeof(sub_cap),
+                               sub_cap, &resp_size, resp);
+
+#ifdef TPM_TRACE
+    printk(TBOOT_DETA"TPM: get prop %08X, return value = %08X\n", prop_id, ret);
+#endif
+    if ( ret != TPM_SUCCESS )
+        return ret;
+
+    if ( resp_size != sizeof(resp) ) {
+        printk(TBOOT_WARN"TPM: tpm12_get_duration() response size incorrect\n");
+        return TPM_FAIL;
+    }
+
+    offset = 0;
+    for ( uint32_t i = 0; i < count; i++ )
+        LOAD_INTEGER(resp, offset, duration[i]);
+
+    return ret;
+}
+
 /* ensure TPM is ready to accept commands */
 static bool tpm12_init(struct tpm_if *ti)
 {
     tpm_permanent_flags_t pflags;
     tpm_stclear_flags_t vflags;
     uint32_t timeout[4];
+    uint32_t duration[3];
     uint32_t locality;
     uint32_t ret;
 
@@ -1814,6 +2040,32 @@ static bool tpm12_init(struct tpm_if *ti)
         }
     }
 
+    /* get tpm command durations, used to bound the wait for a response */
+    ret = tpm12_get_duration(locality, duration, ARRAY_SIZE(duration));
+    if ( ret != TPM_SUCCESS ) {
+        printk(TBOOT_WARN"TPM duration values are not achieved, "
+               "timeout C will be used.\n");
+    } else {
+        /* durations are reported in microseconds too */
+        ti->duration.duration_short = duration[0]/1000;
+        ti->duration.duration_medium = duration[1]/1000;
+        ti->duration.duration_long = duration[2]/1000;
+        printk(TBOOT_DETA"TPM duration values: short: %u, medium: %u, long: %u\n",
+               ti->duration.duration_short, ti->duration.duration_medium,
+               ti->duration.duration_long);
+    }
+
+    /* largest NV read that fits the TPM's and our own response buffers */
+    uint32_t input_buffer;
+    ti->nv_buf_max = NV_READ_SEG_SIZE;
+    if ( tpm12_get_input_buffer_size(locality, &input_buffer) == TPM_SUCCESS &&
+         input_buffer > RSP_HEAD_SIZE + sizeof(uint32_t) ) {
+        ti->nv_buf_max = input_buffer - RSP_HEAD_SIZE - sizeof(uint32_t);
+        if ( ti->nv_buf_max > TPM_NV_READ_VALUE_DATA_SIZE_MAX )
+            ti->nv_buf_max = TPM_NV_READ_VALUE_DATA_SIZE_MAX;
+    }
+    printk(TBOOT_DETA"TPM: NV read chunk size = %u\n", ti->nv_buf_max);
+
     /* init version */
     ti->major = TPM12_VER_MAJOR;
     ti->minor = TPM12_VER_MINOR;
@@ -1989,6 +2241,8 @@ static bool tpm12_check(void)
 const struct tpm_if_fp tpm_12_if_fp = {
     .init = tpm12_init,
     .pcr_read = tpm12_pcr_read,
+    .pcr_read_multi = tpm12_pcr_read_multi,
+    .release_sessions = tpm12_release_sessions,
     .pcr_extend = tpm12_pcr_extend,
     .pcr_reset = tpm12_pcr_reset,
     .nv_read = tpm12_nv_read_value,
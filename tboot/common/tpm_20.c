@@ -1577,6 +1577,64 @@ static uint32_t _tpm20_nv_read_public(uint32_t locality,
     return ret;
 }
 
+static uint32_t _tpm20_get_capability(uint32_t locality,
+                                      tpm_get_capability_in *in,
+                                      tpm_get_capability_out *out)
+{
+    u32 ret;
+    u32 cmd_size, rsp_size;
+    void *other;
+
+    /* only TPM properties are parsed */
+    if ( in->capability != TPM_CAP_TPM_PROPERTIES )
+        return TPM_RC_FAILURE;
+
+    reverse_copy_header(TPM_CC_GetCapability, 0);
+
+    other = (void *)cmd_buf + CMD_HEAD_SIZE;
+    reverse_copy_in(other, in->capability);
+    reverse_copy_in(other, in->property);
+    reverse_copy_in(other, in->property_count);
+
+    /* Now set the command size field, now that we know the size of the whole command */
+    cmd_size = (u8 *)other - cmd_buf;
+    reverse_copy(cmd_buf + CMD_SIZE_OFFSET, &cmd_size, sizeof(cmd_size));
+
+    rsp_size = sizeof(rsp_buf);
+
+    if (g_tpm_family == TPM_IF_20_FIFO) {
+        if (!tpm_submit_cmd(locality, cmd_buf, cmd_size, rsp_buf, &rsp_size))
+            return TPM_RC_FAILURE;
+        }
+    if (g_tpm_family == TPM_IF_20_CRB) {
+        if (!tpm_submit_cmd_crb(locality, cmd_buf, cmd_size, rsp_buf, &rsp_size))
+            return TPM_RC_FAILURE;
+        }
+
+    reverse_copy(&ret, rsp_buf + RSP_RST_OFFSET, sizeof(ret));
+    if ( ret != TPM_RC_SUCCESS )
+        return ret;
+
+    other = (void *)rsp_buf + RSP_HEAD_SIZE;
+    reverse_copy_out(out->more_data, other);
+    reverse_copy_out(out->data.capability, other);
+    reverse_copy_out(out->data.data.tpm_properties.count, other);
+    if ( out->data.data.tpm_properties.count > MAX_TPM_PROPERTIES )
+        out->data.data.tpm_properties.count = MAX_TPM_PROPERTIES;
+    for ( u32 i = 0; i < out->data.data.tpm_properties.count; i++ ) {
+        if ( (u8 *)other + sizeof(TPMS_TAGGED_PROPERTY) > rsp_buf + rsp_size ) {
+            out->data.data.tpm_properties.count = i;
+            break;
+        }
+        reverse_copy_out(out->data.data.tpm_properties.tpm_property[i].property,
+                         other);
+        reverse_copy_out(out->data.data.tpm_properties.tpm_property[i].value,
+                         other);
+    }
+
+    return ret;
+}
+
 static uint32_t _tpm20_get_random(uint32_t locality,
                                  tpm_get_random_in *in,
                                  tpm_get_random_out *out)
@@ -1655,7 +1713,14 @@ static uint32_t _tpm20_shutdown(uint32_t locality, u16 type)
     return ret;
 }
 
-__data u32 handle2048 = 0;
+/*
+ * context of the primary key that parents every object tboot seals; it is
+ * saved right after CreatePrimary and kept in __data so that later tboot
+ * entries (post-launch, S3 resume/suspend) only need a ContextLoad rather
+ * than generating another RSA 2048 key
+ */
+static __data tpm_contextsave_out tpm2_context_saved;
+static __data bool tpm2_context_valid = false;
 static const char auth_str[] = "test";
 static uint32_t _tpm20_create_primary(uint32_t locality,
                                      tpm_create_primary_in *in,
@@ -2108,38 +2173,92 @@ static void create_pw_session(TPM_CMD_SESSION_DATA_IN *ses)
     ses->hmac.t.size = 0;
 }
 
-#define SET_PCR_SELECT_BIT( pcr_selection, pcr ) \
-    (pcr_selection).pcr_select[( (pcr)/8 )] |= ( 1 << ( (pcr) % 8) );
-static bool tpm20_pcr_read(struct tpm_if *ti, uint32_t locality,
-                           uint32_t pcr, tpm_pcr_value_t *out)
+static bool tpm20_pcr_read_multi(struct tpm_if *ti, uint32_t locality,
+                                 uint32_t pcr_mask, uint32_t alg_count,
+                                 const uint16_t *algs, tpm_pcr_value_t *out)
 {
     tpm_pcr_read_in read_in;
     tpm_pcr_read_out read_out;
+    TPMS_PCR_SELECTION *sel;
+    u32 remaining[HASH_COUNT];
+    u32 n, i, j, k, pcr, digest;
     u32 ret;
 
-    if ( ti == NULL || out == NULL )
+    if ( ti == NULL || algs == NULL || out == NULL || pcr_mask == 0
+         || (pcr_mask >> IMPLEMENTATION_PCR) != 0
+         || alg_count == 0 || alg_count > HASH_COUNT )
         return false;
 
-    read_in.pcr_selection.count = 1;
-    read_in.pcr_selection.selections[0].hash = ti->cur_alg;
-    read_in.pcr_selection.selections[0].size_of_select = 3;
-    read_in.pcr_selection.selections[0].pcr_select[0] = 0;
-    read_in.pcr_selection.selections[0].pcr_select[1] = 0;
-    read_in.pcr_selection.selections[0].pcr_select[2] = 0;
-    SET_PCR_SELECT_BIT( read_in.pcr_selection.selections[0], pcr );
+    n = tpm_pcr_count(pcr_mask);
+    for ( i = 0; i < alg_count; i++ )
+        remaining[i] = pcr_mask;
+
+    /*
+     * ask for every outstanding PCR of every bank in one TPM2_PCR_Read; the
+     * TPM returns as many digests as fit its response (at most 8) along with
+     * the selection they belong to, so repeat for whatever is left
+     */
+    while ( true ) {
+        read_in.pcr_selection.count = 0;
+        for ( i = 0; i < alg_count; i++ ) {
+            if ( remaining[i] == 0 )
+                continue;
+            sel = &read_in.pcr_selection.selections[read_in.pcr_selection.count++];
+            sel->hash = algs[i];
+            sel->size_of_select = PCR_SELECT_MAX;
+            for ( k = 0; k < PCR_SELECT_MAX; k++ )
+                sel->pcr_select[k] = (u8)(remaining[i] >> (8 * k));
+        }
+        if ( read_in.pcr_selection.count == 0 )
+            return true;
 
-    ret = _tpm20_pcr_read(locality, &read_in, &read_out);
-    if (ret != TPM_RC_SUCCESS) {
-        printk(TBOOT_WARN"TPM: Pcr %d Read return value = %08X\n", pcr, ret);
-        ti->error = ret;
-        return false;
+        ret = _tpm20_pcr_read(locality, &read_in, &read_out);
+        if ( ret != TPM_RC_SUCCESS ) {
+            printk(TBOOT_WARN"TPM: Pcr mask %08X Read return value = %08X\n",
+                   pcr_mask, ret);
+            ti->error = ret;
+            return false;
+        }
+
+        /* digests are returned bank by bank, lowest PCR first */
+        digest = 0;
+        for ( j = 0; j < read_out.pcr_selection.count; j++ ) {
+            sel = &read_out.pcr_selection.selections[j];
+            for ( i = 0; i < alg_count && algs[i] != sel->hash; i++ )
+                ;
+            if ( i == alg_count )
+                return false;
+            for ( pcr = 0; pcr < 8 * sel->size_of_select; pcr++ ) {
+                if ( !(sel->pcr_select[pcr / 8] & (1 << (pcr % 8))) )
+                    continue;
+                if ( digest >= read_out.pcr_values.count
+                     || !(remaining[i] & TPM_PCR_MASK(pcr)) )
+                    return false;
+                copy_hash(&out[i * n + tpm_pcr_count(pcr_mask & (TPM_PCR_MASK(pcr) - 1))],
+                        (tb_hash_t *)&(read_out.pcr_values.digests[digest].t.buffer[0]),
+                        algs[i]);
+                remaining[i] &= ~TPM_PCR_MASK(pcr);
+                digest++;
+            }
+        }
+
+        /* an unallocated bank or unimplemented PCR is returned empty */
+        if ( digest == 0 ) {
+            printk(TBOOT_WARN"TPM: Pcr mask %08X Read returned no values\n",
+                   pcr_mask);
+            return false;
+        }
     }
+}
 
-    copy_hash(out,
-            (tb_hash_t *)&(read_out.pcr_values.digests[0].t.buffer[0]),
-            ti->cur_alg);
+static bool tpm20_pcr_read(struct tpm_if *ti, uint32_t locality,
+                           uint32_t pcr, tpm_pcr_value_t *out)
+{
+    if ( ti == NULL || out == NULL || pcr >= IMPLEMENTATION_PCR )
+        return false;
 
-    return true;
+    return tpm20_pcr_read_multi(ti, locality, TPM_PCR_MASK(pcr), 1,
+                                &ti->cur_alg, out);
 }
 
 static bool tpm20_pcr_extend(struct tpm_if *ti, uint32_t locality,
@@ -2388,15 +2507,121 @@ static bool tpm20_get_nvindex_permission(struct tpm_if *ti, uint32_t locality,
     return true;
 }
 
+static bool tpm20_create_primary_key(struct tpm_if *ti, uint32_t locality,
+                                     TPM_HANDLE *handle)
+{
+    tpm_create_primary_in primary_in;
+    tpm_create_primary_out primary_out;
+    u32 ret;
+
+    primary_in.primary_handle = TPM_RH_NULL;
+    primary_in.sessions.num_sessions = 1;
+    primary_in.sessions.sessions[0].session_handle = TPM_RS_PW;
+    primary_in.sessions.sessions[0].nonce.t.size = 0;
+    primary_in.sessions.sessions[0].hmac.t.size = 0;
+    *((u8 *)((void *)&primary_in.sessions.sessions[0].session_attr)) = 0;
+
+    primary_in.sensitive.t.sensitive.user_auth.t.size = 2;
+    primary_in.sensitive.t.sensitive.user_auth.t.buffer[0] = 0x00;
+    primary_in.sensitive.t.sensitive.user_auth.t.buffer[1] = 0xff;
+    primary_in.sensitive.t.sensitive.data.t.size = 0;
+
+    primary_in.public.t.public_area.type = TPM_ALG_RSA;
+    primary_in.public.t.public_area.name_alg = ti->cur_alg;
+    *(u32 *)&primary_in.public.t.public_area.object_attr = 0;
+    primary_in.public.t.public_area.object_attr.restricted = 1;
+    primary_in.public.t.public_area.object_attr.userWithAuth = 1;
+    primary_in.public.t.public_area.object_attr.decrypt = 1;
+    primary_in.public.t.public_area.object_attr.fixedTPM = 1;
+    primary_in.public.t.public_area.object_attr.fixedParent = 1;
+    primary_in.public.t.public_area.object_attr.noDA = 1;
+    primary_in.public.t.public_area.object_attr.sensitiveDataOrigin = 1;
+    primary_in.public.t.public_area.auth_policy.t.size = 0;
+    primary_in.public.t.public_area.param.rsa.symmetric.alg = TPM_ALG_AES;
+    primary_in.public.t.public_area.param.rsa.symmetric.key_bits.aes= 128;
+    primary_in.public.t.public_area.param.rsa.symmetric.mode.aes = TPM_ALG_CFB;
+    primary_in.public.t.public_area.param.rsa.scheme.scheme = TPM_ALG_NULL;
+    primary_in.public.t.public_area.param.rsa.key_bits = 2048;
+    primary_in.public.t.public_area.param.rsa.exponent = 0;
+    primary_in.public.t.public_area.unique.keyed_hash.t.size = 0;
+    primary_in.outside_info.t.size = 0;
+    primary_in.creation_pcr.count = 0;
+    
+    printk(TBOOT_DETA"TPM:CreatePrimary creating hierarchy handle = %08X\n", primary_in.primary_handle);
+    ret = _tpm20_create_primary(locality, &primary_in, &primary_out);
+    if (ret != TPM_RC_SUCCESS) {
+        printk(TBOOT_WARN"TPM: CreatePrimary return value = %08X\n", ret);
+        ti->error = ret;
+        return false;
+    }
+    *handle = primary_out.obj_handle;
+
+    printk(TBOOT_DETA"TPM:CreatePrimary created object handle = %08X\n", *handle);
+    return true;
+}
+
+static void tpm20_flush_handle(uint32_t locality, TPM_HANDLE handle)
+{
+    tpm_flushcontext_in in;
+    u32 ret;
+
+    in.flushHandle = handle;
+    ret = _tpm20_context_flush(locality, &in);
+    if ( ret != TPM_RC_SUCCESS )
+        printk(TBOOT_WARN"TPM: FlushContext of %08X return value = %08X\n",
+               handle, ret);
+}
+
+/*
+ * load the seal parent key: reload its saved context when there is one,
+ * otherwise (first use in this boot, or the saved context no longer loads)
+ * create it and save its context for the next tboot entry.  the caller
+ * must flush the returned handle when done so that no transient object is
+ * left behind for the kernel.
+ */
+static bool tpm20_load_primary_key(struct tpm_if *ti, uint32_t locality,
+                                   TPM_HANDLE *handle)
+{
+    tpm_contextload_in load_in;
+    tpm_contextload_out load_out;
+    tpm_contextsave_in save_in;
+    u32 ret;
+
+    if ( tpm2_context_valid ) {
+        tb_memcpy(&load_in, &tpm2_context_saved, sizeof(tpm2_context_saved));
+        ret = _tpm20_context_load(locality, &load_in, &load_out);
+        if ( ret == TPM_RC_SUCCESS ) {
+            *handle = load_out.loadedHandle;
+            return true;
+        }
+        printk(TBOOT_WARN"TPM: ContextLoad of primary key return value = "
+               "%08X, recreating it\n", ret);
+        tpm2_context_valid = false;
+    }
+
+    if ( !tpm20_create_primary_key(ti, locality, handle) )
+        return false;
+
+    save_in.saveHandle = *handle;
+    ret = _tpm20_context_save(locality, &save_in, &tpm2_context_saved);
+    if ( ret == TPM_RC_SUCCESS )
+        tpm2_context_valid = true;
+    else
+        printk(TBOOT_WARN"TPM: ContextSave of primary key return value = "
+               "%08X\n", ret);
+
+    return true;
+}
+
 static bool tpm20_seal(struct tpm_if *ti, uint32_t locality,
                        uint32_t in_data_size, const uint8_t *in_data,
                        uint32_t *sealed_data_size, uint8_t *sealed_data)
 {
     tpm_create_in create_in; 
     tpm_create_out create_out; 
+    TPM_HANDLE primary_handle;
     u32 ret;
 
-    create_in.parent_handle = handle2048;
     create_in.sessions.num_sessions = 1;
     create_in.sessions.sessions[0] = pw_session;
     create_in.sessions.sessions[0].hmac.t.size = 2;
@@ -2433,7 +2658,12 @@ static bool tpm20_seal(struct tpm_if *ti, uint32_t locality,
     create_in.creation_pcr.count = 0;
     tb_memset(&create_out, 0, sizeof(create_out));
 
+    if ( !tpm20_load_primary_key(ti, locality, &primary_handle) )
+        return false;
+    create_in.parent_handle = primary_handle;
+
     ret = _tpm20_create(locality, &create_in, &create_out);
+    tpm20_flush_handle(locality, primary_handle);
     if ( ret != TPM_RC_SUCCESS ) {
         printk(TBOOT_WARN"TPM: Create return value = %08X\n", ret);
         ti->error = ret;
@@ -2453,6 +2683,7 @@ static bool tpm20_unseal(struct tpm_if *ti, uint32_t locality,
     tpm_load_out load_out; 
     tpm_unseal_in unseal_in; 
     tpm_unseal_out unseal_out; 
+    TPM_HANDLE primary_handle;
     u32 ret;
 
     if ( ti == NULL || locality >= TPM_NR_LOCALITIES
@@ -2460,7 +2691,9 @@ static bool tpm20_unseal(struct tpm_if *ti, uint32_t locality,
         return false;
 
     /* For TPM 2.0, the object will need to be loaded before it may be used.*/
-    load_in.parent_handle = handle2048;
+    if ( !tpm20_load_primary_key(ti, locality, &primary_handle) )
+        return false;
+    load_in.parent_handle = primary_handle;
     load_in.sessions.num_sessions = 1;
     load_in.sessions.sessions[0] = pw_session;
     load_in.sessions.sessions[0].hmac.t.size = 2;
@@ -2470,6 +2703,7 @@ static bool tpm20_unseal(struct tpm_if *ti, uint32_t locality,
     load_in.public = ((tpm_create_out *)sealed_data)->public;
 
     ret = _tpm20_load(locality, &load_in, &load_out);
+    tpm20_flush_handle(locality, primary_handle);
     if ( ret != TPM_RC_SUCCESS ) {
         printk(TBOOT_WARN"TPM: Load return value = %08X\n", ret);
         ti->error = ret;
@@ -2484,6 +2718,7 @@ static bool tpm20_unseal(struct tpm_if *ti, uint32_t locality,
     unseal_in.item_handle = load_out.obj_handle;
 
     ret = _tpm20_unseal(locality, &unseal_in, &unseal_out);
+    tpm20_flush_handle(locality, load_out.obj_handle);
     if ( ret != TPM_RC_SUCCESS ) {
         printk(TBOOT_WARN"TPM: Unseal return value = %08X\n", ret);
         ti->error = ret;
@@ -2624,8 +2859,6 @@ static bool alg_is_supported(u16 alg)
 
     return false;
 }
-__data tpm_contextsave_out tpm2_context_saved;
-
 static bool tpm20_context_save(struct tpm_if *ti, u32 locality, TPM_HANDLE handle, void *context_saved)
 {
     tpm_contextsave_in in;
@@ -2694,6 +2927,34 @@ static bool tpm20_context_flush(struct tpm_if *ti, u32 locality, TPM_HANDLE hand
     return true;
 }	
 
+static bool tpm20_get_property(struct tpm_if *ti, u32 locality,
+                               TPM_PT property, u32 *value)
+{
+    tpm_get_capability_in in;
+    tpm_get_capability_out out;
+    u32 ret;
+
+    in.capability = TPM_CAP_TPM_PROPERTIES;
+    in.property = property;
+    in.property_count = 1;
+
+    ret = _tpm20_get_capability(locality, &in, &out);
+    if ( ret != TPM_RC_SUCCESS ) {
+        printk(TBOOT_WARN"TPM: get property 0x%08X, return value = %08X\n",
+               property, ret);
+        ti->error = ret;
+        return false;
+    }
+    if ( out.data.data.tpm_properties.count == 0 ||
+         out.data.data.tpm_properties.tpm_property[0].property != property ) {
+        printk(TBOOT_WARN"TPM: property 0x%08X not reported\n", property);
+        return false;
+    }
+
+    *value = out.data.data.tpm_properties.tpm_property[0].value;
+    return true;
+}
+
 static bool tpm20_init(struct tpm_if *ti)
 {
     u32 ret;
@@ -2718,6 +2979,18 @@ static bool tpm20_init(struct tpm_if *ti)
     ti->timeout.timeout_c = TIMEOUT_C;
     ti->timeout.timeout_d = TIMEOUT_D;
 
+    /* largest NV read the TPM (and our TPM2B buffers) can handle at once */
+    u32 nv_buffer_max = 0;
+    ti->nv_buf_max = NV_READ_SEG_SIZE;
+    if ( tpm20_get_property(ti, ti->cur_loc, TPM_PT_NV_BUFFER_MAX,
+                            &nv_buffer_max) && nv_buffer_max > 0 ) {
+        ti->nv_buf_max = nv_buffer_max;
+        if ( ti->nv_buf_max > MAX_NV_INDEX_SIZE )
+            ti->nv_buf_max = MAX_NV_INDEX_SIZE;
+    }
+    printk(TBOOT_DETA"TPM: NV buffer max = %u, using %u\n",
+           nv_buffer_max, ti->nv_buf_max);
+
     /* get pcr extend policy from cmdline */
     get_tboot_extpol();
     if (info_list->capabilities.tpm_nv_index_set == 0){
@@ -2778,56 +3051,6 @@ static bool tpm20_init(struct tpm_if *ti)
 	return false;
     }
 
-    if (handle2048 != 0)
-        goto out;
-
-    /* create primary object as parent obj for seal */
-    tpm_create_primary_in primary_in;
-    tpm_create_primary_out primary_out;
-    primary_in.primary_handle = TPM_RH_NULL;
-    primary_in.sessions.num_sessions = 1;
-    primary_in.sessions.sessions[0].session_handle = TPM_RS_PW;
-    primary_in.sessions.sessions[0].nonce.t.size = 0;
-    primary_in.sessions.sessions[0].hmac.t.size = 0;
-    *((u8 *)((void *)&primary_in.sessions.sessions[0].session_attr)) = 0;
-
-    primary_in.sensitive.t.sensitive.user_auth.t.size = 2;
-    primary_in.sensitive.t.sensitive.user_auth.t.buffer[0] = 0x00;
-    primary_in.sensitive.t.sensitive.user_auth.t.buffer[1] = 0xff;
-    primary_in.sensitive.t.sensitive.data.t.size = 0;
-
-    primary_in.public.t.public_area.type = TPM_ALG_RSA;
-    primary_in.public.t.public_area.name_alg = ti->cur_alg;
-    *(u32 *)&primary_in.public.t.public_area.object_attr = 0;
-    primary_in.public.t.public_area.object_attr.restricted = 1;
-    primary_in.public.t.public_area.object_attr.userWithAuth = 1;
-    primary_in.public.t.public_area.object_attr.decrypt = 1;
-    primary_in.public.t.public_area.object_attr.fixedTPM = 1;
-    primary_in.public.t.public_area.object_attr.fixedParent = 1;
-    primary_in.public.t.public_area.object_attr.noDA = 1;
-    primary_in.public.t.public_area.object_attr.sensitiveDataOrigin = 1;
-    primary_in.public.t.public_area.auth_policy.t.size = 0;
-    primary_in.public.t.public_area.param.rsa.symmetric.alg = TPM_ALG_AES;
-    primary_in.public.t.public_area.param.rsa.symmetric.key_bits.aes= 128;
-    primary_in.public.t.public_area.param.rsa.symmetric.mode.aes = TPM_ALG_CFB;
-    primary_in.public.t.public_area.param.rsa.scheme.scheme = TPM_ALG_NULL;
-    primary_in.public.t.public_area.param.rsa.key_bits = 2048;
-    primary_in.public.t.public_area.param.rsa.exponent = 0;
-    primary_in.public.t.public_area.unique.keyed_hash.t.size = 0;
-    primary_in.outside_info.t.size = 0;
-    primary_in.creation_pcr.count = 0;
-    
-    printk(TBOOT_DETA"TPM:CreatePrimary creating hierarchy handle = %08X\n", primary_in.primary_handle);
-    ret = _tpm20_create_primary(ti->cur_loc, &primary_in, &primary_out);
-    if (ret != TPM_RC_SUCCESS) {
-        printk(TBOOT_WARN"TPM: CreatePrimary return value = %08X\n", ret);
-        ti->error = ret;
-        return false;
-    }
-    handle2048 = primary_out.obj_handle;
- 
-    printk(TBOOT_DETA"TPM:CreatePrimary created object handle = %08X\n", handle2048);
-out:
     tpm_print(ti);
     return true;
 }
@@ -2835,6 +3058,7 @@ out:
 const struct tpm_if_fp tpm_20_if_fp = {
     .init = tpm20_init,
     .pcr_read = tpm20_pcr_read,
+    .pcr_read_multi = tpm20_pcr_read_multi,
     .pcr_extend = tpm20_pcr_extend,
     .hash = tpm20_hash,
     .pcr_reset = tpm20_pcr_reset,
@@ -225,6 +225,7 @@ struct acpi_madt_lapic {
 	u_int8_t	apic_id;
 	u_int32_t	flags;
 #define	ACPI_PROC_ENABLE	0x00000001
+#define	ACPI_PROC_ONLINE_CAPABLE	0x00000002
 } __packed;
 
 struct acpi_madt_ioapic {
@@ -322,6 +323,16 @@ struct acpi_madt_platform_int {
 #define	ACPI_MADT_PLATFORM_CPEI		0x00000001
 } __packed;
 
+struct acpi_madt_x2apic {
+	u_int8_t	apic_type;
+#define	ACPI_MADT_X2APIC	9
+	u_int8_t	length;
+	u_int16_t	reserved;
+	u_int32_t	x2apic_id;
+	u_int32_t	flags;		/* Same flags as acpi_madt_lapic */
+	u_int32_t	acpi_proc_uid;
+} __packed;
+
 union acpi_madt_entry {
 	struct acpi_madt_lapic		madt_lapic;
 	struct acpi_madt_ioapic		madt_ioapic;
@@ -332,6 +343,7 @@ union acpi_madt_entry {
 	struct acpi_madt_io_sapic	madt_io_sapic;
 	struct acpi_madt_local_sapic	madt_local_sapic;
 	struct acpi_madt_platform_int	madt_platform_int;
+	struct acpi_madt_x2apic		madt_x2apic;
 } __packed;
 
 struct device_scope {
@@ -498,6 +510,7 @@ extern bool remove_vtd_dmar_table(void);
 
 extern struct acpi_table_ioapic *get_acpi_ioapic_table(void);
 extern struct acpi_mcfg *get_acpi_mcfg_table(void);
+extern bool get_madt_max_apic_id(uint32_t *max_id);
 extern void disable_smis(void);
 
 extern bool machine_sleep(const tboot_acpi_sleep_info_t *);
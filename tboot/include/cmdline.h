@@ -57,6 +57,8 @@ extern bool get_tboot_measure_nv(void);
 extern void get_tboot_extpol(void);
 extern bool get_tboot_force_tpm2_legacy_log(void);
 extern bool get_tboot_save_vtd(void);
+extern bool get_tboot_decompress_kernel(void);
+extern bool get_tboot_decompress_all(void);
 
 /* for parse cmdline of linux kernel, say vga and mem */
 extern void linux_parse_cmdline(const char *cmdline);
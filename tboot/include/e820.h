@@ -77,11 +77,22 @@ typedef struct {
 	uint64_t attribute;
 } efi_memory_desc_t;
 
+/* a range to protect or reserve in bulk */
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+    uint32_t type;
+} e820_range_t;
+
 extern memory_map_t *get_e820_copy(void);
 extern unsigned int get_nr_map(void);
 extern bool copy_e820_map(loader_ctx *lctx);
 extern bool e820_protect_region(uint64_t addr, uint64_t size, uint32_t type);
 extern bool e820_reserve_ram(uint64_t base, uint64_t length);
+extern bool e820_protect_regions(const e820_range_t *ranges,
+                                 unsigned int nr_ranges);
+extern bool e820_reserve_ram_regions(const e820_range_t *ranges,
+                                     unsigned int nr_ranges);
 extern void print_e820_map(void);
 extern uint32_t e820_check_region(uint64_t base, uint64_t length);
 extern bool get_ram_ranges(uint64_t *min_lo_ram, uint64_t *max_lo_ram,
@@ -36,9 +36,22 @@
 #ifndef __LOADER_H__
 #define __LOADER_H__
 
+/* number of MB2 module tags whose location is cached in loader_ctx: every
+   module a launch policy can name (TB_POL_MAX_MOD_NUM + 1) */
+#define LOADER_CTX_MOD_INDEX_SIZE   128
+
 typedef struct {
     void *addr;
     uint32_t type;
+    /* MB2 only: module count and offsets (from addr) of the module tags,
+       built on first use and dropped whenever the tag list is reshuffled;
+       offsets stay valid when the whole structure is moved; past the index,
+       the last module looked up is remembered so in-order walks stay linear */
+    bool mod_index_valid;
+    uint32_t mod_count;
+    uint32_t mod_offsets[LOADER_CTX_MOD_INDEX_SIZE];
+    uint32_t mod_cursor;
+    uint32_t mod_cursor_offset;
 } loader_ctx;
 
 extern loader_ctx *g_ldr_ctx;
@@ -85,6 +98,9 @@ extern bool verify_modules(loader_ctx *lctx);
 extern module_t *get_module(loader_ctx *lctx, unsigned int i);
 extern unsigned int get_module_count(loader_ctx *lctx);
 extern bool remove_txt_modules(loader_ctx *lctx);
+extern bool decompress_modules(loader_ctx *lctx);
+extern bool relocate_kernel_modules(loader_ctx *lctx);
+extern bool relocate_modules_from_tboot(loader_ctx *lctx);
 
 extern bool	have_loader_memlimits(loader_ctx *lctx);
 extern bool have_loader_memmap(loader_ctx *lctx);
@@ -44,6 +44,10 @@ extern "C" {
 int LZ_Compress( char *in, char *out, unsigned int insize, unsigned int outsize );
 int LZ_Uncompress( char *in, char *out, unsigned int insize, unsigned int outsize );
 
+typedef void (*LZ_Writer)( const char *buf, unsigned int len, void *ctx );
+int LZ_UncompressStream( char *in, unsigned int insize, unsigned int outsize,
+                         LZ_Writer writer, void *ctx );
+
 
 #ifdef __cplusplus
 }
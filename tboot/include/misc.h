@@ -39,6 +39,9 @@
 extern void print_hex(const char * buf, const void * prtptr, size_t size);
 
 extern void delay(int millisecs);
+extern uint64_t tsc_deadline(uint32_t millisecs);
+extern bool tsc_expired(uint64_t deadline);
+extern uint32_t tsc_to_microsecs(uint64_t ticks);
 
 /*
  *  These three "plus overflow" functions take a "x" value
@@ -23,6 +23,10 @@ typedef struct {
     unsigned char buf[64];
 }sha256_state;
 
+void sha256_init(sha256_state *md);
+int sha256_process(sha256_state *md, const unsigned char *in,
+                   unsigned long inlen);
+int sha256_done(sha256_state *md, unsigned char *out);
 void sha256_buffer(const unsigned char *buffer, size_t len,
                   unsigned char hash[32]);
 
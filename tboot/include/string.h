@@ -40,6 +40,7 @@
 #include <types.h>
 
 int	 tb_memcmp(const void *b1, const void *b2, size_t len);
+int	 tb_consttime_memequal(const void *b1, const void *b2, size_t len);
 char	*tb_index(const char *, int);
 int	 tb_strcmp(const char *, const char *);
 size_t	 tb_strlen(const char *);
@@ -52,10 +53,20 @@ unsigned long tb_strtoul(const char *nptr, char **endptr, int base);
 
 static inline void *tb_memset(void *b, int c, size_t len)
 {
-	char *bb;
+	void *bb = b;
+	size_t n = len / sizeof(uint32_t);
+	uint32_t w = (unsigned char)c * 0x01010101U;
 
-	for (bb = (char *)b; len--; )
-		*bb++ = c;
+	/* whole dwords, then the (at most 3) trailing bytes */
+	__asm__ __volatile__ ("rep stosl"
+			      : "+D" (bb), "+c" (n)
+			      : "a" (w)
+			      : "memory");
+	n = len & (sizeof(uint32_t) - 1);
+	__asm__ __volatile__ ("rep stosb"
+			      : "+D" (bb), "+c" (n)
+			      : "a" (w)
+			      : "memory");
 
 	return (b);
 }
@@ -98,11 +98,11 @@
 /*
  * The term timeout applies to timings between various states
  * or transitions within the interface protocol.
+ * All values are in milliseconds.
  */
-#define TIMEOUT_UNIT    (0x100000 / 330) /* ~1ms, 1 tpm r/w need > 330ns */
 #define TIMEOUT_A       750  /* 750ms */
 #define TIMEOUT_B       2000 /* 2s */
-#define TIMEOUT_C       75000  /* 750ms */
+#define TIMEOUT_C       75000  /* 75s */
 #define TIMEOUT_D       750  /* 750ms */
 
 typedef struct __packed {
@@ -112,6 +112,21 @@ typedef struct __packed {
     uint32_t timeout_d;
 } tpm_timeout_t;
 
+/*
+ * The term duration applies to the time a command takes to execute; only
+ * TPM 1.2 reports them (TPM_CAP_PROP_DURATION), TPM 2.0 relies on the
+ * timeouts above. 0 means unknown.
+ */
+#define DURATION_SHORT  0
+#define DURATION_MEDIUM 0
+#define DURATION_LONG   0
+
+typedef struct __packed {
+    uint32_t duration_short;
+    uint32_t duration_medium;
+    uint32_t duration_long;
+} tpm_duration_t;
+
 /*
  * The TCG maintains a registry of all algorithms that have an
  * assigned algorithm ID. That registry is the definitive list
@@ -406,12 +421,30 @@ static inline void _reverse_copy(uint8_t *out, uint8_t *in, uint32_t count)
         out[i] = in[count - i - 1];
 }
 
+/*
+ * NV reads are issued in chunks of tpm_if.nv_buf_max bytes, which is
+ * queried from the TPM at init; this is the fallback if the query fails
+ */
+#define NV_READ_SEG_SIZE    256
+
 /* alg id list supported by Tboot */
 extern u16 tboot_alg_list[];
 
 typedef tb_hash_t tpm_digest_t;
 typedef tpm_digest_t tpm_pcr_value_t;
 
+#define TPM_PCR_MASK(pcr)     (1U << (pcr))
+
+/* number of PCRs selected in a pcr_mask */
+static inline u32 tpm_pcr_count(u32 pcr_mask)
+{
+    u32 count = 0;
+
+    for ( ; pcr_mask != 0; pcr_mask &= pcr_mask - 1 )
+        count++;
+    return count;
+}
+
 /* only for tpm1.2 to (un)seal */
 extern tpm_pcr_value_t post_launch_pcr17;
 extern tpm_pcr_value_t post_launch_pcr18;
@@ -429,6 +462,7 @@ struct tpm_if {
     u16 family;
 
     tpm_timeout_t timeout;
+    tpm_duration_t duration;
 
     u32 error; /* last reported error */
     u32 cur_loc;
@@ -447,6 +481,9 @@ struct tpm_if {
     u8 extpol;
     u16 cur_alg;
 
+    /* max bytes returned by a single NV read command */
+    u32 nv_buf_max;
+
     /* NV index to be used */
     u32 lcp_own_index;
     u32 tb_policy_index;
@@ -459,6 +496,11 @@ struct tpm_if_fp {
     bool (*init)(struct tpm_if *ti);
 
     bool (*pcr_read)(struct tpm_if *ti, u32 locality, u32 pcr, tpm_pcr_value_t *out);
+    /* reads every PCR in pcr_mask from each of the alg_count banks in algs
+       with as few commands as the TPM allows; out[b * n + i] receives the
+       i-th lowest selected PCR of bank b, n being tpm_pcr_count(pcr_mask) */
+    bool (*pcr_read_multi)(struct tpm_if *ti, u32 locality, u32 pcr_mask,
+                           u32 alg_count, const u16 *algs, tpm_pcr_value_t *out);
     bool (*pcr_extend)(struct tpm_if *ti, u32 locality, u32 pcr, const hash_list_t *in);
     bool (*pcr_reset)(struct tpm_if *ti, u32 locality, u32 pcr);
     bool (*hash)(struct tpm_if *ti, u32 locality, const u8 *data, u32 data_size, hash_list_t *hl);
@@ -478,6 +520,9 @@ struct tpm_if_fp {
     bool (*seal)(struct tpm_if *ti, u32 locality, u32 in_data_size, const u8 *in_data, u32 *sealed_data_size, u8 *sealed_data);
     bool (*unseal)(struct tpm_if *ti, u32 locality, u32 sealed_data_size, const u8 *sealed_data, u32 *secret_size, u8 *secret);
     bool (*verify_creation)(struct tpm_if *ti, u32 sealed_data_size, u8 *sealed_data);
+    /* closes authorization sessions kept open across seal/unseal calls;
+       NULL if the TPM family keeps none */
+    void (*release_sessions)(struct tpm_if *ti, u32 locality);
 
     bool (*get_random)(struct tpm_if *ti, u32 locality, u8 *random_data, u32 *data_size);
 
@@ -503,6 +548,12 @@ extern bool release_locality(uint32_t locality);
 extern bool prepare_tpm(void);
 extern bool tpm_detect(void);
 extern void tpm_print(struct tpm_if *ti);
+extern void tpm_print_cmd_stats(void);
+extern void tpm_nv_cache_invalidate(void);
+extern bool tpm_nv_read(struct tpm_if *ti, u32 locality, u32 index, u32 offset, u8 *data, u32 *data_size);
+extern bool tpm_nv_write(struct tpm_if *ti, u32 locality, u32 index, u32 offset, const u8 *data, u32 data_size);
+extern bool tpm_get_nvindex_size(struct tpm_if *ti, u32 locality, u32 index, u32 *size);
+extern bool tpm_get_nvindex_permission(struct tpm_if *ti, u32 locality, u32 index, u32 *attribute);
 extern bool tpm_submit_cmd(u32 locality, u8 *in, u32 in_size, u8 *out, u32 *out_size);
 extern bool tpm_submit_cmd_crb(u32 locality, u8 *in, u32 in_size, u8 *out, u32 *out_size);
 extern bool tpm_wait_cmd_ready(uint32_t locality);
@@ -511,6 +511,14 @@ typedef u32 TPM_CAP;
 #define TPM_CAP_LAST               (TPM_CAP)(0x00000008)    
 #define TPM_CAP_VENDOR_PROPERTY    (TPM_CAP)(0x00000100) 
 
+// Table 23 -- TPM_PT Constants <I/O,S>
+typedef u32 TPM_PT;
+
+#define PT_GROUP                   (TPM_PT)(0x00000100)
+#define PT_FIXED                   (TPM_PT)(PT_GROUP * 1)
+#define TPM_PT_INPUT_BUFFER        (TPM_PT)(PT_FIXED + 13)
+#define TPM_PT_NV_BUFFER_MAX       (TPM_PT)(PT_FIXED + 44)
+
 // Table 25 -- Handles Types <I/O>
 typedef u32     TPM_HANDLE;
 typedef u8      TPM_HT;
@@ -763,9 +771,23 @@ typedef struct {
     TPMS_ALG_PROPERTY    alg_pros[MAX_CAP_ALGS];
 } TPML_ALG_PROPERTY;
 
+// Table 91 -- TPMS_TAGGED_PROPERTY Structure <O,S>
+typedef struct {
+    TPM_PT    property;
+    u32       value;
+} TPMS_TAGGED_PROPERTY;
+
+#define MAX_TPM_PROPERTIES  (MAX_CAP_DATA/sizeof(TPMS_TAGGED_PROPERTY))
+// Table 101 -- TPML_TAGGED_TPM_PROPERTY Structure <O,S>
+typedef struct {
+    u32                     count;
+    TPMS_TAGGED_PROPERTY    tpm_property[MAX_TPM_PROPERTIES];
+} TPML_TAGGED_TPM_PROPERTY;
+
 // Table 103 -- TPMU_CAPABILITIES Union <O,S>
 typedef union {
     TPML_ALG_PROPERTY  algs;  
+    TPML_TAGGED_TPM_PROPERTY  tpm_properties;
 } TPMU_CAPABILITIES;
 
 // Table 104 -- TPMS_CAPABILITY_DATA Structure <O,S>
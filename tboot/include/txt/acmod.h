@@ -170,6 +170,50 @@ typedef struct __packed {
     acm_processor_id_t   processor_ids[];
 } acm_processor_id_list_t;
 
+/*
+ * ACM catalog: a module made by acminfo --catalog from a directory of ACMs,
+ * so that tboot can pick the ACM for the platform from among many modules
+ * without walking every ACM's chipset and processor ID lists.  It is only
+ * a hint: whatever it points at is still checked like any other ACM.
+ */
+#define ACM_CATALOG_SIGNATURE   "TBOOT ACM CATALOG"
+#define ACM_CATALOG_VER         1
+#define ACM_CATALOG_MAX_ENTRIES 0x10000
+
+/* identifies an ACM among the modules */
+typedef struct __packed {
+    uint32_t  size;                 /* acm_hdr_t.size */
+    uint32_t  date;
+    uint8_t   sig_prefix[16];       /* start of acm_hdr_t.rsa2048_sig */
+    uint8_t   chipset_acm_type;
+    uint8_t   debug_signed;
+    uint16_t  reserved;
+} acm_catalog_acm_t;
+
+/*
+ * one per chipset ID/processor ID pair of each ACM, sorted by chipset
+ * vendor/device ID and then by preference (newest ACM first); ACMs
+ * without a processor ID list get an all-0 (match any) processor ID
+ */
+typedef struct __packed {
+    acm_chipset_id_t    chipset;
+    acm_processor_id_t  processor;
+    uint32_t            acm;        /* index into the ACM table */
+} acm_catalog_key_t;
+
+typedef struct __packed {
+    char      signature[20];        /* ACM_CATALOG_SIGNATURE, 0-padded */
+    uint16_t  version;
+    uint16_t  reserved;
+    uint32_t  num_acms;
+    uint32_t  num_keys;
+    /* acm_catalog_acm_t acms[num_acms]; */
+    /* acm_catalog_key_t keys[num_keys]; */
+} acm_catalog_hdr_t;
+
+/* for the type mask of next_acm_catalog_match() */
+#define ACM_CATALOG_TYPE(t)     (1U << (t))
+
 extern void print_txt_caps(const char *prefix, txt_caps_t caps);
 extern bool is_racm_acmod(const void *acmod_base, uint32_t acmod_size, bool quiet);
 extern acm_hdr_t *copy_racm(const acm_hdr_t *racm);
@@ -182,6 +226,13 @@ extern uint32_t get_supported_os_sinit_data_ver(const acm_hdr_t* hdr);
 extern txt_caps_t get_sinit_capabilities(const acm_hdr_t* hdr);
 extern tpm_info_list_t *get_tpm_info_list(const acm_hdr_t* hdr);
 extern void verify_IA32_se_svn_status(const acm_hdr_t *acm_hdr);
+extern void get_acm_catalog_id(const acm_hdr_t *hdr, acm_catalog_acm_t *id);
+extern bool is_acm_catalog(const void *base, uint32_t size);
+extern const acm_catalog_acm_t *next_acm_catalog_match(const void *catalog,
+                                                       uint32_t type_mask,
+                                                       uint32_t *pos);
+extern bool is_acm_catalog_entry(const acm_catalog_acm_t *id,
+                                 const void *base, uint32_t size);
 #endif /* __TXT_ACMOD_H__ */
 
 /*
@@ -128,7 +128,16 @@ typedef struct {
     mtrr_physmask_t     mtrr_physmasks[MAX_VARIABLE_MTRRS];
 } mtrr_state_t;
 
+/* a variable MTRR's range: a naturally aligned power-of-two block */
+typedef struct {
+    uint64_t     base;          /* in pages */
+    unsigned int order;         /* size is 2^order pages */
+    uint8_t      type;
+} mtrr_block_t;
+
 extern bool set_mtrrs_for_acmod(const acm_hdr_t *hdr);
+extern int plan_mtrr_cover(uint64_t base, uint64_t nr_pages, uint8_t mem_type,
+                           mtrr_block_t *plan, unsigned int max);
 extern void save_mtrrs(mtrr_state_t *saved_state);
 extern void set_all_mtrrs(bool enable);
 extern bool set_mem_type(const void *base, uint32_t size, uint32_t mem_type);
@@ -544,41 +544,73 @@ bool is_sinit_acmod(const void *acmod_base, uint32_t acmod_size, bool quiet)
     return true;
 }
 
-bool does_acmod_match_platform(const acm_hdr_t* hdr)
+/* what ACMs' chipset and processor ID lists are matched against */
+typedef struct {
+    txt_didvid_t  didvid;
+    bool          prod_fused;
+    uint32_t      fms;
+    uint64_t      platform_id;
+} platform_ids_t;
+
+static void get_platform_ids(platform_ids_t *ids)
 {
-    /* used to ensure we don't print chipset/proc info for each module */
-    static bool printed_host_info;
-
-    /* this fn assumes that the ACM has already passed the is_acmod() checks */
+    txt_ver_fsbif_qpiif_t ver;
 
     /* get chipset fusing, device, and vendor id info */
-    txt_didvid_t didvid;
-    didvid._raw = read_pub_config_reg(TXTCR_DIDVID);
-    txt_ver_fsbif_qpiif_t ver;
+    ids->didvid._raw = read_pub_config_reg(TXTCR_DIDVID);
     ver._raw = read_pub_config_reg(TXTCR_VER_FSBIF);
     if ( (ver._raw & 0xffffffff) == 0xffffffff ||
          (ver._raw & 0xffffffff) == 0x00 )         /* need to use VER.QPIIF */
         ver._raw = read_pub_config_reg(TXTCR_VER_QPIIF);
-    if ( !printed_host_info ) {
-        printk(TBOOT_DETA"chipset production fused: %x\n", ver.prod_fused );
-        printk(TBOOT_DETA"chipset ids: vendor: 0x%x, device: 0x%x, revision: 0x%x\n",
-               didvid.vendor_id, didvid.device_id, didvid.revision_id);
-    }
+    ids->prod_fused = ver.prod_fused;
 
     /* get processor family/model/stepping and platform ID */
-    uint64_t platform_id;
-    uint32_t fms = cpuid_eax(1);
-    platform_id = rdmsr(MSR_IA32_PLATFORM_ID);
+    ids->fms = cpuid_eax(1);
+    ids->platform_id = rdmsr(MSR_IA32_PLATFORM_ID);
+}
+
+static bool does_chipset_id_match(const acm_chipset_id_t *chipset_id,
+                                  txt_didvid_t didvid)
+{
+    return (didvid.vendor_id == chipset_id->vendor_id ) &&
+           (didvid.device_id == chipset_id->device_id ) &&
+           ( ( ( (chipset_id->flags & 0x1) == 0) &&
+               (didvid.revision_id == chipset_id->revision_id) ) ||
+             ( ( (chipset_id->flags & 0x1) == 1) &&
+               ( (didvid.revision_id & chipset_id->revision_id) != 0 ) ) );
+}
+
+static bool does_processor_id_match(const acm_processor_id_t *proc_id,
+                                    uint32_t fms, uint64_t platform_id)
+{
+    return (proc_id->fms == (fms & proc_id->fms_mask)) &&
+           (proc_id->platform_id == (platform_id & proc_id->platform_mask));
+}
+
+bool does_acmod_match_platform(const acm_hdr_t* hdr)
+{
+    /* used to ensure we don't print chipset/proc info for each module */
+    static bool printed_host_info;
+    platform_ids_t ids;
+
+    /* this fn assumes that the ACM has already passed the is_acmod() checks */
+
+    get_platform_ids(&ids);
     if ( !printed_host_info ) {
-        printk(TBOOT_DETA"processor family/model/stepping: 0x%x\n", fms );
-        printk(TBOOT_DETA"platform id: 0x%Lx\n", (unsigned long long)platform_id);
+        printk(TBOOT_DETA"chipset production fused: %x\n", ids.prod_fused );
+        printk(TBOOT_DETA"chipset ids: vendor: 0x%x, device: 0x%x, revision: 0x%x\n",
+               ids.didvid.vendor_id, ids.didvid.device_id,
+               ids.didvid.revision_id);
+        printk(TBOOT_DETA"processor family/model/stepping: 0x%x\n", ids.fms );
+        printk(TBOOT_DETA"platform id: 0x%Lx\n",
+               (unsigned long long)ids.platform_id);
     }
     printed_host_info = true;
 
     /*
      * check if chipset fusing is same
      */
-    if ( ver.prod_fused != !hdr->flags.debug_signed ) {
+    if ( ids.prod_fused != !hdr->flags.debug_signed ) {
         printk(TBOOT_ERR"\t production/debug mismatch between chipset and ACM\n");
         return false;
     }
@@ -600,12 +632,7 @@ bool does_acmod_match_platform(const acm_hdr_t* hdr)
                (uint32_t)chipset_id->device_id, chipset_id->flags,
                (uint32_t)chipset_id->revision_id, chipset_id->extended_id);
 
-        if ( (didvid.vendor_id == chipset_id->vendor_id ) &&
-             (didvid.device_id == chipset_id->device_id ) &&
-             ( ( ( (chipset_id->flags & 0x1) == 0) &&
-                 (didvid.revision_id == chipset_id->revision_id) ) ||
-               ( ( (chipset_id->flags & 0x1) == 1) &&
-                 ( (didvid.revision_id & chipset_id->revision_id) != 0 ) ) ) )
+        if ( does_chipset_id_match(chipset_id, ids.didvid) )
             break;
     }
     if ( i >= chipset_id_list->count ) {
@@ -634,9 +661,7 @@ bool does_acmod_match_platform(const acm_hdr_t* hdr)
                    (unsigned long long)proc_id->platform_id,
                    (unsigned long long)proc_id->platform_mask);
 
-            if ( (proc_id->fms == (fms & proc_id->fms_mask)) &&
-                 (proc_id->platform_id == (platform_id & proc_id->platform_mask))
-               )
+            if ( does_processor_id_match(proc_id, ids.fms, ids.platform_id) )
                 break;
         }
         if ( i >= proc_id_list->count ) {
@@ -648,6 +673,148 @@ bool does_acmod_match_platform(const acm_hdr_t* hdr)
     return true;
 }
 
+/*
+ * ACM catalog
+ */
+
+void get_acm_catalog_id(const acm_hdr_t *hdr, acm_catalog_acm_t *id)
+{
+    /* this fn assumes that the ACM has already passed the is_acmod() checks */
+    acm_info_table_t *info_table = get_acmod_info_table(hdr);
+
+    tb_memset(id, 0, sizeof(*id));
+    id->size = hdr->size;
+    id->date = hdr->date;
+    tb_memcpy(id->sig_prefix, hdr->rsa2048_sig, sizeof(id->sig_prefix));
+    if ( info_table != NULL )
+        id->chipset_acm_type = info_table->chipset_acm_type;
+    id->debug_signed = hdr->flags.debug_signed;
+}
+
+static const acm_catalog_acm_t *get_acm_catalog_acms(const void *catalog)
+{
+    return (const acm_catalog_acm_t *)((const acm_catalog_hdr_t *)catalog + 1);
+}
+
+static const acm_catalog_key_t *get_acm_catalog_keys(const void *catalog)
+{
+    const acm_catalog_hdr_t *hdr = catalog;
+
+    return (const acm_catalog_key_t *)(get_acm_catalog_acms(catalog) +
+                                       hdr->num_acms);
+}
+
+bool is_acm_catalog(const void *base, uint32_t size)
+{
+    const acm_catalog_hdr_t *hdr = base;
+    const acm_catalog_key_t *keys;
+
+    if ( size < sizeof(*hdr) ||
+         tb_memcmp(hdr->signature, ACM_CATALOG_SIGNATURE,
+                   sizeof(ACM_CATALOG_SIGNATURE)) != 0 )
+        return false;
+
+    if ( hdr->version != ACM_CATALOG_VER ) {
+        printk(TBOOT_WARN"unsupported ACM catalog version (%u)\n",
+               hdr->version);
+        return false;
+    }
+
+    if ( hdr->num_acms > ACM_CATALOG_MAX_ENTRIES ||
+         hdr->num_keys > ACM_CATALOG_MAX_ENTRIES ||
+         sizeof(*hdr) + hdr->num_acms * sizeof(acm_catalog_acm_t) +
+         hdr->num_keys * sizeof(acm_catalog_key_t) > size ) {
+        printk(TBOOT_ERR"ACM catalog is truncated\n");
+        return false;
+    }
+
+    keys = get_acm_catalog_keys(base);
+    for ( unsigned int i = 0; i < hdr->num_keys; i++ ) {
+        if ( keys[i].acm >= hdr->num_acms ) {
+            printk(TBOOT_ERR"ACM catalog entry %u is invalid\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t chipset_sort_key(uint16_t vendor_id, uint16_t device_id)
+{
+    return ((uint32_t)vendor_id << 16) | device_id;
+}
+
+/*
+ * the next ACM in the catalog (in order of preference) that is for this
+ * platform and of one of the types in type_mask; *pos should be 0 for the
+ * first call and is updated for the next one
+ * (assumes the catalog passed is_acm_catalog())
+ */
+const acm_catalog_acm_t *next_acm_catalog_match(const void *catalog,
+                                                uint32_t type_mask,
+                                                uint32_t *pos)
+{
+    const acm_catalog_hdr_t *hdr = catalog;
+    const acm_catalog_acm_t *acms = get_acm_catalog_acms(catalog);
+    const acm_catalog_key_t *keys = get_acm_catalog_keys(catalog);
+    platform_ids_t ids;
+    uint32_t i, chipset;
+
+    get_platform_ids(&ids);
+    chipset = chipset_sort_key(ids.didvid.vendor_id, ids.didvid.device_id);
+
+    /* keys are sorted by chipset, so start at the first one for ours */
+    i = *pos;
+    if ( i == 0 ) {
+        uint32_t hi = hdr->num_keys;
+
+        while ( i < hi ) {
+            uint32_t mid = i + (hi - i) / 2;
+            if ( chipset_sort_key(keys[mid].chipset.vendor_id,
+                                  keys[mid].chipset.device_id) < chipset )
+                i = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+
+    for ( ; i < hdr->num_keys; i++ ) {
+        const acm_catalog_key_t *key = &keys[i];
+        const acm_catalog_acm_t *acm = &acms[key->acm];
+
+        if ( chipset_sort_key(key->chipset.vendor_id,
+                              key->chipset.device_id) != chipset )
+            break;
+        if ( acm->chipset_acm_type >= 32 ||
+             !(type_mask & ACM_CATALOG_TYPE(acm->chipset_acm_type)) )
+            continue;
+        if ( ids.prod_fused != !acm->debug_signed )
+            continue;
+        if ( !does_chipset_id_match(&key->chipset, ids.didvid) ||
+             !does_processor_id_match(&key->processor, ids.fms,
+                                      ids.platform_id) )
+            continue;
+
+        *pos = i + 1;
+        return acm;
+    }
+
+    *pos = hdr->num_keys;
+    return NULL;
+}
+
+/* is the ACM at base the one that the catalog entry id describes? */
+bool is_acm_catalog_entry(const acm_catalog_acm_t *id, const void *base,
+                          uint32_t size)
+{
+    const acm_hdr_t *hdr = base;
+
+    return size >= sizeof(*hdr) && size / 4 == id->size &&
+           hdr->size == id->size && hdr->date == id->date &&
+           tb_memcmp(hdr->rsa2048_sig, id->sig_prefix,
+                     sizeof(id->sig_prefix)) == 0;
+}
+
 #ifndef IS_INCLUDED
 acm_hdr_t *get_bios_sinit(const void *sinit_region_base)
 {
@@ -835,7 +1002,6 @@ bool verify_racm(const acm_hdr_t *acm_hdr)
 void verify_IA32_se_svn_status(const acm_hdr_t *acm_hdr)
 {
     struct tpm_if *tpm = get_tpm();
-    const struct tpm_if_fp *tpm_fp = get_tpm_fp();
   
     printk(TBOOT_INFO"SGX:verify_IA32_se_svn_status is called\n");
         
@@ -849,7 +1015,7 @@ void verify_IA32_se_svn_status(const acm_hdr_t *acm_hdr)
     
     if (((rdmsr(MSR_IA32_SE_SVN_STATUS)>>16) & 0xff) != acm_hdr->se_svn) {
         printk(TBOOT_INFO"se_svn is not equal to ACM se_svn\n");
-        if (!tpm_fp->nv_write(tpm, 0, tpm->sgx_svn_index, 0, (uint8_t *)&(acm_hdr->se_svn), 1)) 
+        if (!tpm_nv_write(tpm, 0, tpm->sgx_svn_index, 0, (uint8_t *)&(acm_hdr->se_svn), 1)) 
             printk(TBOOT_ERR"Write sgx_svn_index 0x%x failed. \n", tpm->sgx_svn_index);
         else
             printk(TBOOT_INFO"Write sgx_svn_index with 0x%x successful.\n", acm_hdr->se_svn);
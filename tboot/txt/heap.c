@@ -626,11 +626,6 @@ bool verify_bios_data(const txt_heap_t *txt_heap)
                bios_data->num_logical_procs);
         return false;
     }
-    else if ( bios_data->num_logical_procs > NR_CPUS ) {
-        printk(TBOOT_ERR"BIOS data specifies too many CPUs (%u)\n",
-               bios_data->num_logical_procs);
-        return false;
-    }
 
     if ( bios_data->version >= 4 && size > sizeof(*bios_data) + sizeof(size) ) {
         if ( !verify_ext_data_elts(bios_data->ext_data_elts,
@@ -0,0 +1,169 @@
+/*
+ * mtrr_plan.c: planning of the variable MTRRs for a range
+ *
+ *
+ * Copyright (c) 2026, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Intel Corporation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <config.h>
+#include <types.h>
+#include <stdbool.h>
+#include <printk.h>
+#include <uuid.h>
+#include <mle.h>
+#include <msr.h>
+#include <txt/mtrrs.h>
+
+/*
+ * Variable MTRR planning: find the fewest MTRRs that make a page range
+ * mem_type and leave everything else UC (the default type).  Each MTRR
+ * covers a naturally aligned power-of-two block of pages and UC wins where
+ * blocks overlap, so a range can also be covered by a bigger mem_type block
+ * with UC blocks cut out of it.  The aligned blocks form a binary tree in
+ * which only those straddling an end of the range (at most two per level)
+ * need a decision: cover the block with mem_type, or leave it to its
+ * halves.
+ */
+
+typedef struct {
+    unsigned int uncovered;     /* MTRRs needed if no block above covers it */
+    unsigned int covered;       /* ...if a mem_type block above covers it */
+} cover_cost_t;
+
+static cover_cost_t cover_cost(uint64_t blk, unsigned int order,
+                               uint64_t start, uint64_t end)
+{
+    uint64_t blk_end = blk + (1ULL << order);
+    cover_cost_t cost, lo, hi;
+
+    if ( end <= blk || start >= blk_end ) {
+        cost.uncovered = 0;
+        cost.covered = 1;       /* UC block */
+        return cost;
+    }
+    if ( start <= blk && end >= blk_end ) {
+        cost.uncovered = 1;     /* mem_type block */
+        cost.covered = 0;
+        return cost;
+    }
+
+    /* a single page is always in or out, so order > 0 here */
+    lo = cover_cost(blk, order - 1, start, end);
+    hi = cover_cost(blk + (1ULL << (order - 1)), order - 1, start, end);
+    cost.covered = lo.covered + hi.covered;
+    cost.uncovered = lo.uncovered + hi.uncovered;
+    if ( 1 + cost.covered < cost.uncovered )
+        cost.uncovered = 1 + cost.covered;
+    return cost;
+}
+
+static bool add_block(mtrr_block_t *plan, unsigned int *nr, unsigned int max,
+                      uint64_t blk, unsigned int order, uint8_t type)
+{
+    if ( *nr >= max )
+        return false;
+    plan[*nr].base = blk;
+    plan[*nr].order = order;
+    plan[*nr].type = type;
+    (*nr)++;
+    return true;
+}
+
+static bool plan_cover(uint64_t blk, unsigned int order, uint64_t start,
+                       uint64_t end, bool covered, uint8_t mem_type,
+                       mtrr_block_t *plan, unsigned int *nr, unsigned int max)
+{
+    uint64_t half;
+
+    if ( end <= blk || start >= blk + (1ULL << order) ) {
+        if ( covered )
+            return add_block(plan, nr, max, blk, order,
+                             MTRR_TYPE_UNCACHABLE);
+        return true;
+    }
+    if ( start <= blk && end >= blk + (1ULL << order) ) {
+        if ( !covered )
+            return add_block(plan, nr, max, blk, order, mem_type);
+        return true;
+    }
+
+    half = 1ULL << (order - 1);
+    if ( !covered ) {
+        cover_cost_t lo = cover_cost(blk, order - 1, start, end);
+        cover_cost_t hi = cover_cost(blk + half, order - 1, start, end);
+
+        if ( 1 + lo.covered + hi.covered < lo.uncovered + hi.uncovered ) {
+            if ( !add_block(plan, nr, max, blk, order, mem_type) )
+                return false;
+            covered = true;
+        }
+    }
+    return plan_cover(blk, order - 1, start, end, covered, mem_type,
+                      plan, nr, max) &&
+           plan_cover(blk + half, order - 1, start, end, covered, mem_type,
+                      plan, nr, max);
+}
+
+/*
+ * plan the variable MTRRs for making pages [base, base + nr_pages) mem_type
+ * and all other memory UC; returns the number of MTRRs in plan, or -1 if
+ * that would take more than max of them
+ */
+int plan_mtrr_cover(uint64_t base, uint64_t nr_pages, uint8_t mem_type,
+                    mtrr_block_t *plan, unsigned int max)
+{
+    uint64_t end = base + nr_pages, blk;
+    unsigned int order = 0, nr = 0;
+
+    if ( nr_pages == 0 )
+        return 0;
+
+    /* nothing bigger than the smallest block holding the range can help */
+    while ( order < 63 && (base >> order) != ((end - 1) >> order) )
+        order++;
+    blk = base & ~((1ULL << order) - 1);
+
+    if ( !plan_cover(blk, order, base, end, false, mem_type, plan, &nr, max) )
+        return -1;
+    return nr;
+}
+
+
+/*
+ * Local variables:
+ * mode: C
+ * c-set-style: "BSD"
+ * c-basic-offset: 4
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
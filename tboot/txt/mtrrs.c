@@ -486,12 +486,13 @@ void restore_mtrrs(const mtrr_state_t *saved_state)
  */
 bool set_mem_type(const void *base, uint32_t size, uint32_t mem_type)
 {
-    int num_pages;
-    int ndx;
+    int num_pages, num_mtrrs;
+    unsigned int ndx, max_mtrrs;
     mtrr_def_type_t mtrr_def_type;
     mtrr_cap_t mtrr_cap;
     mtrr_physmask_t mtrr_physmask;
     mtrr_physbase_t mtrr_physbase;
+    mtrr_block_t plan[MAX_VARIABLE_MTRRS];
 
     /*
      * disable all fixed MTRRs
@@ -517,83 +518,34 @@ bool set_mem_type(const void *base, uint32_t size, uint32_t mem_type)
      */
 
     num_pages = PAGE_UP(size) >> PAGE_SHIFT;
-    ndx = 0;
 
     printk(TBOOT_DETA"setting MTRRs for acmod: base=%p, size=%x, num_pages=%d\n",
            base, size, num_pages);
-    /*
-     * Each VAR MTRR base must be a multiple if that MTRR's Size
-    */
-    unsigned long base_v;
-    base_v = (unsigned long) base;
-    int i =0;   
-    // mtrr size in pages
-    int mtrr_s = 1;
-    while ((base_v & 0x01) == 0) {
-          i++;
-          base_v = base_v >>1 ;
-
-    }
-    for (int j=i-12; j>0; j--) mtrr_s =mtrr_s*2; //mtrr_s = mtrr_s << 1
-    printk(TBOOT_DETA"The maximum allowed MTRR range size=%d Pages \n", mtrr_s);
-	
-    while (num_pages >= mtrr_s){
-	
-	/* set the base of the current MTRR */
-        mtrr_physbase.raw = rdmsr(MTRR_PHYS_BASE0_MSR + ndx*2);
-        mtrr_physbase.base = ((unsigned long)base >> PAGE_SHIFT) &
-	                     SINIT_MTRR_MASK;
-        mtrr_physbase.type = mem_type;
-        wrmsr(MTRR_PHYS_BASE0_MSR + ndx*2, mtrr_physbase.raw);
 
-        mtrr_physmask.raw = rdmsr(MTRR_PHYS_MASK0_MSR + ndx*2);
-        mtrr_physmask.mask = ~(mtrr_s - 1) & SINIT_MTRR_MASK;
-        mtrr_physmask.v = 1;
-        wrmsr(MTRR_PHYS_MASK0_MSR + ndx*2, mtrr_physmask.raw);
-		
-        base += (mtrr_s * PAGE_SIZE);
-        num_pages -= mtrr_s;
-        ndx++;
-        if ( ndx == mtrr_cap.vcnt ) {
-            printk(TBOOT_ERR"exceeded number of var MTRRs when mapping range\n");
-            return false;
-        }
+    /* only as many as save_mtrrs() can restore */
+    max_mtrrs = mtrr_cap.vcnt;
+    if ( max_mtrrs > MAX_VARIABLE_MTRRS )
+        max_mtrrs = MAX_VARIABLE_MTRRS;
+    num_mtrrs = plan_mtrr_cover((unsigned long)base >> PAGE_SHIFT, num_pages,
+                                mem_type, plan, max_mtrrs);
+    if ( num_mtrrs < 0 ) {
+        printk(TBOOT_ERR"exceeded number of var MTRRs (%u) when mapping range\n",
+               max_mtrrs);
+        return false;
     }
-    while ( num_pages > 0 ) {
-        uint32_t pages_in_range;
+    printk(TBOOT_DETA"using %d of %u var MTRRs\n", num_mtrrs, max_mtrrs);
 
-        /* set the base of the current MTRR */
+    for ( ndx = 0; ndx < (unsigned int)num_mtrrs; ndx++ ) {
         mtrr_physbase.raw = rdmsr(MTRR_PHYS_BASE0_MSR + ndx*2);
-        mtrr_physbase.base = ((unsigned long)base >> PAGE_SHIFT) &
-	                     SINIT_MTRR_MASK;
-        mtrr_physbase.type = mem_type;
+        mtrr_physbase.base = plan[ndx].base & SINIT_MTRR_MASK;
+        mtrr_physbase.type = plan[ndx].type;
         wrmsr(MTRR_PHYS_BASE0_MSR + ndx*2, mtrr_physbase.raw);
 
-        /*
-         * calculate MTRR mask
-         * MTRRs can map pages in power of 2
-         * may need to use multiple MTRRS to map all of region
-         */
-        pages_in_range = 1 << (fls(num_pages) - 1);
-
         mtrr_physmask.raw = rdmsr(MTRR_PHYS_MASK0_MSR + ndx*2);
-        mtrr_physmask.mask = ~(pages_in_range - 1) & SINIT_MTRR_MASK;
+        mtrr_physmask.mask = ~((1ULL << plan[ndx].order) - 1) &
+                             SINIT_MTRR_MASK;
         mtrr_physmask.v = 1;
         wrmsr(MTRR_PHYS_MASK0_MSR + ndx*2, mtrr_physmask.raw);
-
-        /*prepare for the next loop depending on number of pages
-         * We figure out from the above how many pages could be used in this
-         * mtrr. Then we decrement the count, increment the base,
-         * increment the mtrr we are dealing with, and if num_pages is
-         * still not zero, we do it again.
-         */
-        base += (pages_in_range * PAGE_SIZE);
-        num_pages -= pages_in_range;
-        ndx++;
-        if ( ndx == mtrr_cap.vcnt ) {
-            printk(TBOOT_ERR"exceeded number of var MTRRs when mapping range\n");
-            return false;
-        }
     }
     return true;
 }
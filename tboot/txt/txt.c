@@ -65,9 +65,10 @@
 #include <txt/verify.h>
 #include <txt/vmcs.h>
 #include <io.h>
+#include <percpu.h>
 
-/* counter timeout for waiting for all APs to enter wait-for-sipi */
-#define AP_WFS_TIMEOUT     0x10000000
+/* time allowed for all APs to enter wait-for-sipi */
+#define AP_WFS_TIMEOUT_MS  2000
 
 __data struct acpi_rsdp g_rsdp;
 extern char _start[];             /* start of module */
@@ -112,6 +113,11 @@ static __text const mle_hdr_t g_mle_hdr = {
  */
 /* count of APs in WAIT-FOR-SIPI */
 atomic_t ap_wfs_count;
+/* count of APs whose LAPIC base had to be restored */
+static atomic_t ap_apic_base_fixups;
+
+/* LAPIC base from the MADT, looked up once by the BSP for all APs */
+static uint64_t g_ap_apic_base;
 
 static void print_file_info(void)
 {
@@ -705,6 +711,15 @@ static void txt_wakeup_cpus(void)
     __getsec_smctrl();
 
     atomic_set(&ap_wfs_count, 0);
+    atomic_set(&ap_apic_base_fixups, 0);
+
+    /* look up what the APs need now, so they don't walk the ACPI tables */
+    g_ap_apic_base = get_madt_apic_base();
+    if ( g_ap_apic_base == 0 ) {
+        printk(TBOOT_ERR"not able to get apci base from MADT\n");
+        apply_policy(TB_ERR_FATAL);
+        return;
+    }
 
     /* RLPs will use our GDT and CS */
     extern char gdt_table[], gdt_table_end[];
@@ -728,6 +743,18 @@ static void txt_wakeup_cpus(void)
     sinit_mle_data_t *sinit_mle_data = get_sinit_mle_data_start(txt_heap);
     os_sinit_data_t *os_sinit_data = get_os_sinit_data_start(txt_heap);
 
+    /* assume BIOS isn't lying to us about # CPUs, else some CPUS may not */
+    /* have entered wait-for-sipi before we launch *or* we have to wait */
+    /* for timeout before launching */
+    /* (all TXT-capable CPUs have at least 2 cores) */
+    bios_data_t *bios_data = get_bios_data_start(txt_heap);
+    /* (percpu_init() made room for all of them) */
+    ap_wakeup_count = bios_data->num_logical_procs - 1;
+
+    /* calibrates the TSC, so do it before the APs are running */
+    uint64_t deadline = tsc_deadline(AP_WFS_TIMEOUT_MS);
+    uint64_t start = rdtsc();
+
     /* choose wakeup mechanism based on capabilities used */
     if ( os_sinit_data->capabilities.rlp_wake_monitor ) {
         printk(TBOOT_INFO"joining RLPs to MLE with MONITOR wakeup\n");
@@ -740,36 +767,20 @@ static void txt_wakeup_cpus(void)
         printk(TBOOT_INFO"GETSEC[WAKEUP] completed\n");
     }
 
-    /* assume BIOS isn't lying to us about # CPUs, else some CPUS may not */
-    /* have entered wait-for-sipi before we launch *or* we have to wait */
-    /* for timeout before launching */
-    /* (all TXT-capable CPUs have at least 2 cores) */
-    bios_data_t *bios_data = get_bios_data_start(txt_heap);
-    ap_wakeup_count = bios_data->num_logical_procs - 1;
-    if ( ap_wakeup_count >= NR_CPUS ) {
-        printk(TBOOT_INFO"there are too many CPUs (%u)\n", ap_wakeup_count);
-        ap_wakeup_count = NR_CPUS - 1;
-    }
-
-    printk(TBOOT_INFO"waiting for all APs (%d) to enter wait-for-sipi...\n",
-           ap_wakeup_count);
     /* wait for all APs that woke up to have entered wait-for-sipi */
-    uint32_t timeout = AP_WFS_TIMEOUT;
-    do {
-        if ( timeout % 0x8000 == 0 )
-            printk(TBOOT_INFO".");
-        else
-            cpu_relax();
-        if ( timeout % 0x200000 == 0 )
-            printk(TBOOT_INFO"\n");
-        timeout--;
-    } while ( ( atomic_read(&ap_wfs_count) < ap_wakeup_count ) &&
-              timeout > 0 );
-    printk(TBOOT_INFO"\n");
-    if ( timeout == 0 )
-        printk(TBOOT_INFO"wait-for-sipi loop timed-out\n");
+    while ( atomic_read(&ap_wfs_count) < ap_wakeup_count &&
+            !tsc_expired(deadline) )
+        cpu_relax();
+
+    uint32_t elapsed = tsc_to_microsecs(rdtsc() - start);
+    if ( atomic_read(&ap_wfs_count) < ap_wakeup_count )
+        printk(TBOOT_WARN"wait-for-sipi timed out after %u ms: %u of %u APs"
+               " arrived\n", AP_WFS_TIMEOUT_MS, atomic_read(&ap_wfs_count),
+               ap_wakeup_count);
     else
-        printk(TBOOT_INFO"all APs in wait-for-sipi\n");
+        printk(TBOOT_INFO"all %u APs in wait-for-sipi after %u us"
+               " (%u had LAPIC base restored)\n", ap_wakeup_count, elapsed,
+               atomic_read(&ap_apic_base_fixups));
 }
 
 bool txt_is_launched(void)
@@ -1084,10 +1095,9 @@ void txt_post_launch(void)
 
 void ap_wait(unsigned int cpuid)
 {
-    if ( cpuid >= NR_CPUS ) {
+    if ( cpuid >= get_nr_cpu_slots() ) {
         printk(TBOOT_ERR"cpuid (%u) exceeds # supported CPUs\n", cpuid);
         apply_policy(TB_ERR_FATAL);
-        mtx_leave(&ap_lock);
         return;
     }
 
@@ -1099,9 +1109,7 @@ void ap_wait(unsigned int cpuid)
 
     /* this is close enough to entering monitor/mwait loop, so inc counter */
     atomic_inc((atomic_t *)&_tboot_shared.num_in_wfs);
-    mtx_leave(&ap_lock);
 
-    printk(TBOOT_INFO"cpu %u mwait'ing\n", cpuid);
     while ( _tboot_shared.ap_wake_trigger != cpuid ) {
         cpu_monitor(&_tboot_shared.ap_wake_trigger, 0, 0);
         mb();
@@ -1120,30 +1128,26 @@ void txt_cpu_wakeup(void)
 {
     txt_heap_t *txt_heap;
     os_mle_data_t *os_mle_data;
-    uint64_t madt_apicbase, msr_apicbase;
+    uint64_t msr_apicbase;
     unsigned int cpuid = get_apicid();
 
-    if ( cpuid >= NR_CPUS ) {
+    if ( cpuid >= get_nr_cpu_slots() ) {
         printk(TBOOT_ERR"cpuid (%u) exceeds # supported CPUs\n", cpuid);
         apply_policy(TB_ERR_FATAL);
         return;
     }
 
-    mtx_enter(&ap_lock);
-
-    printk(TBOOT_INFO"cpu %u waking up from TXT sleep\n", cpuid);
+    /*
+     * APs run this in parallel: it only touches this CPU's MSRs and data
+     * the BSP set up before waking them, and only counters are shared (the
+     * BSP logs a summary once all have arrived)
+     */
 
     /* restore LAPIC base address for AP */
-    madt_apicbase = (uint64_t)get_madt_apic_base();
-    if ( madt_apicbase == 0 ) {
-        printk(TBOOT_ERR"not able to get apci base from MADT\n");
-        apply_policy(TB_ERR_FATAL);
-        return;
-    }
     msr_apicbase = rdmsr(MSR_APICBASE);
-    if ( madt_apicbase != (msr_apicbase & ~0xFFFULL) ) {
-        printk(TBOOT_INFO"cpu %u restore apic base to %llx\n", cpuid, madt_apicbase);
-        wrmsr(MSR_APICBASE, (msr_apicbase & 0xFFFULL) | madt_apicbase);
+    if ( g_ap_apic_base != (msr_apicbase & ~0xFFFULL) ) {
+        wrmsr(MSR_APICBASE, (msr_apicbase & 0xFFFULL) | g_ap_apic_base);
+        atomic_inc(&ap_apic_base_fixups);
     }
 
     txt_heap = get_txt_heap();
@@ -1159,7 +1163,6 @@ void txt_cpu_wakeup(void)
         apply_policy(TB_ERR_POST_LAUNCH_VERIFICATION);
 
     /* enable SMIs */
-    printk(TBOOT_DETA"enabling SMIs on cpu %u\n", cpuid);
     __getsec_smctrl();
 
     atomic_inc(&ap_wfs_count);
@@ -1171,7 +1174,7 @@ void txt_cpu_wakeup(void)
 
 tb_error_t txt_protect_mem_regions(void)
 {
-    uint64_t base, size;
+    e820_range_t ranges[3];
 
     /*
      * TXT has 2 regions of RAM that need to be reserved for use by only the
@@ -1180,28 +1183,28 @@ tb_error_t txt_protect_mem_regions(void)
      */
 
     /* TXT heap */
-    base = read_pub_config_reg(TXTCR_HEAP_BASE);
-    size = read_pub_config_reg(TXTCR_HEAP_SIZE);
-    printk(TBOOT_INFO"protecting TXT heap (%Lx - %Lx) in e820 table\n", base,
-           (base + size - 1));
-    if ( !e820_protect_region(base, size, E820_RESERVED) )
-        return TB_ERR_FATAL;
+    ranges[0].base = read_pub_config_reg(TXTCR_HEAP_BASE);
+    ranges[0].size = read_pub_config_reg(TXTCR_HEAP_SIZE);
+    ranges[0].type = E820_RESERVED;
+    printk(TBOOT_INFO"protecting TXT heap (%Lx - %Lx) in e820 table\n",
+           ranges[0].base, (ranges[0].base + ranges[0].size - 1));
 
     /* SINIT */
-    base = read_pub_config_reg(TXTCR_SINIT_BASE);
-    size = read_pub_config_reg(TXTCR_SINIT_SIZE);
-    printk(TBOOT_INFO"protecting SINIT (%Lx - %Lx) in e820 table\n", base,
-           (base + size - 1));
-    if ( !e820_protect_region(base, size, E820_RESERVED) )
-        return TB_ERR_FATAL;
+    ranges[1].base = read_pub_config_reg(TXTCR_SINIT_BASE);
+    ranges[1].size = read_pub_config_reg(TXTCR_SINIT_SIZE);
+    ranges[1].type = E820_RESERVED;
+    printk(TBOOT_INFO"protecting SINIT (%Lx - %Lx) in e820 table\n",
+           ranges[1].base, (ranges[1].base + ranges[1].size - 1));
 
     /* TXT private space */
-    base = TXT_PRIV_CONFIG_REGS_BASE;
-    size = TXT_CONFIG_REGS_SIZE;
+    ranges[2].base = TXT_PRIV_CONFIG_REGS_BASE;
+    ranges[2].size = TXT_CONFIG_REGS_SIZE;
+    ranges[2].type = E820_RESERVED;
     printk(TBOOT_INFO
            "protecting TXT Private Space (%Lx - %Lx) in e820 table\n",
-           base, (base + size - 1));
-    if ( !e820_protect_region(base, size, E820_RESERVED) )
+           ranges[2].base, (ranges[2].base + ranges[2].size - 1));
+
+    if ( !e820_protect_regions(ranges, ARRAY_SIZE(ranges)) )
         return TB_ERR_FATAL;
 
     /* ensure that memory not marked as good RAM by the MDRs is RESERVED in
@@ -426,6 +426,8 @@ bool verify_e820_map(sinit_mdr_t* mdrs_base, uint32_t num_mdrs)
 {
     sinit_mdr_t* mdr_entry;
     sinit_mdr_t tmp_entry;
+    e820_range_t gaps[16];
+    unsigned int nr_gaps = 0;
     uint64_t base, length;
     uint32_t i, j, pos;
 
@@ -452,7 +454,9 @@ bool verify_e820_map(sinit_mdr_t* mdrs_base, uint32_t num_mdrs)
 
     /* verify e820 map against mdrs */
     /* find all ranges *not* in MDRs:
-       if any of it is in e820 as RAM then set that to RESERVED. */
+       if any of it is in e820 as RAM then set that to RESERVED.
+       the gaps are reserved a batch at a time to save rewriting the e820
+       table for each of them */
     i = 0;
     base = 0;
     while ( i < num_mdrs ) {
@@ -460,14 +464,24 @@ bool verify_e820_map(sinit_mdr_t* mdrs_base, uint32_t num_mdrs)
         i++;
         if ( mdr_entry->mem_type > MDR_MEMTYPE_GOOD )
             continue;
-        length = mdr_entry->base - base;
-        if ( (length > 0) && (!e820_reserve_ram(base, length)) )
-            return false;
+        if ( mdr_entry->base > base ) {
+            length = mdr_entry->base - base;
+            if ( nr_gaps == ARRAY_SIZE(gaps) ) {
+                if ( !e820_reserve_ram_regions(gaps, nr_gaps) )
+                    return false;
+                nr_gaps = 0;
+            }
+            gaps[nr_gaps].base = base;
+            gaps[nr_gaps].size = length;
+            gaps[nr_gaps++].type = E820_RESERVED;
+        }
         base = mdr_entry->base + mdr_entry->length;
     }
 
     /* deal with the last gap */
     length = (uint64_t)-1 - base;
+    if ( !e820_reserve_ram_regions(gaps, nr_gaps) )
+        return false;
     return e820_reserve_ram(base, length);
 }
 
@@ -577,17 +591,14 @@ bool verify_stm(unsigned int cpuid)
         printk(TBOOT_INFO" : succeeded.\n");
     }
     else {
-        printk(TBOOT_DETA"MSR for SMM monitor control on cpu %u is 0x%Lx\n",
-               cpuid, smm_mon_ctl);
-
         /* verify ILP's SMM MSR == RLP's SMM MSR */
-        printk(TBOOT_INFO"verifying ILP's MSR_IA32_SMM_MONITOR_CTL with cpu %u\n\t",
-               cpuid);
+        /* (quiet on success, since all APs do this at the same time) */
         if ( smm_mon_ctl != ilp_smm_mon_ctl ) {
-            printk(TBOOT_ERR" : failed.\n");
+            printk(TBOOT_ERR"MSR_IA32_SMM_MONITOR_CTL on cpu %u (0x%Lx) "
+                   "differs from ILP's (0x%Lx)\n", cpuid, smm_mon_ctl,
+                   ilp_smm_mon_ctl);
             return false;
         }
-        printk(TBOOT_INFO" : succeeded.\n");
 
         /* since the RLP's MSR is the same. No need to verify MSEG header */
     }
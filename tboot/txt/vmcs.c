@@ -51,6 +51,7 @@
 #include <tboot.h>
 #include <txt/txt.h>
 #include <txt/vmcs.h>
+#include <percpu.h>
 
 
 /* no vmexit on external intr as mini guest only handle INIT & SIPI */
@@ -140,14 +141,17 @@ static void init_vmcs_config(void)
 
 extern uint32_t idle_pg_table[PAGE_SIZE / 4];
 
-/* build a 1-level identity-map page table [0, _end] on AP for vmxon */
+/* build a 1-level identity-map page table [0, tboot mem end] on AP for vmxon */
+/* (this covers the per-CPU data the APs use) */
 static void build_ap_pagetable(void)
 {
 #define PTE_FLAGS   0xe3 /* PRESENT+RW+A+D+4MB */
     uint32_t pt_entry = PTE_FLAGS;
     uint32_t *pte = &idle_pg_table[0];
+    uint32_t end = get_tboot_mem_end() - 1;
 
-    while ( pt_entry <= (uint32_t)&_end + PTE_FLAGS ) {
+    while ( pte < &idle_pg_table[PAGE_SIZE / 4] &&
+            pt_entry - PTE_FLAGS <= end ) {
         *pte = pt_entry;
         /* Incriments 4MB page at a time */ 
         pt_entry += 1 << FOURMB_PAGE_SHIFT;
@@ -156,7 +160,6 @@ static void build_ap_pagetable(void)
 }
 
 extern char host_vmcs[PAGE_SIZE];
-extern char ap_vmcs[NR_CPUS][PAGE_SIZE];
 
 static bool start_vmx(unsigned int cpuid)
 {
@@ -184,7 +187,7 @@ static bool start_vmx(unsigned int cpuid)
 
     /*printk(TBOOT_INFO"per-cpu initializing VMX mini-guest on cpu %u\n", cpuid);*/
 
-    /* enable paging using 1:1 page table [0, _end] */
+    /* enable paging using 1:1 page table [0, tboot mem end] */
     /* addrs outside of tboot (e.g. MMIO) are not mapped) */
     write_cr3((unsigned long)idle_pg_table);
     write_cr4(read_cr4() | CR4_PSE);
@@ -198,7 +201,6 @@ static bool start_vmx(unsigned int cpuid)
         return false;
     }
 
-    printk(TBOOT_DETA"VMXON done for cpu %u\n", cpuid);
     return true;
 }
 
@@ -422,7 +424,7 @@ static void construct_vmcs(void)
 
 static bool vmx_create_vmcs(unsigned int cpuid)
 {
-    struct vmcs_struct *vmcs = (struct vmcs_struct *)&ap_vmcs[cpuid];
+    struct vmcs_struct *vmcs = get_ap_vmcs(cpuid);
 
     tb_memset(vmcs, 0, PAGE_SIZE);
 
@@ -442,8 +444,6 @@ static void launch_mini_guest(unsigned int cpuid)
 {
     unsigned long error;
 
-    printk(TBOOT_DETA"launching mini-guest for cpu %u\n", cpuid);
-
     /* this is close enough to entering wait-for-sipi, so inc counter */
     atomic_inc((atomic_t *)&_tboot_shared.num_in_wfs);
 
@@ -538,13 +538,15 @@ void vmx_vmexit_handler(void)
 /* Launch a mini guest to handle the physical INIT-SIPI-SIPI from BSP */
 void handle_init_sipi_sipi(unsigned int cpuid)
 {
-    if ( cpuid >= NR_CPUS ) {
+    if ( cpuid >= get_nr_cpu_slots() ) {
         printk(TBOOT_ERR"cpuid (%u) exceeds # supported CPUs\n", cpuid);
         apply_policy(TB_ERR_FATAL);
-        mtx_leave(&ap_lock);
         return;
     }
 
+    /* the TSS descriptor, VMXON region and AP page table are shared */
+    mtx_enter(&ap_lock);
+
     /* setup a dummy tss as vmentry require a non-zero host TR */
     load_TR(3);
 
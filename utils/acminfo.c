@@ -38,15 +38,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/user.h>
 #include <fcntl.h>
 
-#define printk   printf
+/* --scan prints JSON, so messages from the tboot code are dropped there */
+static bool quiet;
+#define printk(...)   do { if ( !quiet ) printf(__VA_ARGS__); } while ( 0 )
 #include "../include/config.h"
 #include "../include/uuid.h"
 #include "../include/mle.h"
@@ -98,9 +105,24 @@ static void *pub_config_base;
 #define MIN_OS_SINIT_DATA_VER 4
 #define MAX_OS_SINIT_DATA_VER 6
 
+#define tb_memcpy      memcpy
+#define tb_memset      memset
+#define tb_memcmp      memcmp
+
 #define IS_INCLUDED    /* prevent acmod.c #include */
 #include "../tboot/txt/acmod.c"
 
+typedef uint32_t u32;
+typedef uint64_t u64;
+#include "../include/hash.h"
+#include "../tboot/include/sha1.h"
+#undef BIG_ENDIAN      /* sha1.c derives these from the target arch */
+#undef LITTLE_ENDIAN
+#include "../tboot/common/sha1.c"
+#undef S
+#include "../tboot/include/sha256.h"
+#include "../tboot/common/sha256.c"
+
 static void *load_acm(const char *file_name, size_t *size)
 {
     int fd;
@@ -120,7 +142,7 @@ static void *load_acm(const char *file_name, size_t *size)
     }
 
     addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if ( addr == NULL ) {
+    if ( addr == MAP_FAILED ) {
         printf("Error:  failed to map file %s of size %lu\n", file_name,
                sb.st_size);
         close(fd);
@@ -207,19 +229,598 @@ static bool match_platform(acm_hdr_t *hdr)
     return true;
 }
 
+/*
+ * --catalog: build an ACM catalog (see acm_catalog_hdr_t) from the SINIT and
+ * revocation ACMs in a directory
+ */
+
+static acm_catalog_acm_t *catalog_acms;
+static uint32_t num_catalog_acms;
+static acm_catalog_key_t *catalog_keys;
+static uint32_t num_catalog_keys;
+
+static bool add_catalog_acm(const acm_hdr_t *hdr)
+{
+    static const acm_processor_id_t any_processor;
+    acm_info_table_t *info_table = get_acmod_info_table(hdr);
+    acm_chipset_id_list_t *chipset_id_list = get_acmod_chipset_list(hdr);
+    acm_processor_id_list_t *proc_id_list = NULL;
+    uint32_t num_procs = 1;
+
+    if ( info_table == NULL || chipset_id_list == NULL )
+        return false;
+    /* older ACMs have no processor ID list and so match any processor */
+    if ( info_table->version >= 4 ) {
+        proc_id_list = get_acmod_processor_list(hdr);
+        if ( proc_id_list == NULL )
+            return false;
+        num_procs = proc_id_list->count;
+    }
+
+    uint64_t num_keys = (uint64_t)chipset_id_list->count * num_procs;
+    if ( num_catalog_acms >= ACM_CATALOG_MAX_ENTRIES ||
+         num_catalog_keys + num_keys > ACM_CATALOG_MAX_ENTRIES ) {
+        printf("Error:  too many ACMs for the catalog\n");
+        return false;
+    }
+
+    void *acms = realloc(catalog_acms,
+                         (num_catalog_acms + 1) * sizeof(*catalog_acms));
+    if ( acms == NULL )
+        return false;
+    catalog_acms = acms;
+    if ( num_keys > 0 ) {
+        void *keys = realloc(catalog_keys, (num_catalog_keys + num_keys) *
+                                           sizeof(*catalog_keys));
+        if ( keys == NULL )
+            return false;
+        catalog_keys = keys;
+    }
+
+    get_acm_catalog_id(hdr, &catalog_acms[num_catalog_acms]);
+    for ( uint32_t i = 0; i < chipset_id_list->count; i++ ) {
+        for ( uint32_t j = 0; j < num_procs; j++ ) {
+            acm_catalog_key_t *key = &catalog_keys[num_catalog_keys++];
+
+            key->chipset = chipset_id_list->chipset_ids[i];
+            key->processor = (proc_id_list == NULL) ? any_processor :
+                                 proc_id_list->processor_ids[j];
+            key->acm = num_catalog_acms;
+        }
+    }
+    num_catalog_acms++;
+
+    return true;
+}
+
+/* by chipset, then newest ACM first */
+static int cmp_catalog_keys(const void *p1, const void *p2)
+{
+    const acm_catalog_key_t *key1 = p1, *key2 = p2;
+    uint32_t chipset1 = chipset_sort_key(key1->chipset.vendor_id,
+                                         key1->chipset.device_id);
+    uint32_t chipset2 = chipset_sort_key(key2->chipset.vendor_id,
+                                         key2->chipset.device_id);
+    uint32_t date1 = catalog_acms[key1->acm].date;
+    uint32_t date2 = catalog_acms[key2->acm].date;
+
+    if ( chipset1 != chipset2 )
+        return (chipset1 < chipset2) ? -1 : 1;
+    if ( date1 != date2 )
+        return (date1 > date2) ? -1 : 1;
+    if ( key1->acm != key2->acm )
+        return (key1->acm < key2->acm) ? -1 : 1;
+    return 0;
+}
+
+static bool write_catalog(const char *file_name)
+{
+    acm_catalog_hdr_t hdr;
+    FILE *f;
+    bool ok;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.signature, ACM_CATALOG_SIGNATURE, sizeof(ACM_CATALOG_SIGNATURE));
+    hdr.version = ACM_CATALOG_VER;
+    hdr.num_acms = num_catalog_acms;
+    hdr.num_keys = num_catalog_keys;
+
+    qsort(catalog_keys, num_catalog_keys, sizeof(*catalog_keys),
+          cmp_catalog_keys);
+
+    f = fopen(file_name, "wb");
+    if ( f == NULL ) {
+        printf("Error:  failed to create file %s\n", file_name);
+        return false;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+         fwrite(catalog_acms, sizeof(*catalog_acms), num_catalog_acms, f) ==
+             num_catalog_acms &&
+         fwrite(catalog_keys, sizeof(*catalog_keys), num_catalog_keys, f) ==
+             num_catalog_keys;
+    if ( fclose(f) != 0 )
+        ok = false;
+    if ( !ok )
+        printf("Error:  failed to write file %s\n", file_name);
+
+    return ok;
+}
+
+static int make_catalog(const char *out_file, const char *dir_name)
+{
+    DIR *dir;
+    struct dirent *de;
+    bool ok = true;
+
+    dir = opendir(dir_name);
+    if ( dir == NULL ) {
+        printf("Error:  failed to open directory %s\n", dir_name);
+        return 1;
+    }
+
+    while ( ok && (de = readdir(dir)) != NULL ) {
+        char path[PATH_MAX];
+        struct stat sb;
+        void *acm_mem;
+        size_t size;
+        uint8_t type;
+
+        if ( snprintf(path, sizeof(path), "%s/%s", dir_name, de->d_name) >=
+             (int)sizeof(path) )
+            continue;
+        if ( stat(path, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+             sb.st_size < (off_t)sizeof(acm_hdr_t) )
+            continue;
+
+        acm_mem = load_acm(path, &size);
+        if ( acm_mem == NULL )
+            continue;
+
+        if ( is_acmod(acm_mem, size, &type, true) &&
+             ((type == ACM_CHIPSET_TYPE_SINIT &&
+               is_sinit_acmod(acm_mem, size, true)) ||
+              ((type == ACM_CHIPSET_TYPE_BIOS_REVOC ||
+                type == ACM_CHIPSET_TYPE_SINIT_REVOC) &&
+               is_racm_acmod(acm_mem, size, true))) ) {
+            ok = add_catalog_acm((acm_hdr_t *)acm_mem);
+            if ( ok )
+                printf("added %s\n", path);
+            else
+                printf("Error:  failed to add ACM %s\n", path);
+        }
+
+        munmap(acm_mem, size);
+    }
+    closedir(dir);
+
+    if ( ok )
+        ok = write_catalog(out_file);
+    if ( ok )
+        printf("%u ACMs, %u catalog entries\n", num_catalog_acms,
+               num_catalog_keys);
+
+    free(catalog_acms);
+    free(catalog_keys);
+    return ok ? 0 : 1;
+}
+
+/*
+ * --scan: check every ACM in a directory (in parallel) and print a JSON
+ * record for each, then a matrix of which ACMs support which chipsets
+ */
+#define MAX_SCAN_JOBS     64
+
+typedef struct {
+    char              *path;
+    bool              valid;
+    uint32_t          date;
+    char              *json;            /* the record for this ACM */
+    size_t            json_len;
+    acm_chipset_id_t  *chipset_ids;
+    uint32_t          nr_chipset_ids;
+} scan_result_t;
+
+static scan_result_t *scan_results;
+static unsigned int nr_scan_results;
+static unsigned int next_scan_result;   /* claimed atomically by workers */
+
+static void print_json_string(FILE *f, const char *str)
+{
+    fprintf(f, "\"");
+    for ( ; *str != '\0'; str++ ) {
+        if ( *str == '"' || *str == '\\' )
+            fprintf(f, "\\%c", *str);
+        else if ( (unsigned char)*str < 0x20 || (unsigned char)*str >= 0x7f )
+            fprintf(f, "\\u%04x", (unsigned char)*str);
+        else
+            fprintf(f, "%c", *str);
+    }
+    fprintf(f, "\"");
+}
+
+static void print_json_hex(FILE *f, const uint8_t *buf, size_t len)
+{
+    fprintf(f, "\"");
+    for ( size_t i = 0; i < len; i++ )
+        fprintf(f, "%02x", buf[i]);
+    fprintf(f, "\"");
+}
+
+static const char *acm_type_name(uint8_t type)
+{
+    switch ( type ) {
+    case ACM_CHIPSET_TYPE_BIOS:         return "bios";
+    case ACM_CHIPSET_TYPE_SINIT:        return "sinit";
+    case ACM_CHIPSET_TYPE_BIOS_REVOC:   return "bios_revoc";
+    case ACM_CHIPSET_TYPE_SINIT_REVOC:  return "sinit_revoc";
+    default:                            return "unknown";
+    }
+}
+
+static void print_json_chipset_id(FILE *f, const acm_chipset_id_t *id)
+{
+    fprintf(f, "{\"vendor\": \"0x%04x\", \"device\": \"0x%04x\", "
+            "\"revision\": \"0x%x\", \"flags\": \"0x%x\", "
+            "\"extended\": \"0x%x\"}", (uint32_t)id->vendor_id,
+            (uint32_t)id->device_id, (uint32_t)id->revision_id, id->flags,
+            id->extended_id);
+}
+
+/* returns false if the ACM is malformed past the header checks */
+static bool print_json_acm(FILE *f, const acm_hdr_t *hdr, size_t size,
+                           scan_result_t *r)
+{
+    acm_info_table_t *info_table = get_acmod_info_table(hdr);
+    acm_chipset_id_list_t *chipset_id_list = get_acmod_chipset_list(hdr);
+    uint8_t sha1[SHA1_LENGTH], sha256[SHA256_LENGTH];
+
+    if ( info_table == NULL || chipset_id_list == NULL )
+        return false;
+
+    fprintf(f, ", \"type\": \"%s\", \"date\": \"0x%08x\", \"size\": %zu",
+            acm_type_name(info_table->chipset_acm_type), hdr->date, size);
+    fprintf(f, ", \"debug_signed\": %s, \"txt_svn\": %u, \"se_svn\": %u",
+            hdr->flags.debug_signed ? "true" : "false", hdr->txt_svn,
+            hdr->se_svn);
+    fprintf(f, ", \"info_table\": {\"version\": %u, \"os_sinit_data_ver\": %u, "
+            "\"min_mle_hdr_ver\": \"0x%08x\", \"capabilities\": \"0x%08x\", "
+            "\"acm_ver\": %u}", (uint32_t)info_table->version,
+            info_table->os_sinit_data_ver, info_table->min_mle_hdr_ver,
+            info_table->capabilities._raw, (uint32_t)info_table->acm_ver);
+
+    fprintf(f, ", \"chipsets\": [");
+    for ( uint32_t i = 0; i < chipset_id_list->count; i++ ) {
+        fprintf(f, "%s", i ? ", " : "");
+        print_json_chipset_id(f, &chipset_id_list->chipset_ids[i]);
+    }
+    fprintf(f, "]");
+
+    /* older ACMs have no processor ID list and so match any processor */
+    fprintf(f, ", \"processors\": ");
+    if ( info_table->version >= 4 ) {
+        acm_processor_id_list_t *proc_id_list = get_acmod_processor_list(hdr);
+        if ( proc_id_list == NULL )
+            return false;
+        fprintf(f, "[");
+        for ( uint32_t i = 0; i < proc_id_list->count; i++ ) {
+            acm_processor_id_t *proc_id = &proc_id_list->processor_ids[i];
+            fprintf(f, "%s{\"fms\": \"0x%x\", \"fms_mask\": \"0x%x\", "
+                    "\"platform_id\": \"0x%llx\", "
+                    "\"platform_mask\": \"0x%llx\"}", i ? ", " : "",
+                    proc_id->fms, proc_id->fms_mask,
+                    (unsigned long long)proc_id->platform_id,
+                    (unsigned long long)proc_id->platform_mask);
+        }
+        fprintf(f, "]");
+    }
+    else
+        fprintf(f, "null");
+
+    fprintf(f, ", \"tpm\": ");
+    if ( info_table->version >= 5 ) {
+        tpm_info_list_t *info_list = get_tpm_info_list(hdr);
+        if ( info_list == NULL )
+            return false;
+        fprintf(f, "{\"ext_policy\": %u, \"tpm_family\": \"0x%x\", "
+                "\"tpm_nv_index_set\": %s, \"algs\": [",
+                info_list->capabilities.ext_policy,
+                info_list->capabilities.tpm_family,
+                info_list->capabilities.tpm_nv_index_set ? "true" : "false");
+        for ( uint32_t i = 0; i < info_list->count; i++ )
+            fprintf(f, "%s\"0x%04x\"", i ? ", " : "", info_list->alg_id[i]);
+        fprintf(f, "]}");
+    }
+    else
+        fprintf(f, "null");
+
+    sha1_buffer((const unsigned char *)hdr, size, sha1);
+    sha256_buffer((const unsigned char *)hdr, size, sha256);
+    fprintf(f, ", \"sha1\": ");
+    print_json_hex(f, sha1, sizeof(sha1));
+    fprintf(f, ", \"sha256\": ");
+    print_json_hex(f, sha256, sizeof(sha256));
+
+    /* keep the chipset IDs for the matrix */
+    if ( chipset_id_list->count > 0 ) {
+        r->chipset_ids = malloc(chipset_id_list->count *
+                                sizeof(*r->chipset_ids));
+        if ( r->chipset_ids == NULL )
+            return false;
+        memcpy(r->chipset_ids, chipset_id_list->chipset_ids,
+               chipset_id_list->count * sizeof(*r->chipset_ids));
+        r->nr_chipset_ids = chipset_id_list->count;
+    }
+    r->date = hdr->date;
+
+    return true;
+}
+
+static void scan_acm(scan_result_t *r)
+{
+    struct stat sb;
+    void *acm_mem = MAP_FAILED;
+    uint8_t type;
+    FILE *f;
+    int fd;
+
+    f = open_memstream(&r->json, &r->json_len);
+    if ( f == NULL )
+        return;
+    fprintf(f, "{\"file\": ");
+    print_json_string(f, r->path);
+
+    fd = open(r->path, O_RDONLY);
+    if ( fd != -1 ) {
+        if ( fstat(fd, &sb) == 0 && sb.st_size >= (off_t)sizeof(acm_hdr_t) &&
+             sb.st_size <= UINT32_MAX )
+            acm_mem = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+    }
+
+    if ( acm_mem != MAP_FAILED ) {
+        if ( is_acmod(acm_mem, sb.st_size, &type, true) ) {
+            long pos = ftell(f);
+
+            fprintf(f, ", \"valid\": true");
+            r->valid = print_json_acm(f, acm_mem, sb.st_size, r);
+            if ( !r->valid )
+                fseek(f, pos, SEEK_SET);
+        }
+        munmap(acm_mem, sb.st_size);
+    }
+
+    if ( !r->valid )
+        fprintf(f, ", \"valid\": false");
+    fprintf(f, "}\n");
+    fclose(f);
+}
+
+static void *scan_worker(void *arg)
+{
+    (void)arg;
+
+    for ( ;; ) {
+        unsigned int i = __sync_fetch_and_add(&next_scan_result, 1);
+        if ( i >= nr_scan_results )
+            return NULL;
+        scan_acm(&scan_results[i]);
+    }
+}
+
+static int cmp_scan_results(const void *p1, const void *p2)
+{
+    const scan_result_t *r1 = p1, *r2 = p2;
+
+    return strcmp(r1->path, r2->path);
+}
+
+static bool is_same_chipset_id(const acm_chipset_id_t *id1,
+                               const acm_chipset_id_t *id2)
+{
+    return id1->vendor_id == id2->vendor_id &&
+           id1->device_id == id2->device_id &&
+           id1->revision_id == id2->revision_id &&
+           (id1->flags & 0x1) == (id2->flags & 0x1);
+}
+
+/*
+ * one row per distinct chipset ID, listing the valid ACMs that support it
+ * newest first (processor IDs are in each ACM's own record)
+ */
+static void print_json_matrix(void)
+{
+    unsigned int *order = malloc(nr_scan_results * sizeof(*order));
+    bool first_row = true;
+
+    if ( order == NULL && nr_scan_results > 0 )
+        return;
+
+    /* newest first, by insertion sort of the (already name sorted) list */
+    for ( unsigned int i = 0; i < nr_scan_results; i++ ) {
+        unsigned int j = i;
+        for ( ; j > 0 && scan_results[order[j - 1]].date <
+                         scan_results[i].date; j-- )
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    printf("{\"matrix\": [");
+    for ( unsigned int i = 0; i < nr_scan_results; i++ ) {
+        for ( uint32_t j = 0; j < scan_results[i].nr_chipset_ids; j++ ) {
+            const acm_chipset_id_t *id = &scan_results[i].chipset_ids[j];
+            bool seen = false, first_acm = true;
+
+            /* only the first occurrence of an ID starts a row */
+            for ( unsigned int k = 0; k <= i && !seen; k++ ) {
+                uint32_t end = (k == i) ? j : scan_results[k].nr_chipset_ids;
+                for ( uint32_t l = 0; l < end && !seen; l++ )
+                    seen = is_same_chipset_id(&scan_results[k].chipset_ids[l],
+                                              id);
+            }
+            if ( seen )
+                continue;
+
+            printf("%s{\"chipset\": ", first_row ? "" : ", ");
+            print_json_chipset_id(stdout, id);
+            printf(", \"acms\": [");
+            for ( unsigned int k = 0; k < nr_scan_results; k++ ) {
+                const scan_result_t *r = &scan_results[order[k]];
+                bool supported = false;
+
+                for ( uint32_t l = 0; l < r->nr_chipset_ids && !supported; l++ )
+                    supported = is_same_chipset_id(&r->chipset_ids[l], id);
+                if ( !supported )
+                    continue;
+                printf("%s", first_acm ? "" : ", ");
+                print_json_string(stdout, r->path);
+                first_acm = false;
+            }
+            printf("]}");
+            first_row = false;
+        }
+    }
+    printf("]}\n");
+
+    free(order);
+}
+
+static int scan_acms(const char *dir_name, unsigned int jobs)
+{
+    pthread_t threads[MAX_SCAN_JOBS];
+    unsigned int nr_threads = 0;
+    bool all_valid = true;
+    DIR *dir;
+    struct dirent *de;
+
+    dir = opendir(dir_name);
+    if ( dir == NULL ) {
+        fprintf(stderr, "Error:  failed to open directory %s\n", dir_name);
+        return 1;
+    }
+    while ( (de = readdir(dir)) != NULL ) {
+        char path[PATH_MAX];
+        struct stat sb;
+
+        if ( snprintf(path, sizeof(path), "%s/%s", dir_name, de->d_name) >=
+             (int)sizeof(path) )
+            continue;
+        if ( stat(path, &sb) == -1 || !S_ISREG(sb.st_mode) )
+            continue;
+
+        void *results = realloc(scan_results,
+                                (nr_scan_results + 1) * sizeof(*scan_results));
+        if ( results == NULL ) {
+            closedir(dir);
+            fprintf(stderr, "Error:  out of memory\n");
+            return 1;
+        }
+        scan_results = results;
+        memset(&scan_results[nr_scan_results], 0, sizeof(*scan_results));
+        scan_results[nr_scan_results].path = strdup(path);
+        if ( scan_results[nr_scan_results].path == NULL ) {
+            closedir(dir);
+            fprintf(stderr, "Error:  out of memory\n");
+            return 1;
+        }
+        nr_scan_results++;
+    }
+    closedir(dir);
+    qsort(scan_results, nr_scan_results, sizeof(*scan_results),
+          cmp_scan_results);
+
+    /* the tboot code's messages would break up the JSON */
+    quiet = true;
+
+    if ( jobs == 0 )
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( jobs > MAX_SCAN_JOBS )
+        jobs = MAX_SCAN_JOBS;
+    if ( jobs > nr_scan_results )
+        jobs = nr_scan_results;
+    /* this thread is one of the workers */
+    while ( nr_threads + 1 < jobs &&
+            pthread_create(&threads[nr_threads], NULL, scan_worker,
+                           NULL) == 0 )
+        nr_threads++;
+    scan_worker(NULL);
+    for ( unsigned int i = 0; i < nr_threads; i++ )
+        pthread_join(threads[i], NULL);
+
+    for ( unsigned int i = 0; i < nr_scan_results; i++ ) {
+        const scan_result_t *r = &scan_results[i];
+
+        if ( r->json != NULL )
+            fwrite(r->json, 1, r->json_len, stdout);
+        if ( !r->valid )
+            all_valid = false;
+    }
+    print_json_matrix();
+
+    for ( unsigned int i = 0; i < nr_scan_results; i++ ) {
+        free(scan_results[i].path);
+        free(scan_results[i].json);
+        free(scan_results[i].chipset_ids);
+    }
+    free(scan_results);
+
+    return all_valid ? 0 : 1;
+}
+
+static struct option longopts[] = {
+    {"catalog", 1, 0, 'c'},
+    {"scan", 0, 0, 's'},
+    {"jobs", 1, 0, 'j'},
+    {0, 0, 0, 0}
+};
+
+static void print_usage(const char *prog)
+{
+    printf("usage:  %s acm_file_name\n", prog);
+    printf("        %s --catalog catalog_file_name acm_dir\n", prog);
+    printf("        %s --scan [-j N] acm_dir\n", prog);
+}
+
 int main(int argc, char *argv[])
 {
     void *acm_mem = NULL;
     char *acm_file;
+    const char *catalog_file = NULL;
+    bool scan = false;
+    unsigned int jobs = 0;
     size_t size;
     bool valid;
+    int c;
+
+    while ( (c = getopt_long(argc, argv, "j:", longopts, NULL)) != -1 )
+        switch ( c ) {
+        case 'c':
+            catalog_file = optarg;
+            break;
+
+        case 's':
+            scan = true;
+            break;
 
-    if ( argc != 2 ) {
-        printf("usage:  %s acm_file_name\n", argv[0]);
+        case 'j':
+            jobs = strtoul(optarg, NULL, 0);
+            break;
+
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+
+    if ( optind != argc - 1 || (scan && catalog_file != NULL) ) {
+        print_usage(argv[0]);
         return 1;
     }
 
-    acm_file = argv[1];
+    if ( catalog_file != NULL )
+        return make_catalog(catalog_file, argv[optind]);
+    if ( scan )
+        return scan_acms(argv[optind], jobs);
+
+    acm_file = argv[optind];
 
     /* load ACM file into memory */
     acm_mem = load_acm(acm_file, &size);
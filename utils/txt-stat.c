@@ -36,17 +36,22 @@
 
 #include <features.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <malloc.h>
 #include <errno.h>
 #include <sys/user.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <time.h>
 #include <safe_lib.h>
 
 #define printk   printf
@@ -66,6 +71,17 @@ void print_hex(const char* prefix, const void *start, size_t len);
 #include "../tboot/txt/heap.c"
 #include "../tboot/include/lz.h"
 #include "../tboot/common/lz.c"
+#define tb_memcpy      memcpy
+#define tb_memset      memset
+typedef uint32_t u32;
+typedef uint64_t u64;
+#include "../tboot/include/sha1.h"
+#undef BIG_ENDIAN      /* sha1.c derives these from the target arch */
+#undef LITTLE_ENDIAN
+#include "../tboot/common/sha1.c"
+#undef S
+#include "../tboot/include/sha256.h"
+#include "../tboot/common/sha256.c"
 
 static inline uint64_t read_txt_config_reg(void *config_regs_base,
                                            uint32_t reg)
@@ -216,15 +232,53 @@ static void display_heap(txt_heap_t *heap)
     print_bios_data(bios_data, size);
 }
 
+/* sanity check a log header read from memory before using its offsets */
+static bool is_tboot_log_valid(const tboot_log_t *log)
+{
+    if ( !are_uuids_equal(&(log->uuid), &((uuid_t)TBOOT_LOG_UUID)) )
+        return false;
+    if ( log->max_size > TBOOT_SERIAL_LOG_SIZE - sizeof(*log) ||
+         log->curr_pos > log->max_size || log->zip_count > ZIP_COUNT_MAX )
+        return false;
+    for ( unsigned int i = 0; i < log->zip_count; i++ ) {
+        if ( log->zip_pos[i] + log->zip_size[i] > log->curr_pos )
+            return false;
+    }
+    return true;
+}
+
+/* the uncompressed text follows the last compressed chunk */
+static unsigned int get_tboot_log_tail(const tboot_log_t *log)
+{
+    unsigned int last = log->zip_count - 1;
+
+    if ( log->zip_count == 0 )
+        return 0;
+    return log->zip_pos[last] + log->zip_size[last];
+}
+
+/* LZ_UncompressStream() writer: skip what was already shown, print the rest */
+static void write_log_text(const char *buf, unsigned int len, void *ctx)
+{
+    unsigned int *skip = ctx;
+
+    if ( *skip >= len ) {
+        *skip -= len;
+        return;
+    }
+    fwrite(buf + *skip, 1, len - *skip, stdout);
+    *skip = 0;
+}
+
 static void display_tboot_log(void *log_base)
 {
-    static char buf[512];
-    char pbuf[32*1024];
-    char *out = pbuf;
     tboot_log_t *log = (tboot_log_t *)log_base;
+    /* log->buf is phys addr of buf, which will not match where we copied */
+    /* it to, but since it is always just past end of struct, use that */
     char *log_buf = log->buf;
-    uint8_t i = 0;
-    if ( !are_uuids_equal(&(log->uuid), &((uuid_t)TBOOT_LOG_UUID)) ) {
+    unsigned int tail;
+
+    if ( !is_tboot_log_valid(log) ) {
         printf("unable to find TBOOT log\n");
         return;
     }
@@ -232,41 +286,1162 @@ static void display_tboot_log(void *log_base)
     printf("TBOOT log:\n");
     printf("\t max_size=%d\n", log->max_size);
     printf("\t zip_count=%d\n", log->zip_count);
-    while ( i < log->zip_count) {
+    for ( unsigned int i = 0; i < log->zip_count; i++ ) {
         printf("\t zip_pos[%d] = %d\n", i, log->zip_pos[i]);
         printf("\t zip_size[%d] = %d\n", i, log->zip_size[i]);
-          i++;
     }
-    
+
     printf("\t curr_pos=%d\n", log->curr_pos);
     printf("\t buf:\n");
-    /* log->buf is phys addr of buf, which will not match where mmap has */
-    /* map'ed us, but since it is always just past end of struct, use that */
-    /* to uncompress tboot log */ 
-    if (log->zip_count > 0) {
-        for ( i = 0; i< log->zip_count; i++) {
-            int length = LZ_Uncompress(&log_buf[log->zip_pos[i]], out, log->zip_size[i], sizeof(pbuf));
-            if ( length < 0 )
-               continue;
-            /* log is too big for single printk(), so break it up */
-            /* print out the uncompressed log */
-            for ( int curr_pos = 0; curr_pos < length; curr_pos += sizeof(buf)-1 ) {
-                if ( length - curr_pos >= (int)sizeof(buf) - 1 ) {
-                    strncpy_s(buf, sizeof(buf), out + curr_pos, sizeof(buf)-1);
-                }
-                else {
-                    strncpy_s(buf, sizeof(buf), out + curr_pos, length - curr_pos);
-                }
-                printf("%s", buf);
+    /* stream each compressed chunk straight to stdout, then the tail */
+    for ( unsigned int i = 0; i < log->zip_count; i++ ) {
+        unsigned int skip = 0;
+        LZ_UncompressStream(&log_buf[log->zip_pos[i]], log->zip_size[i],
+                            log->max_size, write_log_text, &skip);
+    }
+
+    tail = get_tboot_log_tail(log);
+    fwrite(log_buf + tail, 1, log->curr_pos - tail, stdout);
+    printf("\n");
+}
+
+/*
+ * physical memory access
+ *
+ * everything is read either from /dev/mem or, when decoding a snapshot
+ * taken with --dump, from the ranges captured in the dump file
+ */
+#define MAX_PHYS_READ_SIZE   (64*1024*1024)
+
+#define TXT_DUMP_MAGIC       "TXTDUMP"
+#define TXT_DUMP_VER         1
+#define TXT_DUMP_MAX_RANGES  16
+#define TXT_DUMP_MAX_PCRS    32
+
+typedef struct __packed {
+    uint64_t  phys_addr;
+    uint64_t  size;
+    uint64_t  offset;              /* of the data from the start of file */
+} txt_dump_range_t;
+
+typedef struct __packed {
+    uint16_t  alg;
+    uint16_t  pcr;
+    uint32_t  size;
+    uint8_t   val[SHA512_LENGTH];
+} txt_dump_pcr_t;
+
+typedef struct __packed {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  nr_ranges;
+    uint32_t  nr_pcrs;
+    uint32_t  reserved;
+    uint64_t  timestamp;           /* seconds since the epoch */
+    char      hostname[64];
+    /* txt_dump_range_t ranges[nr_ranges]; */
+    /* txt_dump_pcr_t pcrs[nr_pcrs]; */
+    /* range data */
+} txt_dump_hdr_t;
+
+typedef struct {
+    const void              *base;     /* whole file, mmap'ed */
+    size_t                   size;
+    const txt_dump_hdr_t    *hdr;
+    const txt_dump_range_t  *ranges;
+    const txt_dump_pcr_t    *pcrs;
+} txt_dump_t;
+
+static int fd_mem = -1;
+static const txt_dump_t *cur_dump;     /* set when decoding a dump */
+static bool capture_phys_reads;        /* set while taking a dump */
+
+static bool open_dump(const char *path, txt_dump_t *dump)
+{
+    struct stat st;
+    const txt_dump_hdr_t *hdr;
+    uint64_t tables_size;
+    void *base;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if ( fd == -1 )
+        return false;
+    if ( fstat(fd, &st) == -1 || (uint64_t)st.st_size < sizeof(*hdr) ) {
+        close(fd);
+        return false;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( base == MAP_FAILED )
+        return false;
+
+    dump->base = base;
+    dump->size = st.st_size;
+    dump->hdr = hdr = base;
+    if ( memcmp(hdr->magic, TXT_DUMP_MAGIC, sizeof(TXT_DUMP_MAGIC)) != 0 ||
+         hdr->version != TXT_DUMP_VER || hdr->nr_ranges > TXT_DUMP_MAX_RANGES ||
+         hdr->nr_pcrs > TXT_DUMP_MAX_PCRS )
+        goto bad;
+    tables_size = sizeof(*hdr) + hdr->nr_ranges * sizeof(txt_dump_range_t) +
+                  hdr->nr_pcrs * sizeof(txt_dump_pcr_t);
+    if ( tables_size > dump->size )
+        goto bad;
+    dump->ranges = base + sizeof(*hdr);
+    dump->pcrs = (const void *)(dump->ranges + hdr->nr_ranges);
+
+    for ( uint32_t i = 0; i < hdr->nr_ranges; i++ ) {
+        const txt_dump_range_t *r = &dump->ranges[i];
+        if ( r->offset < tables_size || r->offset > dump->size ||
+             r->size > dump->size - r->offset )
+            goto bad;
+    }
+    for ( uint32_t i = 0; i < hdr->nr_pcrs; i++ ) {
+        if ( dump->pcrs[i].size > SHA512_LENGTH )
+            goto bad;
+    }
+    return true;
+
+bad:
+    munmap(base, dump->size);
+    return false;
+}
+
+static void close_dump(const txt_dump_t *dump)
+{
+    munmap((void *)dump->base, dump->size);
+}
+
+static const void *find_dump_range(const txt_dump_t *dump, uint64_t addr,
+                                   uint64_t size)
+{
+    for ( uint32_t i = 0; i < dump->hdr->nr_ranges; i++ ) {
+        const txt_dump_range_t *r = &dump->ranges[i];
+        if ( addr >= r->phys_addr && addr - r->phys_addr <= r->size &&
+             size <= r->size - (addr - r->phys_addr) )
+            return dump->base + r->offset + (addr - r->phys_addr);
+    }
+    return NULL;
+}
+
+typedef struct {
+    uint64_t  phys_addr;
+    uint64_t  size;
+    void     *data;
+} captured_range_t;
+
+static captured_range_t captured_ranges[TXT_DUMP_MAX_RANGES];
+static unsigned int nr_captured_ranges;
+static bool capture_failed;        /* a range could not be kept */
+
+static void free_captured_ranges(void)
+{
+    for ( unsigned int i = 0; i < nr_captured_ranges; i++ ) {
+        free(captured_ranges[i].data);
+        captured_ranges[i].data = NULL;
+    }
+    nr_captured_ranges = 0;
+    capture_failed = false;
+}
+
+static void capture_range(uint64_t addr, size_t size, const void *data)
+{
+    captured_range_t *r;
+
+    for ( unsigned int i = 0; i < nr_captured_ranges; i++ ) {
+        r = &captured_ranges[i];
+        if ( addr >= r->phys_addr && addr - r->phys_addr <= r->size &&
+             size <= r->size - (addr - r->phys_addr) )
+            return;
+    }
+    if ( nr_captured_ranges == TXT_DUMP_MAX_RANGES ) {
+        fprintf(stderr, "ERROR: more than %u ranges to dump, 0x%jx+0x%zx "
+                "not captured\n", TXT_DUMP_MAX_RANGES, (uintmax_t)addr, size);
+        capture_failed = true;
+        return;
+    }
+    r = &captured_ranges[nr_captured_ranges];
+    r->data = malloc(size);
+    if ( r->data == NULL ) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        capture_failed = true;
+        return;
+    }
+    memcpy(r->data, data, size);
+    r->phys_addr = addr;
+    r->size = size;
+    nr_captured_ranges++;
+}
+
+static void *read_phys_mem(uint64_t addr, size_t size)
+{
+    void *buf;
+
+    if ( size == 0 || size > MAX_PHYS_READ_SIZE )
+        return NULL;
+    buf = malloc(size);
+    if ( buf == NULL )
+        return NULL;
+
+    if ( cur_dump != NULL ) {
+        const void *data = find_dump_range(cur_dump, addr, size);
+        if ( data == NULL ) {
+            free(buf);
+            return NULL;
+        }
+        memcpy(buf, data, size);
+        return buf;
+    }
+
+    if ( pread64(fd_mem, buf, size, addr) != (ssize_t)size ) {
+        /* some kernels only allow mmap of reserved memory */
+        uint64_t page_mask = (uint64_t)sysconf(_SC_PAGESIZE) - 1;
+        uint64_t base = addr & ~page_mask;
+        size_t map_size = size + (addr - base);
+        void *map = mmap64(NULL, map_size, PROT_READ, MAP_PRIVATE, fd_mem,
+                           base);
+        if ( map == MAP_FAILED ) {
+            free(buf);
+            return NULL;
+        }
+        memcpy(buf, map + (addr - base), size);
+        munmap(map, map_size);
+    }
+
+    if ( capture_phys_reads )
+        capture_range(addr, size, buf);
+    return buf;
+}
+
+/* bounds check the first nr_regions size-prefixed regions of a heap copy */
+static bool is_heap_layout_valid(const txt_heap_t *heap, uint64_t heap_size,
+                                 unsigned int nr_regions)
+{
+    uint64_t off = 0;
+
+    for ( unsigned int i = 0; i < nr_regions; i++ ) {
+        uint64_t size;
+        if ( heap_size - off < sizeof(uint64_t) )
+            return false;
+        size = *(const uint64_t *)(heap + off);
+        if ( size < sizeof(uint64_t) || size > heap_size - off )
+            return false;
+        off += size;
+    }
+    return true;
+}
+
+/*
+ * PCR replay
+ *
+ * walk every TXT event log referenced from the OsSinitData extended
+ * elements once, extend each measurement into a software copy of the DRTM
+ * PCRs for its bank and compare the result with what the TPM reports
+ */
+#define REPLAY_PCR_FIRST     17
+#define REPLAY_PCR_LAST      19
+#define REPLAY_NR_PCRS       (REPLAY_PCR_LAST - REPLAY_PCR_FIRST + 1)
+#define REPLAY_MAX_BANKS     5
+#define EV_NO_ACTION         0x03
+
+typedef struct {
+    uint16_t      alg;
+    unsigned int  size;
+    bool          supported;         /* have an in-tree hash for alg */
+    uint8_t       pcrs[REPLAY_NR_PCRS][SHA512_LENGTH];
+} replay_bank_t;
+
+static replay_bank_t replay_banks[REPLAY_MAX_BANKS];
+static unsigned int nr_replay_banks;
+static unsigned int nr_replay_events;
+static const char *replay_log_format = "none";
+static bool replay_log_malformed;
+
+static const char *replay_alg_name(uint16_t alg)
+{
+    static char name[8];
+
+    switch ( alg ) {
+    case TB_HALG_SHA1:   return "sha1";
+    case TB_HALG_SHA256: return "sha256";
+    case TB_HALG_SM3:    return "sm3";
+    case TB_HALG_SHA384: return "sha384";
+    case TB_HALG_SHA512: return "sha512";
+    default:
+        snprintf(name, sizeof(name), "0x%04x", alg);
+        return name;
+    }
+}
+
+static replay_bank_t *get_replay_bank(uint16_t alg, unsigned int size)
+{
+    replay_bank_t *bank;
+
+    if ( alg == TB_HALG_SHA1_LG )
+        alg = TB_HALG_SHA1;
+    for ( unsigned int i = 0; i < nr_replay_banks; i++ ) {
+        if ( replay_banks[i].alg == alg )
+            return replay_banks[i].size == size ? &replay_banks[i] : NULL;
+    }
+
+    if ( nr_replay_banks == REPLAY_MAX_BANKS || size == 0 ||
+         size > SHA512_LENGTH )
+        return NULL;
+    bank = &replay_banks[nr_replay_banks++];
+    bank->alg = alg;
+    bank->size = size;
+    bank->supported = (alg == TB_HALG_SHA1 || alg == TB_HALG_SHA256);
+    memset(bank->pcrs, 0, sizeof(bank->pcrs));   /* DRTM PCRs reset to 0 */
+    return bank;
+}
+
+static void replay_extend(uint32_t pcr, uint32_t type, uint16_t alg,
+                          const uint8_t *digest, unsigned int size)
+{
+    uint8_t buf[2*SHA256_LENGTH];
+    replay_bank_t *bank;
+    uint8_t *val;
+
+    if ( type == EV_NO_ACTION )
+        return;
+    bank = get_replay_bank(alg, size);
+    if ( bank == NULL ) {
+        replay_log_malformed = true;
+        return;
+    }
+    nr_replay_events++;
+    if ( pcr < REPLAY_PCR_FIRST || pcr > REPLAY_PCR_LAST || !bank->supported )
+        return;
+
+    /* PCR = H(PCR || digest) */
+    val = bank->pcrs[pcr - REPLAY_PCR_FIRST];
+    memcpy(buf, val, size);
+    memcpy(buf + size, digest, size);
+    if ( alg == TB_HALG_SHA256 )
+        sha256_buffer(buf, 2*size, val);
+    else
+        sha1_buffer(buf, 2*size, val);
+}
+
+/* HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR: TPM 1.2 event container, SHA1 only */
+static void replay_tpm12_log(uint64_t log_addr)
+{
+    event_log_container_t *elog;
+    uint32_t size;
+
+    elog = read_phys_mem(log_addr, sizeof(*elog));
+    if ( elog == NULL ) {
+        replay_log_malformed = true;
+        return;
+    }
+    size = elog->size;
+    if ( memcmp(elog->signature, EVTLOG_SIGNATURE,
+                sizeof(elog->signature)) != 0 || size < sizeof(*elog) ) {
+        free(elog);
+        replay_log_malformed = true;
+        return;
+    }
+    free(elog);
+
+    elog = read_phys_mem(log_addr, size);
+    if ( elog == NULL || elog->next_event_offset > size ||
+         elog->pcr_events_offset > elog->next_event_offset ) {
+        free(elog);
+        replay_log_malformed = true;
+        return;
+    }
+
+    replay_log_format = "tpm12";
+    uint32_t off = elog->pcr_events_offset;
+    uint32_t end = elog->next_event_offset;
+    while ( off < end ) {
+        const tpm12_pcr_event_t *evt = (void *)elog + off;
+        if ( end - off < sizeof(*evt) ||
+             evt->data_size > end - off - sizeof(*evt) ) {
+            replay_log_malformed = true;
+            break;
+        }
+        replay_extend(evt->pcr_index, evt->type, TB_HALG_SHA1, evt->digest,
+                      SHA1_LENGTH);
+        off += sizeof(*evt) + evt->data_size;
+    }
+    free(elog);
+}
+
+/* HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2: one legacy format log per bank */
+static void replay_tpm20_log(const heap_event_log_descr_t *descr)
+{
+    unsigned int hash_size = get_hash_size(descr->alg);
+    uint32_t off = descr->pcr_events_offset;
+    uint32_t end = descr->next_event_offset;
+    void *log;
+
+    if ( off == end )
+        return;
+    if ( hash_size == 0 || end > descr->size || off > end ) {
+        replay_log_malformed = true;
+        return;
+    }
+    log = read_phys_mem(descr->phys_addr, end);
+    if ( log == NULL ) {
+        replay_log_malformed = true;
+        return;
+    }
+
+    replay_log_format = "tpm20";
+    /* non-SHA1 logs start with a TPM 1.2 style EV_NO_ACTION descriptor */
+    if ( descr->alg != TB_HALG_SHA1 ) {
+        const tpm12_pcr_event_t *hdr = log + off;
+        if ( end - off < sizeof(*hdr) ||
+             hdr->data_size > end - off - sizeof(*hdr) ) {
+            replay_log_malformed = true;
+            free(log);
+            return;
+        }
+        off += sizeof(*hdr) + hdr->data_size;
+    }
+
+    while ( off < end ) {
+        const uint8_t *evt = log + off;
+        uint32_t data_size;
+        if ( end - off < 3*sizeof(uint32_t) + hash_size ) {
+            replay_log_malformed = true;
+            break;
+        }
+        data_size = *(uint32_t *)(evt + 2*sizeof(uint32_t) + hash_size);
+        if ( data_size > end - off - 3*sizeof(uint32_t) - hash_size ) {
+            replay_log_malformed = true;
+            break;
+        }
+        replay_extend(*(uint32_t *)evt, *(uint32_t *)(evt + sizeof(uint32_t)),
+                      descr->alg, evt + 2*sizeof(uint32_t), hash_size);
+        off += 3*sizeof(uint32_t) + hash_size + data_size;
+    }
+    free(log);
+}
+
+/* HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2_1: TCG crypto agile log */
+static void replay_tcg_log(const heap_event_log_ptr_elt2_1_t *elog_elt)
+{
+    tcg_efi_spec_id_event_algorithm_size sizes[REPLAY_MAX_BANKS];
+    uint32_t nr_sizes;
+    uint32_t off = elog_elt->first_record_offset;
+    uint32_t end = elog_elt->next_record_offset;
+    void *log;
+
+    if ( off == end )
+        return;
+    if ( end > elog_elt->allcoated_event_container_size || off > end ) {
+        replay_log_malformed = true;
+        return;
+    }
+    log = read_phys_mem(elog_elt->phys_addr, end);
+    if ( log == NULL ) {
+        replay_log_malformed = true;
+        return;
+    }
+
+    /* the header event carries the digest size of every bank */
+    const tcg_pcr_event *hdr = log + off;
+    const tcg_efi_specid_event_strcut *spec_id =
+                 (const tcg_efi_specid_event_strcut *)hdr->event_data;
+    if ( end - off < sizeof(*hdr) ||
+         hdr->event_data_size > end - off - sizeof(*hdr) ||
+         hdr->event_data_size < offsetof(tcg_efi_specid_event_strcut,
+                                         digestSizes) ) {
+        replay_log_malformed = true;
+        free(log);
+        return;
+    }
+    nr_sizes = spec_id->number_of_algorithms;
+    if ( nr_sizes > REPLAY_MAX_BANKS ||
+         hdr->event_data_size < offsetof(tcg_efi_specid_event_strcut,
+                                         digestSizes) +
+                                nr_sizes * sizeof(sizes[0]) ) {
+        replay_log_malformed = true;
+        free(log);
+        return;
+    }
+    memcpy(sizes, spec_id->digestSizes, nr_sizes * sizeof(sizes[0]));
+    off += sizeof(*hdr) + hdr->event_data_size;
+
+    replay_log_format = "tcg";
+    while ( off < end ) {
+        const uint8_t *evt = log + off;
+        uint32_t pcr, type, count, pos, event_size;
+        if ( end - off < 3*sizeof(uint32_t) ) {
+            replay_log_malformed = true;
+            break;
+        }
+        pcr = *(uint32_t *)evt;
+        type = *(uint32_t *)(evt + sizeof(uint32_t));
+        count = *(uint32_t *)(evt + 2*sizeof(uint32_t));
+        pos = 3*sizeof(uint32_t);
+
+        for ( uint32_t i = 0; i < count; i++ ) {
+            uint16_t alg;
+            unsigned int size = 0;
+            if ( end - off - pos < sizeof(uint16_t) )
+                break;
+            alg = *(uint16_t *)(evt + pos);
+            for ( uint32_t j = 0; j < nr_sizes; j++ ) {
+                if ( sizes[j].algorithm_id == alg )
+                    size = sizes[j].digest_size;
+            }
+            pos += sizeof(uint16_t);
+            if ( size == 0 || end - off - pos < size ) {
+                pos = end - off + 1;
+                break;
+            }
+            replay_extend(pcr, type, alg, evt + pos, size);
+            pos += size;
+        }
+        if ( pos > end - off || end - off - pos < sizeof(uint32_t) ) {
+            replay_log_malformed = true;
+            break;
+        }
+        event_size = *(uint32_t *)(evt + pos);
+        pos += sizeof(uint32_t);
+        if ( event_size > end - off - pos ) {
+            replay_log_malformed = true;
+            break;
+        }
+        off += pos + event_size;
+    }
+    free(log);
+}
+
+static void replay_ext_data_elts(const os_sinit_data_t *os_sinit_data,
+                                 uint64_t size)
+{
+    const void *end = (const void *)os_sinit_data + size;
+    const heap_ext_data_element_t *elt = os_sinit_data->ext_data_elts;
+
+    if ( os_sinit_data->version < 6 )
+        return;
+
+    while ( (const void *)elt + sizeof(*elt) <= end &&
+            elt->type != HEAP_EXTDATA_TYPE_END ) {
+        if ( elt->size < sizeof(*elt) ||
+             elt->size > (uint64_t)(end - (const void *)elt) ) {
+            replay_log_malformed = true;
+            return;
+        }
+        /* the pointer elements must hold the structure they are read as */
+        size_t min_size = sizeof(*elt);
+        if ( elt->type == HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR )
+            min_size += sizeof(heap_event_log_ptr_elt_t);
+        else if ( elt->type == HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2 )
+            min_size += sizeof(heap_event_log_ptr_elt2_t);
+        else if ( elt->type == HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2_1 )
+            min_size += sizeof(heap_event_log_ptr_elt2_1_t);
+        if ( elt->size < min_size ) {
+            replay_log_malformed = true;
+            return;
+        }
+        switch ( elt->type ) {
+        case HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR: {
+            const heap_event_log_ptr_elt_t *ptr = (const void *)elt->data;
+            if ( ptr->event_log_phys_addr )
+                replay_tpm12_log(ptr->event_log_phys_addr);
+            break;
+        }
+        case HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2: {
+            const heap_event_log_ptr_elt2_t *ptr = (const void *)elt->data;
+            for ( uint32_t i = 0; i < ptr->count; i++ ) {
+                if ( (const void *)&ptr->event_log_descr[i + 1] >
+                     (const void *)elt + elt->size )
+                    break;
+                replay_tpm20_log(&ptr->event_log_descr[i]);
             }
+            break;
+        }
+        case HEAP_EXTDATA_TYPE_TPM_EVENT_LOG_PTR_2_1:
+            replay_tcg_log((const heap_event_log_ptr_elt2_1_t *)elt->data);
+            break;
+        default:
+            break;
         }
-    } 
+        elt = (const void *)elt + elt->size;
+    }
+}
+
+static int hex_nibble(char c)
+{
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return -1;
+}
 
-    for ( unsigned int curr_pos = log->zip_pos[log->zip_count]; curr_pos < log->curr_pos; curr_pos += sizeof(buf)-1 ) {
-        strncpy_s(buf, sizeof(buf), log_buf + curr_pos, sizeof(buf)-1);
-        printf("%s", buf);
+/* parse size bytes of hex, ignoring blanks between digits */
+static bool parse_hex(const char *str, uint8_t *out, unsigned int size)
+{
+    unsigned int n = 0;
+
+    while ( *str != '\0' && *str != '\n' && n < 2*size ) {
+        int v = hex_nibble(*str++);
+        if ( v < 0 ) {
+            if ( str[-1] == ' ' )
+                continue;
+            return false;
+        }
+        if ( n % 2 == 0 )
+            out[n/2] = v << 4;
+        else
+            out[n/2] |= v;
+        n++;
+    }
+    return n == 2*size;
+}
+
+/* the live PCR value, from the TPM 2.0 or TPM 1.2 sysfs interface */
+static bool read_tpm_pcr(uint16_t alg, unsigned int pcr, uint8_t *val,
+                         unsigned int size)
+{
+    char path[64], line[256];
+    bool found = false;
+    FILE *f;
+
+    if ( cur_dump != NULL ) {
+        for ( uint32_t i = 0; i < cur_dump->hdr->nr_pcrs; i++ ) {
+            const txt_dump_pcr_t *p = &cur_dump->pcrs[i];
+            if ( p->alg == alg && p->pcr == pcr && p->size == size ) {
+                memcpy(val, p->val, size);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/tpm/tpm0/pcr-%s/%u",
+             replay_alg_name(alg), pcr);
+    f = fopen(path, "r");
+    if ( f != NULL ) {
+        if ( fgets(line, sizeof(line), f) != NULL )
+            found = parse_hex(line, val, size);
+        fclose(f);
+        return found;
+    }
+
+    if ( alg != TB_HALG_SHA1 )
+        return false;
+    f = fopen("/sys/class/tpm/tpm0/device/pcrs", "r");
+    if ( f == NULL )
+        return false;
+    snprintf(path, sizeof(path), "PCR-%02u:", pcr);
+    while ( !found && fgets(line, sizeof(line), f) != NULL ) {
+        if ( strncmp(line, path, strlen(path)) == 0 )
+            found = parse_hex(line + strlen(path), val, size);
+    }
+    fclose(f);
+    return found;
+}
+
+static void print_json_hex(const uint8_t *buf, unsigned int size)
+{
+    printf("\"");
+    for ( unsigned int i = 0; i < size; i++ )
+        printf("%02x", buf[i]);
+    printf("\"");
+}
+
+static bool print_replay_json(void)
+{
+    bool all_match = true;
+
+    printf("{\n");
+    printf("  \"log_format\": \"%s\",\n", replay_log_format);
+    printf("  \"measurements\": %u,\n", nr_replay_events);
+    printf("  \"malformed\": %s,\n", replay_log_malformed ? "true" : "false");
+    printf("  \"banks\": [");
+    for ( unsigned int i = 0; i < nr_replay_banks; i++ ) {
+        replay_bank_t *bank = &replay_banks[i];
+
+        printf("%s\n    {\n", i ? "," : "");
+        printf("      \"alg\": \"%s\",\n", replay_alg_name(bank->alg));
+        printf("      \"replayed\": %s,\n", bank->supported ? "true" : "false");
+        printf("      \"pcrs\": {");
+        for ( unsigned int pcr = REPLAY_PCR_FIRST; pcr <= REPLAY_PCR_LAST;
+              pcr++ ) {
+            const uint8_t *computed = bank->pcrs[pcr - REPLAY_PCR_FIRST];
+            uint8_t actual[SHA512_LENGTH];
+            bool have_actual = read_tpm_pcr(bank->alg, pcr, actual, bank->size);
+
+            printf("%s\n        \"%u\": { \"computed\": ",
+                   pcr == REPLAY_PCR_FIRST ? "" : ",", pcr);
+            if ( bank->supported )
+                print_json_hex(computed, bank->size);
+            else
+                printf("null");
+            printf(", \"actual\": ");
+            if ( have_actual )
+                print_json_hex(actual, bank->size);
+            else
+                printf("null");
+            printf(", \"match\": ");
+            if ( bank->supported && have_actual ) {
+                bool match = memcmp(computed, actual, bank->size) == 0;
+                printf("%s }", match ? "true" : "false");
+                all_match = all_match && match;
+            }
+            else
+                printf("null }");
+        }
+        printf("\n      }\n    }");
+    }
+    printf("%s],\n", nr_replay_banks ? "\n  " : "");
+    printf("  \"match\": %s\n", all_match ? "true" : "false");
+    printf("}\n");
+
+    return all_match;
+}
+
+/* read the heap and feed every event log it points to into the replay */
+static bool walk_event_logs(void)
+{
+    void *regs, *heap;
+    uint64_t heap_base, heap_size;
+
+    regs = read_phys_mem(TXT_PUB_CONFIG_REGS_BASE, TXT_CONFIG_REGS_SIZE);
+    if ( regs == NULL ) {
+        fprintf(stderr, "ERROR: cannot read TXT config registers\n");
+        return false;
+    }
+    heap_base = read_txt_config_reg(regs, TXTCR_HEAP_BASE);
+    heap_size = read_txt_config_reg(regs, TXTCR_HEAP_SIZE);
+    free(regs);
+
+    heap = read_phys_mem(heap_base, heap_size);
+    if ( heap == NULL ) {
+        fprintf(stderr, "ERROR: cannot read TXT heap\n");
+        return false;
+    }
+
+    if ( is_heap_layout_valid(heap, heap_size, 3) &&
+         get_os_sinit_data_size(heap) >= sizeof(uint64_t) +
+                                         sizeof(os_sinit_data_t) )
+        replay_ext_data_elts(get_os_sinit_data_start(heap),
+                             get_os_sinit_data_size(heap) - sizeof(uint64_t));
+    else
+        replay_log_malformed = true;
+    free(heap);
+    return true;
+}
+
+static int replay_event_logs(void)
+{
+    if ( !walk_event_logs() )
+        return 1;
+    return print_replay_json() && !replay_log_malformed ? 0 : 1;
+}
+
+/*
+ * --dump: snapshot config regs, heap, event logs, tboot log and PCRs
+ */
+static int write_dump(const char *path)
+{
+    static const uint16_t algs[] = { TB_HALG_SHA1, TB_HALG_SHA256,
+                                     TB_HALG_SM3, TB_HALG_SHA384,
+                                     TB_HALG_SHA512 };
+    txt_dump_pcr_t pcrs[TXT_DUMP_MAX_PCRS];
+    txt_dump_hdr_t hdr;
+    uint64_t offset;
+    bool ok = true;
+    int rc = 1;
+    FILE *f;
+
+    /* every range the decoders read is recorded by read_phys_mem() */
+    capture_phys_reads = true;
+    ok = walk_event_logs();
+    if ( ok )
+        free(read_phys_mem(TBOOT_SERIAL_LOG_ADDR, TBOOT_SERIAL_LOG_SIZE));
+    capture_phys_reads = false;
+    /* a dump missing some of what was read would not decode the same */
+    if ( !ok || capture_failed )
+        goto out;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TXT_DUMP_MAGIC, sizeof(TXT_DUMP_MAGIC));
+    hdr.version = TXT_DUMP_VER;
+    hdr.nr_ranges = nr_captured_ranges;
+    hdr.timestamp = time(NULL);
+    gethostname(hdr.hostname, sizeof(hdr.hostname) - 1);
+
+    memset(pcrs, 0, sizeof(pcrs));
+    for ( unsigned int i = 0; i < sizeof(algs)/sizeof(algs[0]); i++ ) {
+        for ( unsigned int pcr = REPLAY_PCR_FIRST; pcr <= REPLAY_PCR_LAST;
+              pcr++ ) {
+            txt_dump_pcr_t *p = &pcrs[hdr.nr_pcrs];
+            p->alg = algs[i];
+            p->pcr = pcr;
+            p->size = get_hash_size(algs[i]);
+            if ( read_tpm_pcr(p->alg, pcr, p->val, p->size) )
+                hdr.nr_pcrs++;
+        }
+    }
+
+    f = fopen(path, "wb");
+    if ( f == NULL ) {
+        fprintf(stderr, "ERROR: cannot create %s: %s\n", path,
+                strerror(errno));
+        goto out;
+    }
+    ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    offset = sizeof(hdr) + hdr.nr_ranges * sizeof(txt_dump_range_t) +
+             hdr.nr_pcrs * sizeof(txt_dump_pcr_t);
+    for ( unsigned int i = 0; ok && i < nr_captured_ranges; i++ ) {
+        txt_dump_range_t r = { captured_ranges[i].phys_addr,
+                               captured_ranges[i].size, offset };
+        ok = fwrite(&r, sizeof(r), 1, f) == 1;
+        offset += r.size;
+    }
+    if ( ok && hdr.nr_pcrs )
+        ok = fwrite(pcrs, sizeof(pcrs[0]), hdr.nr_pcrs, f) == hdr.nr_pcrs;
+    for ( unsigned int i = 0; ok && i < nr_captured_ranges; i++ )
+        ok = fwrite(captured_ranges[i].data, captured_ranges[i].size, 1,
+                    f) == 1;
+    if ( fclose(f) != 0 )
+        ok = false;
+    if ( !ok ) {
+        fprintf(stderr, "ERROR: writing %s failed\n", path);
+        unlink(path);
+        goto out;
+    }
+    rc = 0;
+
+out:
+    free_captured_ranges();
+    return rc;
+}
+
+/*
+ * --summary: decode many dumps in parallel into one JSON line per host
+ */
+#define MAX_SUMMARY_JOBS     64
+
+typedef struct {
+    const char  *path;
+    bool         valid;
+    char         hostname[64];
+    uint64_t     timestamp;
+    uint64_t     sts, ests, e2sts, errorcode;
+    bool         have_heap;
+    uint32_t     bios_data_ver, num_logical_procs;
+    uint32_t     os_sinit_data_ver, sinit_mle_data_ver;
+    bool         have_log;
+    uint16_t     log_curr_pos;
+    uint8_t      log_zip_count;
+    char         last_line[128];
+} dump_summary_t;
+
+static dump_summary_t *summaries;
+static unsigned int nr_summaries;
+static unsigned int next_summary;      /* claimed atomically by workers */
+
+/* LZ_UncompressStream() writer keeping only the newest text */
+typedef struct {
+    char          text[256];
+    unsigned int  len;
+} recent_text_t;
+
+static void keep_recent_text(const char *buf, unsigned int len, void *ctx)
+{
+    recent_text_t *r = ctx;
+
+    if ( len >= sizeof(r->text) ) {
+        memcpy(r->text, buf + len - sizeof(r->text), sizeof(r->text));
+        r->len = sizeof(r->text);
+        return;
+    }
+    if ( r->len + len > sizeof(r->text) ) {
+        unsigned int drop = r->len + len - sizeof(r->text);
+        memmove(r->text, r->text + drop, r->len - drop);
+        r->len -= drop;
+    }
+    memcpy(r->text + r->len, buf, len);
+    r->len += len;
+}
+
+static void summarize_tboot_log(dump_summary_t *s, const tboot_log_t *log)
+{
+    recent_text_t recent = { .len = 0 };
+    unsigned int tail, start, end;
+
+    if ( !is_tboot_log_valid(log) )
+        return;
+    s->have_log = true;
+    s->log_curr_pos = log->curr_pos;
+    s->log_zip_count = log->zip_count;
+
+    /* the newest text is the last compressed chunk plus the tail */
+    if ( log->zip_count > 0 ) {
+        unsigned int i = log->zip_count - 1;
+        LZ_UncompressStream((char *)&log->buf[log->zip_pos[i]],
+                            log->zip_size[i], log->max_size, keep_recent_text,
+                            &recent);
+    }
+    tail = get_tboot_log_tail(log);
+    keep_recent_text(&log->buf[tail], log->curr_pos - tail, &recent);
+
+    end = recent.len;
+    while ( end > 0 && (recent.text[end - 1] == '\n' ||
+                        recent.text[end - 1] == '\0' ||
+                        recent.text[end - 1] == ' ') )
+        end--;
+    start = end;
+    while ( start > 0 && recent.text[start - 1] != '\n' )
+        start--;
+    if ( end - start >= sizeof(s->last_line) )
+        start = end - sizeof(s->last_line) + 1;
+    memcpy(s->last_line, recent.text + start, end - start);
+    s->last_line[end - start] = '\0';
+}
+
+/* a heap region's size field plus its struct up to and including field */
+#define HEAP_DATA_MIN_SIZE(type, field) \
+    (sizeof(uint64_t) + offsetof(type, field) + sizeof(((type *)0)->field))
+
+static void summarize_dump(dump_summary_t *s)
+{
+    txt_dump_t dump;
+    const void *regs, *log;
+    const txt_heap_t *heap;
+    uint64_t heap_base, heap_size;
+
+    if ( !open_dump(s->path, &dump) )
+        return;
+    s->valid = true;
+    memcpy(s->hostname, dump.hdr->hostname, sizeof(s->hostname) - 1);
+    s->timestamp = dump.hdr->timestamp;
+
+    regs = find_dump_range(&dump, TXT_PUB_CONFIG_REGS_BASE,
+                           TXT_CONFIG_REGS_SIZE);
+    if ( regs != NULL ) {
+        s->sts = read_txt_config_reg((void *)regs, TXTCR_STS);
+        s->ests = read_txt_config_reg((void *)regs, TXTCR_ESTS);
+        s->e2sts = read_txt_config_reg((void *)regs, TXTCR_E2STS);
+        s->errorcode = read_txt_config_reg((void *)regs, TXTCR_ERRORCODE);
+        heap_base = read_txt_config_reg((void *)regs, TXTCR_HEAP_BASE);
+        heap_size = read_txt_config_reg((void *)regs, TXTCR_HEAP_SIZE);
+        heap = find_dump_range(&dump, heap_base, heap_size);
+        if ( heap != NULL && is_heap_layout_valid(heap, heap_size, 4) &&
+             get_bios_data_size(heap) >=
+                 HEAP_DATA_MIN_SIZE(bios_data_t, num_logical_procs) &&
+             get_os_sinit_data_size(heap) >=
+                 HEAP_DATA_MIN_SIZE(os_sinit_data_t, version) &&
+             get_sinit_mle_data_size(heap) >=
+                 HEAP_DATA_MIN_SIZE(sinit_mle_data_t, version) ) {
+            s->have_heap = true;
+            s->bios_data_ver = get_bios_data_start(heap)->version;
+            s->num_logical_procs =
+                get_bios_data_start(heap)->num_logical_procs;
+            s->os_sinit_data_ver = get_os_sinit_data_start(heap)->version;
+            s->sinit_mle_data_ver = get_sinit_mle_data_start(heap)->version;
+        }
+    }
+
+    log = find_dump_range(&dump, TBOOT_SERIAL_LOG_ADDR, TBOOT_SERIAL_LOG_SIZE);
+    if ( log != NULL )
+        summarize_tboot_log(s, log);
+
+    close_dump(&dump);
+}
+
+static void *summary_worker(void *arg)
+{
+    (void)arg;
+
+    for ( ;; ) {
+        unsigned int i = __sync_fetch_and_add(&next_summary, 1);
+        if ( i >= nr_summaries )
+            return NULL;
+        summarize_dump(&summaries[i]);
+    }
+}
+
+static void print_json_string(const char *str)
+{
+    printf("\"");
+    for ( ; *str != '\0'; str++ ) {
+        if ( *str == '"' || *str == '\\' )
+            printf("\\%c", *str);
+        else if ( (unsigned char)*str < 0x20 || (unsigned char)*str >= 0x7f )
+            printf("\\u%04x", (unsigned char)*str);
+        else
+            printf("%c", *str);
+    }
+    printf("\"");
+}
+
+static int summarize_dumps(char *const paths[], unsigned int nr_paths,
+                           unsigned int jobs)
+{
+    pthread_t threads[MAX_SUMMARY_JOBS];
+    unsigned int nr_threads = 0;
+    bool all_valid = true;
+
+    summaries = calloc(nr_paths, sizeof(*summaries));
+    if ( summaries == NULL ) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+    nr_summaries = nr_paths;
+    for ( unsigned int i = 0; i < nr_paths; i++ )
+        summaries[i].path = paths[i];
+
+    if ( jobs == 0 )
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( jobs > MAX_SUMMARY_JOBS )
+        jobs = MAX_SUMMARY_JOBS;
+    if ( jobs > nr_paths )
+        jobs = nr_paths;
+    /* this thread is one of the workers */
+    while ( nr_threads + 1 < jobs &&
+            pthread_create(&threads[nr_threads], NULL, summary_worker,
+                           NULL) == 0 )
+        nr_threads++;
+    summary_worker(NULL);
+    for ( unsigned int i = 0; i < nr_threads; i++ )
+        pthread_join(threads[i], NULL);
+
+    for ( unsigned int i = 0; i < nr_summaries; i++ ) {
+        const dump_summary_t *s = &summaries[i];
+        txt_sts_t sts = { ._raw = s->sts };
+        txt_ests_t ests = { ._raw = s->ests };
+        txt_e2sts_t e2sts = { ._raw = s->e2sts };
+
+        printf("{\"file\": ");
+        print_json_string(s->path);
+        if ( !s->valid ) {
+            printf(", \"valid\": false}\n");
+            all_valid = false;
+            continue;
+        }
+        printf(", \"valid\": true, \"host\": ");
+        print_json_string(s->hostname);
+        printf(", \"time\": %ju", s->timestamp);
+        printf(", \"senter_done\": %s, \"secrets\": %s, \"txt_reset\": %s",
+               sts.senter_done_sts ? "true" : "false",
+               e2sts.secrets_sts ? "true" : "false",
+               ests.txt_reset_sts ? "true" : "false");
+        printf(", \"errorcode\": \"0x%08jx\"", s->errorcode);
+        if ( s->have_heap )
+            printf(", \"heap\": {\"bios_data_ver\": %u, "
+                   "\"num_logical_procs\": %u, \"os_sinit_data_ver\": %u, "
+                   "\"sinit_mle_data_ver\": %u}", s->bios_data_ver,
+                   s->num_logical_procs, s->os_sinit_data_ver,
+                   s->sinit_mle_data_ver);
+        else
+            printf(", \"heap\": null");
+        if ( s->have_log ) {
+            printf(", \"tboot_log\": {\"curr_pos\": %u, \"zip_count\": %u, "
+                   "\"last_line\": ", s->log_curr_pos, s->log_zip_count);
+            print_json_string(s->last_line);
+            printf("}");
+        }
+        else
+            printf(", \"tboot_log\": null");
+        printf("}\n");
+    }
+
+    free(summaries);
+    return all_valid ? 0 : 1;
+}
+
+/*
+ * --follow: after the whole log has been shown, poll the log header and
+ * print only what tboot has appended since
+ */
+#define FOLLOW_INTERVAL_US   500000
+
+static void *read_tboot_log_bytes(unsigned int pos, unsigned int size)
+{
+    return read_phys_mem(TBOOT_SERIAL_LOG_ADDR + offsetof(tboot_log_t, buf) +
+                         pos, size);
+}
+
+static bool is_same_tboot_log(const tboot_log_t *prev, const tboot_log_t *log,
+                              unsigned int shown)
+{
+    if ( log->zip_count < prev->zip_count )
+        return false;
+    for ( unsigned int i = 0; i < prev->zip_count; i++ ) {
+        if ( log->zip_pos[i] != prev->zip_pos[i] ||
+             log->zip_size[i] != prev->zip_size[i] )
+            return false;
+    }
+    /* with no new chunk the tail can only have grown */
+    return log->zip_count != prev->zip_count ||
+           log->curr_pos >= get_tboot_log_tail(log) + shown;
+}
+
+static int follow_tboot_log(const tboot_log_t *initial)
+{
+    tboot_log_t prev;
+    unsigned int shown = 0;
+
+    memset(&prev, 0, sizeof(prev));
+    if ( is_tboot_log_valid(initial) ) {
+        prev = *initial;
+        shown = prev.curr_pos - get_tboot_log_tail(&prev);
+    }
+
+    for ( ;; ) {
+        tboot_log_t *log;
+        unsigned int first_chunk = prev.zip_count;
+        unsigned int skip = shown;
+        unsigned int tail;
+        void *buf;
+
+        fflush(stdout);
+        usleep(FOLLOW_INTERVAL_US);
+
+        log = read_phys_mem(TBOOT_SERIAL_LOG_ADDR, sizeof(*log));
+        if ( log == NULL ) {
+            printf("ERROR: reading TBOOT log failed\n");
+            return 1;
+        }
+        if ( !is_tboot_log_valid(log) ) {
+            free(log);
+            continue;
+        }
+        if ( !is_same_tboot_log(&prev, log, shown) ) {
+            printf("\n--- TBOOT log was reset ---\n");
+            first_chunk = 0;
+            skip = shown = 0;
+        }
+
+        /* chunks compressed since the last poll start with shown text */
+        for ( unsigned int i = first_chunk; i < log->zip_count; i++ ) {
+            buf = read_tboot_log_bytes(log->zip_pos[i], log->zip_size[i]);
+            if ( buf != NULL ) {
+                LZ_UncompressStream(buf, log->zip_size[i], log->max_size,
+                                    write_log_text, &skip);
+                free(buf);
+            }
+            skip = 0;
+        }
+        if ( first_chunk < log->zip_count )
+            shown = 0;
+
+        tail = get_tboot_log_tail(log);
+        if ( log->curr_pos > tail + shown ) {
+            buf = read_tboot_log_bytes(tail + shown,
+                                       log->curr_pos - tail - shown);
+            if ( buf != NULL ) {
+                fwrite(buf, 1, log->curr_pos - tail - shown, stdout);
+                free(buf);
+                shown = log->curr_pos - tail;
+            }
+        }
+
+        prev = *log;
+        free(log);
     }
-    printf("\n");
 }
 
 static bool is_txt_supported(void)
@@ -274,37 +1449,49 @@ static bool is_txt_supported(void)
     return true;
 }
 
-static int fd_mem;
 static void *buf_config_regs_read;
-static void *buf_config_regs_mmap;
 
 static inline uint64_t read_config_reg(uint32_t config_regs_base, uint32_t reg)
 {
-    uint64_t reg_val;
-    void *buf;
-
     (void)config_regs_base;
 
-    buf = buf_config_regs_read;
-    if ( buf == NULL )
-        buf = buf_config_regs_mmap;
-    if ( buf == NULL )
+    if ( buf_config_regs_read == NULL )
         return 0;
-
-    reg_val = read_txt_config_reg(buf, reg);
-    return reg_val;
+    return read_txt_config_reg(buf_config_regs_read, reg);
 }
 
 bool display_heap_optin = false;
-static const char *short_option = "h";
+bool replay_optin = false;
+bool summary_optin = false;
+bool follow_optin = false;
+static const char *dump_out_file;
+static const char *dump_in_file;
+static unsigned int summary_jobs;
+static const char *short_option = "fhj:";
 static struct option longopts[] = {
     {"heap", 0, 0, 'p'},
+    {"replay", 0, 0, 'r'},
+    {"dump", 1, 0, 'd'},
+    {"file", 1, 0, 'i'},
+    {"follow", 0, 0, 'f'},
+    {"summary", 0, 0, 's'},
+    {"jobs", 1, 0, 'j'},
     {"help", 0, 0, 'h'},
     {0, 0, 0, 0}
 };
-static const char *usage_string = "txt-stat [--heap] [-h]";
+static const char *usage_string =
+    "txt-stat [--heap] [--replay] [--dump FILE] [--file FILE] [-f] [-h]\n"
+    "       txt-stat --summary [-j N] FILE...";
 static const char *option_strings[] = {
     "--heap:\t\tprint out heap info.\n",
+    "--replay:\treplay the TXT event logs and print computed vs. actual\n"
+    "\t\tPCR 17-19 values as JSON.\n",
+    "--dump FILE:\tsave config regs, heap, event logs, TBOOT log and PCRs\n"
+    "\t\tto FILE instead of displaying them.\n",
+    "--file FILE:\tdecode a dump saved with --dump instead of /dev/mem.\n",
+    "-f, --follow:\tkeep printing the TBOOT log as it grows.\n",
+    "--summary:\tprint a one line JSON summary of each dump FILE.\n",
+    "-j, --jobs N:\tnumber of threads for --summary (default: all CPUs).\n",
     "-h, --help:\tprint out this help message.\n",
     NULL
 };
@@ -313,9 +1500,9 @@ int main(int argc, char *argv[])
 {
     uint64_t heap = 0;
     uint64_t heap_size = 0;
-    void *buf = NULL;
-    off_t seek_ret = -1;
-    size_t read_ret = 0;
+    txt_dump_t dump;
+    void *buf;
+    int ret = 0;
 
     int c;
     while ( (c = getopt_long(argc, (char **const)argv,
@@ -329,61 +1516,84 @@ int main(int argc, char *argv[])
             display_heap_optin = true;
             break;
 
+        case 'r':
+            replay_optin = true;
+            break;
+
+        case 'd':
+            dump_out_file = optarg;
+            break;
+
+        case 'i':
+            dump_in_file = optarg;
+            break;
+
+        case 'f':
+            follow_optin = true;
+            break;
+
+        case 's':
+            summary_optin = true;
+            break;
+
+        case 'j':
+            summary_jobs = strtoul(optarg, NULL, 0);
+            break;
+
         default:
             return 1;
         }
 
-    if ( !is_txt_supported() ) {
-        printf("Intel(r) TXT is not supported\n");
-        return 1;
+    if ( summary_optin ) {
+        if ( optind == argc ) {
+            print_help(usage_string, option_strings);
+            return 1;
+        }
+        return summarize_dumps(&argv[optind], argc - optind, summary_jobs);
     }
 
-    fd_mem = open("/dev/mem", O_RDONLY);
-    if ( fd_mem == -1 ) {
-        printf("ERROR: cannot open /dev/mem\n");
-        return 1;
+    if ( dump_in_file != NULL ) {
+        if ( dump_out_file != NULL || follow_optin ) {
+            printf("ERROR: --dump and --follow need live memory\n");
+            return 1;
+        }
+        if ( !open_dump(dump_in_file, &dump) ) {
+            printf("ERROR: %s is not a valid txt-stat dump\n", dump_in_file);
+            return 1;
+        }
+        cur_dump = &dump;
     }
-
-    /*
-     * display public config regs
-     */
-    seek_ret = lseek(fd_mem, TXT_PUB_CONFIG_REGS_BASE, SEEK_SET);
-    if ( seek_ret == -1 )
-        printf("ERROR: seeking public config registers failed: %s, try mmap\n",
-               strerror(errno));
     else {
-        buf = malloc(TXT_CONFIG_REGS_SIZE);
-        if ( buf == NULL )
-            printf("ERROR: out of memory, try mmap\n");
-        else {
-            read_ret = read(fd_mem, buf, TXT_CONFIG_REGS_SIZE);
-            if ( read_ret != TXT_CONFIG_REGS_SIZE ) {
-                printf("ERROR: reading public config registers failed: %s,"
-                       "try mmap\n", strerror(errno));
-                free(buf);
-                buf = NULL;
-            }
-            else
-                buf_config_regs_read = buf;
+        if ( !is_txt_supported() ) {
+            printf("Intel(r) TXT is not supported\n");
+            return 1;
         }
-    }
 
-    /*
-     * try mmap to display public config regs,
-     * since public config regs should be displayed always.
-     */
-    if ( buf == NULL ) {
-        buf = mmap(NULL, TXT_CONFIG_REGS_SIZE, PROT_READ,
-                   MAP_PRIVATE, fd_mem, TXT_PUB_CONFIG_REGS_BASE);
-        if ( buf == MAP_FAILED ) {
-            printf("ERROR: cannot map config regs by mmap()\n");
-            buf = NULL;
+        fd_mem = open("/dev/mem", O_RDONLY);
+        if ( fd_mem == -1 ) {
+            printf("ERROR: cannot open /dev/mem\n");
+            return 1;
         }
-        else
-            buf_config_regs_mmap = buf;
     }
 
-    if ( buf ) {
+    if ( dump_out_file != NULL ) {
+        ret = write_dump(dump_out_file);
+        goto out;
+    }
+
+    if ( replay_optin ) {
+        ret = replay_event_logs();
+        goto out;
+    }
+
+    /*
+     * display public config regs
+     */
+    buf = read_phys_mem(TXT_PUB_CONFIG_REGS_BASE, TXT_CONFIG_REGS_SIZE);
+    if ( buf == NULL )
+        printf("ERROR: reading public config registers failed\n");
+    else {
+        buf_config_regs_read = buf;
         display_config_regs(buf);
         heap = read_txt_config_reg(buf, TXTCR_HEAP_BASE);
         heap_size = read_txt_config_reg(buf, TXTCR_HEAP_SIZE);
@@ -393,72 +1603,38 @@ int main(int argc, char *argv[])
      * display heap
      */
     if ( heap && heap_size && display_heap_optin ) {
-        seek_ret = lseek(fd_mem, heap, SEEK_SET);
-        if ( seek_ret == -1 ) {
-            printf("ERROR: seeking TXT heap failed by lseek(): %s, try mmap\n",
-                   strerror(errno));
-            goto try_mmap_heap;
-        }
-        buf = malloc(heap_size);
-        if ( buf == NULL ) {
-            printf("ERROR: out of memory, try mmap\n");
-            goto try_mmap_heap;
-        }
-        read_ret = read(fd_mem, buf, heap_size);
-        if ( read_ret != heap_size ) {
-            printf("ERROR: reading TXT heap failed by read(): %s, try mmap\n",
-                   strerror(errno));
-            free(buf);
-            goto try_mmap_heap;
-        }
-        display_heap((txt_heap_t *)buf);
-        free(buf);
-        goto try_display_log;
-
-    try_mmap_heap:
-
-        buf = mmap(NULL, heap_size, PROT_READ, MAP_PRIVATE, fd_mem, heap);
-        if ( buf == MAP_FAILED )
-            printf("ERROR: cannot map TXT heap by mmap()\n");
+        buf = read_phys_mem(heap, heap_size);
+        if ( buf == NULL )
+            printf("ERROR: reading TXT heap failed\n");
         else {
             display_heap((txt_heap_t *)buf);
-            munmap(buf, heap_size);
+            free(buf);
         }
     }
 
-try_display_log:
-    if ( buf_config_regs_read )
-        free(buf_config_regs_read);
-    if ( buf_config_regs_mmap )
-        munmap(buf_config_regs_mmap, TXT_CONFIG_REGS_SIZE);
+    free(buf_config_regs_read);
+    buf_config_regs_read = NULL;
 
     /*
      * display serial log from tboot memory (if exists)
      */
-    seek_ret = lseek(fd_mem, TBOOT_SERIAL_LOG_ADDR, SEEK_SET);
-    if ( seek_ret == -1 ) {
-        printf("ERROR: seeking TBOOT log failed by lseek()\n");
-        close(fd_mem);
-        return 1;
-    }
-    buf = malloc(TBOOT_SERIAL_LOG_SIZE);
+    buf = read_phys_mem(TBOOT_SERIAL_LOG_ADDR, TBOOT_SERIAL_LOG_SIZE);
     if ( buf == NULL ) {
-        printf("ERROR: out of memory\n");
-        close(fd_mem);
-        return 1;
-    }
-    read_ret = read(fd_mem, buf, TBOOT_SERIAL_LOG_SIZE);
-    if ( read_ret != TBOOT_SERIAL_LOG_SIZE ) {
-        printf("ERROR: reading TBOOT log failed by read()\n");
-        free(buf);
-        close(fd_mem);
-        return 1;
+        printf("ERROR: reading TBOOT log failed\n");
+        ret = 1;
+        goto out;
     }
     display_tboot_log(buf);
+    if ( follow_optin )
+        ret = follow_tboot_log(buf);
     free(buf);
-    close(fd_mem);
 
-    return 0;
+out:
+    if ( cur_dump != NULL )
+        close_dump(cur_dump);
+    else
+        close(fd_mem);
+    return ret;
 }
 
 